@@ -0,0 +1,12 @@
+#ifndef _BITS_SMP_H
+#define _BITS_SMP_H
+
+/** @file
+ *
+ * LoongArch64-specific application processor worker API implementations
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#endif /* _BITS_SMP_H */
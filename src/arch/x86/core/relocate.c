@@ -40,7 +40,7 @@ extern char _etextdata[];
  * address space, and returns the physical address of the new location
  * to the prefix in %edi.
  */
-__asmcall void relocate ( struct i386_all_regs *ix86 ) {
+__asmcall __init void relocate ( struct i386_all_regs *ix86 ) {
 	struct memory_map memmap;
 	uint32_t start, end, size, padded_size, max;
 	uint32_t new_start, new_end;
@@ -0,0 +1,134 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * TSC nanosecond clock
+ *
+ * The TSC is used as the nanosecond clock only if it is invariant,
+ * since a TSC that varies with the processor's power state is not a
+ * usable clock source.  The rate is measured over two consecutive
+ * calibration intervals, and the nanosecond clock falls back to using
+ * the system timer if the TSC is absent, is not invariant, is not
+ * running, or is not running at a consistent rate.
+ *
+ */
+
+#include <string.h>
+#include <ipxe/cpuid.h>
+#include <ipxe/pit8254.h>
+#include <ipxe/init.h>
+#include <ipxe/nstime.h>
+
+/** Number of microseconds to use for each TSC calibration interval */
+#define TSC_NSTIME_CALIBRATE_US 1024
+
+/** Maximum variation between calibration intervals (as a shift)
+ *
+ * The two measurements must agree to within 1/32 (around 3%), which
+ * allows for the occasional system management interrupt.
+ */
+#define TSC_NSTIME_TOLERANCE_SHIFT 5
+
+/** Colour for debug messages */
+#define colour &nstime_mult
+
+/**
+ * Measure TSC rate
+ *
+ * @ret mult		Nanoseconds per 2^NSTIME_SHIFT cycles, or zero
+ */
+static uint64_t tsc_nstime_measure ( void ) {
+	uint64_t before;
+	uint64_t after;
+
+	/* Count cycles over a calibration interval timed by the PIT */
+	before = profile_timestamp();
+	pit8254_udelay ( TSC_NSTIME_CALIBRATE_US );
+	after = profile_timestamp();
+	if ( after <= before )
+		return 0;
+
+	return ( ( ( TSC_NSTIME_CALIBRATE_US * 1000ULL ) << NSTIME_SHIFT ) /
+		 ( after - before ) );
+}
+
+/**
+ * Calibrate TSC nanosecond clock
+ *
+ */
+static void tsc_nstime_init ( void ) {
+	struct x86_features features;
+	uint64_t mult;
+	uint64_t check;
+	uint64_t diff;
+	uint32_t apm;
+	uint32_t discard_a;
+	uint32_t discard_b;
+	uint32_t discard_c;
+	int rc;
+
+	/* Check that TSC is present and invariant */
+	x86_features ( &features );
+	if ( ! ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_TSC ) ) {
+		DBGC ( colour, "TSC is not present\n" );
+		return;
+	}
+	if ( ( rc = cpuid_supported ( CPUID_APM ) ) != 0 ) {
+		DBGC ( colour, "TSC cannot determine APM features: %s\n",
+		       strerror ( rc ) );
+		return;
+	}
+	cpuid ( CPUID_APM, 0, &discard_a, &discard_b, &discard_c, &apm );
+	if ( ! ( apm & CPUID_APM_EDX_TSC_INVARIANT ) ) {
+		DBGC ( colour, "TSC is not invariant (%#08x)\n", apm );
+		return;
+	}
+
+	/* Calibrate via 8254 PIT, checking that the rate is consistent */
+	mult = tsc_nstime_measure();
+	check = tsc_nstime_measure();
+	if ( ( mult == 0 ) || ( check == 0 ) ) {
+		DBGC ( colour, "TSC is not running\n" );
+		return;
+	}
+	diff = ( ( mult > check ) ? ( mult - check ) : ( check - mult ) );
+	if ( diff > ( mult >> TSC_NSTIME_TOLERANCE_SHIFT ) ) {
+		DBGC ( colour, "TSC rate is not consistent (%#llx then %#llx "
+		       "ns per 2^%d cycles)\n", mult, check, NSTIME_SHIFT );
+		return;
+	}
+	if ( mult > 0xffffffffULL ) {
+		DBGC ( colour, "TSC has unusable rate (%#llx ns per 2^%d "
+		       "cycles)\n", mult, NSTIME_SHIFT );
+		return;
+	}
+	nstime_mult = mult;
+	DBGC ( colour, "TSC has %#08x ns per 2^%d cycles\n",
+	       nstime_mult, NSTIME_SHIFT );
+}
+
+/** TSC nanosecond clock initialisation function */
+struct init_fn tsc_nstime_init_fn __init_fn ( INIT_NORMAL ) = {
+	.initialise = tsc_nstime_init,
+};
@@ -0,0 +1,301 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * AES algorithm
+ *
+ * The AES instructions (AES-NI) perform an entire round in hardware.
+ * The round keys constructed by the generic key expansion are
+ * already in the form required: the encryption keys are the standard
+ * expanded key, and the decryption keys are those of the equivalent
+ * inverse cipher (i.e. reversed, with InvMixColumns applied to all
+ * but the first and last).
+ *
+ * Each round instruction has a latency of several cycles but can be
+ * issued every cycle, so blocks are processed four at a time to keep
+ * the pipeline full.  As with the other SSE code, the XMM registers
+ * used are saved and restored within a single block of inline
+ * assembly, with SSE instructions enabled only for the duration of
+ * the block.
+ *
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <ipxe/init.h>
+#include <ipxe/cpuid.h>
+#include <ipxe/aes.h>
+
+/** Supported AES implementations (as a bitmask) */
+static unsigned int aes_supported = ( 1 << X86_AES_GENERIC );
+
+/** Selected AES implementation */
+enum x86_aes_impl x86_aes_impl = X86_AES_GENERIC;
+
+/** AES instructions working area */
+struct aes_ni_work {
+	/** Saved XMM registers */
+	uint8_t save[ 5 * 16 /* %xmm0-%xmm4 */ ];
+	/** Round keys */
+	const union aes_matrix *key;
+	/** Number of intermediate rounds */
+	unsigned long rounds;
+	/** Number of groups of four blocks */
+	uint32_t quads;
+	/** Number of remaining single blocks */
+	uint32_t singles;
+};
+
+/**
+ * Process blocks using AES instructions
+ *
+ * @v round		Intermediate round instruction
+ * @v last		Final round instruction
+ */
+#define AES_NI_BLOCKS( round, last )					\
+	/* Preserve XMM registers */					\
+	"movdqu %%xmm0, 0x00(%[work])\n\t"				\
+	"movdqu %%xmm1, 0x10(%[work])\n\t"				\
+	"movdqu %%xmm2, 0x20(%[work])\n\t"				\
+	"movdqu %%xmm3, 0x30(%[work])\n\t"				\
+	"movdqu %%xmm4, 0x40(%[work])\n\t"				\
+	/* Process four blocks at a time */				\
+	"cmpl $0, %c[quads](%[work])\n\t"				\
+	"je 3f\n\t"							\
+	"\n1:\n\t"							\
+	"mov %c[key](%[work]), %[k]\n\t"				\
+	"mov %c[rounds](%[work]), %[n]\n\t"				\
+	"movdqu (%[k]), %%xmm4\n\t"					\
+	"movdqu 0x00(%[src]), %%xmm0\n\t"				\
+	"movdqu 0x10(%[src]), %%xmm1\n\t"				\
+	"movdqu 0x20(%[src]), %%xmm2\n\t"				\
+	"movdqu 0x30(%[src]), %%xmm3\n\t"				\
+	"pxor %%xmm4, %%xmm0\n\t"					\
+	"pxor %%xmm4, %%xmm1\n\t"					\
+	"pxor %%xmm4, %%xmm2\n\t"					\
+	"pxor %%xmm4, %%xmm3\n\t"					\
+	"\n2:\n\t"							\
+	"add $0x10, %[k]\n\t"						\
+	"movdqu (%[k]), %%xmm4\n\t"					\
+	round " %%xmm4, %%xmm0\n\t"					\
+	round " %%xmm4, %%xmm1\n\t"					\
+	round " %%xmm4, %%xmm2\n\t"					\
+	round " %%xmm4, %%xmm3\n\t"					\
+	"dec %[n]\n\t"							\
+	"jnz 2b\n\t"							\
+	"movdqu 0x10(%[k]), %%xmm4\n\t"					\
+	last " %%xmm4, %%xmm0\n\t"					\
+	last " %%xmm4, %%xmm1\n\t"					\
+	last " %%xmm4, %%xmm2\n\t"					\
+	last " %%xmm4, %%xmm3\n\t"					\
+	"movdqu %%xmm0, 0x00(%[dst])\n\t"				\
+	"movdqu %%xmm1, 0x10(%[dst])\n\t"				\
+	"movdqu %%xmm2, 0x20(%[dst])\n\t"				\
+	"movdqu %%xmm3, 0x30(%[dst])\n\t"				\
+	"add $0x40, %[src]\n\t"						\
+	"add $0x40, %[dst]\n\t"						\
+	"decl %c[quads](%[work])\n\t"					\
+	"jnz 1b\n\t"							\
+	"\n3:\n\t"							\
+	/* Process remaining blocks individually */			\
+	"cmpl $0, %c[singles](%[work])\n\t"				\
+	"je 6f\n\t"							\
+	"\n4:\n\t"							\
+	"mov %c[key](%[work]), %[k]\n\t"				\
+	"mov %c[rounds](%[work]), %[n]\n\t"				\
+	"movdqu (%[k]), %%xmm4\n\t"					\
+	"movdqu (%[src]), %%xmm0\n\t"					\
+	"pxor %%xmm4, %%xmm0\n\t"					\
+	"\n5:\n\t"							\
+	"add $0x10, %[k]\n\t"						\
+	"movdqu (%[k]), %%xmm4\n\t"					\
+	round " %%xmm4, %%xmm0\n\t"					\
+	"dec %[n]\n\t"							\
+	"jnz 5b\n\t"							\
+	"movdqu 0x10(%[k]), %%xmm4\n\t"					\
+	last " %%xmm4, %%xmm0\n\t"					\
+	"movdqu %%xmm0, (%[dst])\n\t"					\
+	"add $0x10, %[src]\n\t"						\
+	"add $0x10, %[dst]\n\t"						\
+	"decl %c[singles](%[work])\n\t"					\
+	"jnz 4b\n\t"							\
+	"\n6:\n\t"							\
+	/* Restore XMM registers */					\
+	"movdqu 0x00(%[work]), %%xmm0\n\t"				\
+	"movdqu 0x10(%[work]), %%xmm1\n\t"				\
+	"movdqu 0x20(%[work]), %%xmm2\n\t"				\
+	"movdqu 0x30(%[work]), %%xmm3\n\t"				\
+	"movdqu 0x40(%[work]), %%xmm4\n\t"
+
+/** AES instructions assembly operands */
+#define AES_NI_OPERANDS							\
+	: [src] "+r" ( src ), [dst] "+r" ( dst ),			\
+	  [k] "=&r" ( discard_k ), [n] "=&r" ( discard_n )		\
+	: [work] "r" ( &work ),						\
+	  [key] "i" ( offsetof ( struct aes_ni_work, key ) ),		\
+	  [rounds] "i" ( offsetof ( struct aes_ni_work, rounds ) ),	\
+	  [quads] "i" ( offsetof ( struct aes_ni_work, quads ) ),	\
+	  [singles] "i" ( offsetof ( struct aes_ni_work, singles ) )	\
+	: "cc", "memory"
+
+/**
+ * Encrypt data blocks using AES instructions
+ *
+ * @v aes		AES context
+ * @v src		Data to encrypt
+ * @v dst		Buffer for encrypted data
+ * @v count		Number of blocks
+ */
+static void aes_ni_encrypt_blocks ( struct aes_context *aes, const void *src,
+				    void *dst, size_t count ) {
+	struct aes_ni_work work;
+	struct x86_sse_state sse;
+	unsigned long discard_k;
+	unsigned long discard_n;
+
+	/* Initialise working area */
+	work.key = aes->encrypt.key;
+	work.rounds = ( aes->rounds - 2 );
+	work.quads = ( count / 4 );
+	work.singles = ( count % 4 );
+
+	/* Encrypt blocks */
+	x86_sse_enable ( &sse );
+	__asm__ __volatile__ ( AES_NI_BLOCKS ( "aesenc", "aesenclast" )
+			       AES_NI_OPERANDS );
+	x86_sse_restore ( &sse );
+}
+
+/**
+ * Decrypt data blocks using AES instructions
+ *
+ * @v aes		AES context
+ * @v src		Data to decrypt
+ * @v dst		Buffer for decrypted data
+ * @v count		Number of blocks
+ */
+static void aes_ni_decrypt_blocks ( struct aes_context *aes, const void *src,
+				    void *dst, size_t count ) {
+	struct aes_ni_work work;
+	struct x86_sse_state sse;
+	unsigned long discard_k;
+	unsigned long discard_n;
+
+	/* Initialise working area */
+	work.key = aes->decrypt.key;
+	work.rounds = ( aes->rounds - 2 );
+	work.quads = ( count / 4 );
+	work.singles = ( count % 4 );
+
+	/* Decrypt blocks */
+	x86_sse_enable ( &sse );
+	__asm__ __volatile__ ( AES_NI_BLOCKS ( "aesdec", "aesdeclast" )
+			       AES_NI_OPERANDS );
+	x86_sse_restore ( &sse );
+}
+
+/**
+ * Encrypt data blocks
+ *
+ * @v aes		AES context
+ * @v src		Data to encrypt
+ * @v dst		Buffer for encrypted data
+ * @v count		Number of blocks
+ */
+void aes_encrypt_blocks ( struct aes_context *aes, const void *src,
+			  void *dst, size_t count ) {
+
+	/* Use AES instructions, if available */
+	if ( x86_aes_impl == X86_AES_NI ) {
+		aes_ni_encrypt_blocks ( aes, src, dst, count );
+	} else {
+		generic_aes_encrypt_blocks ( aes, src, dst, count );
+	}
+}
+
+/**
+ * Decrypt data blocks
+ *
+ * @v aes		AES context
+ * @v src		Data to decrypt
+ * @v dst		Buffer for decrypted data
+ * @v count		Number of blocks
+ */
+void aes_decrypt_blocks ( struct aes_context *aes, const void *src,
+			  void *dst, size_t count ) {
+
+	/* Use AES instructions, if available */
+	if ( x86_aes_impl == X86_AES_NI ) {
+		aes_ni_decrypt_blocks ( aes, src, dst, count );
+	} else {
+		generic_aes_decrypt_blocks ( aes, src, dst, count );
+	}
+}
+
+/**
+ * Force use of a specific AES implementation
+ *
+ * @v impl		AES implementation
+ * @ret rc		Return status code
+ *
+ * This allows the self-tests to exercise every implementation that
+ * is supported by the CPU.
+ */
+int x86_aes_force ( enum x86_aes_impl impl ) {
+
+	if ( ! ( aes_supported & ( 1 << impl ) ) )
+		return -ENOTSUP;
+	x86_aes_impl = impl;
+	return 0;
+}
+
+/**
+ * Select AES implementation
+ *
+ */
+static void aes_init ( void ) {
+	struct x86_features features;
+
+	/* Check for AES instructions (and SSE2) */
+	x86_features ( &features );
+	if ( ! ( features.intel.ecx & CPUID_FEATURES_INTEL_ECX_AES ) ) {
+		DBGC ( &x86_aes_impl, "AES instructions not supported\n" );
+		return;
+	}
+	if ( ! ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_SSE2 ) ) {
+		DBGC ( &x86_aes_impl, "AES SSE2 not supported\n" );
+		return;
+	}
+
+	/* Use AES instructions */
+	aes_supported |= ( 1 << X86_AES_NI );
+	x86_aes_impl = X86_AES_NI;
+	DBGC ( &x86_aes_impl, "AES using AES instructions\n" );
+}
+
+/** AES initialisation function */
+struct init_fn aes_init_fn __init_fn ( INIT_EARLY ) = {
+	.initialise = aes_init,
+};
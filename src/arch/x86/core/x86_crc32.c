@@ -0,0 +1,287 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * CRC32 checksum
+ *
+ * Large blocks are folded 64 bytes at a time using carry-less
+ * multiplication, as described in Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction" white paper, and
+ * then reduced to a 32-bit CRC via a Barrett reduction.  Any
+ * remaining bytes are processed by the generic implementation.
+ *
+ * iPXE is built without SSE support, and may be called (e.g. via INT
+ * 13) by code that expects its SSE state to be preserved.  The fold
+ * is therefore written as a single block of inline assembly that
+ * saves and restores the XMM registers that it uses, with SSE
+ * instructions enabled only for the duration of the block.
+ *
+ */
+
+#include <stdint.h>
+#include <errno.h>
+#include <ipxe/init.h>
+#include <ipxe/cpuid.h>
+#include <ipxe/crc32.h>
+
+/** Minimum length for which carry-less multiplication is used */
+#define CRC32_PCLMUL_MIN_LEN 64
+
+/** Carry-less multiplication folding constants
+ *
+ * These are the constants for the bit-reflected polynomial
+ * 0xedb88320, as given in the white paper.
+ */
+struct crc32_pclmul_constants {
+	/** Fold by four 128-bit blocks */
+	uint64_t r2r1[2];
+	/** Fold by one 128-bit block */
+	uint64_t r4r3[2];
+	/** Fold 64 bits to 32 bits */
+	uint64_t r5[2];
+	/** Barrett reduction constants */
+	uint64_t rupoly[2];
+	/** Low 32-bit mask */
+	uint64_t mask32[2];
+};
+
+/** Carry-less multiplication folding constants */
+static const struct crc32_pclmul_constants crc32_pclmul_constants = {
+	.r2r1 = { 0x0000000154442bd4ULL, 0x00000001c6e41596ULL },
+	.r4r3 = { 0x00000001751997d0ULL, 0x00000000ccaa009eULL },
+	.r5 = { 0x0000000163cd6124ULL, 0 },
+	.rupoly = { 0x00000001db710641ULL, 0x00000001f7011641ULL },
+	.mask32 = { 0x00000000ffffffffULL, 0 },
+};
+
+/** Supported CRC32 implementations (as a bitmask) */
+static unsigned int crc32_supported = ( 1 << X86_CRC32_GENERIC );
+
+/** Selected CRC32 implementation */
+enum x86_crc32_impl x86_crc32_impl = X86_CRC32_GENERIC;
+
+/**
+ * Calculate CRC32 of whole 128-bit blocks using carry-less multiplication
+ *
+ * @v crc		Initial value
+ * @v data		Data to checksum
+ * @v len		Length of data (a multiple of 16, and at least 64)
+ * @ret crc		Updated CRC
+ */
+static u32 crc32_pclmul_fold ( u32 crc, const void *data, size_t len ) {
+	uint8_t save[ 7 * 16 /* %xmm0-%xmm6 */ ];
+	struct x86_sse_state sse;
+
+	x86_sse_enable ( &sse );
+	__asm__ __volatile__ ( /* Preserve XMM registers */
+			       "movdqu %%xmm0, 0x00(%[save])\n\t"
+			       "movdqu %%xmm1, 0x10(%[save])\n\t"
+			       "movdqu %%xmm2, 0x20(%[save])\n\t"
+			       "movdqu %%xmm3, 0x30(%[save])\n\t"
+			       "movdqu %%xmm4, 0x40(%[save])\n\t"
+			       "movdqu %%xmm5, 0x50(%[save])\n\t"
+			       "movdqu %%xmm6, 0x60(%[save])\n\t"
+			       /* Load first four blocks and initial value */
+			       "movdqu 0x00(%[data]), %%xmm1\n\t"
+			       "movdqu 0x10(%[data]), %%xmm2\n\t"
+			       "movdqu 0x20(%[data]), %%xmm3\n\t"
+			       "movdqu 0x30(%[data]), %%xmm4\n\t"
+			       "movd %[crc], %%xmm0\n\t"
+			       "pxor %%xmm0, %%xmm1\n\t"
+			       "sub $0x40, %[len]\n\t"
+			       "add $0x40, %[data]\n\t"
+			       /* Fold four blocks at a time */
+			       "movdqu 0x00(%[k]), %%xmm0\n\t"
+			       "cmp $0x40, %[len]\n\t"
+			       "jb 2f\n\t"
+			       "\n1:\n\t"
+			       "movdqa %%xmm1, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm1\n\t"
+			       "movdqu 0x00(%[data]), %%xmm6\n\t"
+			       "pxor %%xmm6, %%xmm1\n\t"
+			       "movdqa %%xmm2, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm2\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm2\n\t"
+			       "movdqu 0x10(%[data]), %%xmm6\n\t"
+			       "pxor %%xmm6, %%xmm2\n\t"
+			       "movdqa %%xmm3, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm3\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm3\n\t"
+			       "movdqu 0x20(%[data]), %%xmm6\n\t"
+			       "pxor %%xmm6, %%xmm3\n\t"
+			       "movdqa %%xmm4, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm4\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm4\n\t"
+			       "movdqu 0x30(%[data]), %%xmm6\n\t"
+			       "pxor %%xmm6, %%xmm4\n\t"
+			       "sub $0x40, %[len]\n\t"
+			       "add $0x40, %[data]\n\t"
+			       "cmp $0x40, %[len]\n\t"
+			       "jae 1b\n\t"
+			       /* Fold four blocks into one block */
+			       "\n2:\n\t"
+			       "movdqu 0x10(%[k]), %%xmm0\n\t"
+			       "movdqa %%xmm1, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm1\n\t"
+			       "pxor %%xmm2, %%xmm1\n\t"
+			       "movdqa %%xmm1, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm1\n\t"
+			       "pxor %%xmm3, %%xmm1\n\t"
+			       "movdqa %%xmm1, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm1\n\t"
+			       "pxor %%xmm4, %%xmm1\n\t"
+			       /* Fold remaining blocks one at a time */
+			       "cmp $0x10, %[len]\n\t"
+			       "jb 4f\n\t"
+			       "\n3:\n\t"
+			       "movdqa %%xmm1, %%xmm5\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pclmulqdq $0x11, %%xmm0, %%xmm5\n\t"
+			       "pxor %%xmm5, %%xmm1\n\t"
+			       "movdqu 0x00(%[data]), %%xmm6\n\t"
+			       "pxor %%xmm6, %%xmm1\n\t"
+			       "sub $0x10, %[len]\n\t"
+			       "add $0x10, %[data]\n\t"
+			       "cmp $0x10, %[len]\n\t"
+			       "jae 3b\n\t"
+			       /* Fold 128 bits to 64 bits */
+			       "\n4:\n\t"
+			       "pclmulqdq $0x01, %%xmm1, %%xmm0\n\t"
+			       "psrldq $0x08, %%xmm1\n\t"
+			       "pxor %%xmm0, %%xmm1\n\t"
+			       /* Fold 64 bits to 32 bits */
+			       "movdqa %%xmm1, %%xmm2\n\t"
+			       "movdqu 0x20(%[k]), %%xmm0\n\t"
+			       "movdqu 0x40(%[k]), %%xmm3\n\t"
+			       "psrldq $0x04, %%xmm2\n\t"
+			       "pand %%xmm3, %%xmm1\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pxor %%xmm2, %%xmm1\n\t"
+			       /* Reduce to 32 bits (Barrett reduction) */
+			       "movdqu 0x30(%[k]), %%xmm0\n\t"
+			       "movdqa %%xmm1, %%xmm2\n\t"
+			       "pand %%xmm3, %%xmm1\n\t"
+			       "pclmulqdq $0x10, %%xmm0, %%xmm1\n\t"
+			       "pand %%xmm3, %%xmm1\n\t"
+			       "pclmulqdq $0x00, %%xmm0, %%xmm1\n\t"
+			       "pxor %%xmm2, %%xmm1\n\t"
+			       "psrldq $0x04, %%xmm1\n\t"
+			       "movd %%xmm1, %[crc]\n\t"
+			       /* Restore XMM registers */
+			       "movdqu 0x00(%[save]), %%xmm0\n\t"
+			       "movdqu 0x10(%[save]), %%xmm1\n\t"
+			       "movdqu 0x20(%[save]), %%xmm2\n\t"
+			       "movdqu 0x30(%[save]), %%xmm3\n\t"
+			       "movdqu 0x40(%[save]), %%xmm4\n\t"
+			       "movdqu 0x50(%[save]), %%xmm5\n\t"
+			       "movdqu 0x60(%[save]), %%xmm6\n\t"
+			       : [crc] "+r" ( crc ), [data] "+r" ( data ),
+				 [len] "+r" ( len )
+			       : [k] "r" ( &crc32_pclmul_constants ),
+				 [save] "r" ( save )
+			       : "cc", "memory" );
+	x86_sse_restore ( &sse );
+
+	return crc;
+}
+
+/**
+ * Calculate 32-bit little-endian CRC checksum
+ *
+ * @v seed	Initial value
+ * @v data	Data to checksum
+ * @v len	Length of data
+ */
+u32 crc32_le ( u32 seed, const void *data, size_t len ) {
+	size_t fold_len;
+
+	/* Fold whole 128-bit blocks, if possible */
+	if ( ( x86_crc32_impl == X86_CRC32_PCLMUL ) &&
+	     ( len >= CRC32_PCLMUL_MIN_LEN ) ) {
+		fold_len = ( len & ~( ( size_t ) 0x0f ) );
+		seed = crc32_pclmul_fold ( seed, data, fold_len );
+		data += fold_len;
+		len -= fold_len;
+	}
+
+	/* Process any remaining data */
+	return generic_crc32_le ( seed, data, len );
+}
+
+/**
+ * Force use of a specific CRC32 implementation
+ *
+ * @v impl		CRC32 implementation
+ * @ret rc		Return status code
+ *
+ * This allows the self-tests to exercise every implementation that
+ * is supported by the CPU.
+ */
+int x86_crc32_force ( enum x86_crc32_impl impl ) {
+
+	if ( ! ( crc32_supported & ( 1 << impl ) ) )
+		return -ENOTSUP;
+	x86_crc32_impl = impl;
+	return 0;
+}
+
+/**
+ * Select CRC32 implementation
+ *
+ */
+static void crc32_init ( void ) {
+	struct x86_features features;
+
+	/* Check for PCLMULQDQ (and SSE2) */
+	x86_features ( &features );
+	if ( ! ( features.intel.ecx & CPUID_FEATURES_INTEL_ECX_PCLMULQDQ ) ) {
+		DBGC ( &x86_crc32_impl, "CRC32 PCLMULQDQ not supported\n" );
+		return;
+	}
+	if ( ! ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_SSE2 ) ) {
+		DBGC ( &x86_crc32_impl, "CRC32 SSE2 not supported\n" );
+		return;
+	}
+
+	/* Use carry-less multiplication */
+	crc32_supported |= ( 1 << X86_CRC32_PCLMUL );
+	x86_crc32_impl = X86_CRC32_PCLMUL;
+	DBGC ( &x86_crc32_impl, "CRC32 using PCLMULQDQ\n" );
+}
+
+/** CRC32 initialisation function */
+struct init_fn crc32_init_fn __init_fn ( INIT_EARLY ) = {
+	.initialise = crc32_init,
+};
@@ -0,0 +1,814 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * SHA-256 algorithm
+ *
+ * Three accelerated implementations are provided:
+ *
+ * - the SHA extensions (SHA-NI) perform the entire compression
+ *   function in hardware, following the structure given in Intel's
+ *   "Intel SHA Extensions" white paper;
+ *
+ * - SSSE3 is used to byte-swap the message and to calculate the
+ *   message schedule four words at a time, leaving only the rounds
+ *   to be performed by the generic code;
+ *
+ * - SSSE3 is used to digest blocks from four independent messages in
+ *   parallel, with each 32-bit lane of an XMM register holding the
+ *   state for one message.
+ *
+ * iPXE is built without SSE support, and may be called (e.g. via INT
+ * 13) by code that expects its SSE state to be preserved.  Each
+ * implementation is therefore written as a single block of inline
+ * assembly that saves and restores the XMM registers that it uses,
+ * with SSE instructions enabled only while the data is digested.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <ipxe/init.h>
+#include <ipxe/cpuid.h>
+#include <ipxe/sha256.h>
+
+/** Byte-swap mask for converting big-endian message words */
+static const uint8_t sha256_bswap_mask[16] = {
+	0x03, 0x02, 0x01, 0x00, 0x07, 0x06, 0x05, 0x04,
+	0x0b, 0x0a, 0x09, 0x08, 0x0f, 0x0e, 0x0d, 0x0c,
+};
+
+/** Supported SHA-256 implementations (as a bitmask) */
+static unsigned int sha256_supported = ( 1 << X86_SHA256_GENERIC );
+
+/** Selected SHA-256 implementation */
+enum x86_sha256_impl x86_sha256_impl = X86_SHA256_GENERIC;
+
+/** SHA extensions working area */
+struct sha256_shani_work {
+	/** Byte-swap mask */
+	uint8_t mask[16];
+	/** State words A, B, E, and F (in reverse order) */
+	uint32_t abef[4];
+	/** State words C, D, G, and H (in reverse order) */
+	uint32_t cdgh[4];
+	/** Saved XMM registers */
+	uint8_t save[ 8 * 16 /* %xmm0-%xmm7 */ ];
+};
+
+/**
+ * Load message words using SHA extensions
+ *
+ * @v offset		Offset within data block
+ * @v m0		Message register number
+ */
+#define SHA256_NI_LOAD( offset, m0 )					\
+	"movdqu " #offset "(%[data]), %%xmm" #m0 "\n\t"			\
+	"movdqu 0x00(%[work]), %%xmm7\n\t"				\
+	"pshufb %%xmm7, %%xmm" #m0 "\n\t"
+
+/**
+ * Perform first two of four rounds using SHA extensions
+ *
+ * @v offset		Offset within round constants
+ * @v m0		Message register number
+ */
+#define SHA256_NI_RNDS_LO( offset, m0 )					\
+	"movdqu " #offset "(%[k]), %%xmm0\n\t"				\
+	"paddd %%xmm" #m0 ", %%xmm0\n\t"				\
+	"sha256rnds2 %%xmm1, %%xmm2\n\t"
+
+/**
+ * Perform last two of four rounds using SHA extensions
+ *
+ */
+#define SHA256_NI_RNDS_HI						\
+	"pshufd $0x0e, %%xmm0, %%xmm0\n\t"				\
+	"sha256rnds2 %%xmm2, %%xmm1\n\t"
+
+/**
+ * Complete calculation of four message schedule words
+ *
+ * @v m0		Most recent message register number
+ * @v m1		Message register number to be completed
+ * @v m3		Oldest message register number
+ */
+#define SHA256_NI_MSG2( m0, m1, m3 )					\
+	"movdqa %%xmm" #m0 ", %%xmm7\n\t"				\
+	"palignr $4, %%xmm" #m3 ", %%xmm7\n\t"				\
+	"paddd %%xmm7, %%xmm" #m1 "\n\t"				\
+	"sha256msg2 %%xmm" #m0 ", %%xmm" #m1 "\n\t"
+
+/**
+ * Start calculation of four message schedule words
+ *
+ * @v m0		Most recent message register number
+ * @v m3		Message register number to be started
+ */
+#define SHA256_NI_MSG1( m0, m3 )					\
+	"sha256msg1 %%xmm" #m0 ", %%xmm" #m3 "\n\t"
+
+/**
+ * Perform four rounds using SHA extensions
+ *
+ * @v offset		Offset within round constants
+ * @v m0		Current message register number
+ * @v m1		Next message register number
+ * @v m3		Previous message register number
+ */
+#define SHA256_NI_ROUNDS( offset, m0, m1, m3 )				\
+	SHA256_NI_RNDS_LO ( offset, m0 )				\
+	SHA256_NI_MSG2 ( m0, m1, m3 )					\
+	SHA256_NI_RNDS_HI						\
+	SHA256_NI_MSG1 ( m0, m3 )
+
+/**
+ * Digest SHA-256 data blocks using SHA extensions
+ *
+ * @v digest		Digest (in host-endian order)
+ * @v data		Data blocks
+ * @v count		Number of blocks (must be non-zero)
+ */
+static void sha256_shani_blocks ( struct sha256_digest *digest,
+				  const void *data, size_t count ) {
+	struct sha256_shani_work work;
+	struct x86_sse_state sse;
+
+	/* Construct initial state */
+	memcpy ( work.mask, sha256_bswap_mask, sizeof ( work.mask ) );
+	work.abef[0] = digest->h[5];
+	work.abef[1] = digest->h[4];
+	work.abef[2] = digest->h[1];
+	work.abef[3] = digest->h[0];
+	work.cdgh[0] = digest->h[7];
+	work.cdgh[1] = digest->h[6];
+	work.cdgh[2] = digest->h[3];
+	work.cdgh[3] = digest->h[2];
+
+	/* Digest blocks */
+	x86_sse_enable ( &sse );
+	__asm__ __volatile__ ( /* Preserve XMM registers */
+			       "movdqu %%xmm0, 0x30(%[work])\n\t"
+			       "movdqu %%xmm1, 0x40(%[work])\n\t"
+			       "movdqu %%xmm2, 0x50(%[work])\n\t"
+			       "movdqu %%xmm3, 0x60(%[work])\n\t"
+			       "movdqu %%xmm4, 0x70(%[work])\n\t"
+			       "movdqu %%xmm5, 0x80(%[work])\n\t"
+			       "movdqu %%xmm6, 0x90(%[work])\n\t"
+			       "movdqu %%xmm7, 0xa0(%[work])\n\t"
+			       /* Load state */
+			       "movdqu 0x10(%[work]), %%xmm1\n\t"
+			       "movdqu 0x20(%[work]), %%xmm2\n\t"
+			       "\n1:\n\t"
+			       /* Save state for this block */
+			       "movdqu %%xmm1, 0x10(%[work])\n\t"
+			       "movdqu %%xmm2, 0x20(%[work])\n\t"
+			       /* Rounds 0-15 (loading message) */
+			       SHA256_NI_LOAD ( 0x00, 3 )
+			       SHA256_NI_RNDS_LO ( 0x00, 3 )
+			       SHA256_NI_RNDS_HI
+			       SHA256_NI_LOAD ( 0x10, 4 )
+			       SHA256_NI_RNDS_LO ( 0x10, 4 )
+			       SHA256_NI_RNDS_HI
+			       SHA256_NI_MSG1 ( 4, 3 )
+			       SHA256_NI_LOAD ( 0x20, 5 )
+			       SHA256_NI_RNDS_LO ( 0x20, 5 )
+			       SHA256_NI_RNDS_HI
+			       SHA256_NI_MSG1 ( 5, 4 )
+			       SHA256_NI_LOAD ( 0x30, 6 )
+			       SHA256_NI_ROUNDS ( 0x30, 6, 3, 5 )
+			       /* Rounds 16-51 */
+			       SHA256_NI_ROUNDS ( 0x40, 3, 4, 6 )
+			       SHA256_NI_ROUNDS ( 0x50, 4, 5, 3 )
+			       SHA256_NI_ROUNDS ( 0x60, 5, 6, 4 )
+			       SHA256_NI_ROUNDS ( 0x70, 6, 3, 5 )
+			       SHA256_NI_ROUNDS ( 0x80, 3, 4, 6 )
+			       SHA256_NI_ROUNDS ( 0x90, 4, 5, 3 )
+			       SHA256_NI_ROUNDS ( 0xa0, 5, 6, 4 )
+			       SHA256_NI_ROUNDS ( 0xb0, 6, 3, 5 )
+			       SHA256_NI_ROUNDS ( 0xc0, 3, 4, 6 )
+			       /* Rounds 52-63 (no further message words) */
+			       SHA256_NI_RNDS_LO ( 0xd0, 4 )
+			       SHA256_NI_MSG2 ( 4, 5, 3 )
+			       SHA256_NI_RNDS_HI
+			       SHA256_NI_RNDS_LO ( 0xe0, 5 )
+			       SHA256_NI_MSG2 ( 5, 6, 4 )
+			       SHA256_NI_RNDS_HI
+			       SHA256_NI_RNDS_LO ( 0xf0, 6 )
+			       SHA256_NI_RNDS_HI
+			       /* Add chunk to hash */
+			       "movdqu 0x10(%[work]), %%xmm7\n\t"
+			       "paddd %%xmm7, %%xmm1\n\t"
+			       "movdqu 0x20(%[work]), %%xmm7\n\t"
+			       "paddd %%xmm7, %%xmm2\n\t"
+			       "add $0x40, %[data]\n\t"
+			       "dec %[count]\n\t"
+			       "jnz 1b\n\t"
+			       /* Store state */
+			       "movdqu %%xmm1, 0x10(%[work])\n\t"
+			       "movdqu %%xmm2, 0x20(%[work])\n\t"
+			       /* Restore XMM registers */
+			       "movdqu 0x30(%[work]), %%xmm0\n\t"
+			       "movdqu 0x40(%[work]), %%xmm1\n\t"
+			       "movdqu 0x50(%[work]), %%xmm2\n\t"
+			       "movdqu 0x60(%[work]), %%xmm3\n\t"
+			       "movdqu 0x70(%[work]), %%xmm4\n\t"
+			       "movdqu 0x80(%[work]), %%xmm5\n\t"
+			       "movdqu 0x90(%[work]), %%xmm6\n\t"
+			       "movdqu 0xa0(%[work]), %%xmm7\n\t"
+			       : [data] "+r" ( data ), [count] "+r" ( count )
+			       : [k] "r" ( sha256_k ), [work] "r" ( &work )
+			       : "cc", "memory" );
+	x86_sse_restore ( &sse );
+
+	/* Extract final state */
+	digest->h[0] = work.abef[3];
+	digest->h[1] = work.abef[2];
+	digest->h[4] = work.abef[1];
+	digest->h[5] = work.abef[0];
+	digest->h[2] = work.cdgh[3];
+	digest->h[3] = work.cdgh[2];
+	digest->h[6] = work.cdgh[1];
+	digest->h[7] = work.cdgh[0];
+}
+
+/** SSSE3 message schedule working area */
+struct sha256_ssse3_work {
+	/** Byte-swap mask */
+	uint8_t mask[16];
+	/** Saved XMM registers */
+	uint8_t save[ 8 * 16 /* %xmm0-%xmm7 */ ];
+};
+
+/**
+ * Calculate message schedule small sigma function using SSE2
+ *
+ * @v x			Input register number (destroyed)
+ * @v out		Output register number
+ * @v tmp		Temporary register number
+ * @v r1		First rotation
+ * @v r2		Second rotation
+ * @v s			Shift
+ */
+#define SHA256_SSE_SIGMA( x, out, tmp, r1, r2, s )			\
+	"movdqa %%xmm" #x ", %%xmm" #out "\n\t"				\
+	"psrld $" #s ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"psrld $" #r1 ", %%xmm" #tmp "\n\t"				\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"psrld $" #r2 ", %%xmm" #tmp "\n\t"				\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"pslld $(32-" #r1 "), %%xmm" #tmp "\n\t"			\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"pslld $(32-" #r2 "), %%xmm" #x "\n\t"				\
+	"pxor %%xmm" #x ", %%xmm" #out "\n\t"
+
+/**
+ * Calculate round function big sigma function using SSE2
+ *
+ * @v x			Input register number (destroyed)
+ * @v out		Output register number
+ * @v tmp		Temporary register number
+ * @v r1		First rotation
+ * @v r2		Second rotation
+ * @v r3		Third rotation
+ */
+#define SHA256_SSE_BIG_SIGMA( x, out, tmp, r1, r2, r3 )			\
+	"movdqa %%xmm" #x ", %%xmm" #out "\n\t"				\
+	"psrld $" #r1 ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"psrld $" #r2 ", %%xmm" #tmp "\n\t"				\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"psrld $" #r3 ", %%xmm" #tmp "\n\t"				\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"pslld $(32-" #r1 "), %%xmm" #tmp "\n\t"			\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"movdqa %%xmm" #x ", %%xmm" #tmp "\n\t"				\
+	"pslld $(32-" #r2 "), %%xmm" #tmp "\n\t"			\
+	"pxor %%xmm" #tmp ", %%xmm" #out "\n\t"				\
+	"pslld $(32-" #r3 "), %%xmm" #x "\n\t"				\
+	"pxor %%xmm" #x ", %%xmm" #out "\n\t"
+
+/**
+ * Calculate four message schedule words using SSSE3
+ *
+ * @v offset		Offset of output within schedule and round constants
+ * @v x0		Register holding w[i-16..i-13], replaced by w[i..i+3]
+ * @v x1		Register holding w[i-12..i-9]
+ * @v x2		Register holding w[i-8..i-5]
+ * @v x3		Register holding w[i-4..i-1]
+ *
+ * The last two words depend upon the first two, and so the sigma1
+ * term is calculated in two halves.
+ */
+#define SHA256_SSSE3_SCHEDULE( offset, x0, x1, x2, x3 )			\
+	/* %xmm4 = w[i-16] + sigma0(w[i-15]) + w[i-7] */		\
+	"movdqa %%xmm" #x1 ", %%xmm5\n\t"				\
+	"palignr $4, %%xmm" #x0 ", %%xmm5\n\t"				\
+	SHA256_SSE_SIGMA ( 5, 4, 6, 7, 18, 3 )				\
+	"paddd %%xmm" #x0 ", %%xmm4\n\t"				\
+	"movdqa %%xmm" #x3 ", %%xmm5\n\t"				\
+	"palignr $4, %%xmm" #x2 ", %%xmm5\n\t"				\
+	"paddd %%xmm5, %%xmm4\n\t"					\
+	/* Add sigma1(w[i-2..i-1]) to low words */			\
+	"movdqa %%xmm" #x3 ", %%xmm5\n\t"				\
+	"psrldq $8, %%xmm5\n\t"						\
+	SHA256_SSE_SIGMA ( 5, 7, 6, 17, 19, 10 )			\
+	"paddd %%xmm7, %%xmm4\n\t"					\
+	/* Add sigma1(w[i..i+1]) to high words */			\
+	"movdqa %%xmm4, %%xmm5\n\t"					\
+	"pslldq $8, %%xmm5\n\t"						\
+	SHA256_SSE_SIGMA ( 5, 7, 6, 17, 19, 10 )			\
+	"paddd %%xmm7, %%xmm4\n\t"					\
+	/* Store w[i..i+3] + k[i..i+3] */				\
+	"movdqa %%xmm4, %%xmm" #x0 "\n\t"				\
+	"movdqu " #offset "(%[k]), %%xmm5\n\t"				\
+	"paddd %%xmm4, %%xmm5\n\t"					\
+	"movdqu %%xmm5, " #offset "(%[w])\n\t"
+
+/**
+ * Calculate SHA-256 message schedule using SSSE3
+ *
+ * @v w			Message schedule (with round constants added) to fill in
+ * @v data		Data block
+ *
+ * The caller must have enabled SSE instructions.
+ */
+static void sha256_ssse3_schedule ( uint32_t *w, const void *data ) {
+	struct sha256_ssse3_work work;
+	const uint32_t *k = sha256_k;
+	unsigned int loop = 3;
+
+	/* Construct byte-swap mask */
+	memcpy ( work.mask, sha256_bswap_mask, sizeof ( work.mask ) );
+
+	/* Calculate schedule */
+	__asm__ __volatile__ ( /* Preserve XMM registers */
+			       "movdqu %%xmm0, 0x10(%[work])\n\t"
+			       "movdqu %%xmm1, 0x20(%[work])\n\t"
+			       "movdqu %%xmm2, 0x30(%[work])\n\t"
+			       "movdqu %%xmm3, 0x40(%[work])\n\t"
+			       "movdqu %%xmm4, 0x50(%[work])\n\t"
+			       "movdqu %%xmm5, 0x60(%[work])\n\t"
+			       "movdqu %%xmm6, 0x70(%[work])\n\t"
+			       "movdqu %%xmm7, 0x80(%[work])\n\t"
+			       /* Load and byte-swap w[0..15] */
+			       "movdqu 0x00(%[work]), %%xmm7\n\t"
+			       "movdqu 0x00(%[data]), %%xmm0\n\t"
+			       "movdqu 0x10(%[data]), %%xmm1\n\t"
+			       "movdqu 0x20(%[data]), %%xmm2\n\t"
+			       "movdqu 0x30(%[data]), %%xmm3\n\t"
+			       "pshufb %%xmm7, %%xmm0\n\t"
+			       "pshufb %%xmm7, %%xmm1\n\t"
+			       "pshufb %%xmm7, %%xmm2\n\t"
+			       "pshufb %%xmm7, %%xmm3\n\t"
+			       "movdqu 0x00(%[k]), %%xmm4\n\t"
+			       "paddd %%xmm0, %%xmm4\n\t"
+			       "movdqu %%xmm4, 0x00(%[w])\n\t"
+			       "movdqu 0x10(%[k]), %%xmm4\n\t"
+			       "paddd %%xmm1, %%xmm4\n\t"
+			       "movdqu %%xmm4, 0x10(%[w])\n\t"
+			       "movdqu 0x20(%[k]), %%xmm4\n\t"
+			       "paddd %%xmm2, %%xmm4\n\t"
+			       "movdqu %%xmm4, 0x20(%[w])\n\t"
+			       "movdqu 0x30(%[k]), %%xmm4\n\t"
+			       "paddd %%xmm3, %%xmm4\n\t"
+			       "movdqu %%xmm4, 0x30(%[w])\n\t"
+			       /* Calculate w[16..63] */
+			       "\n1:\n\t"
+			       SHA256_SSSE3_SCHEDULE ( 0x40, 0, 1, 2, 3 )
+			       SHA256_SSSE3_SCHEDULE ( 0x50, 1, 2, 3, 0 )
+			       SHA256_SSSE3_SCHEDULE ( 0x60, 2, 3, 0, 1 )
+			       SHA256_SSSE3_SCHEDULE ( 0x70, 3, 0, 1, 2 )
+			       "add $0x40, %[w]\n\t"
+			       "add $0x40, %[k]\n\t"
+			       "dec %[loop]\n\t"
+			       "jnz 1b\n\t"
+			       /* Restore XMM registers */
+			       "movdqu 0x10(%[work]), %%xmm0\n\t"
+			       "movdqu 0x20(%[work]), %%xmm1\n\t"
+			       "movdqu 0x30(%[work]), %%xmm2\n\t"
+			       "movdqu 0x40(%[work]), %%xmm3\n\t"
+			       "movdqu 0x50(%[work]), %%xmm4\n\t"
+			       "movdqu 0x60(%[work]), %%xmm5\n\t"
+			       "movdqu 0x70(%[work]), %%xmm6\n\t"
+			       "movdqu 0x80(%[work]), %%xmm7\n\t"
+			       : [w] "+r" ( w ), [k] "+r" ( k ),
+				 [loop] "+r" ( loop )
+			       : [data] "r" ( data ), [work] "r" ( &work )
+			       : "cc", "memory" );
+}
+
+/**
+ * Digest SHA-256 data blocks using SSSE3 message schedule
+ *
+ * @v digest		Digest (in host-endian order)
+ * @v data		Data blocks
+ * @v count		Number of blocks
+ */
+static void sha256_ssse3_blocks ( struct sha256_digest *digest,
+				  const void *data, size_t count ) {
+	uint32_t w[SHA256_ROUNDS];
+	struct x86_sse_state sse;
+
+	x86_sse_enable ( &sse );
+	for ( ; count ; count-- ) {
+		sha256_ssse3_schedule ( w, data );
+		sha256_rounds ( digest, w );
+		data += sizeof ( union sha256_block );
+	}
+	x86_sse_restore ( &sse );
+}
+
+/** SSSE3 parallel digest working area
+ *
+ * This structure must be 16-byte aligned, since fields within the
+ * first 0x510 bytes are used as memory operands.
+ */
+struct sha256_lanes_work {
+	/** State (one register per variable, one lane per message) */
+	uint32_t state[8][SHA256_LANES];
+	/** State at start of current block */
+	uint32_t save[8][SHA256_LANES];
+	/** Message schedule (with round constants added) */
+	uint32_t w[SHA256_ROUNDS][SHA256_LANES];
+	/** Byte-swap mask */
+	uint8_t mask[16];
+	/** Saved XMM registers */
+	uint8_t xmm[ 6 * 16 /* %xmm0-%xmm5 */ ];
+	/** Round constants */
+	const uint32_t *k;
+	/** Total length of each message */
+	unsigned long len;
+	/** Data blocks (one pointer per message) */
+	const void *data[SHA256_LANES];
+} __attribute__ (( aligned ( 16 ) ));
+
+/**
+ * Perform one round on four messages in parallel using SSE2
+ *
+ * @v a..h		State variable indices
+ * @v offset		Offset within message schedule
+ */
+#define SHA256_LANES_RND( a, b, c, d, e, f, g, h, offset )		\
+	/* %xmm2 = h + ch(e,f,g) + k + w */				\
+	"movdqa (" #e "*16)(%[work]), %%xmm0\n\t"			\
+	"movdqa (" #f "*16)(%[work]), %%xmm2\n\t"			\
+	"pxor (" #g "*16)(%[work]), %%xmm2\n\t"				\
+	"pand %%xmm0, %%xmm2\n\t"					\
+	"pxor (" #g "*16)(%[work]), %%xmm2\n\t"				\
+	"paddd (" #h "*16)(%[work]), %%xmm2\n\t"			\
+	"paddd " #offset "(%[ptr]), %%xmm2\n\t"				\
+	/* %xmm2 = t1 = %xmm2 + Sigma1(e) */				\
+	SHA256_SSE_BIG_SIGMA ( 0, 1, 3, 6, 11, 25 )			\
+	"paddd %%xmm1, %%xmm2\n\t"					\
+	/* d += t1 */							\
+	"movdqa (" #d "*16)(%[work]), %%xmm0\n\t"			\
+	"paddd %%xmm2, %%xmm0\n\t"					\
+	"movdqa %%xmm0, (" #d "*16)(%[work])\n\t"			\
+	/* %xmm2 = t1 + maj(a,b,c) */					\
+	"movdqa (" #a "*16)(%[work]), %%xmm0\n\t"			\
+	"movdqa %%xmm0, %%xmm1\n\t"					\
+	"pand (" #b "*16)(%[work]), %%xmm1\n\t"				\
+	"movdqa %%xmm0, %%xmm3\n\t"					\
+	"pxor (" #b "*16)(%[work]), %%xmm3\n\t"				\
+	"pand (" #c "*16)(%[work]), %%xmm3\n\t"				\
+	"pxor %%xmm3, %%xmm1\n\t"					\
+	"paddd %%xmm1, %%xmm2\n\t"					\
+	/* h = t1 + t2 = %xmm2 + Sigma0(a) */				\
+	SHA256_SSE_BIG_SIGMA ( 0, 1, 3, 2, 13, 22 )			\
+	"paddd %%xmm1, %%xmm2\n\t"					\
+	"movdqa %%xmm2, (" #h "*16)(%[work])\n\t"
+
+/**
+ * Load and transpose four message words from each of four messages
+ *
+ * @v offset		Offset within data block
+ * @v woffset		Offset within message schedule
+ */
+#define SHA256_LANES_LOAD( offset, woffset )				\
+	"mov %c[data0](%[work]), %[tmp]\n\t"				\
+	"movdqu " #offset "(%[tmp],%[off]), %%xmm0\n\t"			\
+	"mov %c[data1](%[work]), %[tmp]\n\t"				\
+	"movdqu " #offset "(%[tmp],%[off]), %%xmm1\n\t"			\
+	"mov %c[data2](%[work]), %[tmp]\n\t"				\
+	"movdqu " #offset "(%[tmp],%[off]), %%xmm2\n\t"			\
+	"mov %c[data3](%[work]), %[tmp]\n\t"				\
+	"movdqu " #offset "(%[tmp],%[off]), %%xmm3\n\t"			\
+	"pshufb %c[mask](%[work]), %%xmm0\n\t"				\
+	"pshufb %c[mask](%[work]), %%xmm1\n\t"				\
+	"pshufb %c[mask](%[work]), %%xmm2\n\t"				\
+	"pshufb %c[mask](%[work]), %%xmm3\n\t"				\
+	"movdqa %%xmm0, %%xmm4\n\t"					\
+	"punpckldq %%xmm1, %%xmm4\n\t"					\
+	"punpckhdq %%xmm1, %%xmm0\n\t"					\
+	"movdqa %%xmm2, %%xmm5\n\t"					\
+	"punpckldq %%xmm3, %%xmm5\n\t"					\
+	"punpckhdq %%xmm3, %%xmm2\n\t"					\
+	"movdqa %%xmm4, %%xmm1\n\t"					\
+	"punpcklqdq %%xmm5, %%xmm1\n\t"					\
+	"punpckhqdq %%xmm5, %%xmm4\n\t"					\
+	"movdqa %%xmm0, %%xmm3\n\t"					\
+	"punpcklqdq %%xmm2, %%xmm3\n\t"					\
+	"punpckhqdq %%xmm2, %%xmm0\n\t"					\
+	"movdqa %%xmm1, (0x100+" #woffset "+0x00)(%[work])\n\t"		\
+	"movdqa %%xmm4, (0x100+" #woffset "+0x10)(%[work])\n\t"		\
+	"movdqa %%xmm3, (0x100+" #woffset "+0x20)(%[work])\n\t"		\
+	"movdqa %%xmm0, (0x100+" #woffset "+0x30)(%[work])\n\t"
+
+/**
+ * Digest SHA-256 data blocks from four messages in parallel using SSSE3
+ *
+ * @v digests		Digests (in host-endian order), one per message
+ * @v data		Data blocks, one pointer per message
+ * @v lanes		Number of messages (at most SHA256_LANES)
+ * @v count		Number of blocks within each message
+ */
+static void sha256_ssse3_lanes ( struct sha256_digest *digests,
+				 const void **data, unsigned int lanes,
+				 size_t count ) {
+	struct sha256_lanes_work work;
+	struct x86_sse_state sse;
+	unsigned long off = 0;
+	unsigned long loop;
+	unsigned long tmp;
+	void *ptr;
+	unsigned int lane;
+	unsigned int src;
+	unsigned int i;
+
+	/* Sanity checks */
+	linker_assert ( offsetof ( typeof ( work ), save ) == 0x080,
+			sha256_lanes_bad_layout );
+	linker_assert ( offsetof ( typeof ( work ), w ) == 0x100,
+			sha256_lanes_bad_layout );
+	assert ( lanes <= SHA256_LANES );
+
+	/* Construct initial state, duplicating the first message into
+	 * any unused lanes
+	 */
+	for ( lane = 0 ; lane < SHA256_LANES ; lane++ ) {
+		src = ( ( lane < lanes ) ? lane : 0 );
+		for ( i = 0 ; i < 8 ; i++ )
+			work.state[i][lane] = digests[src].h[i];
+		work.data[lane] = data[src];
+	}
+	memcpy ( work.mask, sha256_bswap_mask, sizeof ( work.mask ) );
+	work.k = sha256_k;
+	work.len = ( count * sizeof ( union sha256_block ) );
+
+	/* Digest blocks */
+	x86_sse_enable ( &sse );
+	__asm__ __volatile__ ( /* Preserve XMM registers */
+			       "movdqu %%xmm0, (%c[xmm]+0x00)(%[work])\n\t"
+			       "movdqu %%xmm1, (%c[xmm]+0x10)(%[work])\n\t"
+			       "movdqu %%xmm2, (%c[xmm]+0x20)(%[work])\n\t"
+			       "movdqu %%xmm3, (%c[xmm]+0x30)(%[work])\n\t"
+			       "movdqu %%xmm4, (%c[xmm]+0x40)(%[work])\n\t"
+			       "movdqu %%xmm5, (%c[xmm]+0x50)(%[work])\n\t"
+			       "\n1:\n\t"
+			       /* Load w[0..15] */
+			       SHA256_LANES_LOAD ( 0x00, 0x000 )
+			       SHA256_LANES_LOAD ( 0x10, 0x040 )
+			       SHA256_LANES_LOAD ( 0x20, 0x080 )
+			       SHA256_LANES_LOAD ( 0x30, 0x0c0 )
+			       /* Calculate w[16..63] */
+			       "lea 0x100(%[work]), %[ptr]\n\t"
+			       "mov $48, %[loop]\n\t"
+			       "\n2:\n\t"
+			       "movdqa 0x10(%[ptr]), %%xmm0\n\t"
+			       SHA256_SSE_SIGMA ( 0, 1, 2, 7, 18, 3 )
+			       "paddd 0x00(%[ptr]), %%xmm1\n\t"
+			       "paddd 0x90(%[ptr]), %%xmm1\n\t"
+			       "movdqa 0xe0(%[ptr]), %%xmm0\n\t"
+			       SHA256_SSE_SIGMA ( 0, 3, 2, 17, 19, 10 )
+			       "paddd %%xmm3, %%xmm1\n\t"
+			       "movdqa %%xmm1, 0x100(%[ptr])\n\t"
+			       "add $0x10, %[ptr]\n\t"
+			       "dec %[loop]\n\t"
+			       "jnz 2b\n\t"
+			       /* Add round constants */
+			       "lea 0x100(%[work]), %[ptr]\n\t"
+			       "mov %c[k](%[work]), %[tmp]\n\t"
+			       "mov $64, %[loop]\n\t"
+			       "\n3:\n\t"
+			       "movd (%[tmp]), %%xmm0\n\t"
+			       "pshufd $0x00, %%xmm0, %%xmm0\n\t"
+			       "paddd (%[ptr]), %%xmm0\n\t"
+			       "movdqa %%xmm0, (%[ptr])\n\t"
+			       "add $4, %[tmp]\n\t"
+			       "add $0x10, %[ptr]\n\t"
+			       "dec %[loop]\n\t"
+			       "jnz 3b\n\t"
+			       /* Save state for this block */
+			       "movdqa 0x00(%[work]), %%xmm0\n\t"
+			       "movdqa 0x10(%[work]), %%xmm1\n\t"
+			       "movdqa 0x20(%[work]), %%xmm2\n\t"
+			       "movdqa 0x30(%[work]), %%xmm3\n\t"
+			       "movdqa %%xmm0, 0x80(%[work])\n\t"
+			       "movdqa %%xmm1, 0x90(%[work])\n\t"
+			       "movdqa %%xmm2, 0xa0(%[work])\n\t"
+			       "movdqa %%xmm3, 0xb0(%[work])\n\t"
+			       "movdqa 0x40(%[work]), %%xmm0\n\t"
+			       "movdqa 0x50(%[work]), %%xmm1\n\t"
+			       "movdqa 0x60(%[work]), %%xmm2\n\t"
+			       "movdqa 0x70(%[work]), %%xmm3\n\t"
+			       "movdqa %%xmm0, 0xc0(%[work])\n\t"
+			       "movdqa %%xmm1, 0xd0(%[work])\n\t"
+			       "movdqa %%xmm2, 0xe0(%[work])\n\t"
+			       "movdqa %%xmm3, 0xf0(%[work])\n\t"
+			       /* Perform rounds, eight at a time */
+			       "lea 0x100(%[work]), %[ptr]\n\t"
+			       "mov $8, %[loop]\n\t"
+			       "\n4:\n\t"
+			       SHA256_LANES_RND ( 0, 1, 2, 3, 4, 5, 6, 7, 0x00 )
+			       SHA256_LANES_RND ( 7, 0, 1, 2, 3, 4, 5, 6, 0x10 )
+			       SHA256_LANES_RND ( 6, 7, 0, 1, 2, 3, 4, 5, 0x20 )
+			       SHA256_LANES_RND ( 5, 6, 7, 0, 1, 2, 3, 4, 0x30 )
+			       SHA256_LANES_RND ( 4, 5, 6, 7, 0, 1, 2, 3, 0x40 )
+			       SHA256_LANES_RND ( 3, 4, 5, 6, 7, 0, 1, 2, 0x50 )
+			       SHA256_LANES_RND ( 2, 3, 4, 5, 6, 7, 0, 1, 0x60 )
+			       SHA256_LANES_RND ( 1, 2, 3, 4, 5, 6, 7, 0, 0x70 )
+			       "add $0x80, %[ptr]\n\t"
+			       "dec %[loop]\n\t"
+			       "jnz 4b\n\t"
+			       /* Add chunk to hash */
+			       "lea 0x80(%[work]), %[ptr]\n\t"
+			       "mov $8, %[loop]\n\t"
+			       "\n5:\n\t"
+			       "movdqa -0x80(%[ptr]), %%xmm0\n\t"
+			       "paddd (%[ptr]), %%xmm0\n\t"
+			       "movdqa %%xmm0, -0x80(%[ptr])\n\t"
+			       "add $0x10, %[ptr]\n\t"
+			       "dec %[loop]\n\t"
+			       "jnz 5b\n\t"
+			       /* Move to next block */
+			       "add $0x40, %[off]\n\t"
+			       "cmp %c[len](%[work]), %[off]\n\t"
+			       "jb 1b\n\t"
+			       /* Restore XMM registers */
+			       "movdqu (%c[xmm]+0x00)(%[work]), %%xmm0\n\t"
+			       "movdqu (%c[xmm]+0x10)(%[work]), %%xmm1\n\t"
+			       "movdqu (%c[xmm]+0x20)(%[work]), %%xmm2\n\t"
+			       "movdqu (%c[xmm]+0x30)(%[work]), %%xmm3\n\t"
+			       "movdqu (%c[xmm]+0x40)(%[work]), %%xmm4\n\t"
+			       "movdqu (%c[xmm]+0x50)(%[work]), %%xmm5\n\t"
+			       : [off] "+r" ( off ), [loop] "=&r" ( loop ),
+				 [tmp] "=&r" ( tmp ), [ptr] "=&r" ( ptr )
+			       : [work] "r" ( &work ),
+				 [mask] "i" ( offsetof ( typeof ( work ),
+							mask ) ),
+				 [xmm] "i" ( offsetof ( typeof ( work ),
+							xmm ) ),
+				 [k] "i" ( offsetof ( typeof ( work ), k ) ),
+				 [len] "i" ( offsetof ( typeof ( work ),
+							len ) ),
+				 [data0] "i" ( offsetof ( typeof ( work ),
+							  data[0] ) ),
+				 [data1] "i" ( offsetof ( typeof ( work ),
+							  data[1] ) ),
+				 [data2] "i" ( offsetof ( typeof ( work ),
+							  data[2] ) ),
+				 [data3] "i" ( offsetof ( typeof ( work ),
+							  data[3] ) )
+			       : "cc", "memory" );
+	x86_sse_restore ( &sse );
+
+	/* Extract final state */
+	for ( lane = 0 ; lane < lanes ; lane++ ) {
+		for ( i = 0 ; i < 8 ; i++ )
+			digests[lane].h[i] = work.state[i][lane];
+	}
+}
+
+/**
+ * Digest SHA-256 data blocks
+ *
+ * @v digest		Digest (in host-endian order)
+ * @v data		Data blocks
+ * @v count		Number of blocks
+ */
+void sha256_blocks ( struct sha256_digest *digest, const void *data,
+		     size_t count ) {
+
+	/* Use fastest available implementation */
+	if ( ! count ) {
+		/* Nothing to do */
+	} else if ( x86_sha256_impl == X86_SHA256_SHANI ) {
+		sha256_shani_blocks ( digest, data, count );
+	} else if ( x86_sha256_impl == X86_SHA256_SSSE3 ) {
+		sha256_ssse3_blocks ( digest, data, count );
+	} else {
+		generic_sha256_blocks ( digest, data, count );
+	}
+}
+
+/**
+ * Digest SHA-256 data blocks from multiple independent messages
+ *
+ * @v digests		Digests (in host-endian order), one per message
+ * @v data		Data blocks, one pointer per message
+ * @v lanes		Number of messages (at most SHA256_LANES)
+ * @v count		Number of blocks within each message
+ */
+void sha256_multi_blocks ( struct sha256_digest *digests, const void **data,
+			   unsigned int lanes, size_t count ) {
+
+	/* The SHA extensions are faster than four-way SSSE3 even
+	 * when digesting each message in turn.
+	 */
+	if ( ( x86_sha256_impl == X86_SHA256_SSSE3 ) && ( lanes > 1 ) &&
+	     count ) {
+		sha256_ssse3_lanes ( digests, data, lanes, count );
+	} else {
+		generic_sha256_multi_blocks ( digests, data, lanes, count );
+	}
+}
+
+/**
+ * Force use of a specific SHA-256 implementation
+ *
+ * @v impl		SHA-256 implementation
+ * @ret rc		Return status code
+ *
+ * This allows the self-tests to exercise every implementation that
+ * is supported by the CPU.
+ */
+int x86_sha256_force ( enum x86_sha256_impl impl ) {
+
+	if ( ! ( sha256_supported & ( 1 << impl ) ) )
+		return -ENOTSUP;
+	x86_sha256_impl = impl;
+	return 0;
+}
+
+/**
+ * Select SHA-256 implementation
+ *
+ */
+static void sha256_init ( void ) {
+	struct x86_features features;
+	uint32_t discard_a;
+	uint32_t ebx;
+	uint32_t discard_c;
+	uint32_t discard_d;
+
+	/* Check for SSSE3 (and SSE2) */
+	x86_features ( &features );
+	if ( ! ( features.intel.ecx & CPUID_FEATURES_INTEL_ECX_SSSE3 ) ) {
+		DBGC ( &x86_sha256_impl, "SHA256 SSSE3 not supported\n" );
+		return;
+	}
+	if ( ! ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_SSE2 ) ) {
+		DBGC ( &x86_sha256_impl, "SHA256 SSE2 not supported\n" );
+		return;
+	}
+	sha256_supported |= ( 1 << X86_SHA256_SSSE3 );
+	x86_sha256_impl = X86_SHA256_SSSE3;
+
+	/* Check for SHA extensions */
+	if ( cpuid_supported ( CPUID_EXTENDED_FEATURES ) == 0 ) {
+		cpuid ( CPUID_EXTENDED_FEATURES, 0, &discard_a, &ebx,
+			&discard_c, &discard_d );
+		if ( ebx & CPUID_EXTENDED_FEATURES_EBX_SHA ) {
+			sha256_supported |= ( 1 << X86_SHA256_SHANI );
+			x86_sha256_impl = X86_SHA256_SHANI;
+		}
+	}
+
+	DBGC ( &x86_sha256_impl, "SHA256 using %s\n",
+	       ( ( x86_sha256_impl == X86_SHA256_SHANI ) ?
+		 "SHA extensions" : "SSSE3" ) );
+}
+
+/** SHA-256 initialisation function */
+struct init_fn sha256_init_fn __init_fn ( INIT_EARLY ) = {
+	.initialise = sha256_init,
+};
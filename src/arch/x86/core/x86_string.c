@@ -29,7 +29,10 @@
 
 FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
+#include <stdint.h>
 #include <string.h>
+#include <ipxe/init.h>
+#include <ipxe/cpuid.h>
 #include <config/defaults.h>
 
 /* Use generic_memcpy_reverse() if we cannot safely set the direction flag */
@@ -39,6 +42,60 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define USE_GENERIC_MEMCPY_REVERSE 0
 #endif
 
+/** Minimum length for which non-temporal stores are used
+ *
+ * Large copies (such as a complete NVMe transfer being copied out of
+ * a bounce buffer into an INT 13 caller's buffer) are not read back
+ * by iPXE, and would otherwise evict the whole of a small cache.
+ */
+#define MEMCPY_NT_MIN_LEN 16384
+
+/** Copy using "rep movsb" (CPU has enhanced REP MOVSB) */
+static int memcpy_erms;
+
+/** Copy large blocks using non-temporal stores (CPU has SSE2) */
+static int memcpy_nt;
+
+/**
+ * Copy memory area using non-temporal stores
+ *
+ * @v dest		Destination address
+ * @v src		Source address
+ * @v len		Length
+ *
+ * MOVNTI operates on general-purpose registers, and so (unlike the
+ * MMX and SSE non-temporal stores) does not require the FPU state to
+ * be preserved or the BIOS to have enabled SSE via CR4.OSFXSR.  It
+ * does require SSE2, and so must not be used on CPUs (such as the
+ * Pentium III) that lack SSE2.
+ */
+void __memcpy_movnti ( void *dest, const void *src, size_t len ) {
+	unsigned long *dest_word;
+	const unsigned long *src_word;
+	size_t head;
+	size_t count;
+
+	/* Copy unaligned head bytewise */
+	head = ( ( - ( ( intptr_t ) dest ) ) & ( sizeof ( *dest_word ) - 1 ) );
+	if ( head > len )
+		head = len;
+	__memcpy_movsb ( dest, src, head );
+	dest_word = ( dest + head );
+	src_word = ( src + head );
+	len -= head;
+
+	/* Copy aligned body using non-temporal stores */
+	for ( count = ( len / sizeof ( *dest_word ) ) ; count ; count-- ) {
+		__asm__ __volatile__ ( "movnti %1, %0"
+				       : "=m" ( *(dest_word++) )
+				       : "r" ( *(src_word++) ) );
+	}
+	__asm__ __volatile__ ( "sfence" : : : "memory" );
+
+	/* Copy tail bytewise */
+	__memcpy_movsb ( dest_word, src_word, ( len % sizeof ( *dest_word ) ) );
+}
+
 /**
  * Copy memory area
  *
@@ -53,6 +110,18 @@ void * __attribute__ (( noinline )) __memcpy ( void *dest, const void *src,
 	const void *esi = src;
 	int discard_ecx;
 
+	/* Use "rep movsb" if the CPU reports that it is fast */
+	if ( memcpy_erms ) {
+		__memcpy_movsb ( dest, src, len );
+		return dest;
+	}
+
+	/* Use non-temporal stores for large copies, if available */
+	if ( memcpy_nt && ( len >= MEMCPY_NT_MIN_LEN ) ) {
+		__memcpy_movnti ( dest, src, len );
+		return dest;
+	}
+
 	/* We often do large dword-aligned and dword-length block
 	 * moves.  Using movsl rather than movsb speeds these up by
 	 * around 32%.
@@ -122,3 +191,35 @@ void * __memmove ( void *dest, const void *src, size_t len ) {
 		return __memcpy_reverse ( dest, src, len );
 	}
 }
+
+/**
+ * Select memory copy implementation
+ *
+ */
+static void x86_string_init ( void ) {
+	struct x86_features features;
+	uint32_t discard_a;
+	uint32_t ebx;
+	uint32_t discard_c;
+	uint32_t discard_d;
+
+	/* Check for enhanced REP MOVSB */
+	if ( cpuid_supported ( CPUID_EXTENDED_FEATURES ) == 0 ) {
+		cpuid ( CPUID_EXTENDED_FEATURES, 0, &discard_a, &ebx,
+			&discard_c, &discard_d );
+		memcpy_erms = ( ebx & CPUID_EXTENDED_FEATURES_EBX_ERMS );
+	}
+
+	/* Check for MOVNTI (and SFENCE) */
+	x86_features ( &features );
+	memcpy_nt = ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_SSE2 );
+
+	DBGC ( &memcpy_erms, "MEMCPY using %s\n",
+	       ( memcpy_erms ? "rep movsb" :
+		 ( memcpy_nt ? "rep movsl and movnti" : "rep movsl" ) ) );
+}
+
+/** Memory copy initialisation function */
+struct init_fn x86_string_init_fn __init_fn ( INIT_EARLY ) = {
+	.initialise = x86_string_init,
+};
@@ -0,0 +1,28 @@
+#ifndef _BITS_AES_H
+#define _BITS_AES_H
+
+/** @file
+ *
+ * AES algorithm
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** x86 AES implementations */
+enum x86_aes_impl {
+	/** Generic (table-based) implementation */
+	X86_AES_GENERIC = 0,
+	/** AES instructions (AES-NI) */
+	X86_AES_NI,
+};
+
+extern enum x86_aes_impl x86_aes_impl;
+
+extern void aes_encrypt_blocks ( struct aes_context *aes, const void *src,
+				 void *dst, size_t count );
+extern void aes_decrypt_blocks ( struct aes_context *aes, const void *src,
+				 void *dst, size_t count );
+extern int x86_aes_force ( enum x86_aes_impl impl );
+
+#endif /* _BITS_AES_H */
@@ -0,0 +1,25 @@
+#ifndef _BITS_CRC32_H
+#define _BITS_CRC32_H
+
+/** @file
+ *
+ * CRC32 checksum
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** x86 CRC32 implementations */
+enum x86_crc32_impl {
+	/** Generic implementation */
+	X86_CRC32_GENERIC = 0,
+	/** Carry-less multiplication (PCLMULQDQ) */
+	X86_CRC32_PCLMUL,
+};
+
+extern enum x86_crc32_impl x86_crc32_impl;
+
+extern u32 crc32_le ( u32 seed, const void *data, size_t len );
+extern int x86_crc32_force ( enum x86_crc32_impl impl );
+
+#endif /* _BITS_CRC32_H */
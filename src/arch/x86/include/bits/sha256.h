@@ -0,0 +1,31 @@
+#ifndef _BITS_SHA256_H
+#define _BITS_SHA256_H
+
+/** @file
+ *
+ * SHA-256 algorithm
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** x86 SHA-256 implementations */
+enum x86_sha256_impl {
+	/** Generic implementation */
+	X86_SHA256_GENERIC = 0,
+	/** SSSE3 message schedule and four-way parallel digests */
+	X86_SHA256_SSSE3,
+	/** SHA extensions (SHA-NI) */
+	X86_SHA256_SHANI,
+};
+
+extern enum x86_sha256_impl x86_sha256_impl;
+
+extern void sha256_blocks ( struct sha256_digest *digest, const void *data,
+			    size_t count );
+extern void sha256_multi_blocks ( struct sha256_digest *digests,
+				  const void **data, unsigned int lanes,
+				  size_t count );
+extern int x86_sha256_force ( enum x86_sha256_impl impl );
+
+#endif /* _BITS_SHA256_H */
@@ -0,0 +1,14 @@
+#ifndef _BITS_SMP_H
+#define _BITS_SMP_H
+
+/** @file
+ *
+ * x86-specific application processor worker API implementations
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <ipxe/bios_smp.h>
+
+#endif /* _BITS_SMP_H */
@@ -34,6 +34,27 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 extern void * __memcpy ( void *dest, const void *src, size_t len );
 extern void * __memcpy_reverse ( void *dest, const void *src, size_t len );
+extern void __memcpy_movnti ( void *dest, const void *src, size_t len );
+
+/**
+ * Copy memory area using "rep movsb"
+ *
+ * @v dest		Destination address
+ * @v src		Source address
+ * @v len		Length
+ */
+static inline __attribute__ (( always_inline )) void
+__memcpy_movsb ( void *dest, const void *src, size_t len ) {
+	void *edi = dest;
+	const void *esi = src;
+	int discard_ecx;
+
+	__asm__ __volatile__ ( "rep movsb"
+			       : "=&D" ( edi ), "=&S" ( esi ),
+				 "=&c" ( discard_ecx )
+			       : "0" ( edi ), "1" ( esi ), "2" ( len )
+			       : "memory" );
+}
 
 /**
  * Copy memory area (where length is a compile-time constant)
@@ -0,0 +1,14 @@
+#ifndef _BITS_TESTS_H
+#define _BITS_TESTS_H
+
+/** @file
+ *
+ * x86-specific self-tests
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+REQUIRE_OBJECT ( x86_memcpy_test );
+
+#endif /* _BITS_TESTS_H */
@@ -0,0 +1,22 @@
+#ifndef _IPXE_BIOS_SMP_H
+#define _IPXE_BIOS_SMP_H
+
+/** @file
+ *
+ * BIOS application processor worker
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#ifdef SMP_PCBIOS
+#define SMP_PREFIX_pcbios
+#else
+#define SMP_PREFIX_pcbios __pcbios_
+#endif
+
+#if defined ( SMP_PCBIOS ) && defined ( __x86_64__ )
+#error "SMP_PCBIOS is supported only for 32-bit BIOS builds"
+#endif
+
+#endif /* _IPXE_BIOS_SMP_H */
@@ -39,6 +39,15 @@ struct x86_features {
 /** Get standard features */
 #define CPUID_FEATURES 0x00000001UL
 
+/** PCLMULQDQ instruction is supported */
+#define CPUID_FEATURES_INTEL_ECX_PCLMULQDQ 0x00000002UL
+
+/** SSSE3 instructions are supported */
+#define CPUID_FEATURES_INTEL_ECX_SSSE3 0x00000200UL
+
+/** AES instructions are supported */
+#define CPUID_FEATURES_INTEL_ECX_AES 0x02000000UL
+
 /** RDRAND instruction is supported */
 #define CPUID_FEATURES_INTEL_ECX_RDRAND 0x40000000UL
 
@@ -48,9 +57,27 @@ struct x86_features {
 /** TSC is present */
 #define CPUID_FEATURES_INTEL_EDX_TSC 0x00000010UL
 
+/** Local APIC is present */
+#define CPUID_FEATURES_INTEL_EDX_APIC 0x00000200UL
+
 /** FXSAVE and FXRSTOR are supported */
 #define CPUID_FEATURES_INTEL_EDX_FXSR 0x01000000UL
 
+/** SSE instructions are supported */
+#define CPUID_FEATURES_INTEL_EDX_SSE 0x02000000UL
+
+/** SSE2 instructions are supported */
+#define CPUID_FEATURES_INTEL_EDX_SSE2 0x04000000UL
+
+/** Get structured extended features */
+#define CPUID_EXTENDED_FEATURES 0x00000007UL
+
+/** Enhanced REP MOVSB/STOSB is supported */
+#define CPUID_EXTENDED_FEATURES_EBX_ERMS 0x00000200UL
+
+/** SHA extensions are supported */
+#define CPUID_EXTENDED_FEATURES_EBX_SHA 0x20000000UL
+
 /** Get largest extended function */
 #define CPUID_AMD_MAX_FN 0x80000000UL
 
@@ -72,6 +99,23 @@ struct x86_features {
 /** Invariant TSC */
 #define CPUID_APM_EDX_TSC_INVARIANT 0x00000100UL
 
+/** CR0 bit indicating that the FPU is emulated */
+#define CR0_EM 0x00000004UL
+
+/** CR0 bit indicating that a task switch has occurred */
+#define CR0_TS 0x00000008UL
+
+/** CR4 bit indicating that the operating system supports SSE */
+#define CR4_OSFXSR 0x00000200UL
+
+/** Saved SSE enablement state */
+struct x86_sse_state {
+	/** Original CR0 */
+	unsigned long cr0;
+	/** Original CR4 */
+	unsigned long cr4;
+};
+
 /**
  * Issue CPUID instruction
  *
@@ -91,6 +135,52 @@ cpuid ( uint32_t function, uint32_t subfunction, uint32_t *eax, uint32_t *ebx,
 		  : "0" ( function ), "2" ( subfunction ) );
 }
 
+/**
+ * Enable SSE instructions
+ *
+ * @v state		Saved state to fill in
+ *
+ * iPXE may be called (e.g. via INT 13) with SSE instructions disabled
+ * by the firmware or operating system, either permanently (via
+ * CR4.OSFXSR or CR0.EM) or pending a lazy FPU context switch (via
+ * CR0.TS).  Code using SSE instructions must therefore enable them
+ * around each use, must preserve any XMM registers that it modifies,
+ * and must then call x86_sse_restore().
+ *
+ * SSE instructions are always enabled by a Linux host.
+ */
+static inline __attribute__ (( always_inline )) void
+x86_sse_enable ( struct x86_sse_state *state __unused ) {
+#ifndef PLATFORM_linux
+	__asm__ __volatile__ ( "mov %%cr0, %0" : "=r" ( state->cr0 ) );
+	__asm__ __volatile__ ( "mov %%cr4, %0" : "=r" ( state->cr4 ) );
+	if ( state->cr0 & ( CR0_EM | CR0_TS ) ) {
+		__asm__ __volatile__ ( "mov %0, %%cr0"
+				       : : "r" ( state->cr0 &
+						 ~( CR0_EM | CR0_TS ) ) );
+	}
+	if ( ! ( state->cr4 & CR4_OSFXSR ) ) {
+		__asm__ __volatile__ ( "mov %0, %%cr4"
+				       : : "r" ( state->cr4 | CR4_OSFXSR ) );
+	}
+#endif
+}
+
+/**
+ * Restore SSE enablement state
+ *
+ * @v state		Saved state
+ */
+static inline __attribute__ (( always_inline )) void
+x86_sse_restore ( struct x86_sse_state *state __unused ) {
+#ifndef PLATFORM_linux
+	if ( ! ( state->cr4 & CR4_OSFXSR ) )
+		__asm__ __volatile__ ( "mov %0, %%cr4" : : "r" ( state->cr4 ) );
+	if ( state->cr0 & ( CR0_EM | CR0_TS ) )
+		__asm__ __volatile__ ( "mov %0, %%cr0" : : "r" ( state->cr0 ) );
+#endif
+}
+
 extern int cpuid_supported ( uint32_t function );
 extern void x86_features ( struct x86_features *features );
 
@@ -246,6 +246,8 @@ extern const uint16_t __text16 ( rm_ds );
 
 extern uint16_t copy_user_to_rm_stack ( userptr_t data, size_t size );
 extern void remove_user_from_rm_stack ( userptr_t data, size_t size );
+extern void relocate_real ( unsigned int text16_seg, size_t text16_len,
+			   unsigned int data16_seg, size_t data16_len );
 
 /* CODE_DEFAULT: restore default .code32/.code64 directive */
 #ifdef __x86_64__
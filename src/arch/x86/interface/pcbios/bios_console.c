@@ -594,4 +594,5 @@ struct startup_fn bios_inject_startup_fn __startup_fn ( STARTUP_NORMAL ) = {
 	.name = "bios_inject",
 	.startup = bios_inject_startup,
 	.shutdown = bios_inject_shutdown,
+	.deferrable = 1,
 };
@@ -0,0 +1,556 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * BIOS application processor worker
+ *
+ * A single application processor (AP) is woken using the
+ * INIT-SIPI-SIPI sequence (with the INIT level de-assertion required
+ * by P6 family processors), and is used to perform bulk data work
+ * (such as copying out NVMe bounce buffers) in parallel with the
+ * bootstrap processor (BSP).  Work is handed to the AP via a
+ * lock-free single-producer single-consumer ring.
+ *
+ * The AP runs in flat 32-bit protected mode using the BSP's GDT, and
+ * never calls into the rest of iPXE.  It is returned to the
+ * wait-for-SIPI state (by broadcasting an INIT IPI) before an
+ * operating system is booted.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <realmode.h>
+#include <basemem.h>
+#include <ipxe/io.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/timer.h>
+#include <ipxe/cpuid.h>
+#include <ipxe/msr.h>
+#include <ipxe/init.h>
+#include <ipxe/smp.h>
+
+/** Local APIC base address MSR */
+#define MSR_APIC_BASE 0x0000001b
+
+/** Local APIC is globally enabled */
+#define MSR_APIC_BASE_EN 0x00000800UL
+
+/** Local APIC is in x2APIC mode */
+#define MSR_APIC_BASE_EXTD 0x00000400UL
+
+/** Local APIC base address mask */
+#define MSR_APIC_BASE_MASK 0xfffff000UL
+
+/** x2APIC interrupt command register MSR */
+#define MSR_X2APIC_ICR 0x00000830
+
+/** Local APIC register space length */
+#define APIC_LEN 0x1000
+
+/** Local APIC interrupt command register (low dword) */
+#define APIC_ICR_LOW 0x300
+
+/** Local APIC interrupt command register (high dword) */
+#define APIC_ICR_HIGH 0x310
+
+/** INIT delivery mode */
+#define APIC_ICR_INIT 0x00000500UL
+
+/** Startup delivery mode */
+#define APIC_ICR_STARTUP 0x00000600UL
+
+/** Delivery status: send pending */
+#define APIC_ICR_PENDING 0x00001000UL
+
+/** Level assert */
+#define APIC_ICR_ASSERT 0x00004000UL
+
+/** Level-triggered */
+#define APIC_ICR_LEVEL 0x00008000UL
+
+/** Destination shorthand: all excluding self */
+#define APIC_ICR_ALL_BUT_SELF 0x000c0000UL
+
+/** Maximum time to wait for an IPI to be sent (in us) */
+#define SMP_IPI_MAX_WAIT_US 1000
+
+/** Time to wait between INIT and Startup IPIs (in ms) */
+#define SMP_INIT_DELAY_MS 10
+
+/** Time to wait between Startup IPIs (in us) */
+#define SMP_STARTUP_DELAY_US 200
+
+/** Maximum time to wait for the worker to start (in ms) */
+#define SMP_START_MAX_WAIT_MS 100
+
+/** Worker stack size */
+#define SMP_STACK_SIZE 4096
+
+/** Trampoline page size (in kB) */
+#define SMP_TRAMPOLINE_KB 4
+
+/** Work ring size (must be a power of two) */
+#define SMP_RING_SIZE 8
+
+/** Minimum length for a copy to be split with the worker
+ *
+ * Handing work to the AP costs a few hundred nanoseconds of cache
+ * line transfers, which is recovered only for large copies.
+ */
+#define SMP_MEMCPY_MIN_LEN 8192
+
+/** Alignment of the split point for a copy */
+#define SMP_MEMCPY_ALIGN 64
+
+/** AP startup trampoline parameters */
+struct smp_trampoline_params {
+	/** GDT limit */
+	uint16_t gdt_limit;
+	/** GDT base (physical address) */
+	uint32_t gdt_base;
+	/** Entry point offset */
+	uint32_t offset;
+	/** Entry point segment */
+	uint16_t segment;
+} __attribute__ (( packed ));
+
+/** A copy performed by the worker */
+struct smp_copy {
+	/** Work item */
+	struct smp_work work;
+	/** Destination */
+	void *dest;
+	/** Source */
+	const void *src;
+	/** Length */
+	size_t len;
+};
+
+/** AP startup trampoline */
+extern char smp_trampoline[];
+
+/** AP startup trampoline parameters */
+extern char smp_trampoline_params[];
+
+/** End of AP startup trampoline */
+extern char smp_trampoline_end[];
+
+/** AP protected-mode entry point */
+extern char smp_ap_entry[];
+
+/** Worker role has been claimed by an AP (used by smp_ap_entry) */
+volatile uint32_t smp_ap_claimed;
+
+/** Worker stack pointer (used by smp_ap_entry) */
+uint32_t smp_ap_stack;
+
+/** Worker stack */
+static void *smp_stack;
+
+/** Worker is running */
+static volatile int smp_running;
+
+/** Local APIC registers (if not in x2APIC mode) */
+static void *smp_apic;
+
+/** Work ring */
+static struct smp_work *smp_ring[SMP_RING_SIZE];
+
+/** Work ring producer index (written only by the BSP) */
+static volatile unsigned int smp_prod
+	__attribute__ (( aligned ( SMP_MEMCPY_ALIGN ) ));
+
+/** Work ring consumer index (written only by the worker) */
+static volatile unsigned int smp_cons
+	__attribute__ (( aligned ( SMP_MEMCPY_ALIGN ) ));
+
+/**
+ * Pause within a spin loop
+ *
+ */
+static inline __attribute__ (( always_inline )) void smp_pause ( void ) {
+	__asm__ __volatile__ ( "pause" );
+}
+
+/**
+ * Run worker
+ *
+ * This is the C entry point for the AP, called from smp_ap_entry on
+ * the worker stack.  It never returns: the AP is stopped only by an
+ * INIT IPI.
+ */
+__asmcall __used void smp_ap_main ( void ) {
+	struct smp_work *work;
+	unsigned int cons;
+
+	/* Notify BSP that we are running */
+	smp_running = 1;
+
+	while ( 1 ) {
+
+		/* Wait for work */
+		cons = smp_cons;
+		if ( cons == smp_prod ) {
+			smp_pause();
+			continue;
+		}
+		rmb();
+
+		/* Perform work */
+		work = smp_ring[ cons % SMP_RING_SIZE ];
+		work->run ( work );
+
+		/* Mark work as complete and consume ring entry */
+		wmb();
+		work->done = 1;
+		smp_cons = ( cons + 1 );
+	}
+}
+
+/**
+ * Submit work to worker
+ *
+ * @v work		Work item
+ *
+ * The work is performed immediately on the BSP if there is no worker
+ * or if the ring is full.
+ */
+static void bios_smp_submit ( struct smp_work *work ) {
+	unsigned int prod = smp_prod;
+
+	work->done = 0;
+
+	/* Run work directly if worker is unavailable */
+	if ( ( ! smp_running ) ||
+	     ( ( prod - smp_cons ) >= SMP_RING_SIZE ) ) {
+		work->run ( work );
+		work->done = 1;
+		return;
+	}
+
+	/* Add to ring */
+	smp_ring[ prod % SMP_RING_SIZE ] = work;
+	wmb();
+	smp_prod = ( prod + 1 );
+}
+
+/**
+ * Wait for work to complete
+ *
+ * @v work		Work item
+ */
+static void bios_smp_wait ( struct smp_work *work ) {
+
+	while ( ! work->done )
+		smp_pause();
+	rmb();
+}
+
+/**
+ * Perform copy
+ *
+ * @v work		Work item
+ */
+static void smp_copy_run ( struct smp_work *work ) {
+	struct smp_copy *copy =
+		container_of ( work, struct smp_copy, work );
+
+	memcpy ( copy->dest, copy->src, copy->len );
+}
+
+/**
+ * Copy memory using the worker
+ *
+ * @v dest		Destination
+ * @v src		Source
+ * @v len		Length
+ *
+ * Large copies are split in two, with the worker copying the first
+ * half while the BSP copies the second half.
+ */
+static void bios_smp_memcpy ( void *dest, const void *src, size_t len ) {
+	struct smp_copy copy;
+	size_t half;
+
+	/* Copy directly if worker is unavailable or copy is small */
+	if ( ( ! smp_running ) || ( len < SMP_MEMCPY_MIN_LEN ) ) {
+		memcpy ( dest, src, len );
+		return;
+	}
+
+	/* Hand first half to worker and copy second half ourselves */
+	half = ( ( len / 2 ) & ~( SMP_MEMCPY_ALIGN - 1 ) );
+	copy.work.run = smp_copy_run;
+	copy.dest = dest;
+	copy.src = src;
+	copy.len = half;
+	bios_smp_submit ( &copy.work );
+	memcpy ( ( dest + half ), ( src + half ), ( len - half ) );
+	bios_smp_wait ( &copy.work );
+}
+
+/**
+ * Send IPI to all other processors
+ *
+ * @v icr		Interrupt command
+ * @ret rc		Return status code
+ */
+static int smp_ipi ( uint32_t icr ) {
+	unsigned int i;
+
+	icr |= APIC_ICR_ALL_BUT_SELF;
+
+	/* Use MSR interface in x2APIC mode */
+	if ( ! smp_apic ) {
+		wrmsr ( MSR_X2APIC_ICR, icr );
+		return 0;
+	}
+
+	/* Send IPI and wait for delivery */
+	writel ( 0, ( smp_apic + APIC_ICR_HIGH ) );
+	writel ( icr, ( smp_apic + APIC_ICR_LOW ) );
+	for ( i = 0 ; i < SMP_IPI_MAX_WAIT_US ; i++ ) {
+		if ( ! ( readl ( smp_apic + APIC_ICR_LOW ) &
+			 APIC_ICR_PENDING ) )
+			return 0;
+		udelay ( 1 );
+	}
+
+	DBGC ( &smp_running, "SMP timed out sending IPI %#08x\n", icr );
+	return -ETIMEDOUT;
+}
+
+/**
+ * Send INIT IPI to all other processors
+ *
+ * @ret rc		Return status code
+ *
+ * P6 family processors (with a discrete local APIC bus) require the
+ * level-triggered INIT assertion to be followed by an INIT level
+ * de-assertion.  Later processors ignore the de-assertion, which is
+ * not supported at all in x2APIC mode.
+ */
+static int smp_init ( void ) {
+	int rc;
+
+	/* Assert INIT */
+	if ( ( rc = smp_ipi ( APIC_ICR_INIT | APIC_ICR_LEVEL |
+			      APIC_ICR_ASSERT ) ) != 0 )
+		return rc;
+
+	/* De-assert INIT, if applicable */
+	if ( smp_apic &&
+	     ( ( rc = smp_ipi ( APIC_ICR_INIT | APIC_ICR_LEVEL ) ) != 0 ) )
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Return all other processors to the wait-for-SIPI state
+ *
+ */
+static void smp_reset ( void ) {
+
+	smp_init();
+	mdelay ( SMP_INIT_DELAY_MS );
+	smp_running = 0;
+	smp_ap_claimed = 0;
+	smp_prod = smp_cons = 0;
+}
+
+/**
+ * Start worker
+ *
+ * @ret rc		Return status code
+ */
+static int smp_start ( void ) {
+	struct smp_trampoline_params params;
+	struct x86_features features;
+	unsigned int fbms;
+	unsigned int trampoline_kb;
+	physaddr_t trampoline;
+	uint64_t apic_base;
+	unsigned int vector;
+	unsigned int i;
+	int rc;
+
+	/* Check for a usable local APIC */
+	x86_features ( &features );
+	if ( ! ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_APIC ) ) {
+		DBGC ( &smp_running, "SMP has no local APIC\n" );
+		rc = -ENOTSUP;
+		goto err_apic;
+	}
+	apic_base = rdmsr ( MSR_APIC_BASE );
+	if ( ! ( apic_base & MSR_APIC_BASE_EN ) ) {
+		DBGC ( &smp_running, "SMP local APIC is disabled\n" );
+		rc = -ENOTSUP;
+		goto err_apic;
+	}
+	if ( ! ( apic_base & MSR_APIC_BASE_EXTD ) ) {
+		smp_apic = ioremap ( ( apic_base & MSR_APIC_BASE_MASK ),
+				     APIC_LEN );
+		if ( ! smp_apic ) {
+			rc = -ENODEV;
+			goto err_ioremap;
+		}
+	}
+
+	/* Allocate worker stack */
+	smp_stack = malloc ( SMP_STACK_SIZE );
+	if ( ! smp_stack ) {
+		rc = -ENOMEM;
+		goto err_stack;
+	}
+	smp_ap_stack = ( ( intptr_t ) smp_stack + SMP_STACK_SIZE );
+
+	/* Borrow a page of free base memory for the trampoline */
+	fbms = get_fbms();
+	trampoline_kb = ( ( fbms - SMP_TRAMPOLINE_KB ) &
+			  ~( SMP_TRAMPOLINE_KB - 1 ) );
+	set_fbms ( trampoline_kb );
+	trampoline = ( trampoline_kb * 1024 );
+	vector = ( trampoline / ( SMP_TRAMPOLINE_KB * 1024 ) );
+
+	/* Construct trampoline */
+	__asm__ __volatile__ ( "sgdt %0" : "=m" ( params ) );
+	params.offset = ( ( intptr_t ) smp_ap_entry );
+	params.segment = VIRTUAL_CS;
+	copy_to_user ( phys_to_user ( trampoline ), 0, smp_trampoline,
+		       ( smp_trampoline_end - smp_trampoline ) );
+	copy_to_user ( phys_to_user ( trampoline ),
+		       ( smp_trampoline_params - smp_trampoline ),
+		       &params, sizeof ( params ) );
+	DBGC ( &smp_running, "SMP starting worker via trampoline at %#05lx\n",
+	       trampoline );
+
+	/* Send INIT-SIPI-SIPI */
+	if ( ( rc = smp_init() ) != 0 )
+		goto err_ipi;
+	mdelay ( SMP_INIT_DELAY_MS );
+	for ( i = 0 ; i < 2 ; i++ ) {
+		if ( ( rc = smp_ipi ( APIC_ICR_STARTUP | APIC_ICR_ASSERT |
+				      vector ) ) != 0 )
+			goto err_ipi;
+		udelay ( SMP_STARTUP_DELAY_US );
+	}
+
+	/* Wait for worker to start */
+	for ( i = 0 ; i < SMP_START_MAX_WAIT_MS ; i++ ) {
+		if ( smp_running )
+			break;
+		mdelay ( 1 );
+	}
+	if ( ! smp_running ) {
+		DBGC ( &smp_running, "SMP found no application processor\n" );
+		rc = -ENODEV;
+		goto err_running;
+	}
+
+	/* Allow any other APs time to leave the trampoline */
+	mdelay ( SMP_INIT_DELAY_MS );
+
+	/* Return trampoline page to free base memory */
+	if ( get_fbms() == trampoline_kb )
+		set_fbms ( fbms );
+
+	DBGC ( &smp_running, "SMP worker running\n" );
+	return 0;
+
+ err_running:
+ err_ipi:
+	smp_reset();
+	if ( get_fbms() == trampoline_kb )
+		set_fbms ( fbms );
+	free ( smp_stack );
+	smp_stack = NULL;
+ err_stack:
+	if ( smp_apic )
+		iounmap ( smp_apic );
+	smp_apic = NULL;
+ err_ioremap:
+ err_apic:
+	return rc;
+}
+
+/**
+ * Park worker
+ *
+ * Waits for all outstanding work to complete and returns all
+ * application processors to the wait-for-SIPI state, ready for an
+ * operating system to start them.
+ */
+static void bios_smp_park ( void ) {
+
+	/* Do nothing unless worker is running */
+	if ( ! smp_running )
+		return;
+
+	/* Wait for outstanding work */
+	while ( smp_cons != smp_prod )
+		smp_pause();
+
+	/* Stop all application processors */
+	smp_reset();
+	free ( smp_stack );
+	smp_stack = NULL;
+	if ( smp_apic )
+		iounmap ( smp_apic );
+	smp_apic = NULL;
+	DBGC ( &smp_running, "SMP worker parked\n" );
+}
+
+/**
+ * Start worker at startup
+ *
+ */
+static void smp_startup ( void ) {
+
+	smp_start();
+}
+
+/**
+ * Park worker at shutdown
+ *
+ * @v booting		System is shutting down for OS boot
+ */
+static void smp_shutdown ( int booting __unused ) {
+
+	bios_smp_park();
+}
+
+/** Application processor worker startup function */
+struct startup_fn smp_startup_fn __startup_fn ( STARTUP_NORMAL ) = {
+	.name = "smp",
+	.startup = smp_startup,
+	.shutdown = smp_shutdown,
+};
+
+PROVIDE_SMP ( pcbios, smp_submit, bios_smp_submit );
+PROVIDE_SMP ( pcbios, smp_wait, bios_smp_wait );
+PROVIDE_SMP ( pcbios, smp_memcpy, bios_smp_memcpy );
+PROVIDE_SMP ( pcbios, smp_park, bios_smp_park );
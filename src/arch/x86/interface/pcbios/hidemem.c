@@ -27,9 +27,15 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <biosint.h>
 #include <basemem.h>
 #include <fakee820.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ipxe/init.h>
 #include <ipxe/io.h>
+#include <ipxe/malloc.h>
+#include <ipxe/nap.h>
 #include <ipxe/hidemem.h>
+#include <config/general.h>
 
 /** Set to true if you want to test a fake E820 map */
 #define FAKE_E820 0
@@ -65,6 +71,79 @@ extern struct hidden_region __data16 ( hidemem_umalloc );
 extern struct hidden_region __data16 ( hidemem_textdata );
 #define hidemem_textdata __use_data16 ( hidemem_textdata )
 
+/** Hidden text memory following discarded initialisation code */
+extern struct hidden_region __data16 ( hidemem_textdata_mid );
+#define hidemem_textdata_mid __use_data16 ( hidemem_textdata_mid )
+
+/** Hidden text memory following a compacted heap */
+extern struct hidden_region __data16 ( hidemem_textdata_tail );
+#define hidemem_textdata_tail __use_data16 ( hidemem_textdata_tail )
+
+/** Free heap space retained by a compacted resident image
+ *
+ * Buffers used by the INT 13 runtime (such as the NVMe bounce
+ * buffers, the INT 13 staging buffer and any encryption bounce
+ * buffer) are all allocated before the image is compacted.  The
+ * runtime still allocates small objects (e.g. NVMe commands), which
+ * may require a fresh slab for each object size in use.
+ */
+#define COMPACT_HEAP_RESERVE ( 32 * 1024 )
+
+/** Release base memory when compacting the resident image */
+#ifdef ROM_LOWMEM
+#define COMPACT_BASEMEM 1
+#else
+#define COMPACT_BASEMEM 0
+#endif
+
+/** Real-mode stack pointer used while base memory is released
+ *
+ * The internal real-mode stack is not retained.  A boot sector
+ * started while base memory is released will instead find its
+ * initial stack immediately below the resident real-mode code, in
+ * base memory which has already been returned to the system.
+ */
+#define COMPACT_BASEMEM_SP 0xfff0
+
+/** Resident image has been compacted */
+static int compacted;
+
+/** Heap space returned to the system by compaction */
+static void *compact_start;
+
+/** Length of heap space returned to the system by compaction */
+static size_t compact_len;
+
+/** Start of initialisation code returned to the system by compaction */
+static physaddr_t compact_init;
+
+/** End of initialisation code returned to the system by compaction */
+static physaddr_t compact_einit;
+
+/** Checksum of initialisation code returned to the system by compaction */
+static uint32_t compact_init_sum;
+
+/** Copy of base memory released by compaction */
+static void *compact_basemem;
+
+/** Length of base memory copy */
+static size_t compact_basemem_len;
+
+/** Free base memory counter prior to compaction */
+static unsigned int compact_fbms;
+
+/** Original .text16 segment */
+static uint16_t compact_rm_cs;
+
+/** Original .data16 segment */
+static uint16_t compact_rm_ds;
+
+/** Original real-mode stack segment */
+static uint16_t compact_rm_ss;
+
+/** Original real-mode stack pointer */
+static uint16_t compact_rm_sp;
+
 /** Assembly routine in e820mangler.S */
 extern void int15();
 
@@ -74,11 +153,16 @@ extern struct segoff __text16 ( int15_vector );
 
 /* The linker defines these symbols for us */
 extern char _textdata[];
+extern char _einit_text[];
 extern char _etextdata[];
 extern char _text16_memsz[];
 #define _text16_memsz ( ( size_t ) _text16_memsz )
 extern char _data16_memsz[];
 #define _data16_memsz ( ( size_t ) _data16_memsz )
+extern char _text16_init[];
+#define _text16_init ( ( size_t ) _text16_init )
+extern char _stack16[];
+#define _stack16 ( ( size_t ) _stack16 )
 
 /**
  * Hide region of memory from system memory map
@@ -128,6 +212,337 @@ void hide_umalloc ( physaddr_t start, physaddr_t end ) {
 void hide_textdata ( void ) {
 	hide_region ( &hidemem_textdata, virt_to_phys ( _textdata ),
 		      virt_to_phys ( _etextdata ) );
+	hidemem_textdata_mid.start = hidemem_textdata.end;
+	hidemem_textdata_mid.end = hidemem_textdata.end;
+	hidemem_textdata_tail.start = hidemem_textdata.end;
+	hidemem_textdata_tail.end = hidemem_textdata.end;
+}
+
+/**
+ * Calculate size of hidden region
+ *
+ * @v region		Hidden memory region
+ * @ret len		Length of region
+ */
+static inline size_t hidden_len ( struct hidden_region *region ) {
+	return ( ( region->end > region->start ) ?
+		 ( region->end - region->start ) : 0 );
+}
+
+/**
+ * Calculate checksum of discarded initialisation code
+ *
+ * @ret sum		Checksum
+ */
+static uint32_t compact_init_checksum ( void ) {
+	const uint32_t *data = phys_to_virt ( compact_init );
+	size_t len = ( compact_einit - compact_init );
+	uint32_t sum = 0;
+
+	for ( ; len ; len -= sizeof ( *data ) )
+		sum = ( ( ( sum << 1 ) | ( sum >> 31 ) ) + *(data++) );
+	return sum;
+}
+
+/**
+ * Check that all hooked interrupt vectors still point to us
+ *
+ * @v cs		Real-mode code segment
+ * @ret ok		All hooked interrupt vectors point to us
+ *
+ * Some other code (e.g. an option ROM or a TSR) may have hooked an
+ * interrupt vector since we hooked it, and will then have retained
+ * its own copy of our original far pointer.  This would be left
+ * pointing to base memory that we no longer occupy if we were to
+ * relocate our real-mode code.  We therefore relocate only if every
+ * vector that we have hooked is still found in the interrupt vector
+ * table.
+ */
+static int compact_vectors_ok ( unsigned int cs ) {
+	struct segoff vector;
+	unsigned int intr;
+	unsigned int count = 0;
+
+	for ( intr = 0 ; intr < 256 ; intr++ ) {
+		get_real ( vector, 0, ( intr * sizeof ( vector ) ) );
+		if ( vector.segment == cs )
+			count++;
+	}
+	if ( count != hooked_bios_interrupts ) {
+		DBG ( "Only %d of %d hooked interrupt vectors point to "
+		      "%04x\n", count, hooked_bios_interrupts, cs );
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Redirect interrupt vectors between real-mode code segments
+ *
+ * @v from		Original code segment
+ * @v to		New code segment
+ */
+static void compact_redirect ( unsigned int from, unsigned int to ) {
+	struct segoff vector;
+	unsigned int intr;
+
+	for ( intr = 0 ; intr < 256 ; intr++ ) {
+		get_real ( vector, 0, ( intr * sizeof ( vector ) ) );
+		if ( vector.segment != from )
+			continue;
+		vector.segment = to;
+		put_real ( vector, 0, ( intr * sizeof ( vector ) ) );
+	}
+}
+
+/**
+ * Release base memory
+ *
+ * Only the initial portions of .text16 and .data16 (everything except
+ * the discardable real-mode code and the internal stack) are required
+ * by the resident runtime.  These are moved to the top of the base
+ * memory occupied by iPXE, immediately below the extended BIOS data
+ * area, and everything below them is returned to the system.  A copy
+ * of the original contents is kept in hidden extended memory, so that
+ * base memory can be reclaimed if the operating system returns
+ * control to iPXE.
+ */
+static void hide_compact_basemem ( void ) {
+	physaddr_t text16_phys = ( rm_cs << 4 );
+	physaddr_t data16_phys = ( rm_ds << 4 );
+	physaddr_t top = ( data16_phys + _data16_memsz );
+	physaddr_t new_data16 = ( ( top - _stack16 ) & ~0xf );
+	physaddr_t new_text16 = ( ( new_data16 - _text16_init ) & ~0xf );
+	unsigned int fbms = get_fbms();
+	unsigned int new_fbms = ( new_text16 / 1024 );
+	struct segoff vector;
+	unsigned int intr;
+
+	/* Check that base memory is ours to release */
+	if ( ( ( rm_cs >> 6 ) != fbms ) || ( data16_phys < text16_phys ) ) {
+		DBG ( "Cannot release base memory (CS=%04x DS=%04x "
+		      "FBMS=%dkB)\n", rm_cs, rm_ds, fbms );
+		return;
+	}
+	if ( ( new_text16 < ( data16_phys + _stack16 ) ) ||
+	     ( new_fbms <= fbms ) ) {
+		DBG ( "No base memory to release\n" );
+		return;
+	}
+
+	/* Check that no hooked interrupt vector points to discarded
+	 * real-mode code (e.g. an active PXE API).
+	 */
+	for ( intr = 0 ; intr < 256 ; intr++ ) {
+		get_real ( vector, 0, ( intr * sizeof ( vector ) ) );
+		if ( ( vector.segment == rm_cs ) &&
+		     ( vector.offset >= _text16_init ) ) {
+			DBG ( "Cannot release base memory: INT %02x hooked "
+			      "to %04x:%04x\n", intr, vector.segment,
+			      vector.offset );
+			return;
+		}
+	}
+
+	/* Check that no other code has hooked over our vectors */
+	if ( ! compact_vectors_ok ( rm_cs ) ) {
+		DBG ( "Cannot release base memory: vectors hooked over\n" );
+		return;
+	}
+
+	/* Preserve original contents */
+	compact_basemem_len = ( top - text16_phys );
+	compact_basemem = malloc ( compact_basemem_len );
+	if ( ! compact_basemem ) {
+		DBG ( "Cannot preserve base memory\n" );
+		return;
+	}
+	memcpy ( compact_basemem, phys_to_virt ( text16_phys ),
+		 compact_basemem_len );
+	compact_fbms = fbms;
+	compact_rm_cs = rm_cs;
+	compact_rm_ds = rm_ds;
+	compact_rm_ss = rm_ss;
+	compact_rm_sp = rm_sp;
+
+	/* Move resident portions and switch to the external stack */
+	relocate_real ( ( new_text16 >> 4 ), _text16_init,
+			( new_data16 >> 4 ), _stack16 );
+	compact_redirect ( compact_rm_cs, rm_cs );
+	rm_ss = ( ( new_text16 - COMPACT_BASEMEM_SP ) >> 4 );
+	rm_sp = COMPACT_BASEMEM_SP;
+
+	/* Return base memory to the system */
+	set_fbms ( new_fbms );
+	DBG ( "Base memory used reduced from %dkB to %dkB (%zd bytes "
+	      "resident at %04x:0000)\n", ( 640 - fbms ), ( 640 - new_fbms ),
+	      ( ( size_t ) ( top - new_text16 ) ), rm_cs );
+}
+
+/**
+ * Reclaim released base memory
+ *
+ */
+static void unhide_compact_basemem ( void ) {
+	physaddr_t text16_phys = ( compact_rm_cs << 4 );
+	physaddr_t data16_phys = ( compact_rm_ds << 4 );
+	size_t data16_offset = ( data16_phys - text16_phys );
+	unsigned int cs = rm_cs;
+
+	/* Do nothing unless base memory was released */
+	if ( ! compact_basemem )
+		return;
+
+	/* Released base memory cannot be recovered if the operating
+	 * system has allocated it.
+	 */
+	if ( get_fbms() != ( cs >> 6 ) ) {
+		printf ( "iPXE base memory reallocated; halting\n" );
+		while ( 1 )
+			cpu_nap();
+	}
+
+	/* Any code which has hooked over our vectors since compaction
+	 * will chain to the resident copy, which would be overwritten
+	 * when restoring the original contents.
+	 */
+	if ( ! compact_vectors_ok ( cs ) ) {
+		printf ( "iPXE interrupt vectors hooked over; halting\n" );
+		while ( 1 )
+			cpu_nap();
+	}
+
+	/* Move resident portions back and restore the remainder */
+	relocate_real ( compact_rm_cs, _text16_init, compact_rm_ds, _stack16 );
+	memcpy ( phys_to_virt ( text16_phys + _text16_init ),
+		 ( compact_basemem + _text16_init ),
+		 ( data16_offset - _text16_init ) );
+	memcpy ( phys_to_virt ( data16_phys + _stack16 ),
+		 ( compact_basemem + data16_offset + _stack16 ),
+		 ( compact_basemem_len - data16_offset - _stack16 ) );
+	compact_redirect ( cs, rm_cs );
+	rm_ss = compact_rm_ss;
+	rm_sp = compact_rm_sp;
+
+	/* Reclaim base memory */
+	set_fbms ( compact_fbms );
+	free ( compact_basemem );
+	compact_basemem = NULL;
+}
+
+/**
+ * Compact resident footprint
+ *
+ * Called immediately before handing control to an operating system
+ * which will continue to use iPXE (e.g. via INT 13).  Unused heap
+ * space and the whole pages of initialisation-only code are returned
+ * to the system memory map, leaving only the runtime code, data and a
+ * small heap reserve hidden.
+ *
+ * Initialisation-only code is linked at the start of .textdata and
+ * padded to a page boundary, so that the runtime code and data remain
+ * a single contiguous hidden region between the discarded
+ * initialisation code and the trimmed heap.
+ *
+ * In a low memory build, all base memory except for a small resident
+ * real-mode stub is also returned to the system.
+ */
+void hide_compact ( void ) {
+	physaddr_t textdata = virt_to_phys ( _textdata );
+	physaddr_t etextdata = virt_to_phys ( _etextdata );
+	physaddr_t heap = etextdata;
+	physaddr_t eheap = etextdata;
+
+	/* Do nothing if already compacted */
+	if ( compacted )
+		return;
+	compacted = 1;
+
+	/* Complete any deferred initialisation, which would otherwise
+	 * allocate from the trimmed heap when first required.
+	 */
+	initialise_deferred();
+
+	/* Release base memory, if applicable.  This must happen
+	 * before the heap is trimmed, since the copy of the released
+	 * base memory is allocated from the heap.
+	 */
+	if ( COMPACT_BASEMEM )
+		hide_compact_basemem();
+
+	/* Trim heap */
+	compact_start = mtrim ( COMPACT_HEAP_RESERVE, &compact_len );
+	if ( compact_start ) {
+		heap = virt_to_phys ( compact_start );
+		eheap = ( heap + compact_len );
+	}
+
+	/* Discard whole pages of initialisation code (along with the
+	 * NULL trap, which precedes it and is only a debugging aid).
+	 */
+	compact_init = ( ( textdata + ALIGN_HIDDEN - 1 ) &
+			 ~( ALIGN_HIDDEN - 1 ) );
+	compact_einit = ( virt_to_phys ( _einit_text ) &
+			  ~( ALIGN_HIDDEN - 1 ) );
+	if ( compact_einit < compact_init )
+		compact_einit = compact_init;
+	compact_init_sum = compact_init_checksum();
+
+	/* Split hidden text memory around the released regions */
+	hide_region ( &hidemem_textdata, textdata, compact_init );
+	hide_region ( &hidemem_textdata_mid, compact_einit, heap );
+	if ( compact_start ) {
+		hide_region ( &hidemem_textdata_tail, eheap, etextdata );
+	} else {
+		hidemem_textdata_tail.start = hidemem_textdata_mid.end;
+		hidemem_textdata_tail.end = hidemem_textdata_mid.end;
+	}
+
+	DBG ( "Resident footprint %zdkB base, %zdkB external, %zdkB "
+	      "text/data (%zdkB heap, %zdkB code released)\n",
+	      ( hidden_len ( &hidemem_base ) / 1024 ),
+	      ( hidden_len ( &hidemem_umalloc ) / 1024 ),
+	      ( ( hidden_len ( &hidemem_textdata ) +
+		  hidden_len ( &hidemem_textdata_mid ) +
+		  hidden_len ( &hidemem_textdata_tail ) ) / 1024 ),
+	      ( compact_len / 1024 ),
+	      ( ( size_t ) ( compact_einit - compact_init ) / 1024 ) );
+}
+
+/**
+ * Undo compaction of resident footprint
+ *
+ * Called if the operating system returns control to iPXE.
+ */
+void unhide_compact ( void ) {
+
+	/* Do nothing unless compacted */
+	if ( ! compacted )
+		return;
+
+	/* Reclaim released base memory, if applicable */
+	if ( COMPACT_BASEMEM )
+		unhide_compact_basemem();
+
+	/* Restore hidden text memory */
+	hide_textdata();
+
+	/* Discarded initialisation code cannot be recovered if the
+	 * operating system has overwritten it.
+	 */
+	if ( compact_init_checksum() != compact_init_sum ) {
+		printf ( "iPXE initialisation code overwritten; halting\n" );
+		while ( 1 )
+			cpu_nap();
+	}
+
+	/* Return trimmed space to the heap */
+	if ( compact_start )
+		mpopulate ( compact_start, compact_len );
+	DBG ( "Resident footprint restored\n" );
+	compacted = 0;
+	compact_start = NULL;
+	compact_len = 0;
 }
 
 /**
@@ -136,7 +551,7 @@ void hide_textdata ( void ) {
  * Installs an INT 15 handler to edit Etherboot out of the memory map
  * returned by the BIOS.
  */
-static void hide_etherboot ( void ) {
+static __init void hide_etherboot ( void ) {
 	struct memory_map memmap;
 	unsigned int rm_ds_top;
 	unsigned int rm_cs_top;
@@ -154,6 +569,9 @@ static void hide_etherboot ( void ) {
 	}
 
 	/* Initialise the hidden regions */
+	DBG ( "Base memory used: %zd bytes (.text16 %zd, .data16 %zd)\n",
+	      ( _text16_memsz + _data16_memsz ), _text16_memsz,
+	      _data16_memsz );
 	hide_basemem();
 	hide_umalloc ( virt_to_phys ( _textdata ), virt_to_phys ( _textdata ) );
 	hide_textdata();
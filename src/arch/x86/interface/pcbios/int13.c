@@ -33,14 +33,19 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/io.h>
 #include <ipxe/acpi.h>
 #include <ipxe/sanboot.h>
+#include <ipxe/sanpart.h>
 #include <ipxe/device.h>
 #include <ipxe/pci.h>
 #include <ipxe/eltorito.h>
+#include <ipxe/umalloc.h>
+#include <ipxe/hidemem.h>
+#include <ipxe/smp.h>
 #include <realmode.h>
 #include <bios.h>
 #include <biosint.h>
 #include <bootsector.h>
 #include <int13.h>
+#include <config/general.h>
 
 /** @file
  *
@@ -96,6 +101,44 @@ struct int13_data {
 	int last_status;
 };
 
+/** Size of INT 13 read staging buffer
+ *
+ * Must be a multiple of the largest supported block size.
+ */
+#define INT13_STAGE_SIZE ( 256 * 1024 )
+
+/** INT 13 read staging buffer
+ *
+ * Boot loaders and real-mode operating systems typically read a
+ * large file using a long sequence of small INT 13 calls, each
+ * limited to a single 64kB real-mode segment (or less).  When a read
+ * continues a sequential stream, we read ahead into a large buffer in
+ * hidden extended memory and satisfy subsequent calls from there,
+ * saving a device round trip for each call.
+ */
+struct int13_stage {
+	/** Staging buffer
+	 *
+	 * This is allocated when the INT 13 vector is hooked, so that
+	 * it lies within the memory hidden from the boot loader and
+	 * operating system before either can read the memory map.
+	 */
+	userptr_t buffer;
+	/** SAN device being tracked (not referenced) */
+	struct san_device *sandev;
+	/** Write count of underlying device when data was staged */
+	unsigned int writes;
+	/** Starting LBA of staged data */
+	uint64_t lba;
+	/** Number of staged blocks */
+	unsigned int count;
+	/** LBA following the most recent read */
+	uint64_t next_lba;
+};
+
+/** INT 13 read staging buffer */
+static struct int13_stage int13_stage;
+
 /** Vector for chaining to other INT 13 handlers */
 static struct segoff __text16 ( int13_vector );
 #define int13_vector __use_text16 ( int13_vector )
@@ -164,12 +207,11 @@ static inline int int13_is_fdd ( struct san_device *sandev ) {
  * Parse El Torito parameters
  *
  * @v sandev		SAN device
- * @v scratch		Scratch area for single-sector reads
  * @ret rc		Return status code
  *
- * Reads and parses El Torito parameters, if present.
+ * Parses El Torito parameters, if present.
  */
-static int int13_parse_eltorito ( struct san_device *sandev, void *scratch ) {
+static __init int int13_parse_eltorito ( struct san_device *sandev ) {
 	struct int13_data *int13 = sandev->priv;
 	static const struct eltorito_descriptor_fixed boot_check = {
 		.type = ISO9660_TYPE_BOOT,
@@ -177,20 +219,14 @@ static int int13_parse_eltorito ( struct san_device *sandev, void *scratch ) {
 		.version = 1,
 		.system_id = "EL TORITO SPECIFICATION",
 	};
-	struct eltorito_descriptor *boot = scratch;
-	int rc;
+	const struct eltorito_descriptor *boot;
 
-	/* Read boot record volume descriptor */
-	if ( ( rc = sandev_read ( sandev, ELTORITO_LBA, 1,
-				  virt_to_user ( boot ) ) ) != 0 ) {
-		DBGC ( sandev, "INT13 drive %02x could not read El Torito boot "
-		       "record volume descriptor: %s\n",
-		       sandev->drive, strerror ( rc ) );
-		return rc;
-	}
+	/* Locate boot record volume descriptor within probed data */
+	boot = sandev_probed ( sandev, ELTORITO_LBA, 1 );
 
 	/* Check for an El Torito boot catalog */
-	if ( memcmp ( boot, &boot_check, sizeof ( boot_check ) ) == 0 ) {
+	if ( boot &&
+	     ( memcmp ( boot, &boot_check, sizeof ( boot_check ) ) == 0 ) ) {
 		int13->boot_catalog = boot->sector;
 		DBGC ( sandev, "INT13 drive %02x has an El Torito boot catalog "
 		       "at LBA %08x\n", sandev->drive, int13->boot_catalog );
@@ -206,32 +242,37 @@ static int int13_parse_eltorito ( struct san_device *sandev, void *scratch ) {
  * Guess INT 13 hard disk drive geometry
  *
  * @v sandev		SAN device
- * @v scratch		Scratch area for single-sector reads
  * @ret heads		Guessed number of heads
  * @ret sectors		Guessed number of sectors per track
  * @ret rc		Return status code
  *
  * Guesses the drive geometry by inspecting the partition table.
  */
-static int int13_guess_geometry_hdd ( struct san_device *sandev, void *scratch,
-				      unsigned int *heads,
-				      unsigned int *sectors ) {
-	struct master_boot_record *mbr = scratch;
-	struct partition_table_entry *partition;
+static __init int int13_guess_geometry_hdd ( struct san_device *sandev,
+					     unsigned int *heads,
+					     unsigned int *sectors ) {
+	const struct master_boot_record *mbr;
+	const struct partition_table_entry *partition;
 	unsigned int i;
 	unsigned int start_cylinder;
 	unsigned int start_head;
 	unsigned int start_sector;
 	unsigned int end_head;
 	unsigned int end_sector;
-	int rc;
 
-	/* Read partition table */
-	if ( ( rc = sandev_read ( sandev, 0, 1, virt_to_user ( mbr ) ) ) != 0 ) {
-		DBGC ( sandev, "INT13 drive %02x could not read "
-		       "partition table to guess geometry: %s\n",
-		       sandev->drive, strerror ( rc ) );
-		return rc;
+	/* A partition slice has no partition table */
+	if ( sandev->parent ) {
+		*heads = 255;
+		*sectors = 63;
+		return 0;
+	}
+
+	/* Locate partition table within probed data */
+	mbr = sandev_probed ( sandev, 0, 1 );
+	if ( ! mbr ) {
+		DBGC ( sandev, "INT13 drive %02x has no partition table to "
+		       "guess geometry\n", sandev->drive );
+		return -EIO;
 	}
 	DBGC2 ( sandev, "INT13 drive %02x has MBR:\n", sandev->drive );
 	DBGC2_HDA ( sandev, 0, mbr, sizeof ( *mbr ) );
@@ -327,9 +368,9 @@ static const struct int13_fdd_geometry int13_fdd_geometries[] = {
  *
  * Guesses the drive geometry by inspecting the disk size.
  */
-static int int13_guess_geometry_fdd ( struct san_device *sandev,
-				      unsigned int *heads,
-				      unsigned int *sectors ) {
+static __init int int13_guess_geometry_fdd ( struct san_device *sandev,
+					     unsigned int *heads,
+					     unsigned int *sectors ) {
 	unsigned int blocks = sandev_capacity ( sandev );
 	const struct int13_fdd_geometry *geometry;
 	unsigned int cylinders;
@@ -364,10 +405,9 @@ static int int13_guess_geometry_fdd ( struct san_device *sandev,
  * Guess INT 13 drive geometry
  *
  * @v sandev		SAN device
- * @v scratch		Scratch area for single-sector reads
  * @ret rc		Return status code
  */
-static int int13_guess_geometry ( struct san_device *sandev, void *scratch ) {
+static __init int int13_guess_geometry ( struct san_device *sandev ) {
 	struct int13_data *int13 = sandev->priv;
 	unsigned int guessed_heads;
 	unsigned int guessed_sectors;
@@ -381,8 +421,7 @@ static int int13_guess_geometry ( struct san_device *sandev, void *scratch ) {
 						       &guessed_sectors )) != 0)
 			return rc;
 	} else {
-		if ( ( rc = int13_guess_geometry_hdd ( sandev, scratch,
-						       &guessed_heads,
+		if ( ( rc = int13_guess_geometry_hdd ( sandev, &guessed_heads,
 						       &guessed_sectors )) != 0)
 			return rc;
 	}
@@ -462,6 +501,119 @@ static void int13_check_num_drives ( void ) {
 	}
 }
 
+/**
+ * Discard INT 13 read staging buffer contents
+ *
+ * @v sandev		SAN device
+ */
+static void int13_stage_discard ( struct san_device *sandev ) {
+	struct int13_stage *stage = &int13_stage;
+
+	if ( stage->sandev == sandev ) {
+		stage->sandev = NULL;
+		stage->count = 0;
+	}
+}
+
+/**
+ * Allocate INT 13 read staging buffer
+ *
+ * Failure is not fatal: reads will then bypass the staging buffer.
+ */
+static __init void int13_stage_alloc ( void ) {
+	struct int13_stage *stage = &int13_stage;
+
+	if ( stage->buffer )
+		return;
+	stage->buffer = umalloc ( INT13_STAGE_SIZE );
+	if ( ! stage->buffer ) {
+		DBG ( "INT13 could not allocate staging buffer\n" );
+		return;
+	}
+	stage->sandev = NULL;
+	stage->count = 0;
+}
+
+/**
+ * Read from SAN device via INT 13 read staging buffer
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ */
+static int int13_stage_read ( struct san_device *sandev, uint64_t lba,
+			      unsigned int count, userptr_t buffer ) {
+	struct int13_stage *stage = &int13_stage;
+	struct san_device *root =
+		( sandev->parent ? sandev->parent : sandev );
+	size_t blksize = sandev_blksize ( sandev );
+	uint64_t capacity = sandev_capacity ( sandev );
+	unsigned int max = ( INT13_STAGE_SIZE / blksize );
+	unsigned int ahead;
+	int sequential;
+	int rc;
+
+	/* Track sequential access */
+	sequential = ( ( sandev == stage->sandev ) &&
+		       ( lba == stage->next_lba ) );
+	if ( sandev != stage->sandev ) {
+		stage->sandev = sandev;
+		stage->count = 0;
+	}
+	stage->next_lba = ( lba + count );
+
+	/* Discard staged data if the device (or, for a partition
+	 * slice, the underlying device) has since been written to by
+	 * any means.
+	 */
+	if ( stage->writes != root->writes )
+		stage->count = 0;
+
+	/* Satisfy from staged data, if possible */
+	if ( ( lba >= stage->lba ) &&
+	     ( ( lba + count ) <= ( stage->lba + stage->count ) ) ) {
+		memcpy_user ( buffer, 0, stage->buffer,
+			      ( ( lba - stage->lba ) * blksize ),
+			      ( count * blksize ) );
+		return 0;
+	}
+
+	/* Read random-access, oversized and out-of-range requests
+	 * directly into the caller's buffer.
+	 */
+	if ( ( ! sequential ) || ( ! stage->buffer ) || ( count >= max ) ||
+	     ( lba >= capacity ) || ( count > ( capacity - lba ) ) ) {
+		return sandev_read ( sandev, lba, count, buffer );
+	}
+
+	/* Read ahead into staging buffer */
+	ahead = max;
+	if ( ahead > ( capacity - lba ) )
+		ahead = ( capacity - lba );
+	stage->count = 0;
+	if ( ( rc = sandev_read ( sandev, lba, ahead,
+				  stage->buffer ) ) != 0 ) {
+		/* Read-ahead may have hit an unreadable block beyond
+		 * the requested range; retry only what was asked for.
+		 */
+		DBGC ( sandev, "INT13 drive %02x could not read ahead: %s\n",
+		       sandev->drive, strerror ( rc ) );
+		return sandev_read ( sandev, lba, count, buffer );
+	}
+	stage->lba = lba;
+	stage->count = ahead;
+	stage->writes = root->writes;
+	DBGC2 ( sandev, "INT13 drive %02x staged LBA %08llx+%d\n",
+		sandev->drive, ( ( unsigned long long ) lba ), ahead );
+
+	/* Copy requested blocks to caller's buffer */
+	memcpy_user ( buffer, 0, stage->buffer, 0, ( count * blksize ) );
+
+	return 0;
+}
+
 /**
  * INT 13, 00 - Reset disk system
  *
@@ -474,6 +626,9 @@ static int int13_reset ( struct san_device *sandev,
 
 	DBGC2 ( sandev, "Reset drive\n" );
 
+	/* Discard any staged data */
+	int13_stage_discard ( sandev );
+
 	/* Reset SAN device */
 	if ( ( rc = sandev_reset ( sandev ) ) != 0 )
 		return -INT13_STATUS_RESET_FAILED;
@@ -578,7 +733,7 @@ static int int13_read_sectors ( struct san_device *sandev,
 				struct i386_all_regs *ix86 ) {
 
 	DBGC2 ( sandev, "Read: " );
-	return int13_rw_sectors ( sandev, ix86, sandev_read );
+	return int13_rw_sectors ( sandev, ix86, int13_stage_read );
 }
 
 /**
@@ -782,7 +937,7 @@ static int int13_extended_read ( struct san_device *sandev,
 				 struct i386_all_regs *ix86 ) {
 
 	DBGC2 ( sandev, "Extended read: " );
-	return int13_extended_rw ( sandev, ix86, sandev_read );
+	return int13_extended_rw ( sandev, ix86, int13_stage_read );
 }
 
 /**
@@ -869,6 +1024,10 @@ static int int13_device_path_info ( struct san_device *sandev,
 	uint8_t sum = 0;
 	int rc;
 
+	/* A partition slice has no device path of its own */
+	if ( sandev->parent )
+		return -ENOTTY;
+
 	/* Reopen block device if necessary */
 	if ( sandev_needs_reopen ( sandev ) &&
 	     ( ( rc = sandev_reopen ( sandev ) ) != 0 ) )
@@ -1170,7 +1329,7 @@ static __asmcall __used void int13 ( struct i386_all_regs *ix86 ) {
  * Hook INT 13 handler
  *
  */
-static void int13_hook_vector ( void ) {
+static __init void int13_hook_vector ( void ) {
 	/* Assembly wrapper to call int13().  int13() sets OF if we
 	 * should not chain to the previous handler.  (The wrapper
 	 * clears CF and OF before calling int13()).
@@ -1230,42 +1389,32 @@ static void int13_unhook_vector ( void ) {
 }
 
 /**
- * Hook INT 13 SAN device
+ * Register INT 13 SAN device
  *
+ * @v sandev		SAN device
  * @v drive		Drive number
- * @v uris		List of URIs
- * @v count		Number of URIs
  * @v flags		Flags
  * @ret drive		Drive number, or negative error
  *
  * Registers the drive with the INT 13 emulation subsystem, and hooks
- * the INT 13 interrupt vector (if not already hooked).
+ * the INT 13 interrupt vector (if not already hooked).  On success,
+ * the caller's reference to the SAN device is retained until the
+ * drive is unhooked.
  */
-static int int13_hook ( unsigned int drive, struct uri **uris,
-			unsigned int count, unsigned int flags ) {
-	struct san_device *sandev;
-	struct int13_data *int13;
-	unsigned int natural_drive;
-	void *scratch;
+static __init int int13_register ( struct san_device *sandev,
+				   unsigned int drive, unsigned int flags ) {
+	struct int13_data *int13 = sandev->priv;
 	int need_hook = ( ! have_sandevs() );
 	int rc;
 
 	/* Calculate natural drive number */
 	int13_sync_num_drives();
-	natural_drive = ( ( drive & 0x80 ) ? ( num_drives | 0x80 ) : num_fdds );
+	int13->natural_drive = ( ( drive & 0x80 ) ?
+				 ( num_drives | 0x80 ) : num_fdds );
 
 	/* Use natural drive number if directed to do so */
 	if ( ( drive & 0x7f ) == 0x7f )
-		drive = natural_drive;
-
-	/* Allocate SAN device */
-	sandev = alloc_sandev ( uris, count, sizeof ( *int13 ) );
-	if ( ! sandev ) {
-		rc = -ENOMEM;
-		goto err_alloc;
-	}
-	int13 = sandev->priv;
-	int13->natural_drive = natural_drive;
+		drive = int13->natural_drive;
 
 	/* Register SAN device */
 	if ( ( rc = register_sandev ( sandev, drive, flags ) ) != 0 ) {
@@ -1274,19 +1423,14 @@ static int int13_hook ( unsigned int drive, struct uri **uris,
 		goto err_register;
 	}
 
-	/* Allocate scratch area */
-	scratch = malloc ( sandev_blksize ( sandev ) );
-	if ( ! scratch )
-		goto err_alloc_scratch;
-
 	/* Parse parameters, if present */
 	if ( sandev->is_cdrom &&
-	     ( ( rc = int13_parse_eltorito ( sandev, scratch ) ) != 0 ) )
+	     ( ( rc = int13_parse_eltorito ( sandev ) ) != 0 ) )
 		goto err_parse_eltorito;
 
 	/* Give drive a default geometry, if applicable */
 	if ( ( sandev_blksize ( sandev ) == INT13_BLKSIZE ) &&
-	     ( ( rc = int13_guess_geometry ( sandev, scratch ) ) != 0 ) )
+	     ( ( rc = int13_guess_geometry ( sandev ) ) != 0 ) )
 		goto err_guess_geometry;
 
 	DBGC ( sandev, "INT13 drive %02x (naturally %02x) registered with "
@@ -1298,22 +1442,111 @@ static int int13_hook ( unsigned int drive, struct uri **uris,
 	if ( need_hook ) {
 		int13_hook_vector();
 		devices_get();
+		int13_stage_alloc();
 	}
 
 	/* Update BIOS drive count */
 	int13_sync_num_drives();
 
-	free ( scratch );
 	return drive;
 
  err_guess_geometry:
  err_parse_eltorito:
-	free ( scratch );
- err_alloc_scratch:
 	unregister_sandev ( sandev );
+ err_register:
+	return rc;
+}
+
+/**
+ * Hook INT 13 SAN device
+ *
+ * @v drive		Drive number
+ * @v uris		List of URIs
+ * @v count		Number of URIs
+ * @v flags		Flags
+ * @ret drive		Drive number, or negative error
+ */
+static __init int int13_hook ( unsigned int drive, struct uri **uris,
+			       unsigned int count, unsigned int flags ) {
+	struct san_device *sandev;
+	int rc;
+
+	/* Allocate SAN device */
+	sandev = alloc_sandev ( uris, count, sizeof ( struct int13_data ) );
+	if ( ! sandev ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+
+	/* Register SAN device */
+	if ( ( rc = int13_register ( sandev, drive, flags ) ) < 0 )
+		goto err_register;
+
+	return rc;
+
+ err_register:
+	sandev_put ( sandev );
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Hook INT 13 SAN device partition as a separate drive
+ *
+ * @v drive		Drive number
+ * @v parent_drive	Drive number of parent SAN device
+ * @v index		Partition number
+ * @ret drive		Drive number, or negative error
+ *
+ * The partition is presented as a drive in its own right, without a
+ * partition table.  All accesses are passed to the parent SAN device.
+ */
+static __init int int13_hook_partition ( unsigned int drive,
+					 unsigned int parent_drive,
+					 unsigned int index ) {
+	struct san_device *parent;
+	struct san_partition *partition;
+	struct san_device *sandev;
+	int rc;
+
+	/* Find parent drive and partition */
+	parent = sandev_find ( parent_drive );
+	if ( ! parent ) {
+		DBG ( "INT13 cannot find drive %02x\n", parent_drive );
+		rc = -ENODEV;
+		goto err_find;
+	}
+	partition = sanpart_find ( parent, index );
+	if ( ! partition ) {
+		DBGC ( parent, "INT13 drive %02x has no partition %d\n",
+		       parent_drive, index );
+		rc = -ENOENT;
+		goto err_partition;
+	}
+
+	/* Allocate partition slice */
+	sandev = alloc_sandev_slice ( parent, partition->lba, partition->count,
+				      sizeof ( struct int13_data ) );
+	if ( ! sandev ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+
+	/* Register partition slice.  The parent device (if described)
+	 * already describes the underlying disk.
+	 */
+	if ( ( rc = int13_register ( sandev, drive, SAN_NO_DESCRIBE ) ) < 0 )
+		goto err_register;
+	DBGC ( sandev, "INT13 drive %02x is partition %d of drive %02x\n",
+	       sandev->drive, index, parent_drive );
+
+	return rc;
+
  err_register:
 	sandev_put ( sandev );
  err_alloc:
+ err_partition:
+ err_find:
 	return rc;
 }
 
@@ -1322,12 +1555,13 @@ static int int13_hook ( unsigned int drive, struct uri **uris,
  *
  * @v drive		Drive number
  *
- * Unregisters the drive from the INT 13 emulation subsystem.  If this
- * is the last SAN device, the INT 13 vector is unhooked (if
- * possible).
+ * Unregisters the drive (and any partitions hooked as separate
+ * drives) from the INT 13 emulation subsystem.  If this is the last
+ * SAN device, the INT 13 vector is unhooked (if possible).
  */
 static void int13_unhook ( unsigned int drive ) {
 	struct san_device *sandev;
+	struct san_device *slice;
 
 	/* Find drive */
 	sandev = sandev_find ( drive );
@@ -1336,6 +1570,13 @@ static void int13_unhook ( unsigned int drive ) {
 		return;
 	}
 
+	/* Unhook any partitions of this drive */
+	while ( ( slice = sandev_find_slice ( sandev ) ) != NULL )
+		int13_unhook ( slice->drive );
+
+	/* Discard any staged data */
+	int13_stage_discard ( sandev );
+
 	/* Unregister SAN device */
 	unregister_sandev ( sandev );
 
@@ -1349,6 +1590,8 @@ static void int13_unhook ( unsigned int drive ) {
 	if ( ! have_sandevs() ) {
 		devices_put();
 		int13_unhook_vector();
+		ufree ( int13_stage.buffer );
+		int13_stage.buffer = UNULL;
 	}
 
 	/* Drop reference to drive */
@@ -1405,6 +1648,64 @@ static int int13_load_mbr ( unsigned int drive, struct segoff *address ) {
 	return 0;
 }
 
+/**
+ * Load and verify partition boot record from INT 13 drive
+ *
+ * @v drive		Drive number
+ * @v index		Partition number
+ * @v address		Boot code address to fill in
+ * @ret rc		Return status code
+ *
+ * The boot record is read directly from the SAN device using the
+ * cached partition table, rather than via a chain of INT 13 calls
+ * from a master boot record.
+ */
+static int int13_load_partition ( unsigned int drive, unsigned int index,
+				  struct segoff *address ) {
+	struct san_device *sandev;
+	struct san_partition *partition;
+	uint16_t magic;
+	int rc;
+
+	/* Find drive and partition */
+	sandev = sandev_find ( drive );
+	if ( ! sandev ) {
+		DBG ( "INT13 cannot find drive %02x\n", drive );
+		return -ENODEV;
+	}
+	partition = sanpart_find ( sandev, index );
+	if ( ! partition ) {
+		DBGC ( sandev, "INT13 drive %02x has no partition %d\n",
+		       drive, index );
+		return -ENOENT;
+	}
+
+	/* Read partition boot record */
+	address->segment = 0;
+	address->offset = 0x7c00;
+	if ( ( rc = sandev_read ( sandev, partition->lba, 1,
+				  real_to_user ( address->segment,
+						 address->offset ) ) ) != 0 ) {
+		DBGC ( sandev, "INT13 drive %02x could not read partition %d "
+		       "boot record: %s\n", drive, index, strerror ( rc ) );
+		return rc;
+	}
+
+	/* Check magic signature */
+	get_real ( magic, address->segment,
+		   ( address->offset +
+		     offsetof ( struct master_boot_record, magic ) ) );
+	if ( magic != INT13_MBR_MAGIC ) {
+		DBGC ( sandev, "INT13 drive %02x partition %d does not contain "
+		       "a valid boot record\n", drive, index );
+		return -ENOEXEC;
+	}
+	DBGC ( sandev, "INT13 drive %02x booting partition %d at LBA %#llx\n",
+	       drive, index, partition->lba );
+
+	return 0;
+}
+
 /** El Torito boot catalog command packet */
 static struct int13_cdrom_boot_catalog_command __data16 ( eltorito_cmd ) = {
 	.size = sizeof ( struct int13_cdrom_boot_catalog_command ),
@@ -1507,7 +1808,8 @@ static int int13_load_eltorito ( unsigned int drive, struct segoff *address ) {
  * @ret rc		Return status code
  *
  * This boots from the specified INT 13 drive by loading the Master
- * Boot Record to 0000:7c00 and jumping to it.  INT 18 is hooked to
+ * Boot Record (or the boot record of the partition selected by
+ * SAN_BOOT_PARTITION) to 0000:7c00 and jumping to it.  INT 18 is hooked to
  * capture an attempt by the MBR to boot the next device.  (This is
  * the closest thing to a return path from an MBR).
  *
@@ -1519,9 +1821,14 @@ static int int13_boot ( unsigned int drive, const char *filename __unused ) {
 	int rc;
 
 	/* Look for a usable boot sector */
-	if ( ( ( rc = int13_load_mbr ( drive, &address ) ) != 0 ) &&
-	     ( ( rc = int13_load_eltorito ( drive, &address ) ) != 0 ) )
+	if ( SAN_BOOT_PARTITION ) {
+		if ( ( rc = int13_load_partition ( drive, SAN_BOOT_PARTITION,
+						   &address ) ) != 0 )
+			return rc;
+	} else if ( ( ( rc = int13_load_mbr ( drive, &address ) ) != 0 ) &&
+		    ( ( rc = int13_load_eltorito ( drive, &address ) ) != 0 ) ) {
 		return rc;
+	}
 
 	/* Dump out memory map prior to boot, if memmap debugging is
 	 * enabled.  Not required for program flow, but we have so
@@ -1530,19 +1837,36 @@ static int int13_boot ( unsigned int drive, const char *filename __unused ) {
 	 */
 	get_memmap ( &memmap );
 
+	/* Return application processors to the operating system */
+	smp_park();
+
+	/* Release memory not required by the resident INT 13 runtime */
+	hide_compact();
+
 	/* Jump to boot sector */
 	if ( ( rc = call_bootsector ( address.segment, address.offset,
 				      drive ) ) != 0 ) {
 		DBG ( "INT13 drive %02x boot returned: %s\n",
 		      drive, strerror ( rc ) );
+		unhide_compact();
 		return rc;
 	}
 
 	return -ECANCELED; /* -EIMPOSSIBLE */
 }
 
-/** Maximum size of boot firmware table(s) */
+/** Maximum size of boot firmware table(s)
+ *
+ * Boot firmware tables must reside in base memory.  A low memory
+ * build reserves no space for them, and so cannot describe SAN
+ * devices (such as iSCSI targets) that require a boot firmware
+ * table.
+ */
+#ifdef ROM_LOWMEM
+#define XBFTAB_SIZE 0
+#else
 #define XBFTAB_SIZE 768
+#endif
 
 /** Alignment of boot firmware table entries */
 #define XBFTAB_ALIGN 16
@@ -1623,5 +1947,6 @@ static int int13_describe ( void ) {
 
 PROVIDE_SANBOOT ( pcbios, san_hook, int13_hook );
 PROVIDE_SANBOOT ( pcbios, san_unhook, int13_unhook );
+PROVIDE_SANBOOT ( pcbios, san_hook_partition, int13_hook_partition );
 PROVIDE_SANBOOT ( pcbios, san_boot, int13_boot );
 PROVIDE_SANBOOT ( pcbios, san_describe, int13_describe );
@@ -266,6 +266,7 @@ static void pxe_init_structures ( void ) {
 /** PXE structure initialiser */
 struct init_fn pxe_init_fn __init_fn ( INIT_NORMAL ) = {
 	.initialise = pxe_init_structures,
+	.deferrable = 1,
 };
 
 /**
@@ -278,6 +279,9 @@ void pxe_activate ( struct net_device *netdev ) {
 	uint32_t discard_b;
 	uint32_t discard_d;
 
+	/* Ensure PXE structures are initialised */
+	initialise_deferred();
+
 	/* Ensure INT 1A is hooked */
 	if ( ! int_1a_hooked ) {
 		hook_bios_interrupt ( 0x1a, ( intptr_t ) pxe_int_1a,
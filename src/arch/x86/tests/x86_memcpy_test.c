@@ -0,0 +1,138 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * x86 memcpy() implementation self-tests
+ *
+ * Each implementation is tested directly, regardless of which one
+ * __memcpy() has selected for this CPU.
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ipxe/cpuid.h>
+#include <ipxe/test.h>
+
+/**
+ * Copy memory area using "rep movsb"
+ *
+ * @v dest		Destination address
+ * @v src		Source address
+ * @v len		Length
+ */
+static void x86_memcpy_test_movsb ( void *dest, const void *src,
+				    size_t len ) {
+	__memcpy_movsb ( dest, src, len );
+}
+
+/**
+ * Test correctness of an x86 memcpy() implementation
+ *
+ * @v copy		Copy function
+ * @v dest_offset	Destination alignment offset
+ * @v src_offset	Source alignment offset
+ * @v len		Length of data to copy
+ */
+static void x86_memcpy_test_copy ( void ( * copy ) ( void *dest,
+						     const void *src,
+						     size_t len ),
+				   unsigned int dest_offset,
+				   unsigned int src_offset, size_t len ) {
+	uint8_t *dest;
+	uint8_t *src;
+	unsigned int i;
+	int guarded;
+
+	/* Allocate blocks */
+	dest = malloc ( dest_offset + len + 1 );
+	assert ( dest != NULL );
+	src = malloc ( src_offset + len );
+	assert ( src != NULL );
+
+	/* Generate random source data and fill destination with guard */
+	for ( i = 0 ; i < len ; i++ )
+		src[ src_offset + i ] = random();
+	memset ( dest, 0xa5, ( dest_offset + len + 1 ) );
+
+	/* Copy and check data and surrounding guard bytes */
+	copy ( ( dest + dest_offset ), ( src + src_offset ), len );
+	ok ( memcmp ( ( dest + dest_offset ), ( src + src_offset ),
+		      len ) == 0 );
+	guarded = ( dest[ dest_offset + len ] == 0xa5 );
+	for ( i = 0 ; i < dest_offset ; i++ )
+		guarded &= ( dest[i] == 0xa5 );
+	ok ( guarded );
+
+	/* Free blocks */
+	free ( dest );
+	free ( src );
+}
+
+/**
+ * Perform x86 memcpy() self-tests
+ *
+ */
+static void x86_memcpy_test_exec ( void ) {
+	static const size_t lens[] = {
+		0, 1, 3, 7, 8, 9, 15, 16, 17, 63, 64, 65, 4095, 16387
+	};
+	struct x86_features features;
+	unsigned int dest_offset;
+	unsigned int src_offset;
+	unsigned int offsets;
+	unsigned int i;
+	int sse2;
+
+	/* MOVNTI requires SSE2 */
+	x86_features ( &features );
+	sse2 = ( features.intel.edx & CPUID_FEATURES_INTEL_EDX_SSE2 );
+
+	/* Test each length with all combinations of alignments */
+	for ( i = 0 ; i < ( sizeof ( lens ) / sizeof ( lens[0] ) ) ; i++ ) {
+		for ( offsets = 0 ; offsets < 32 ; offsets++ ) {
+			dest_offset = ( offsets % 8 );
+			src_offset = ( offsets / 8 );
+			x86_memcpy_test_copy ( x86_memcpy_test_movsb,
+					       dest_offset, src_offset,
+					       lens[i] );
+			if ( sse2 ) {
+				x86_memcpy_test_copy ( __memcpy_movnti,
+						       dest_offset, src_offset,
+						       lens[i] );
+			}
+		}
+	}
+}
+
+/** x86 memcpy() self-test */
+struct self_test x86_memcpy_test __self_test = {
+	.name = "x86_memcpy",
+	.exec = x86_memcpy_test_exec,
+};
@@ -85,6 +85,28 @@ void remove_user_from_rm_stack ( userptr_t data, size_t size ) {
 	rm_sp += size;
 };
 
+/**
+ * Relocate real-mode code and data segments
+ *
+ * @v text16_seg	New .text16 segment
+ * @v text16_len	Length of .text16 to retain
+ * @v data16_seg	New .data16 segment
+ * @v data16_len	Length of .data16 to retain
+ *
+ * Only the initial portion of each segment is copied.  The caller is
+ * responsible for ensuring that nothing beyond these portions is used
+ * while the segments remain at their new locations, and for updating
+ * any interrupt vectors which point into .text16.
+ */
+void relocate_real ( unsigned int text16_seg, size_t text16_len,
+		     unsigned int data16_seg, size_t data16_len ) {
+
+	__asm__ __volatile__ ( "call relocate_rm\n\t"
+			       : : "a" ( text16_seg ), "b" ( data16_seg ),
+				   "c" ( text16_len ), "d" ( data16_len )
+			       : "memory" );
+}
+
 /**
  * Set interrupt vector
  *
@@ -137,6 +137,24 @@ REQUIRE_OBJECT ( httpblock );
 #ifdef SANBOOT_PROTO_NVME
 REQUIRE_OBJECT ( nvme );
 #endif
+#ifdef SANBOOT_VERITY
+REQUIRE_OBJECT ( sanverity );
+#endif
+#ifdef SANBOOT_CRYPT
+REQUIRE_OBJECT ( sancrypt );
+#endif
+#ifdef SANFS_FAT
+REQUIRE_OBJECT ( sanfs_fat );
+#endif
+#ifdef SANFS_EXT
+REQUIRE_OBJECT ( sanfs_ext );
+#endif
+#ifdef SANFS_ISO9660
+REQUIRE_OBJECT ( sanfs_iso9660 );
+#endif
+#ifdef SANFS_INFLATE
+REQUIRE_OBJECT ( inflate );
+#endif
 /*
  * Drag in all requested resolvers
  *
@@ -21,6 +21,7 @@
 
 FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
+#include <config/general.h>
 #include <config/console.h>
 
 /** @file
@@ -49,3 +49,10 @@ REQUIRE_OBJECT ( linux_timer );
 #ifdef TIMER_ACPI
 REQUIRE_OBJECT ( acpi_timer );
 #endif
+
+/*
+ * Drag in nanosecond clocks
+ */
+#ifdef NSTIME_TSC
+REQUIRE_OBJECT ( tsc_nstime );
+#endif
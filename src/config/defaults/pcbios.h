@@ -14,6 +14,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define PCIAPI_PCBIOS
 #define DMAAPI_FLAT
 #define TIMER_PCBIOS
+#define NSTIME_TSC
 #define CONSOLE_PCBIOS
 #define NAP_PCBIOS
 #define UMALLOC_MEMTOP
@@ -24,6 +25,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define TIME_RTC
 #define REBOOT_PCBIOS
 #define ACPI_RSDP
+#define SMP_NULL
 
 #ifdef __x86_64__
 #define IOMAP_PAGES
@@ -74,6 +74,21 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #undef	SANBOOT_PROTO_HTTP	/* HTTP SAN protocol */
 #define SANBOOT_PROTO_NVME
 
+/*
+ * SAN boot options
+ *
+ */
+
+#undef	SANBOOT_MULTIPATH	/* Distribute I/O across all SAN paths */
+#undef	SANBOOT_RAID0		/* Stripe SAN paths as a RAID-0 volume */
+#undef	SANBOOT_RAID1		/* Mirror SAN paths as a RAID-1 volume */
+#undef	SANBOOT_VERITY		/* Verify SAN reads against a dm-verity tree */
+#undef	SANBOOT_CRYPT		/* Decrypt AES-XTS encrypted SAN devices */
+#undef	SANFS_FAT		/* Load files from FAT SAN filesystems */
+#undef	SANFS_EXT		/* Load files from ext2/3/4 SAN filesystems */
+#undef	SANFS_ISO9660		/* Load files from ISO9660 SAN filesystems */
+#undef	SANFS_INFLATE		/* Decompress gzip/zlib SAN files while reading */
+
 /*
  * HTTP extensions
  *
@@ -181,6 +196,20 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 #undef	NONPNP_HOOK_INT19	/* Hook INT19 on non-PnP BIOSes */
 #define	AUTOBOOT_ROM_FILTER	/* Autoboot only devices matching our ROM */
+#undef	COMPRESS_LZ		/* Fast LZ payload compression (instead of LZMA)
+				 * for all targets; see also COMPRESS_<rom>
+				 * in arch/x86/Makefile.pcbios */
+#undef	ROM_FAST_BOOT		/* Storage-only fast boot: probe only our
+				 * own PCI device and defer non-storage
+				 * initialisation (excludes a second
+				 * controller for SAN multipath/RAID) */
+#undef	ROM_LOWMEM		/* Minimise base memory usage (excludes
+				 * SAN protocols described via ACPI boot
+				 * firmware tables, e.g. iSCSI iBFT; use
+				 * with COMPRESS_LZ, since the LZMA
+				 * decompressor needs 8kB of .data16).
+				 * Leaves only a 2kB real-mode stub in
+				 * base memory while an INT 13 OS runs */
 
 /*
  * Virtual network devices
@@ -11,6 +11,67 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <config/defaults.h>
 
+/** RAID-0 chunk size (in bytes) */
+#define SAN_RAID_CHUNK_SIZE ( 64 * 1024 )
+
+/** Partition to boot from a SAN drive
+ *
+ * A non-zero value boots the boot record of the specified MBR or GPT
+ * partition (numbered from 1) instead of the drive's master boot
+ * record.
+ */
+#define SAN_BOOT_PARTITION 0
+
+/** Partition to present as a separate SAN drive
+ *
+ * A non-zero value registers the specified MBR or GPT partition
+ * (numbered from 1) of the boot drive as an additional drive, using
+ * the next available drive number.
+ */
+#define SAN_HOOK_PARTITION 0
+
+/** Root hash of verified SAN drives
+ *
+ * This is the hex-encoded SHA-256 root hash reported by "veritysetup
+ * format" for the drive's dm-verity hash tree.  Since it is compiled
+ * into the boot ROM, the hash tree itself may be stored on the
+ * (untrusted) drive.
+ */
+#define SAN_VERITY_ROOT_HASH ""
+
+/** Offset of dm-verity hash area on verified SAN drives (in bytes)
+ *
+ * This is the "--hash-offset" value given to "veritysetup format"
+ * when the hash tree was written to the data device itself.
+ */
+#define SAN_VERITY_HASH_OFFSET 0
+
+/** Number of verified hash tree blocks to cache
+ *
+ * Must be a power of two.
+ */
+#define SAN_VERITY_CACHE 64
+
+/** Key of encrypted SAN drives
+ *
+ * This is the hex-encoded AES-XTS key (i.e. the data key followed by
+ * the tweak key, for a total of 32 or 64 bytes) as used by dm-crypt's
+ * "aes-xts-plain64" cipher.  The entire drive is encrypted, with no
+ * header.
+ */
+#define SAN_CRYPT_KEY ""
+
+/** Encryption sector size of encrypted SAN drives (in bytes)
+ *
+ * This is the "--sector-size" value given to cryptsetup, and must be
+ * a power of two no larger than the drive's block size.  Sectors are
+ * numbered in units of this size.
+ */
+#define SAN_CRYPT_SECTOR_SIZE 512
+
+/** Maximum number of blocks encrypted per write to encrypted SAN drives */
+#define SAN_CRYPT_WRITE_BLOCKS 32
+
 #include <config/local/sanboot.h>
 
 #endif /* CONFIG_SANBOOT_H */
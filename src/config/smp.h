@@ -0,0 +1,23 @@
+#ifndef CONFIG_SMP_H
+#define CONFIG_SMP_H
+
+/** @file
+ *
+ * Application processor worker configuration
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <config/defaults.h>
+
+/* The BIOS worker (SMP_PCBIOS) uses an application processor for bulk
+ * data copies during boot.  It is available only for 32-bit BIOS
+ * builds, and is disabled by default.
+ */
+//#undef	SMP_NULL
+//#define	SMP_PCBIOS
+
+#include <config/local/smp.h>
+
+#endif /* CONFIG_SMP_H */
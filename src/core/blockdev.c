@@ -43,6 +43,11 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  * @v buffer		Data buffer
  * @v len		Length of data buffer
  * @ret rc		Return status code
+ *
+ * The block device may complete the command (by closing the data
+ * interface) before returning.  Callers must therefore be prepared
+ * for the data interface to have been closed by the time this
+ * function returns successfully.
  */
 int block_read ( struct interface *control, struct interface *data,
 		 uint64_t lba, unsigned int count,
@@ -74,6 +79,9 @@ int block_read ( struct interface *control, struct interface *data,
  * @v buffer		Data buffer
  * @v len		Length of data buffer
  * @ret rc		Return status code
+ *
+ * As with block_read(), the command may complete before this function
+ * returns.
  */
 int block_write ( struct interface *control, struct interface *data,
 		  uint64_t lba, unsigned int count,
@@ -120,6 +128,35 @@ int block_read_capacity ( struct interface *control, struct interface *data ) {
 	return rc;
 }
 
+/**
+ * Poll block device for command completions
+ *
+ * @v control		Control interface
+ * @ret rc		Return status code
+ *
+ * A block device that supports polling will complete any finished
+ * commands (by closing their data interfaces) before returning.
+ * Devices that do not support polling complete their commands only
+ * from within the normal process scheduler.
+ */
+int block_poll ( struct interface *control ) {
+	struct interface *dest;
+	block_poll_TYPE ( void * ) *op =
+		intf_get_dest_op ( control, block_poll, &dest );
+	void *object = intf_object ( dest );
+	int rc;
+
+	if ( op ) {
+		rc = op ( object );
+	} else {
+		/* Default is to not support polling */
+		rc = -EOPNOTSUPP;
+	}
+
+	intf_put ( dest );
+	return rc;
+}
+
 /**
  * Report block device capacity
  *
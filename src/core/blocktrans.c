@@ -140,6 +140,9 @@ static void blktrans_close ( struct block_translator *blktrans, int rc ) {
 			( blktrans->xferbuf.len / blktrans->blksize );
 		capacity.blksize = blktrans->blksize;
 		capacity.max_count = -1U;
+		capacity.opt_count = 0;
+		capacity.align = 0;
+		capacity.max_outstanding = 0;
 
 		/* Report block device capacity */
 		block_capacity ( &blktrans->block, &capacity );
@@ -31,6 +31,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <errno.h>
 #include <ipxe/sanboot.h>
+#include <ipxe/sanpart.h>
 
 /**
  * Hook dummy SAN device
@@ -76,6 +77,7 @@ static int dummy_san_hook ( unsigned int drive, struct uri **uris,
  */
 static void dummy_san_unhook ( unsigned int drive ) {
 	struct san_device *sandev;
+	struct san_device *slice;
 
 	/* Find drive */
 	sandev = sandev_find ( drive );
@@ -84,6 +86,10 @@ static void dummy_san_unhook ( unsigned int drive ) {
 		return;
 	}
 
+	/* Unhook any partitions of this drive */
+	while ( ( slice = sandev_find_slice ( sandev ) ) != NULL )
+		dummy_san_unhook ( slice->drive );
+
 	/* Unregister SAN device */
 	unregister_sandev ( sandev );
 
@@ -91,6 +97,62 @@ static void dummy_san_unhook ( unsigned int drive ) {
 	sandev_put ( sandev );
 }
 
+/**
+ * Hook dummy SAN device partition as a separate drive
+ *
+ * @v drive		Drive number
+ * @v parent		Drive number of parent SAN device
+ * @v index		Partition number
+ * @ret drive		Drive number, or negative error
+ */
+static int dummy_san_hook_partition ( unsigned int drive, unsigned int parent,
+				      unsigned int index ) {
+	struct san_device *parent_sandev;
+	struct san_partition *partition;
+	struct san_device *sandev;
+	int rc;
+
+	/* Find parent drive and partition */
+	parent_sandev = sandev_find ( parent );
+	if ( ! parent_sandev ) {
+		DBG ( "SAN %#02x does not exist\n", parent );
+		rc = -ENODEV;
+		goto err_find;
+	}
+	partition = sanpart_find ( parent_sandev, index );
+	if ( ! partition ) {
+		DBGC ( parent_sandev, "SAN %#02x has no partition %d\n",
+		       parent, index );
+		rc = -ENOENT;
+		goto err_partition;
+	}
+
+	/* Allocate partition slice */
+	sandev = alloc_sandev_slice ( parent_sandev, partition->lba,
+				      partition->count, 0 );
+	if ( ! sandev ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+
+	/* Register partition slice */
+	if ( ( rc = register_sandev ( sandev, drive,
+				      SAN_NO_DESCRIBE ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not register: %s\n",
+		       sandev->drive, strerror ( rc ) );
+		goto err_register;
+	}
+
+	return drive;
+
+ err_register:
+	sandev_put ( sandev );
+ err_alloc:
+ err_partition:
+ err_find:
+	return rc;
+}
+
 /**
  * Boot from dummy SAN device
  *
@@ -129,5 +191,6 @@ static int dummy_san_describe ( void ) {
 
 PROVIDE_SANBOOT ( dummy, san_hook, dummy_san_hook );
 PROVIDE_SANBOOT ( dummy, san_unhook, dummy_san_unhook );
+PROVIDE_SANBOOT ( dummy, san_hook_partition, dummy_san_hook_partition );
 PROVIDE_SANBOOT ( dummy, san_boot, dummy_san_boot );
 PROVIDE_SANBOOT ( dummy, san_describe, dummy_san_describe );
@@ -25,20 +25,84 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <ipxe/device.h>
 #include <ipxe/console.h>
+#include <ipxe/profile.h>
 #include <ipxe/init.h>
+#include <config/general.h>
 
 /** @file
  *
  * Initialisation, startup and shutdown routines
  *
+ * In a storage-only fast boot build (ROM_FAST_BOOT), functions marked
+ * as deferrable are skipped by initialise() and startup(), and run
+ * only when initialise_deferred() is called by a subsystem that needs
+ * them.  The deferrable functions register the "builtin", "pci" and
+ * "netX" settings blocks, the embedded image, the PXE structures and
+ * keypress injection, and so initialise_deferred() is called by every
+ * settings access (fetch_setting() and find_settings()), by the
+ * interactive shell and by pxe_activate().  Debug builds report the time
+ * spent in each function, to provide a breakdown of the time spent
+ * during POST.
  */
 
+/** Storage-only fast boot is enabled */
+#ifdef ROM_FAST_BOOT
+#define FAST_BOOT 1
+#else
+#define FAST_BOOT 0
+#endif
+
 /** "startup() has been called" flag */
 static int started = 0;
 
+/** "initialise_deferred() has been called" flag */
+static int deferred = 0;
+
 /** Colour for debug messages */
 #define colour table_start ( INIT_FNS )
 
+/**
+ * Check if function is currently deferred
+ *
+ * @v deferrable	Function is deferrable
+ * @ret is_deferred	Function is currently deferred
+ */
+static inline int is_deferred ( int deferrable ) {
+	return ( FAST_BOOT && deferrable && ( ! deferred ) );
+}
+
+/**
+ * Call initialisation function
+ *
+ * @v init_fn		Initialisation function
+ */
+static void init_call ( struct init_fn *init_fn ) {
+	unsigned long timestamp;
+
+	timestamp = profile_timestamp();
+	init_fn->initialise();
+	DBGC ( colour, "INIT %p took %ld cycles\n", init_fn->initialise,
+	       ( ( unsigned long ) ( profile_timestamp() - timestamp ) ) );
+}
+
+/**
+ * Call startup function
+ *
+ * @v startup_fn	Startup function
+ */
+static void startup_call ( struct startup_fn *startup_fn ) {
+	unsigned long timestamp;
+
+	if ( ! startup_fn->startup )
+		return;
+
+	DBGC ( colour, "INIT startup %s...\n", startup_fn->name );
+	timestamp = profile_timestamp();
+	startup_fn->startup();
+	DBGC ( colour, "INIT startup %s took %ld cycles\n", startup_fn->name,
+	       ( ( unsigned long ) ( profile_timestamp() - timestamp ) ) );
+}
+
 /**
  * Initialise iPXE
  *
@@ -53,8 +117,43 @@ void initialise ( void ) {
 	struct init_fn *init_fn;
 
 	/* Call registered initialisation functions */
-	for_each_table_entry ( init_fn, INIT_FNS )
-		init_fn->initialise ();
+	for_each_table_entry ( init_fn, INIT_FNS ) {
+		if ( ! is_deferred ( init_fn->deferrable ) )
+			init_call ( init_fn );
+	}
+}
+
+/**
+ * Perform deferred initialisation
+ *
+ * This function runs any initialisation and startup functions that
+ * were deferred by a storage-only fast boot build.  It must be called
+ * before using any subsystem that is not required to boot from local
+ * storage.  It is safe to call this function multiple times.
+ */
+void initialise_deferred ( void ) {
+	struct init_fn *init_fn;
+	struct startup_fn *startup_fn;
+
+	/* Do nothing unless functions have been deferred */
+	if ( ! is_deferred ( 1 ) )
+		return;
+	deferred = 1;
+	DBGC ( colour, "INIT performing deferred initialisation\n" );
+
+	/* Call deferred initialisation functions */
+	for_each_table_entry ( init_fn, INIT_FNS ) {
+		if ( init_fn->deferrable )
+			init_call ( init_fn );
+	}
+
+	/* Call deferred startup functions, if already started */
+	if ( started ) {
+		for_each_table_entry ( startup_fn, STARTUP_FNS ) {
+			if ( startup_fn->deferrable )
+				startup_call ( startup_fn );
+		}
+	}
 }
 
 /**
@@ -66,21 +165,21 @@ void initialise ( void ) {
  */
 void startup ( void ) {
 	struct startup_fn *startup_fn;
+	unsigned long timestamp;
 
 	if ( started )
 		return;
 
 	/* Call registered startup functions */
+	timestamp = profile_timestamp();
 	for_each_table_entry ( startup_fn, STARTUP_FNS ) {
-		if ( startup_fn->startup ) {
-			DBGC ( colour, "INIT startup %s...\n",
-			       startup_fn->name );
-			startup_fn->startup();
-		}
+		if ( ! is_deferred ( startup_fn->deferrable ) )
+			startup_call ( startup_fn );
 	}
 
 	started = 1;
-	DBGC ( colour, "INIT startup complete\n" );
+	DBGC ( colour, "INIT startup complete in %ld cycles\n",
+	       ( ( unsigned long ) ( profile_timestamp() - timestamp ) ) );
 }
 
 /**
@@ -103,6 +202,8 @@ void shutdown ( int flags ) {
 
 	/* Call registered shutdown functions (in reverse order) */
 	for_each_table_entry_reverse ( startup_fn, STARTUP_FNS ) {
+		if ( is_deferred ( startup_fn->deferrable ) )
+			continue;
 		if ( startup_fn->shutdown ) {
 			DBGC ( colour, "INIT shutdown %s...\n",
 			       startup_fn->name );
@@ -32,12 +32,21 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/init.h>
 #include <ipxe/refcnt.h>
 #include <ipxe/malloc.h>
+#include <ipxe/profile.h>
 #include <valgrind/memcheck.h>
 
 /** @file
  *
  * Dynamic memory allocation
  *
+ * Small allocations are served from per-size-class slab caches.
+ * Each slab is a single page-aligned page taken from the free block
+ * list and divided into equally sized objects, so that allocating
+ * or freeing a small object takes constant time and every object is
+ * physically aligned to its own (power-of-two) size.  Larger or more
+ * strictly aligned allocations fall back to a first-fit search of
+ * the free block list.
+ *
  */
 
 /** A free block of memory */
@@ -264,7 +273,7 @@ static void discard_all_cache ( void ) {
 }
 
 /**
- * Allocate a memory block
+ * Allocate a memory block from the free block list
  *
  * @v size		Requested size
  * @v align		Physical alignment
@@ -276,7 +285,7 @@ static void discard_all_cache ( void ) {
  *
  * @c align must be a power of two.  @c size may not be zero.
  */
-void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
+static void * alloc_heap_block ( size_t size, size_t align, size_t offset ) {
 	struct memory_block *block;
 	size_t align_mask;
 	size_t actual_size;
@@ -394,14 +403,14 @@ void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
 }
 
 /**
- * Free a memory block
+ * Free a memory block to the free block list
  *
- * @v ptr		Memory allocated by alloc_memblock(), or NULL
+ * @v ptr		Memory allocated by alloc_heap_block(), or NULL
  * @v size		Size of the memory
  *
  * If @c ptr is NULL, no action is taken.
  */
-void free_memblock ( void *ptr, size_t size ) {
+static void free_heap_block ( void *ptr, size_t size ) {
 	struct memory_block *freeing;
 	struct memory_block *block;
 	struct memory_block *tmp;
@@ -498,6 +507,360 @@ void free_memblock ( void *ptr, size_t size ) {
 	valgrind_make_blocks_noaccess();
 }
 
+/** Slab size */
+#define SLAB_SIZE 4096
+
+/** Minimum object size served from a slab */
+#define SLAB_MIN_SIZE 16
+
+/** Number of slab size classes */
+#define SLAB_CLASSES 7
+
+/** Maximum object size served from a slab */
+#define SLAB_MAX_SIZE ( SLAB_MIN_SIZE << ( SLAB_CLASSES - 1 ) )
+
+/** Number of (possibly partial) slab-sized pages within the heap */
+#define HEAP_PAGES ( ( HEAP_SIZE / SLAB_SIZE ) + 1 )
+
+/** A slab cache */
+struct slab_cache {
+	/** Object size */
+	size_t size;
+	/** List of slabs containing at least one free object */
+	struct list_head partial;
+	/** Number of slabs */
+	unsigned int slabs;
+	/** Number of objects in use */
+	unsigned int used;
+};
+
+/** A slab */
+struct slab {
+	/** Slab cache, or NULL if this page is not a slab */
+	struct slab_cache *cache;
+	/** List of slabs containing at least one free object */
+	struct list_head list;
+	/** First free object */
+	void *free;
+	/** Number of objects in use */
+	unsigned int used;
+};
+
+/** Define a slab cache */
+#define SLAB_CACHE( index ) {						\
+	.size = ( SLAB_MIN_SIZE << (index) ),				\
+	.partial = LIST_HEAD_INIT ( slab_caches[index].partial ),	\
+	}
+
+/** Slab caches */
+static struct slab_cache slab_caches[SLAB_CLASSES] = {
+	SLAB_CACHE ( 0 ), SLAB_CACHE ( 1 ), SLAB_CACHE ( 2 ), SLAB_CACHE ( 3 ),
+	SLAB_CACHE ( 4 ), SLAB_CACHE ( 5 ), SLAB_CACHE ( 6 ),
+};
+
+/** Slab descriptors, indexed by page within the heap */
+static struct slab slabs[HEAP_PAGES];
+
+/** Slab allocation profiler */
+static struct profiler slab_alloc_profiler __profiler =
+	{ .name = "malloc.slab" };
+
+/** Free block list allocation profiler */
+static struct profiler heap_alloc_profiler __profiler =
+	{ .name = "malloc.heap" };
+
+/**
+ * Get slab descriptor for an address
+ *
+ * @v ptr		Address
+ * @ret slab		Slab descriptor, or NULL if not within the heap
+ */
+static struct slab * slab_descriptor ( void *ptr ) {
+	unsigned int index;
+
+	if ( ( ptr < ( ( void * ) heap ) ) ||
+	     ( ptr >= ( ( ( void * ) heap ) + sizeof ( heap ) ) ) )
+		return NULL;
+	index = ( ( virt_to_phys ( ptr ) / SLAB_SIZE ) -
+		  ( virt_to_phys ( heap ) / SLAB_SIZE ) );
+	return &slabs[index];
+}
+
+/**
+ * Get page used by a slab
+ *
+ * @v slab		Slab descriptor
+ * @ret page		Page
+ */
+static void * slab_page ( struct slab *slab ) {
+	unsigned int index = ( slab - slabs );
+
+	return phys_to_virt ( ( ( virt_to_phys ( heap ) / SLAB_SIZE ) +
+				index ) * SLAB_SIZE );
+}
+
+/**
+ * Identify slab cache for an allocation
+ *
+ * @v size		Requested size
+ * @v align		Physical alignment
+ * @v offset		Offset from physical alignment
+ * @ret cache		Slab cache, or NULL to use the free block list
+ */
+static struct slab_cache * slab_cache ( size_t size, size_t align,
+					size_t offset ) {
+	unsigned int index;
+
+	/* Objects are physically aligned only to their own size */
+	if ( ( align == 0 ) || ( offset & ( align - 1 ) ) )
+		return NULL;
+	if ( size < align )
+		size = align;
+	if ( ( size == 0 ) || ( size > SLAB_MAX_SIZE ) )
+		return NULL;
+
+	/* Find smallest sufficient size class */
+	index = ( ( size > SLAB_MIN_SIZE ) ?
+		  fls ( ( size - 1 ) / SLAB_MIN_SIZE ) : 0 );
+	return &slab_caches[index];
+}
+
+/**
+ * Create slab
+ *
+ * @v cache		Slab cache
+ * @ret slab		Slab, or NULL on allocation failure
+ */
+static struct slab * slab_create ( struct slab_cache *cache ) {
+	struct slab *slab;
+	void *page;
+	void *ptr;
+	size_t offset;
+
+	/* Allocate page */
+	page = alloc_heap_block ( SLAB_SIZE, SLAB_SIZE, 0 );
+	if ( ! page )
+		return NULL;
+	slab = slab_descriptor ( page );
+	if ( ! slab ) {
+		/* Memory added via mpopulate() cannot be used for slabs */
+		free_heap_block ( page, SLAB_SIZE );
+		return NULL;
+	}
+
+	/* Link all objects into the free list, lowest address first */
+	slab->free = NULL;
+	for ( offset = SLAB_SIZE ; offset ; ) {
+		offset -= cache->size;
+		ptr = ( page + offset );
+		*( ( void ** ) ptr ) = slab->free;
+		slab->free = ptr;
+	}
+	VALGRIND_MAKE_MEM_NOACCESS ( page, SLAB_SIZE );
+	slab->cache = cache;
+	slab->used = 0;
+	list_add ( &slab->list, &cache->partial );
+	cache->slabs++;
+	DBGC2 ( &heap, "Created slab [%p,%p) for %#zx-byte objects\n",
+		page, ( page + SLAB_SIZE ), cache->size );
+
+	return slab;
+}
+
+/**
+ * Destroy empty slab
+ *
+ * @v slab		Slab
+ */
+static void slab_destroy ( struct slab *slab ) {
+	struct slab_cache *cache = slab->cache;
+	void *page = slab_page ( slab );
+
+	/* Sanity check */
+	assert ( slab->used == 0 );
+
+	/* Return page to free block list */
+	DBGC2 ( &heap, "Destroying slab [%p,%p)\n", page, ( page + SLAB_SIZE ) );
+	list_del ( &slab->list );
+	slab->cache = NULL;
+	cache->slabs--;
+	free_heap_block ( page, SLAB_SIZE );
+}
+
+/**
+ * Allocate object from slab cache
+ *
+ * @v cache		Slab cache
+ * @ret ptr		Object, or NULL
+ */
+static void * slab_alloc ( struct slab_cache *cache ) {
+	struct slab *slab;
+	void *ptr;
+
+	/* Use first slab with a free object, creating one if necessary */
+	if ( list_empty ( &cache->partial ) && ( ! slab_create ( cache ) ) )
+		return NULL;
+	slab = list_first_entry ( &cache->partial, struct slab, list );
+
+	/* Remove first free object */
+	ptr = slab->free;
+	VALGRIND_MAKE_MEM_DEFINED ( ptr, sizeof ( void * ) );
+	slab->free = *( ( void ** ) ptr );
+	VALGRIND_MAKE_MEM_UNDEFINED ( ptr, cache->size );
+	slab->used++;
+	cache->used++;
+
+	/* Remove slab from list of partial slabs if now full */
+	if ( ! slab->free )
+		list_del ( &slab->list );
+
+	return ptr;
+}
+
+/**
+ * Free object to slab cache
+ *
+ * @v slab		Slab
+ * @v ptr		Object
+ */
+static void slab_free ( struct slab *slab, void *ptr ) {
+	struct slab_cache *cache = slab->cache;
+
+	/* Sanity checks */
+	assert ( slab->used > 0 );
+	assert ( ( virt_to_phys ( ptr ) & ( cache->size - 1 ) ) == 0 );
+
+	/* Return slab to list of partial slabs if previously full */
+	if ( ! slab->free )
+		list_add ( &slab->list, &cache->partial );
+
+	/* Add object to free list */
+	VALGRIND_MAKE_MEM_UNDEFINED ( ptr, sizeof ( void * ) );
+	*( ( void ** ) ptr ) = slab->free;
+	VALGRIND_MAKE_MEM_NOACCESS ( ptr, cache->size );
+	slab->free = ptr;
+	slab->used--;
+	cache->used--;
+
+	/* Release empty slab, unless it is the last slab in this
+	 * cache.  Retaining one empty slab avoids rebuilding a whole
+	 * page's free list on every allocation of a lone object (such
+	 * as a per-command structure).  Retained slabs are discarded
+	 * by slab_discard() whenever a heap allocation would
+	 * otherwise fail, when the heap is trimmed via mtrim(), and
+	 * on shutdown, so that they never cause an allocation to
+	 * fail.
+	 */
+	if ( ( ! slab->used ) && ( cache->slabs > 1 ) )
+		slab_destroy ( slab );
+}
+
+/**
+ * Discard empty slabs
+ *
+ * @ret discarded	Number of slabs discarded
+ */
+static unsigned int slab_discard ( void ) {
+	struct slab_cache *cache;
+	struct slab *slab;
+	struct slab *tmp;
+	unsigned int discarded = 0;
+
+	for ( cache = slab_caches ; cache < &slab_caches[SLAB_CLASSES] ;
+	      cache++ ) {
+		list_for_each_entry_safe ( slab, tmp, &cache->partial, list ) {
+			if ( ! slab->used ) {
+				slab_destroy ( slab );
+				discarded++;
+			}
+		}
+	}
+	return discarded;
+}
+
+/**
+ * Dump slab cache statistics
+ *
+ */
+static void slab_dump ( void ) {
+	struct slab_cache *cache;
+
+	for ( cache = slab_caches ; cache < &slab_caches[SLAB_CLASSES] ;
+	      cache++ ) {
+		DBGC ( &heap, "Slab cache %4zd bytes: %d slabs, %d/%zd "
+		       "objects in use\n", cache->size, cache->slabs,
+		       cache->used,
+		       ( cache->slabs * ( SLAB_SIZE / cache->size ) ) );
+	}
+	DBGC ( &heap, "Allocation time: slab %ld+/-%ld, list %ld+/-%ld "
+	       "ticks\n", profile_mean ( &slab_alloc_profiler ),
+	       profile_stddev ( &slab_alloc_profiler ),
+	       profile_mean ( &heap_alloc_profiler ),
+	       profile_stddev ( &heap_alloc_profiler ) );
+}
+
+/** Empty slab cache discarder */
+struct cache_discarder slab_discarder __cache_discarder ( CACHE_CHEAP ) = {
+	.discard = slab_discard,
+};
+
+/**
+ * Allocate a memory block
+ *
+ * @v size		Requested size
+ * @v align		Physical alignment
+ * @v offset		Offset from physical alignment
+ * @ret ptr		Memory block, or NULL
+ *
+ * Allocates a memory block @b physically aligned as requested.  No
+ * guarantees are provided for the alignment of the virtual address.
+ *
+ * @c align must be a power of two.  @c size may not be zero.
+ */
+void * alloc_memblock ( size_t size, size_t align, size_t offset ) {
+	struct slab_cache *cache;
+	void *ptr;
+
+	/* Use a slab cache, if possible */
+	cache = slab_cache ( size, align, offset );
+	if ( cache ) {
+		profile_start ( &slab_alloc_profiler );
+		ptr = slab_alloc ( cache );
+		profile_stop ( &slab_alloc_profiler );
+		if ( ptr )
+			return ptr;
+	}
+
+	/* Otherwise, allocate from the free block list */
+	profile_start ( &heap_alloc_profiler );
+	ptr = alloc_heap_block ( size, align, offset );
+	profile_stop ( &heap_alloc_profiler );
+	return ptr;
+}
+
+/**
+ * Free a memory block
+ *
+ * @v ptr		Memory allocated by alloc_memblock(), or NULL
+ * @v size		Size of the memory
+ *
+ * If @c ptr is NULL, no action is taken.
+ */
+void free_memblock ( void *ptr, size_t size ) {
+	struct slab *slab;
+
+	/* Return object to its slab, if applicable */
+	slab = slab_descriptor ( ptr );
+	if ( slab && slab->cache ) {
+		VALGRIND_MAKE_MEM_NOACCESS ( ptr, size );
+		slab_free ( slab, ptr );
+		return;
+	}
+
+	/* Otherwise, return memory to the free block list */
+	free_heap_block ( ptr, size );
+}
+
 /**
  * Reallocate memory
  *
@@ -659,6 +1022,71 @@ void mpopulate ( void *start, size_t len ) {
 	usedmem += len;
 }
 
+/**
+ * Trim free space from the end of the heap
+ *
+ * @v reserve		Free space to retain for later allocations
+ * @v len		Length of trimmed region to fill in
+ * @ret start		Start of trimmed region, or NULL
+ *
+ * All cached data is discarded, and any free space at the end of the
+ * heap beyond the requested reserve is removed from the heap.  The
+ * trimmed region is page-aligned, and will not be touched by the
+ * allocator unless it is returned to the heap using mpopulate().
+ */
+void * mtrim ( size_t reserve, size_t *len ) {
+	struct memory_block *block;
+	void *end = ( heap + sizeof ( heap ) );
+	void *start = NULL;
+	physaddr_t phys;
+	size_t size;
+
+	/* Maximise free space */
+	discard_all_cache();
+
+	/* Sanity checks */
+	valgrind_make_blocks_defined();
+	check_blocks();
+
+	/* Find free block (if any) at the end of the heap */
+	*len = 0;
+	if ( list_empty ( &free_blocks ) )
+		goto out;
+	block = list_last_entry ( &free_blocks, struct memory_block, list );
+	if ( ( ( ( void * ) block ) + block->size ) != end )
+		goto out;
+
+	/* Calculate page-aligned start of trimmed region */
+	if ( block->size <= reserve )
+		goto out;
+	phys = virt_to_phys ( ( ( void * ) block ) + reserve );
+	phys = ( ( phys + SLAB_SIZE - 1 ) & ~( SLAB_SIZE - 1 ) );
+	start = phys_to_virt ( phys );
+	if ( start >= end ) {
+		start = NULL;
+		goto out;
+	}
+	*len = ( end - start );
+
+	/* Shrink free block to end at (or just before) the trimmed
+	 * region, keeping its size a multiple of MIN_MEMBLOCK_SIZE.
+	 */
+	size = ( ( start - ( ( void * ) block ) ) &
+		 ~( MIN_MEMBLOCK_SIZE - 1 ) );
+	freemem -= ( block->size - size );
+	if ( size ) {
+		block->size = size;
+	} else {
+		list_del ( &block->list );
+	}
+	DBGC ( &heap, "Trimmed [%p,%p) from heap\n", start, end );
+
+ out:
+	check_blocks();
+	valgrind_make_blocks_noaccess();
+	return start;
+}
+
 /**
  * Initialise the heap
  *
@@ -679,6 +1107,7 @@ struct init_fn heap_init_fn __init_fn ( INIT_EARLY ) = {
  *
  */
 static void shutdown_cache ( int booting __unused ) {
+	slab_dump();
 	discard_all_cache();
 	DBGC ( &heap, "Maximum heap usage %zdkB\n", ( maxusedmem >> 10 ) );
 }
@@ -692,16 +1121,25 @@ struct startup_fn heap_startup_fn __startup_fn ( STARTUP_EARLY ) = {
 #if 0
 #include <stdio.h>
 /**
- * Dump free block list
+ * Dump free block list and slab cache statistics
  *
  */
 void mdumpfree ( void ) {
 	struct memory_block *block;
+	size_t largest = 0;
+	unsigned int count = 0;
 
 	printf ( "Free block list:\n" );
 	list_for_each_entry ( block, &free_blocks, list ) {
 		printf ( "[%p,%p] (size %#zx)\n", block,
 			 ( ( ( void * ) block ) + block->size ), block->size );
+		if ( block->size > largest )
+			largest = block->size;
+		count++;
 	}
+	printf ( "%d free blocks, largest %#zx of %#zx (%zd%% fragmented)\n",
+		 count, largest, freemem,
+		 ( freemem ? ( 100 - ( ( 100 * largest ) / freemem ) ) : 0 ) );
+	slab_dump();
 }
 #endif
@@ -37,6 +37,12 @@ static void null_san_unhook ( unsigned int drive __unused ) {
 	/* Do nothing */
 }
 
+static int null_san_hook_partition ( unsigned int drive __unused,
+				     unsigned int parent __unused,
+				     unsigned int index __unused ) {
+	return -EOPNOTSUPP;
+}
+
 static int null_san_boot ( unsigned int drive __unused,
 			   const char *filename __unused ) {
 	return -EOPNOTSUPP;
@@ -48,5 +54,6 @@ static int null_san_describe ( void ) {
 
 PROVIDE_SANBOOT ( null, san_hook, null_san_hook );
 PROVIDE_SANBOOT ( null, san_unhook, null_san_unhook );
+PROVIDE_SANBOOT ( null, san_hook_partition, null_san_hook_partition );
 PROVIDE_SANBOOT ( null, san_boot, null_san_boot );
 PROVIDE_SANBOOT ( null, san_describe, null_san_describe );
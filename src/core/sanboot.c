@@ -32,17 +32,23 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <errno.h>
 #include <assert.h>
 #include <ipxe/xfer.h>
 #include <ipxe/open.h>
 #include <ipxe/timer.h>
+#include <ipxe/nstime.h>
 #include <ipxe/process.h>
 #include <ipxe/iso9660.h>
+#include <ipxe/eltorito.h>
 #include <ipxe/dhcp.h>
 #include <ipxe/settings.h>
 #include <ipxe/quiesce.h>
 #include <ipxe/sanboot.h>
+#include <ipxe/sanpart.h>
+#include <ipxe/sanverity.h>
+#include <ipxe/sancrypt.h>
 
 /**
  * Default SAN drive number
@@ -85,6 +91,41 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 #define SAN_REOPEN_DELAY_SECS 5
 
+/**
+ * Maximum time to poll a SAN device directly
+ *
+ * Devices that support polling (e.g. local NVMe controllers) will
+ * typically complete a command within a few microseconds, which is
+ * much less than the cost of running every registered process via
+ * step().  Poll such devices directly for up to this many
+ * microseconds before falling back to the full process scheduler.
+ */
+#define SAN_POLL_USECS 1000
+
+/** Device flags for which all available paths are used concurrently */
+#define SAN_ALL_PATHS ( SAN_MULTIPATH | SAN_RAID0 | SAN_RAID1 )
+
+/** Resolution of smoothed path latencies (as a shift from nanoseconds)
+ *
+ * Latencies are recorded in units of 64ns, which resolves the
+ * completion time of a single fast (e.g. NVMe) fragment while
+ * allowing for latencies of several minutes within an unsigned long.
+ */
+#define SAN_LATENCY_SCALE 6
+
+/** Weight (as a right shift) given to each new path latency sample */
+#define SAN_LATENCY_WEIGHT 3
+
+/**
+ * Length of registration probe read
+ *
+ * This covers the partition table, the ISO9660 primary volume
+ * descriptor and the El Torito boot record volume descriptor, so that
+ * all of the checks performed while registering a drive can be
+ * satisfied by a single read from the underlying device.
+ */
+#define SAN_PROBE_LEN ( ( ELTORITO_LBA + 1 ) * ISO9660_BLKSIZE )
+
 /** List of SAN devices */
 LIST_HEAD ( san_devices );
 
@@ -107,6 +148,22 @@ struct san_device * sandev_find ( unsigned int drive ) {
 	return NULL;
 }
 
+/**
+ * Find partition slice of SAN device
+ *
+ * @v sandev		SAN device
+ * @ret slice		Registered partition slice, or NULL
+ */
+struct san_device * sandev_find_slice ( struct san_device *sandev ) {
+	struct san_device *slice;
+
+	list_for_each_entry ( slice, &san_devices, list ) {
+		if ( slice->parent == sandev )
+			return slice;
+	}
+	return NULL;
+}
+
 /**
  * Free SAN device
  *
@@ -124,6 +181,12 @@ static void sandev_free ( struct refcnt *refcnt ) {
 		uri_put ( sandev->path[i].uri );
 		assert ( sandev->path[i].desc == NULL );
 	}
+	free ( sandev->probe );
+	sanpart_discard ( sandev );
+	sanverity_discard ( sandev );
+	sancrypt_discard ( sandev );
+	if ( sandev->parent )
+		sandev_put ( sandev->parent );
 	free ( sandev );
 }
 
@@ -156,6 +219,28 @@ static void sandev_command_capacity ( struct san_device *sandev,
     DBGC ( sandev, " sandev_command_capacity() \n" );
 	/* Record raw capacity information */
 	memcpy ( &sandev->capacity, capacity, sizeof ( sandev->capacity ) );
+
+	/* Ignore nonsensical alignment preferences */
+	if ( sandev->capacity.align & ( sandev->capacity.align - 1 ) ) {
+		DBGC ( sandev, "SAN %#02x ignoring non-power-of-two alignment "
+		       "%d\n", sandev->drive, sandev->capacity.align );
+		sandev->capacity.align = 0;
+	}
+
+	/* Calculate striped capacity, if applicable */
+	if ( sandev->flags & SAN_RAID0 ) {
+		sandev->chunk_shift = 0;
+		while ( ( sandev->capacity.blksize << sandev->chunk_shift ) <
+			SAN_RAID_CHUNK_SIZE ) {
+			sandev->chunk_shift++;
+		}
+		sandev->capacity.blocks =
+			( ( ( capacity->blocks >> sandev->chunk_shift ) *
+			    sandev->paths ) << sandev->chunk_shift );
+		DBGC ( sandev, "SAN %#02x striped across %d members with "
+		       "%d-block chunks\n", sandev->drive, sandev->paths,
+		       ( 1 << sandev->chunk_shift ) );
+	}
 }
 
 /** SAN device command interface operations */
@@ -169,6 +254,67 @@ static struct interface_operation sandev_command_op[] = {
 static struct interface_descriptor sandev_command_desc =
 	INTF_DESC ( struct san_device, command, sandev_command_op );
 
+/**
+ * Close SAN device fragment
+ *
+ * @v frag		SAN device fragment
+ * @v rc		Reason for close
+ */
+static void sanfrag_close ( struct san_fragment *frag, int rc ) {
+	struct san_device *sandev = frag->sandev;
+	struct san_path *sanpath = frag->path;
+	unsigned long elapsed;
+
+	/* Restart interface */
+	intf_restart ( &frag->block, rc );
+
+	/* Update path statistics */
+	if ( sanpath && ( frag->rc == -EINPROGRESS ) ) {
+		assert ( sanpath->inflight > 0 );
+		sanpath->inflight--;
+		if ( rc == 0 ) {
+			elapsed = ( ( nstime() - frag->started ) >>
+				    SAN_LATENCY_SCALE );
+			sanpath->latency -=
+				( sanpath->latency >> SAN_LATENCY_WEIGHT );
+			sanpath->latency += ( elapsed >> SAN_LATENCY_WEIGHT );
+		}
+	}
+
+	/* Record fragment status */
+	frag->rc = rc;
+
+	/* Treat any completion as forward progress */
+	if ( timer_running ( &sandev->timer ) )
+		start_timer_fixed ( &sandev->timer, SAN_COMMAND_TIMEOUT );
+}
+
+/**
+ * Abort all outstanding SAN device fragments
+ *
+ * @v sandev		SAN device
+ * @v rc		Reason for abort
+ */
+static void sandev_abort_fragments ( struct san_device *sandev, int rc ) {
+	struct san_fragment *frag;
+	unsigned int i;
+
+	for ( i = 0 ; i < SAN_MAX_OUTSTANDING ; i++ ) {
+		frag = &sandev->frag[i];
+		if ( frag->count && ( frag->rc == -EINPROGRESS ) )
+			sanfrag_close ( frag, rc );
+	}
+}
+
+/** SAN device fragment interface operations */
+static struct interface_operation sanfrag_block_op[] = {
+	INTF_OP ( intf_close, struct san_fragment *, sanfrag_close ),
+};
+
+/** SAN device fragment interface descriptor */
+static struct interface_descriptor sanfrag_block_desc =
+	INTF_DESC ( struct san_fragment, block, sanfrag_block_op );
+
 /**
  * Handle SAN device command timeout
  *
@@ -179,6 +325,7 @@ static void sandev_command_expired ( struct retry_timer *timer,
 	struct san_device *sandev =
 		container_of ( timer, struct san_device, timer );
 
+	sandev_abort_fragments ( sandev, -ETIMEDOUT );
 	sandev_command_close ( sandev, -ETIMEDOUT );
 }
 
@@ -220,6 +367,7 @@ static int sanpath_open ( struct san_path *sanpath ) {
 
 	/* Record as in progress */
 	sanpath->path_rc = -EINPROGRESS;
+	sanpath->latency = 0;
 
 	return 0;
 }
@@ -232,10 +380,20 @@ static int sanpath_open ( struct san_path *sanpath ) {
  */
 static void sanpath_close ( struct san_path *sanpath, int rc ) {
 	struct san_device *sandev = sanpath->sandev;
+	struct san_fragment *frag;
+	unsigned int i;
 
 	/* Record status */
 	sanpath->path_rc = rc;
 
+	/* Abort any fragments outstanding on this path */
+	for ( i = 0 ; i < SAN_MAX_OUTSTANDING ; i++ ) {
+		frag = &sandev->frag[i];
+		if ( frag->count && ( frag->path == sanpath ) &&
+		     ( frag->rc == -EINPROGRESS ) )
+			sanfrag_close ( frag, rc );
+	}
+
 	/* Mark as closed */
 	list_del ( &sanpath->list );
 	list_add_tail ( &sanpath->list, &sandev->closed );
@@ -250,7 +408,72 @@ static void sanpath_close ( struct san_path *sanpath, int rc ) {
 		sandev_command_close ( sandev, rc );
 	} else {
 		intf_restart ( &sanpath->block, rc );
+		if ( ( sandev->flags & SAN_ALL_PATHS ) &&
+		     ( sandev->command_rc == -EINPROGRESS ) ) {
+			/* Command may have been issued via this path */
+			sandev_command_close ( sandev, rc );
+		}
+	}
+
+	/* A striped volume cannot survive the loss of any member */
+	if ( sandev->flags & SAN_RAID0 )
+		sandev->active = NULL;
+
+	/* Fail over to any other available path */
+	if ( ( sandev->flags & ( SAN_MULTIPATH | SAN_RAID1 ) ) &&
+	     ( ! sandev->active ) ) {
+		list_for_each_entry ( sanpath, &sandev->opened, list ) {
+			if ( sanpath->path_rc != 0 )
+				continue;
+			DBGC ( sandev, "SAN %#02x.%d is active\n",
+			       sandev->drive, sanpath->index );
+			sandev->active = sanpath;
+			break;
+		}
+	}
+}
+
+/**
+ * Check if SAN path is available for I/O
+ *
+ * @v sanpath		SAN path
+ * @ret is_ready	Path is available for I/O
+ */
+static int sanpath_is_ready ( struct san_path *sanpath ) {
+	struct san_device *sandev = sanpath->sandev;
+	struct san_path *tmp;
+
+	/* The active path is always available */
+	if ( sanpath == sandev->active )
+		return 1;
+
+	/* Other opened paths are available only if using all paths */
+	if ( ! ( sandev->flags & SAN_ALL_PATHS ) )
+		return 0;
+	if ( sanpath->path_rc != 0 )
+		return 0;
+	list_for_each_entry ( tmp, &sandev->opened, list ) {
+		if ( tmp == sanpath )
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * Count SAN paths available for I/O
+ *
+ * @v sandev		SAN device
+ * @ret count		Number of available paths
+ */
+static unsigned int sandev_ready_paths ( struct san_device *sandev ) {
+	unsigned int count = 0;
+	unsigned int i;
+
+	for ( i = 0 ; i < sandev->paths ; i++ ) {
+		if ( sanpath_is_ready ( &sandev->path[i] ) )
+			count++;
 	}
+	return count;
 }
 
 /**
@@ -294,8 +517,8 @@ static size_t sanpath_block_window ( struct san_path *sanpath __unused ) {
 static void sanpath_step ( struct san_path *sanpath ) {
 	struct san_device *sandev = sanpath->sandev;
 
-	/* Ignore if we are already the active device */
-	if ( sanpath == sandev->active )
+	/* Ignore if we are already the active device or available */
+	if ( ( sanpath == sandev->active ) || ( sanpath->path_rc == 0 ) )
 		return;
 
 	/* Wait until path has become available */
@@ -310,6 +533,9 @@ static void sanpath_step ( struct san_path *sanpath ) {
 		DBGC ( sandev, "SAN %#02x.%d is active\n",
 		       sandev->drive, sanpath->index );
 		sandev->active = sanpath;
+	} else if ( sandev->flags & SAN_ALL_PATHS ) {
+		DBGC ( sandev, "SAN %#02x.%d is available for concurrent I/O\n",
+		       sandev->drive, sanpath->index );
 	} else {
 		DBGC ( sandev, "SAN %#02x.%d is available\n",
 		       sandev->drive, sanpath->index );
@@ -332,6 +558,22 @@ static struct interface_descriptor sanpath_block_desc =
 static struct process_descriptor sanpath_process_desc =
 	PROC_DESC_ONCE ( struct san_path, process, sanpath_step );
 
+/**
+ * Check if any SAN path is still opening
+ *
+ * @v sandev		SAN device
+ * @ret is_opening	Any path is still opening
+ */
+static int sandev_opening ( struct san_device *sandev ) {
+	struct san_path *sanpath;
+
+	list_for_each_entry ( sanpath, &sandev->opened, list ) {
+		if ( sanpath->path_rc == -EINPROGRESS )
+			return 1;
+	}
+	return 0;
+}
+
 /**
  * Restart SAN device interface
  *
@@ -350,7 +592,8 @@ static void sandev_restart ( struct san_device *sandev, int rc ) {
 	/* Clear active path */
 	sandev->active = NULL;
 
-	/* Close any outstanding command */
+	/* Close any outstanding fragments and command */
+	sandev_abort_fragments ( sandev, rc );
 	sandev_command_close ( sandev, rc );
 }
 
@@ -366,6 +609,13 @@ int sandev_reopen ( struct san_device *sandev ) {
 	struct san_path *sanpath;
 	int rc;
 
+	/* Reopen parent device, if applicable */
+	if ( sandev->parent ) {
+		if ( ! sandev_needs_reopen ( sandev->parent ) )
+			return 0;
+		return sandev_reopen ( sandev->parent );
+	}
+
 	/* Unquiesce system */
 	unquiesce();
 
@@ -404,9 +654,29 @@ int sandev_reopen ( struct san_device *sandev ) {
 		}
 	}
 
+	/* Wait for all RAID members to either open or fail */
+	if ( sandev->flags & ( SAN_RAID0 | SAN_RAID1 ) ) {
+		while ( sandev_opening ( sandev ) )
+			step();
+	}
+
+	/* A striped volume requires all members to be available */
+	if ( ( sandev->flags & SAN_RAID0 ) &&
+	     ( sandev_ready_paths ( sandev ) != sandev->paths ) ) {
+		rc = -ENODEV;
+		list_for_each_entry ( sanpath, &sandev->closed, list ) {
+			rc = sanpath->path_rc;
+			break;
+		}
+		DBGC ( sandev, "SAN %#02x RAID-0 member unavailable: %s\n",
+		       sandev->drive, strerror ( rc ) );
+		goto err_member;
+	}
+
 	assert ( ! list_empty ( &sandev->opened ) );
 	return 0;
 
+ err_member:
  err_none:
  err_open:
 	sandev_restart ( sandev, rc );
@@ -425,6 +695,8 @@ struct san_command_rw_params {
 	uint64_t lba;
 	/** Block count */
 	unsigned int count;
+	/** Path to use, or NULL to select automatically */
+	struct san_path *path;
 };
 
 /** SAN device command parameters */
@@ -433,6 +705,88 @@ union san_command_params {
 	struct san_command_rw_params rw;
 };
 
+/**
+ * Locate RAID-0 member holding a block
+ *
+ * @v sandev		SAN device
+ * @v lba		Logical block address (in underlying blocks)
+ * @ret member_lba	Logical block address within member
+ * @ret sanpath		Member path, or NULL if any path may be used
+ */
+static struct san_path * sandev_member ( struct san_device *sandev,
+					 uint64_t lba, uint64_t *member_lba ) {
+	uint64_t stripe;
+	uint64_t offset;
+
+	/* All paths are identical unless striped */
+	if ( ! ( sandev->flags & SAN_RAID0 ) ) {
+		*member_lba = lba;
+		return NULL;
+	}
+
+	/* Locate chunk within stripe */
+	stripe = ( lba >> sandev->chunk_shift );
+	offset = ( lba & ( ( 1ULL << sandev->chunk_shift ) - 1 ) );
+	*member_lba = ( ( ( stripe / sandev->paths ) << sandev->chunk_shift ) |
+			offset );
+	return &sandev->path[ stripe % sandev->paths ];
+}
+
+/**
+ * Select SAN path for read/write command
+ *
+ * @v sandev		SAN device
+ * @v params		Command parameters
+ * @v lba		Logical block address (in underlying blocks)
+ * @ret sanpath		SAN path, or NULL if no path can accept a command
+ *
+ * The available path with the lowest expected completion time (based
+ * on its current queue occupancy and smoothed latency) is chosen,
+ * subject to any constraint imposed by the command parameters or by
+ * RAID-0 striping.
+ */
+static struct san_path *
+sandev_select_path ( struct san_device *sandev,
+		     const union san_command_params *params, uint64_t lba ) {
+	struct san_path *required;
+	struct san_path *sanpath;
+	struct san_path *best = NULL;
+	uint64_t member_lba;
+	unsigned int limit;
+	uint64_t cost;
+	uint64_t best_cost = 0;
+	unsigned int i;
+
+	/* Identify any required path */
+	required = params->rw.path;
+	if ( ! required )
+		required = sandev_member ( sandev, lba, &member_lba );
+
+	/* Calculate per-path limit on outstanding commands */
+	limit = sandev->capacity.max_outstanding;
+	if ( ! limit )
+		limit = 1;
+
+	/* Choose least loaded path */
+	for ( i = 0 ; i < sandev->paths ; i++ ) {
+		sanpath = &sandev->path[i];
+		if ( required && ( sanpath != required ) )
+			continue;
+		if ( ! sanpath_is_ready ( sanpath ) )
+			continue;
+		if ( sanpath->inflight >= limit )
+			continue;
+		cost = ( ( sanpath->inflight + 1 ) *
+			 ( ( ( uint64_t ) sanpath->latency ) + 1 ) );
+		if ( ( ! best ) || ( cost < best_cost ) ) {
+			best = sanpath;
+			best_cost = cost;
+		}
+	}
+
+	return best;
+}
+
 /**
  * Initiate SAN device read/write command
  *
@@ -442,16 +796,24 @@ union san_command_params {
  */
 static int sandev_command_rw ( struct san_device *sandev,
 			       const union san_command_params *params ) {
-	struct san_path *sanpath = sandev->active;
+	struct san_path *sanpath;
 	size_t len = ( params->rw.count * sandev->capacity.blksize );
+	uint64_t lba;
 	int rc;
 
-	/* Sanity check */
-	assert ( sanpath != NULL );
+	/* Select path */
+	sanpath = sandev_select_path ( sandev, params, params->rw.lba );
+	if ( ! sanpath ) {
+		DBGC ( sandev, "SAN %#02x has no path for LBA %#llx\n",
+		       sandev->drive, ( ( unsigned long long )
+					params->rw.lba ) );
+		return -ENOTCONN;
+	}
+	sandev_member ( sandev, params->rw.lba, &lba );
 
 	/* Initiate read/write command */
 	if ( ( rc = params->rw.block_rw ( &sanpath->block, &sandev->command,
-					  params->rw.lba, params->rw.count,
+					  lba, params->rw.count,
 					  params->rw.buffer, len ) ) != 0 ) {
 		DBGC ( sandev, "SAN %#02x.%d could not initiate read/write: "
 		       "%s\n", sandev->drive, sanpath->index, strerror ( rc ) );
@@ -488,6 +850,59 @@ sandev_command_read_capacity ( struct san_device *sandev,
 	return 0;
 }
 
+/**
+ * Poll available SAN paths directly
+ *
+ * @v sandev		SAN device
+ * @ret polled		Device was polled
+ *
+ * The device is polled directly only if every available path supports
+ * polling.  A path that does not (e.g. an AoE or iSCSI path, whose
+ * commands complete only as the network stack processes received
+ * packets) can make progress only via the full process scheduler,
+ * which must not be starved by busy-waiting.
+ */
+static int sandev_poll ( struct san_device *sandev ) {
+	struct san_path *sanpath;
+	unsigned int i;
+	int polled = 0;
+
+	for ( i = 0 ; i < sandev->paths ; i++ ) {
+		sanpath = &sandev->path[i];
+		if ( ! sanpath_is_ready ( sanpath ) )
+			continue;
+		if ( block_poll ( &sanpath->block ) != 0 )
+			return 0;
+		polled = 1;
+	}
+	return polled;
+}
+
+/**
+ * Wait for SAN device command to complete
+ *
+ * @v sandev		SAN device
+ */
+static void sandev_command_wait ( struct san_device *sandev ) {
+	unsigned int polls;
+
+	/* Poll device directly, if supported, for a short while */
+	for ( polls = 0 ; polls < SAN_POLL_USECS ; polls++ ) {
+		if ( ! sandev_poll ( sandev ) )
+			break;
+		if ( sandev->command_rc != -EINPROGRESS )
+			return;
+		udelay ( 1 );
+	}
+
+	/* Start expiry timer */
+	start_timer_fixed ( &sandev->timer, SAN_COMMAND_TIMEOUT );
+
+	/* Wait for command to complete */
+	while ( timer_running ( &sandev->timer ) )
+		step();
+}
+
 /**
  * Execute a single SAN device command and wait for completion
  *
@@ -528,18 +943,18 @@ sandev_command ( struct san_device *sandev,
 		}
 
 		/* Initiate command */
+		sandev->command_rc = -EINPROGRESS;
 		if ( ( rc = command ( sandev, params ) ) != 0 ) {
 			retries++;
 			continue;
 		}
 
-		/* Start expiry timer */
-		start_timer_fixed ( &sandev->timer, SAN_COMMAND_TIMEOUT );
+		/* Wait for command to complete, unless it already
+		 * completed before the initiating call returned.
+		 */
+		if ( sandev->command_rc == -EINPROGRESS )
+			sandev_command_wait ( sandev );
 
-		/* Wait for command to complete */
-		while ( timer_running ( &sandev->timer ) ) {
-            step();
-        }
 		/* Check command status */
 		if ( ( rc = sandev->command_rc ) != 0 ) {
 			retries++;
@@ -575,111 +990,734 @@ int sandev_reset ( struct san_device *sandev ) {
 }
 
 /**
- * Read from or write to SAN device
+ * Calculate SAN device fragment length
  *
  * @v sandev		SAN device
- * @v lba		Starting logical block address
- * @v count		Number of logical blocks
- * @v buffer		Data buffer
- * @v block_rw		Block read/write method
- * @ret rc		Return status code
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v remaining		Number of underlying blocks remaining
+ * @ret count		Number of underlying blocks in fragment
+ *
+ * Fragments are limited to the optimal transfer size reported by the
+ * device (if any), and are trimmed where possible so that each
+ * fragment ends on the device's preferred alignment boundary.  Once
+ * the first fragment has brought the transfer into alignment, all
+ * subsequent fragments will therefore be both aligned and optimally
+ * sized.
  */
-static int sandev_rw ( struct san_device *sandev, uint64_t lba,
-		       unsigned int count, userptr_t buffer,
-		       int ( * block_rw ) ( struct interface *control,
-					    struct interface *data,
-					    uint64_t lba, unsigned int count,
-					    userptr_t buffer, size_t len ) ) {
-	union san_command_params params;
-	unsigned int remaining;
-	size_t frag_len;
-	int rc;
-
-	/* Initialise command parameters */
-	params.rw.block_rw = block_rw;
-	params.rw.buffer = buffer;
-	params.rw.lba = ( lba << sandev->blksize_shift );
-	params.rw.count = sandev->capacity.max_count;
-	remaining = ( count << sandev->blksize_shift );
-
-	/* Read/write fragments */
-	while ( remaining ) {
-
-		/* Determine fragment length */
-		if ( params.rw.count > remaining )
-			params.rw.count = remaining;
+static unsigned int sandev_fragment_count ( struct san_device *sandev,
+					    uint64_t lba,
+					    unsigned int remaining ) {
+	struct block_device_capacity *capacity = &sandev->capacity;
+	unsigned int count = capacity->max_count;
+	unsigned int align = capacity->align;
+	unsigned int chunk_end;
+	uint64_t end;
+
+	/* Limit to optimal transfer size, if known */
+	if ( capacity->opt_count && ( count > capacity->opt_count ) )
+		count = capacity->opt_count;
+
+	/* Never cross a RAID-0 chunk boundary */
+	if ( sandev->flags & SAN_RAID0 ) {
+		chunk_end = ( ( 1U << sandev->chunk_shift ) -
+			      ( lba & ( ( 1U << sandev->chunk_shift ) - 1 ) ) );
+		if ( count > chunk_end )
+			count = chunk_end;
+		if ( remaining > chunk_end )
+			remaining = chunk_end;
+	}
 
-		/* Execute command */
-		if ( ( rc = sandev_command ( sandev, sandev_command_rw,
-					     &params ) ) != 0 )
-			return rc;
+	/* The final fragment needs no trimming */
+	if ( count >= remaining )
+		return remaining;
 
-		/* Move to next fragment */
-		frag_len = ( sandev->capacity.blksize * params.rw.count );
-		params.rw.buffer = userptr_add ( params.rw.buffer, frag_len );
-		params.rw.lba += params.rw.count;
-		remaining -= params.rw.count;
+	/* Trim to end on an alignment boundary, if possible */
+	if ( align > 1 ) {
+		end = ( ( lba + count ) & ~( ( uint64_t ) ( align - 1 ) ) );
+		if ( end > lba )
+			count = ( end - lba );
 	}
 
-	return 0;
+	return count;
 }
 
 /**
- * Read from SAN device
+ * Issue SAN device fragment
  *
- * @v sandev		SAN device
- * @v lba		Starting logical block address
- * @v count		Number of logical blocks
- * @v buffer		Data buffer
- * @ret rc		Return status code
+ * @v frag		SAN device fragment
+ * @v sanpath		SAN path
+ * @v params		Command parameters
  */
-int sandev_read ( struct san_device *sandev, uint64_t lba,
-		  unsigned int count, userptr_t buffer ) {
+static void sanfrag_issue ( struct san_fragment *frag,
+			    struct san_path *sanpath,
+			    const union san_command_params *params ) {
+	struct san_device *sandev = frag->sandev;
+	size_t len = ( sandev->capacity.blksize * frag->count );
+	uint64_t lba;
 	int rc;
 
-	/* Read from device */
-	if ( ( rc = sandev_rw ( sandev, lba, count, buffer, block_read ) ) != 0 )
-		return rc;
+	/* Locate fragment within member */
+	sandev_member ( sandev, frag->lba, &lba );
 
-	return 0;
+	/* Record path */
+	frag->path = sanpath;
+	frag->started = nstime();
+	frag->rc = -EINPROGRESS;
+	sanpath->inflight++;
+
+	/* Initiate read/write command */
+	if ( ( rc = params->rw.block_rw ( &sanpath->block, &frag->block,
+					  lba, frag->count, frag->buffer,
+					  len ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x.%d could not initiate fragment: "
+		       "%s\n", sandev->drive, sanpath->index, strerror ( rc ) );
+		sanfrag_close ( frag, rc );
+	}
 }
 
 /**
- * Write to SAN device
+ * Fail over from a SAN path that failed a fragment
  *
- * @v sandev		SAN device
- * @v lba		Starting logical block address
- * @v count		Number of logical blocks
- * @v buffer		Data buffer
- * @ret rc		Return status code
+ * @v sanpath		SAN path
+ * @v rc		Reason for failure
+ * @ret ok		Fragment may be reissued to another path
  */
-int sandev_write ( struct san_device *sandev, uint64_t lba,
-		   unsigned int count, userptr_t buffer ) {
-	int rc;
+static int sanpath_failover ( struct san_path *sanpath, int rc ) {
+	struct san_device *sandev = sanpath->sandev;
 
-	/* Write to device */
-	if ( ( rc = sandev_rw ( sandev, lba, count, buffer, block_write ) ) != 0 )
-		return rc;
+	/* Failover is possible only if paths hold identical content */
+	if ( ! ( sandev->flags & ( SAN_MULTIPATH | SAN_RAID1 ) ) )
+		return 0;
 
-	/* Quiesce system.  This is a heuristic designed to ensure
-	 * that the system is quiesced before Windows starts up, since
-	 * a Windows SAN boot will typically write a status flag to
-	 * the disk as its last action before transferring control to
-	 * the native drivers.
-	 */
-	quiesce();
+	/* Close failed path, if still open and not the last available */
+	if ( sanpath_is_ready ( sanpath ) ) {
+		if ( sandev_ready_paths ( sandev ) < 2 )
+			return 0;
+		DBGC ( sandev, "SAN %#02x.%d failed (%s); failing over\n",
+		       sandev->drive, sanpath->index, strerror ( rc ) );
+		sanpath_close ( sanpath, rc );
+	}
 
-	return 0;
+	return ( sandev->active != NULL );
 }
 
 /**
- * Describe SAN device
+ * Read from or write to SAN device using multiple outstanding fragments
  *
  * @v sandev		SAN device
+ * @v params		Command parameters (updated as fragments are issued)
+ * @v remaining		Number of underlying blocks remaining (updated)
  * @ret rc		Return status code
  *
- * Allow connections to progress until all existent path descriptors
- * are complete.
+ * Fragments are issued to the available path(s) until the limit on
+ * outstanding transfers is reached, and further fragments are issued
+ * as earlier fragments complete.  In multipath mode, a fragment that
+ * fails is reissued to another available path.  Any other fragment
+ * that fails is retried individually (via sandev_command()) once all
+ * outstanding fragments have drained, so that the usual reopen and
+ * retry logic applies.
+ */
+static int sandev_rw_pipeline ( struct san_device *sandev,
+				union san_command_params *params,
+				unsigned int *remaining ) {
+	union san_command_params retry;
+	struct san_fragment *frag;
+	struct san_path *sanpath;
+	unsigned int outstanding;
+	unsigned int pending;
+	unsigned int polls;
+	unsigned int i;
+	uint64_t lba;
+	size_t frag_len;
+	int progress;
+	int failed;
+	int rc;
+
+	/* Sanity check */
+	assert ( ! timer_running ( &sandev->timer ) );
+
+	failed = 0;
+	polls = 0;
+	while ( 1 ) {
+
+		/* Stop issuing fragments if all paths have gone away */
+		if ( ! sandev->active )
+			failed = 1;
+		progress = 0;
+
+		/* Issue fragments into any idle slots */
+		for ( i = 0 ; ( i < SAN_MAX_OUTSTANDING ) && ( ! failed ) ;
+		      i++ ) {
+			frag = &sandev->frag[i];
+			if ( frag->count ? ( frag->path != NULL ) :
+			     ( ! *remaining ) )
+				continue;
+			lba = ( frag->count ? frag->lba : params->rw.lba );
+			sanpath = sandev_select_path ( sandev, params, lba );
+			if ( ! sanpath )
+				break;
+			progress = 1;
+
+			/* Allocate next fragment, unless reissuing */
+			if ( ! frag->count ) {
+				frag->lba = params->rw.lba;
+				frag->count = sandev_fragment_count ( sandev,
+								      frag->lba,
+								      *remaining );
+				frag->buffer = params->rw.buffer;
+				frag_len = ( sandev->capacity.blksize *
+					     frag->count );
+				params->rw.buffer =
+					userptr_add ( params->rw.buffer,
+						      frag_len );
+				params->rw.lba += frag->count;
+				*remaining -= frag->count;
+			}
+
+			/* Issue fragment */
+			sanfrag_issue ( frag, sanpath, params );
+		}
+
+		/* Retire completed fragments */
+		outstanding = 0;
+		pending = 0;
+		for ( i = 0 ; i < SAN_MAX_OUTSTANDING ; i++ ) {
+			frag = &sandev->frag[i];
+			if ( ! frag->count )
+				continue;
+			if ( ! frag->path ) {
+				pending++;
+			} else if ( frag->rc == -EINPROGRESS ) {
+				outstanding++;
+			} else if ( frag->rc == 0 ) {
+				frag->count = 0;
+				frag->path = NULL;
+				polls = 0;
+				progress = 1;
+			} else if ( ( ! failed ) &&
+				    sanpath_failover ( frag->path, frag->rc ) ) {
+				frag->path = NULL;
+				pending++;
+				progress = 1;
+			} else {
+				failed = 1;
+			}
+		}
+
+		/* Stop when nothing remains in flight */
+		if ( ! outstanding ) {
+			if ( failed || ( ! ( *remaining || pending ) ) )
+				break;
+			if ( ! progress ) {
+				/* No path can accept remaining fragments */
+				failed = 1;
+				break;
+			}
+			continue;
+		}
+
+		/* Wait for progress, polling the device directly for a
+		 * short while before falling back to the full process
+		 * scheduler.
+		 */
+		if ( ( polls < SAN_POLL_USECS ) && sandev_poll ( sandev ) ) {
+			polls++;
+			udelay ( 1 );
+			continue;
+		}
+		if ( ! timer_running ( &sandev->timer ) )
+			start_timer_fixed ( &sandev->timer, SAN_COMMAND_TIMEOUT );
+		step();
+	}
+	stop_timer ( &sandev->timer );
+
+	/* Retry any failed fragments individually */
+	retry.rw = params->rw;
+	for ( i = 0 ; i < SAN_MAX_OUTSTANDING ; i++ ) {
+		frag = &sandev->frag[i];
+		if ( ! frag->count )
+			continue;
+		retry.rw.lba = frag->lba;
+		retry.rw.count = frag->count;
+		retry.rw.buffer = frag->buffer;
+		frag->count = 0;
+		frag->path = NULL;
+		if ( ( rc = sandev_command ( sandev, sandev_command_rw,
+					     &retry ) ) != 0 ) {
+			for ( ; i < SAN_MAX_OUTSTANDING ; i++ ) {
+				sandev->frag[i].count = 0;
+				sandev->frag[i].path = NULL;
+			}
+			return rc;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Read from or write to SAN device via a specified path
+ *
+ * @v sandev		SAN device
+ * @v sanpath		SAN path, or NULL to select automatically
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @v block_rw		Block read/write method
+ * @ret rc		Return status code
+ */
+static int sandev_rw_path ( struct san_device *sandev,
+			    struct san_path *sanpath, uint64_t lba,
+			    unsigned int count, userptr_t buffer,
+			    int ( * block_rw ) ( struct interface *control,
+						 struct interface *data,
+						 uint64_t lba,
+						 unsigned int count,
+						 userptr_t buffer,
+						 size_t len ) ) {
+	union san_command_params params;
+	unsigned int remaining;
+	size_t frag_len;
+	int rc;
+
+	/* Initialise command parameters */
+	params.rw.block_rw = block_rw;
+	params.rw.buffer = buffer;
+	params.rw.lba = lba;
+	params.rw.path = sanpath;
+	remaining = count;
+
+	/* Read/write fragments */
+	while ( remaining ) {
+
+		/* Determine fragment length */
+		params.rw.count = sandev_fragment_count ( sandev, params.rw.lba,
+							  remaining );
+
+		/* Hand over to pipelined transfer if applicable (i.e.
+		 * if the device accepts multiple outstanding transfers
+		 * or multiple paths are available).  The first fragment
+		 * is always executed individually if the device needs
+		 * to be reopened.
+		 */
+		if ( ( ( sandev->capacity.max_outstanding > 1 ) ||
+		       ( ( sandev_ready_paths ( sandev ) > 1 ) &&
+			 ( ! sanpath ) ) ) &&
+		     ( params.rw.count < remaining ) &&
+		     ( ! sandev_needs_reopen ( sandev ) ) ) {
+			if ( ( rc = sandev_rw_pipeline ( sandev, &params,
+							 &remaining ) ) != 0 )
+				return rc;
+			continue;
+		}
+
+		/* Execute command */
+		if ( ( rc = sandev_command ( sandev, sandev_command_rw,
+					     &params ) ) != 0 )
+			return rc;
+
+		/* Move to next fragment */
+		frag_len = ( sandev->capacity.blksize * params.rw.count );
+		params.rw.buffer = userptr_add ( params.rw.buffer, frag_len );
+		params.rw.lba += params.rw.count;
+		remaining -= params.rw.count;
+	}
+
+	return 0;
+}
+
+/**
+ * Discard cached data that a write would make stale
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ */
+static void sandev_invalidate ( struct san_device *sandev, uint64_t lba,
+				unsigned int count ) {
+
+	/* Record write */
+	sandev->writes++;
+
+	/* Discard probe buffer if it would become stale */
+	if ( sandev->probe &&
+	     ( ( lba << sandev->blksize_shift ) < sandev->probe_count ) ) {
+		free ( sandev->probe );
+		sandev->probe = NULL;
+		sandev->probe_count = 0;
+	}
+
+	/* Discard cached partition table if it would become stale */
+	if ( sandev->partitions &&
+	     ( ( lba < sandev->partitions->first_usable ) ||
+	       ( ( lba + count ) > ( sandev->partitions->last_usable + 1 ) ) ) )
+		sanpart_discard ( sandev );
+}
+
+static int sandev_rw ( struct san_device *sandev, uint64_t lba,
+		       unsigned int count, userptr_t buffer,
+		       int ( * block_rw ) ( struct interface *control,
+					    struct interface *data,
+					    uint64_t lba, unsigned int count,
+					    userptr_t buffer, size_t len ) );
+
+/**
+ * Read from or write to SAN device partition slice
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @v buffer		Data buffer
+ * @v block_rw		Block read/write method
+ * @ret rc		Return status code
+ */
+static int sandev_rw_slice ( struct san_device *sandev, uint64_t lba,
+			     unsigned int count, userptr_t buffer,
+			     int ( * block_rw ) ( struct interface *control,
+						  struct interface *data,
+						  uint64_t lba,
+						  unsigned int count,
+						  userptr_t buffer,
+						  size_t len ) ) {
+	struct san_device *parent = sandev->parent;
+	uint64_t blocks = sandev->capacity.blocks;
+	uint64_t start = ( lba << sandev->blksize_shift );
+	unsigned int len = ( count << sandev->blksize_shift );
+
+	/* Sanity check */
+	assert ( parent->blksize_shift == 0 );
+
+	/* Check that range lies within slice */
+	if ( ( start > blocks ) || ( len > ( blocks - start ) ) ) {
+		DBGC ( sandev, "SAN %#02x access [%#llx,%#llx) out of range "
+		       "[0,%#llx)\n", sandev->drive, start, ( start + len ),
+		       blocks );
+		return -ERANGE;
+	}
+
+	/* Translate to parent device */
+	start += sandev->start;
+	if ( block_rw == block_write )
+		sandev_invalidate ( parent, start, len );
+	return sandev_rw ( parent, start, len, buffer, block_rw );
+}
+
+/**
+ * Read from or write to SAN device without encryption or verification
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @v block_rw		Block read/write method
+ * @ret rc		Return status code
+ *
+ * This is intended for use only by the encryption layer.
+ */
+int sandev_rw_raw ( struct san_device *sandev, uint64_t lba,
+		    unsigned int count, userptr_t buffer,
+		    int ( * block_rw ) ( struct interface *control,
+					 struct interface *data,
+					 uint64_t lba, unsigned int count,
+					 userptr_t buffer, size_t len ) ) {
+	struct san_path *sanpath;
+	unsigned int written = 0;
+	unsigned int i;
+	int rc;
+
+	/* Sanity check */
+	assert ( sandev->parent == NULL );
+
+	/* Reads, and writes to anything other than a mirror, may use
+	 * any (or the required) path.
+	 */
+	if ( ! ( ( sandev->flags & SAN_RAID1 ) && ( block_rw == block_write ) ))
+		return sandev_rw_path ( sandev, NULL, lba, count, buffer,
+					block_rw );
+
+	/* Reopen device if applicable */
+	if ( sandev_needs_reopen ( sandev ) &&
+	     ( ( rc = sandev_reopen ( sandev ) ) != 0 ) )
+		return rc;
+
+	/* Write to each available mirror member in turn.  A member
+	 * that fails is dropped from the mirror; the write fails only
+	 * if no member could be written.
+	 */
+	rc = -ENOTCONN;
+	for ( i = 0 ; i < sandev->paths ; i++ ) {
+		sanpath = &sandev->path[i];
+		if ( ! sanpath_is_ready ( sanpath ) )
+			continue;
+		if ( ( rc = sandev_rw_path ( sandev, sanpath, lba, count,
+					     buffer, block_rw ) ) != 0 ) {
+			DBGC ( sandev, "SAN %#02x.%d mirror write failed: %s\n",
+			       sandev->drive, sanpath->index, strerror ( rc ) );
+			if ( sanpath_is_ready ( sanpath ) &&
+			     ( sandev_ready_paths ( sandev ) > 1 ) )
+				sanpath_close ( sanpath, rc );
+			continue;
+		}
+		written++;
+	}
+
+	return ( written ? 0 : rc );
+}
+
+/**
+ * Read from or write to SAN device
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @v buffer		Data buffer
+ * @v block_rw		Block read/write method
+ * @ret rc		Return status code
+ */
+static int sandev_rw ( struct san_device *sandev, uint64_t lba,
+		       unsigned int count, userptr_t buffer,
+		       int ( * block_rw ) ( struct interface *control,
+					    struct interface *data,
+					    uint64_t lba, unsigned int count,
+					    userptr_t buffer, size_t len ) ) {
+
+	/* Pass partition slice accesses to parent device */
+	if ( sandev->parent )
+		return sandev_rw_slice ( sandev, lba, count, buffer, block_rw );
+
+	/* Translate to underlying blocks */
+	lba <<= sandev->blksize_shift;
+	count <<= sandev->blksize_shift;
+
+	/* Verify reads from a verified device.  Writes are refused
+	 * by sandev_write() before reaching this point.
+	 */
+	if ( sandev->verity ) {
+		assert ( block_rw == block_read );
+		return sanverity_read ( sandev, lba, count, buffer );
+	}
+
+	/* Decrypt reads from and encrypt writes to an encrypted device */
+	if ( sandev->crypt )
+		return sancrypt_rw ( sandev, lba, count, buffer, block_rw );
+
+	return sandev_rw_raw ( sandev, lba, count, buffer, block_rw );
+}
+
+/**
+ * Read from SAN device without verification
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ *
+ * This bypasses both the probe buffer and any hash tree verification,
+ * and is intended for use only by the hash tree verification layer.
+ * Reads from an encrypted device are still decrypted.
+ */
+int sandev_read_unverified ( struct san_device *sandev, uint64_t lba,
+			     unsigned int count, userptr_t buffer ) {
+
+	/* Sanity check */
+	assert ( sandev->parent == NULL );
+
+	/* Decrypt reads from an encrypted device */
+	if ( sandev->crypt )
+		return sancrypt_rw ( sandev, lba, count, buffer, block_read );
+
+	return sandev_rw_raw ( sandev, lba, count, buffer, block_read );
+}
+
+/**
+ * Get probed data from SAN device
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @ret data		Probed data, or NULL if not held in probe buffer
+ */
+const void * sandev_probed ( struct san_device *sandev, uint64_t lba,
+			     unsigned int count ) {
+	uint64_t start = ( lba << sandev->blksize_shift );
+	unsigned int len = ( count << sandev->blksize_shift );
+
+	/* Use parent's probe buffer for a partition slice, so that a
+	 * write via the parent cannot leave stale data in the slice.
+	 */
+	if ( sandev->parent ) {
+		if ( ( start > sandev->capacity.blocks ) ||
+		     ( len > ( sandev->capacity.blocks - start ) ) )
+			return NULL;
+		start += sandev->start;
+		sandev = sandev->parent;
+	}
+
+	/* Check that range is held in probe buffer */
+	if ( ( ! sandev->probe ) || ( start > sandev->probe_count ) ||
+	     ( len > ( sandev->probe_count - start ) ) )
+		return NULL;
+
+	return ( sandev->probe + ( start * sandev->capacity.blksize ) );
+}
+
+/**
+ * Read from SAN device
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ */
+int sandev_read ( struct san_device *sandev, uint64_t lba,
+		  unsigned int count, userptr_t buffer ) {
+	const void *data;
+	int rc;
+
+	/* Satisfy from probe buffer, if possible */
+	if ( ( data = sandev_probed ( sandev, lba, count ) ) != NULL ) {
+		copy_to_user ( buffer, 0, data,
+			       ( count * sandev_blksize ( sandev ) ) );
+		return 0;
+	}
+
+	/* Read from device */
+	if ( ( rc = sandev_rw ( sandev, lba, count, buffer, block_read ) ) != 0 )
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Write to SAN device
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ */
+int sandev_write ( struct san_device *sandev, uint64_t lba,
+		   unsigned int count, userptr_t buffer ) {
+	struct san_device *root =
+		( sandev->parent ? sandev->parent : sandev );
+	int rc;
+
+	/* Refuse writes to a verified device (or to a slice of one) */
+	if ( root->verity ) {
+		DBGC ( sandev, "SAN %#02x is read-only\n", sandev->drive );
+		return -EROFS;
+	}
+
+	/* Discard any cached data that would become stale */
+	sandev_invalidate ( sandev, lba, count );
+
+	/* Write to device */
+	if ( ( rc = sandev_rw ( sandev, lba, count, buffer, block_write ) ) != 0 )
+		return rc;
+
+	/* Quiesce system.  This is a heuristic designed to ensure
+	 * that the system is quiesced before Windows starts up, since
+	 * a Windows SAN boot will typically write a status flag to
+	 * the disk as its last action before transferring control to
+	 * the native drivers.
+	 */
+	quiesce();
+
+	return 0;
+}
+
+/**
+ * Attach hash tree (when verification support is not present)
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ */
+__weak int sanverity_attach ( struct san_device *sandev __unused ) {
+
+	return -ENOTSUP;
+}
+
+/**
+ * Read from verified SAN device (when verification support is not present)
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ */
+__weak int sanverity_read ( struct san_device *sandev __unused,
+			    uint64_t lba __unused, unsigned int count __unused,
+			    userptr_t buffer __unused ) {
+
+	return -ENOTSUP;
+}
+
+/**
+ * Discard hash tree (when verification support is not present)
+ *
+ * @v sandev		SAN device
+ */
+__weak void sanverity_discard ( struct san_device *sandev __unused ) {
+
+	/* Nothing to do */
+}
+
+/**
+ * Attach encryption (when encryption support is not present)
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ */
+__weak int sancrypt_attach ( struct san_device *sandev __unused ) {
+
+	return -ENOTSUP;
+}
+
+/**
+ * Read from or write to encrypted SAN device (when encryption support
+ * is not present)
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @v block_rw		Block read/write method
+ * @ret rc		Return status code
+ */
+__weak int sancrypt_rw ( struct san_device *sandev __unused,
+			 uint64_t lba __unused, unsigned int count __unused,
+			 userptr_t buffer __unused,
+			 int ( * block_rw ) ( struct interface *control,
+					      struct interface *data,
+					      uint64_t lba, unsigned int count,
+					      userptr_t buffer,
+					      size_t len ) __unused ) {
+
+	return -ENOTSUP;
+}
+
+/**
+ * Discard encryption (when encryption support is not present)
+ *
+ * @v sandev		SAN device
+ */
+__weak void sancrypt_discard ( struct san_device *sandev __unused ) {
+
+	/* Nothing to do */
+}
+
+/**
+ * Describe SAN device
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ *
+ * Allow connections to progress until all existent path descriptors
+ * are complete.
  */
 static int sandev_describe ( struct san_device *sandev ) {
 	struct san_path *sanpath;
@@ -738,6 +1776,60 @@ static void sandev_undescribe ( struct san_device *sandev ) {
 	}
 }
 
+/**
+ * Read initial blocks of SAN device into probe buffer
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ *
+ * Drive registration needs to inspect several structures near the
+ * start of the device (the partition table, the ISO9660 primary
+ * volume descriptor and the El Torito boot record).  Fetch all of
+ * these with a single read, and retain the data so that subsequent
+ * reads of the same blocks do not need to go to the device.
+ */
+static __init int sandev_probe ( struct san_device *sandev ) {
+	size_t blksize = sandev->capacity.blksize;
+	unsigned int count;
+	void *probe;
+	int rc;
+
+	/* Sanity check */
+	assert ( sandev->blksize_shift == 0 );
+	assert ( sandev->probe == NULL );
+
+	/* Calculate probe length */
+	count = ( SAN_PROBE_LEN / blksize );
+	if ( ! count )
+		count = 1;
+	if ( count > sandev->capacity.blocks )
+		count = sandev->capacity.blocks;
+	if ( ! count )
+		return 0;
+
+	/* Allocate probe buffer */
+	probe = malloc ( count * blksize );
+	if ( ! probe )
+		return -ENOMEM;
+
+	/* Read initial blocks */
+	if ( ( rc = sandev_rw ( sandev, 0, count, virt_to_user ( probe ),
+				block_read ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not read initial blocks: %s\n",
+		       sandev->drive, strerror ( rc ) );
+		free ( probe );
+		return rc;
+	}
+
+	/* Record probe buffer */
+	sandev->probe = probe;
+	sandev->probe_count = count;
+	DBGC ( sandev, "SAN %#02x probed initial %d blocks\n",
+	       sandev->drive, count );
+
+	return 0;
+}
+
 /**
  * Configure SAN device as a CD-ROM, if applicable
  *
@@ -757,15 +1849,11 @@ static int sandev_parse_iso9660 ( struct san_device *sandev ) {
 		.type = ISO9660_TYPE_PRIMARY,
 		.id = ISO9660_ID,
 	};
-	union {
-		struct iso9660_primary_descriptor primary;
-		char bytes[ISO9660_BLKSIZE];
-	} *scratch;
+	const struct iso9660_primary_descriptor *primary;
 	unsigned int blksize;
 	unsigned int blksize_shift;
 	unsigned int lba;
 	unsigned int count;
-	int rc;
 
 	/* Calculate required blocksize shift for potential CD-ROM access */
 	blksize = sandev->capacity.blksize;
@@ -776,30 +1864,20 @@ static int sandev_parse_iso9660 ( struct san_device *sandev ) {
 	}
 	if ( blksize > ISO9660_BLKSIZE ) {
 		/* Cannot be a CD-ROM.  This is not an error. */
-		rc = 0;
-		goto invalid_blksize;
+		return 0;
 	}
 	lba = ( ISO9660_PRIMARY_LBA << blksize_shift );
 	count = ( 1 << blksize_shift );
 
-	/* Allocate scratch area */
-	scratch = malloc ( ISO9660_BLKSIZE );
-	if ( ! scratch ) {
-		rc = -ENOMEM;
-		goto err_alloc;
-	}
-
-	/* Read primary volume descriptor */
-	if ( ( rc = sandev_read ( sandev, lba, count,
-				  virt_to_user ( scratch ) ) ) != 0 ) {
-		DBGC ( sandev, "SAN %#02x could not read ISO9660 primary"
-		       "volume descriptor: %s\n",
-		       sandev->drive, strerror ( rc ) );
-		goto err_rw;
+	/* Locate primary volume descriptor within probe buffer */
+	primary = sandev_probed ( sandev, lba, count );
+	if ( ! primary ) {
+		/* Too small to be a CD-ROM.  This is not an error. */
+		return 0;
 	}
 
 	/* Configure as CD-ROM if applicable */
-	if ( memcmp ( &scratch->primary.fixed, &primary_check,
+	if ( memcmp ( &primary->fixed, &primary_check,
 		      sizeof ( primary_check ) ) == 0 ) {
 		DBGC ( sandev, "SAN %#02x contains an ISO9660 filesystem; "
 		       "treating as CD-ROM\n", sandev->drive );
@@ -807,11 +1885,61 @@ static int sandev_parse_iso9660 ( struct san_device *sandev ) {
 		sandev->is_cdrom = 1;
 	}
 
- err_rw:
-	free ( scratch );
- err_alloc:
- invalid_blksize:
-	return rc;
+	return 0;
+}
+
+/**
+ * Configure SAN device
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ */
+static int sandev_configure ( struct san_device *sandev ) {
+	uint64_t blocks;
+	int rc;
+
+	/* Read device capacity, or inherit capacity of parent device
+	 * (retaining the slice's own block count) for a partition
+	 * slice.
+	 */
+	if ( sandev->parent ) {
+		blocks = sandev->capacity.blocks;
+		memcpy ( &sandev->capacity, &sandev->parent->capacity,
+			 sizeof ( sandev->capacity ) );
+		sandev->capacity.blocks = blocks;
+	} else if ( ( rc = sandev_command ( sandev,
+					    sandev_command_read_capacity,
+					    NULL ) ) != 0 ) {
+		return rc;
+	}
+
+	/* Attach encryption, if applicable.  This must precede the
+	 * hash tree, which is stored within the encrypted device.
+	 */
+	if ( ( sandev->flags & SAN_DECRYPT ) && ( ! sandev->parent ) &&
+	     ( ( rc = sancrypt_attach ( sandev ) ) != 0 ) )
+		return rc;
+
+	/* Attach hash tree, if applicable.  This limits the capacity
+	 * to the verified data area, and must precede the probe so
+	 * that the probe buffer holds only verified data.
+	 */
+	if ( ( sandev->flags & SAN_VERIFY ) && ( ! sandev->parent ) &&
+	     ( ( rc = sanverity_attach ( sandev ) ) != 0 ) )
+		return rc;
+
+	/* Read initial blocks.  A partition slice uses its parent's
+	 * probe buffer.
+	 */
+	if ( ( ! sandev->parent ) &&
+	     ( ( rc = sandev_probe ( sandev ) ) != 0 ) )
+		return rc;
+
+	/* Configure as a CD-ROM, if applicable */
+	if ( ( rc = sandev_parse_iso9660 ( sandev ) ) != 0 )
+		return rc;
+
+	return 0;
 }
 
 /**
@@ -822,8 +1950,9 @@ static int sandev_parse_iso9660 ( struct san_device *sandev ) {
  * @v priv_size		Size of private data
  * @ret sandev		SAN device, or NULL
  */
-struct san_device * alloc_sandev ( struct uri **uris, unsigned int count,
-				   size_t priv_size ) {
+__init struct san_device * alloc_sandev ( struct uri **uris,
+					  unsigned int count,
+					  size_t priv_size ) {
 	struct san_device *sandev;
 	struct san_path *sanpath;
 	size_t size;
@@ -842,6 +1971,11 @@ struct san_device * alloc_sandev ( struct uri **uris, unsigned int count,
 	sandev->paths = count;
 	INIT_LIST_HEAD ( &sandev->opened );
 	INIT_LIST_HEAD ( &sandev->closed );
+	for ( i = 0 ; i < SAN_MAX_OUTSTANDING ; i++ ) {
+		sandev->frag[i].sandev = sandev;
+		intf_init ( &sandev->frag[i].block, &sanfrag_block_desc,
+			    &sandev->refcnt );
+	}
 	for ( i = 0 ; i < count ; i++ ) {
 		sanpath = &sandev->path[i];
 		sanpath->sandev = sandev;
@@ -858,6 +1992,37 @@ struct san_device * alloc_sandev ( struct uri **uris, unsigned int count,
 	return sandev;
 }
 
+/**
+ * Allocate SAN device partition slice
+ *
+ * @v parent		Parent SAN device
+ * @v lba		Starting logical block address within parent
+ * @v count		Number of logical blocks
+ * @v priv_size		Size of private data
+ * @ret sandev		SAN device, or NULL
+ *
+ * The slice may then be registered using register_sandev() in the
+ * same way as any other SAN device.
+ */
+__init struct san_device * alloc_sandev_slice ( struct san_device *parent,
+						uint64_t lba, uint64_t count,
+						size_t priv_size ) {
+	struct san_device *sandev;
+
+	/* Sanity check */
+	assert ( parent->blksize_shift == 0 );
+
+	/* Allocate SAN device with no paths of its own */
+	sandev = alloc_sandev ( NULL, 0, priv_size );
+	if ( ! sandev )
+		return NULL;
+	sandev->parent = sandev_get ( parent );
+	sandev->start = lba;
+	sandev->capacity.blocks = count;
+
+	return sandev;
+}
+
 /**
  * Register SAN device
  *
@@ -866,8 +2031,8 @@ struct san_device * alloc_sandev ( struct uri **uris, unsigned int count,
  * @v flags		Flags
  * @ret rc		Return status code
  */
-int register_sandev ( struct san_device *sandev, unsigned int drive,
-		      unsigned int flags ) {
+__init int register_sandev ( struct san_device *sandev, unsigned int drive,
+			     unsigned int flags ) {
 	int rc;
 
 	/* Check that drive number is not in use */
@@ -894,18 +2059,9 @@ int register_sandev ( struct san_device *sandev, unsigned int drive,
 	if ( ( rc = sandev_describe ( sandev ) ) != 0 )
 		goto err_describe;
 
-    DBGC ( sandev, "Read device capacity\n" );
-
-	/* Read device capacity */
-	if ( ( rc = sandev_command ( sandev, sandev_command_read_capacity,
-				     NULL ) ) != 0 )
-		goto err_capacity;
-
-    DBGC ( sandev, "Configure as a CD-ROM, if applicable\n" );
-
-	/* Configure as a CD-ROM, if applicable */
-	if ( ( rc = sandev_parse_iso9660 ( sandev ) ) != 0 )
-		goto err_iso9660;
+	/* Configure device */
+	if ( ( rc = sandev_configure ( sandev ) ) != 0 )
+		goto err_configure;
 
     DBGC ( sandev, "Add to list of SAN devices\n" );
 
@@ -916,10 +2072,8 @@ int register_sandev ( struct san_device *sandev, unsigned int drive,
 	return 0;
 
 	list_del ( &sandev->list );
- err_iso9660:
-    DBGC ( sandev, " err_iso9660\n" );
- err_capacity:
-    DBGC ( sandev, " err_capacity\n" );
+ err_configure:
+    DBGC ( sandev, " err_configure\n" );
  err_describe:
     DBGC ( sandev, " err_describe\n" );
  err_reopen:
@@ -952,6 +2106,54 @@ void unregister_sandev ( struct san_device *sandev ) {
 	DBGC ( sandev, "SAN %#02x unregistered\n", sandev->drive );
 }
 
+/**
+ * Open SAN device for private use
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ *
+ * The device is opened and configured exactly as for registration,
+ * but is not assigned a drive number, is not described via ACPI, and
+ * is not added to the list of SAN devices.  This allows the device to
+ * be read by iPXE itself (e.g. to load files from a filesystem on the
+ * device) without being exposed to the booted operating system.
+ */
+int open_sandev ( struct san_device *sandev ) {
+	int rc;
+
+	/* Open device */
+	if ( ( rc = sandev_reopen ( sandev ) ) != 0 )
+		goto err_reopen;
+
+	/* Configure device */
+	if ( ( rc = sandev_configure ( sandev ) ) != 0 )
+		goto err_configure;
+
+	DBGC ( sandev, "SAN %p opened for private use\n", sandev );
+	return 0;
+
+ err_configure:
+	sandev_restart ( sandev, rc );
+ err_reopen:
+	return rc;
+}
+
+/**
+ * Close SAN device opened for private use
+ *
+ * @v sandev		SAN device
+ */
+void close_sandev ( struct san_device *sandev ) {
+
+	/* Sanity check */
+	assert ( ! timer_running ( &sandev->timer ) );
+
+	/* Shut down interfaces */
+	sandev_restart ( sandev, 0 );
+
+	DBGC ( sandev, "SAN %p closed\n", sandev );
+}
+
 /** The "san-drive" setting */
 const struct setting san_drive_setting __setting ( SETTING_SANBOOT_EXTRA,
 						   san-drive ) = {
@@ -0,0 +1,256 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * SAN device encryption
+ *
+ * An encrypted SAN device is encrypted in its entirety as for
+ * dm-crypt's "aes-xts-plain64" cipher: each sector is encrypted
+ * independently using AES-XTS, with an initialisation vector
+ * comprising the little-endian sector number.
+ *
+ * Reads are transferred directly into the caller's buffer and are
+ * then decrypted in place in a single pass once the whole transfer
+ * has completed, so that the device sees exactly the same requests as
+ * for an unencrypted device.  Writes are encrypted into a bounce
+ * buffer, so that the caller's buffer is left untouched.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <byteswap.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/crypto.h>
+#include <ipxe/aes.h>
+#include <ipxe/base16.h>
+#include <ipxe/blockdev.h>
+#include <ipxe/sanboot.h>
+#include <ipxe/sancrypt.h>
+#include <config/sanboot.h>
+
+/* Disambiguate the various error causes */
+#define EINVAL_KEY __einfo_error ( EINFO_EINVAL_KEY )
+#define EINFO_EINVAL_KEY \
+	__einfo_uniqify ( EINFO_EINVAL, 0x01, \
+			  "Invalid key" )
+#define ENOTSUP_SECTOR __einfo_error ( EINFO_ENOTSUP_SECTOR )
+#define EINFO_ENOTSUP_SECTOR \
+	__einfo_uniqify ( EINFO_ENOTSUP, 0x01, \
+			  "Unsupported sector size" )
+
+/**
+ * Encrypt or decrypt underlying blocks in place
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v data		Data
+ * @v encrypt		Encrypt (rather than decrypt) data
+ */
+static void sancrypt_blocks ( struct san_device *sandev, uint64_t lba,
+			      unsigned int count, void *data, int encrypt ) {
+	struct san_crypt *crypt = sandev->crypt;
+	struct cipher_algorithm *cipher = crypt->cipher;
+	uint64_t sector = ( lba << crypt->sector_shift );
+	unsigned long sectors = ( ( ( unsigned long ) count ) <<
+				  crypt->sector_shift );
+	struct san_crypt_iv iv;
+
+	/* Process each sector with its own initialisation vector */
+	memset ( &iv, 0, sizeof ( iv ) );
+	while ( sectors-- ) {
+		iv.sector = cpu_to_le64 ( sector );
+		cipher_setiv ( cipher, crypt->ctx, &iv, sizeof ( iv ) );
+		if ( encrypt ) {
+			cipher_encrypt ( cipher, crypt->ctx, data, data,
+					 crypt->sector_len );
+		} else {
+			cipher_decrypt ( cipher, crypt->ctx, data, data,
+					 crypt->sector_len );
+		}
+		data += crypt->sector_len;
+		sector++;
+	}
+}
+
+/**
+ * Read from or write to encrypted SAN device
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @v block_rw		Block read/write method
+ * @ret rc		Return status code
+ */
+int sancrypt_rw ( struct san_device *sandev, uint64_t lba,
+		  unsigned int count, userptr_t buffer,
+		  int ( * block_rw ) ( struct interface *control,
+				       struct interface *data,
+				       uint64_t lba, unsigned int count,
+				       userptr_t buffer, size_t len ) ) {
+	struct san_crypt *crypt = sandev->crypt;
+	size_t blksize = sandev->capacity.blksize;
+	unsigned int frag;
+	int rc;
+
+	/* Read and then decrypt in place */
+	if ( block_rw == block_read ) {
+		if ( ( rc = sandev_rw_raw ( sandev, lba, count, buffer,
+					    block_rw ) ) != 0 )
+			return rc;
+		sancrypt_blocks ( sandev, lba, count,
+				  user_to_virt ( buffer, 0 ), 0 );
+		return 0;
+	}
+
+	/* Encrypt via bounce buffer and then write */
+	while ( count ) {
+
+		/* Encrypt fragment */
+		frag = count;
+		if ( frag > crypt->bounce_count )
+			frag = crypt->bounce_count;
+		copy_from_user ( crypt->bounce, buffer, 0, ( frag * blksize ) );
+		sancrypt_blocks ( sandev, lba, frag, crypt->bounce, 1 );
+
+		/* Write fragment */
+		if ( ( rc = sandev_rw_raw ( sandev, lba, frag,
+					    virt_to_user ( crypt->bounce ),
+					    block_rw ) ) != 0 )
+			return rc;
+
+		/* Move to next fragment */
+		buffer = userptr_add ( buffer, ( frag * blksize ) );
+		lba += frag;
+		count -= frag;
+	}
+
+	return 0;
+}
+
+/**
+ * Attach encryption to SAN device
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ */
+int sancrypt_attach ( struct san_device *sandev ) {
+	struct cipher_algorithm *cipher = &aes_xts_algorithm;
+	size_t blksize = sandev->capacity.blksize;
+	struct san_crypt *crypt;
+	uint8_t key[SAN_CRYPT_MAX_KEY];
+	int len;
+	int rc;
+
+	/* Sanity check */
+	assert ( sandev->parent == NULL );
+	assert ( sandev->crypt == NULL );
+
+	/* Allocate and initialise structure */
+	crypt = zalloc ( sizeof ( *crypt ) + cipher->ctxsize );
+	if ( ! crypt ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	sandev->crypt = crypt;
+	crypt->cipher = cipher;
+	crypt->ctx = ( ( ( void * ) crypt ) + sizeof ( *crypt ) );
+	crypt->sector_len = SAN_CRYPT_SECTOR_SIZE;
+
+	/* Check that sector size is a power-of-two fraction of the
+	 * underlying block size, and a whole number of cipher blocks.
+	 */
+	for ( crypt->sector_shift = 0 ;
+	      ( crypt->sector_len << crypt->sector_shift ) < blksize ;
+	      crypt->sector_shift++ ) {}
+	if ( ( ( crypt->sector_len << crypt->sector_shift ) != blksize ) ||
+	     ( crypt->sector_len % cipher->blocksize ) ) {
+		DBGC ( sandev, "SAN %#02x cannot decrypt %zd-byte sectors "
+		       "with %zd-byte underlying blocks\n", sandev->drive,
+		       crypt->sector_len, blksize );
+		rc = -ENOTSUP_SECTOR;
+		goto err_sector;
+	}
+
+	/* Parse and set key */
+	len = base16_decode ( SAN_CRYPT_KEY, key, sizeof ( key ) );
+	if ( ( len < 0 ) || ( len > ( ( int ) sizeof ( key ) ) ) ) {
+		DBGC ( sandev, "SAN %#02x invalid encryption key\n",
+		       sandev->drive );
+		rc = -EINVAL_KEY;
+		goto err_key;
+	}
+	if ( ( rc = cipher_setkey ( cipher, crypt->ctx, key, len ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not set %d-byte %s key: %s\n",
+		       sandev->drive, len, cipher->name, strerror ( rc ) );
+		goto err_setkey;
+	}
+
+	/* Allocate bounce buffer */
+	crypt->bounce_count = SAN_CRYPT_WRITE_BLOCKS;
+	crypt->bounce = malloc ( crypt->bounce_count * blksize );
+	if ( ! crypt->bounce ) {
+		rc = -ENOMEM;
+		goto err_alloc_bounce;
+	}
+
+	DBGC ( sandev, "SAN %#02x using %s with %zd-byte sectors\n",
+	       sandev->drive, cipher->name, crypt->sector_len );
+	memset ( key, 0, sizeof ( key ) );
+	return 0;
+
+ err_alloc_bounce:
+ err_setkey:
+ err_key:
+	memset ( key, 0, sizeof ( key ) );
+ err_sector:
+	/* Also frees any partially constructed encryption */
+	sancrypt_discard ( sandev );
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Discard SAN device encryption
+ *
+ * @v sandev		SAN device
+ */
+void sancrypt_discard ( struct san_device *sandev ) {
+	struct san_crypt *crypt = sandev->crypt;
+
+	/* Do nothing unless encryption is attached */
+	if ( ! crypt )
+		return;
+
+	/* Free encryption, clearing the key schedule */
+	free ( crypt->bounce );
+	memset ( crypt->ctx, 0, crypt->cipher->ctxsize );
+	free ( crypt );
+	sandev->crypt = NULL;
+}
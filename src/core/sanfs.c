@@ -0,0 +1,814 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * SAN device filesystems
+ *
+ * Files are loaded directly from a filesystem on a SAN device, using
+ * a URI such as "nvme://0/boot/vmlinuz".  The filesystem driver
+ * resolves the path to a list of extents on the device, and the file
+ * contents are then read via the SAN device's (pipelined) block read
+ * path without any further filesystem metadata accesses.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <assert.h>
+#include <ipxe/refcnt.h>
+#include <ipxe/xfer.h>
+#include <ipxe/open.h>
+#include <ipxe/iobuf.h>
+#include <ipxe/process.h>
+#include <ipxe/xferbuf.h>
+#include <ipxe/job.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/sanboot.h>
+#include <ipxe/sanpart.h>
+#include <ipxe/sanfs.h>
+#include <ipxe/inflate.h>
+#include <config/general.h>
+
+/** Download fragment length (when delivering via I/O buffers) */
+#define SANFS_FRAG_LEN 65536
+
+/** Download fragment length (when reading directly into receive buffer) */
+#define SANFS_DIRECT_LEN ( 4 * 1024 * 1024 )
+
+/** A SAN filesystem download */
+struct sanfs_download {
+	/** Reference count */
+	struct refcnt refcnt;
+	/** Data transfer interface */
+	struct interface xfer;
+	/** Download process */
+	struct process process;
+
+	/** SAN device */
+	struct san_device *sandev;
+	/** SAN device was opened privately */
+	int private;
+	/** File */
+	struct sanfs_file file;
+	/** Receive buffer has been presized */
+	int presized;
+	/** Current extent index */
+	unsigned int index;
+	/** Offset within current extent */
+	size_t offset;
+	/** Length of file read so far */
+	size_t pos;
+};
+
+/**
+ * Calculate SAN device block size shift
+ *
+ * @v sandev		SAN device
+ * @ret shift		Block size shift, or negative error
+ */
+static int sanfs_blksize_shift ( struct san_device *sandev ) {
+	size_t blksize = sandev_blksize ( sandev );
+
+	/* Block size must be a power of two */
+	if ( ( blksize == 0 ) || ( blksize & ( blksize - 1 ) ) )
+		return -ENOTSUP;
+
+	return ( fls ( blksize ) - 1 );
+}
+
+/**
+ * Read byte range from SAN device
+ *
+ * @v sandev		SAN device
+ * @v offset		Starting byte offset on device
+ * @v buffer		Data buffer
+ * @v len		Length to read
+ * @ret rc		Return status code
+ *
+ * Whole blocks are read directly into the data buffer.  Any partial
+ * blocks at the start or end of the range are read via a bounce
+ * buffer.
+ */
+static int sanfs_read_dev ( struct san_device *sandev, uint64_t offset,
+			    userptr_t buffer, size_t len ) {
+	size_t blksize = sandev_blksize ( sandev );
+	void *bounce = NULL;
+	uint64_t lba;
+	unsigned int count;
+	size_t pos = 0;
+	size_t skip;
+	size_t frag_len;
+	int shift;
+	int rc;
+
+	/* Calculate block size shift */
+	shift = sanfs_blksize_shift ( sandev );
+	if ( shift < 0 ) {
+		rc = shift;
+		goto err_shift;
+	}
+
+	/* Check range */
+	if ( ( ( offset + len ) >> shift ) > sandev_capacity ( sandev ) ) {
+		DBGC ( sandev, "SANFS %p read [%#llx,%#llx) out of range\n",
+		       sandev, offset, ( offset + len ) );
+		rc = -ERANGE;
+		goto err_range;
+	}
+
+	while ( pos < len ) {
+
+		lba = ( ( offset + pos ) >> shift );
+		skip = ( ( offset + pos ) & ( blksize - 1 ) );
+		if ( skip || ( ( len - pos ) < blksize ) ) {
+
+			/* Read partial block via bounce buffer */
+			if ( ! bounce ) {
+				bounce = malloc ( blksize );
+				if ( ! bounce ) {
+					rc = -ENOMEM;
+					goto err_alloc;
+				}
+			}
+			frag_len = ( blksize - skip );
+			if ( frag_len > ( len - pos ) )
+				frag_len = ( len - pos );
+			if ( ( rc = sandev_read ( sandev, lba, 1,
+						  virt_to_user ( bounce ) ) ) != 0 )
+				goto err_read;
+			copy_to_user ( buffer, pos, ( bounce + skip ), frag_len );
+
+		} else {
+
+			/* Read whole blocks directly */
+			count = ( ( len - pos ) >> shift );
+			frag_len = ( ( ( size_t ) count ) << shift );
+			if ( ( rc = sandev_read ( sandev, lba, count,
+						  userptr_add ( buffer,
+								pos ) ) ) != 0 )
+				goto err_read;
+		}
+
+		pos += frag_len;
+	}
+
+	free ( bounce );
+	return 0;
+
+ err_read:
+	DBGC ( sandev, "SANFS %p could not read at %#llx: %s\n",
+	       sandev, ( offset + pos ), strerror ( rc ) );
+ err_alloc:
+	free ( bounce );
+ err_range:
+ err_shift:
+	return rc;
+}
+
+/**
+ * Read filesystem metadata
+ *
+ * @v fs		Filesystem
+ * @v offset		Starting byte offset within filesystem
+ * @v data		Data buffer
+ * @v len		Length to read
+ * @ret rc		Return status code
+ */
+int sanfs_read ( struct sanfs *fs, uint64_t offset, void *data,
+		 size_t len ) {
+	uint64_t device_len;
+	uint64_t window;
+	size_t window_len;
+	size_t skip;
+	size_t frag_len;
+	int rc;
+
+	/* Check range */
+	if ( ( offset > fs->len ) || ( len > ( fs->len - offset ) ) ) {
+		DBGC ( fs, "SANFS %p %s read [%#llx,%#llx) out of range\n",
+		       fs, fs->type->name, offset, ( offset + len ) );
+		return -ERANGE;
+	}
+
+	while ( len ) {
+
+		/* Fill cache, if necessary */
+		window = ( offset & ~( ( uint64_t ) ( SANFS_CACHE_LEN - 1 ) ) );
+		if ( ( ! fs->cache_valid ) || ( fs->cache_offset != window ) ) {
+			fs->cache_valid = 0;
+			device_len = ( sandev_capacity ( fs->sandev ) *
+				       sandev_blksize ( fs->sandev ) );
+			window_len = SANFS_CACHE_LEN;
+			if ( window_len > ( device_len - fs->start - window ) )
+				window_len = ( device_len - fs->start - window );
+			if ( ( rc = sanfs_read_dev ( fs->sandev,
+						     ( fs->start + window ),
+						     virt_to_user ( fs->cache ),
+						     window_len ) ) != 0 )
+				return rc;
+			fs->cache_offset = window;
+			fs->cache_valid = 1;
+		}
+
+		/* Copy from cache */
+		skip = ( offset - window );
+		frag_len = ( SANFS_CACHE_LEN - skip );
+		if ( frag_len > len )
+			frag_len = len;
+		memcpy ( data, ( fs->cache + skip ), frag_len );
+
+		data += frag_len;
+		offset += frag_len;
+		len -= frag_len;
+	}
+
+	return 0;
+}
+
+/**
+ * Get next path component
+ *
+ * @v path		Path (updated to point past the component)
+ * @v len		Length of component to fill in
+ * @ret name		Path component, or NULL if no components remain
+ */
+const char * sanfs_component ( const char **path, size_t *len ) {
+	const char *name;
+
+	/* Skip leading separators */
+	name = *path;
+	while ( *name == '/' )
+		name++;
+	if ( ! *name )
+		return NULL;
+
+	/* Find end of component */
+	*path = name;
+	while ( **path && ( **path != '/' ) )
+		(*path)++;
+	*len = ( *path - name );
+
+	return name;
+}
+
+/**
+ * Append extent to file
+ *
+ * @v fs		Filesystem
+ * @v file		File
+ * @v offset		Starting byte offset within filesystem (or SANFS_HOLE)
+ * @v len		Length
+ * @ret rc		Return status code
+ *
+ * Extents that are contiguous on the device (or consecutive holes)
+ * are merged, so that a contiguously allocated file will be read
+ * using a single extent.
+ */
+int sanfs_extend ( struct sanfs *fs, struct sanfs_file *file,
+		   uint64_t offset, size_t len ) {
+	struct sanfs_extent *extent;
+	uint64_t start;
+
+	/* Ignore empty extents */
+	if ( ! len )
+		return 0;
+
+	/* Check range and convert to device offset */
+	if ( offset == SANFS_HOLE ) {
+		start = SANFS_HOLE;
+	} else {
+		if ( ( offset > fs->len ) || ( len > ( fs->len - offset ) ) ) {
+			DBGC ( fs, "SANFS %p %s extent [%#llx,%#llx) out of "
+			       "range\n", fs, fs->type->name, offset,
+			       ( offset + len ) );
+			return -ERANGE;
+		}
+		start = ( fs->start + offset );
+	}
+
+	/* Merge with previous extent, if possible */
+	if ( file->count ) {
+		extent = &file->extent[ file->count - 1 ];
+		if ( ( ( start == SANFS_HOLE ) && ( extent->start == SANFS_HOLE ))||
+		     ( ( start != SANFS_HOLE ) && ( extent->start != SANFS_HOLE ) &&
+		       ( start == ( extent->start + extent->len ) ) ) ) {
+			if ( ( extent->len + len ) >= extent->len ) {
+				extent->len += len;
+				return 0;
+			}
+		}
+	}
+
+	/* Append new extent */
+	extent = realloc ( file->extent,
+			   ( ( file->count + 1 ) * sizeof ( *extent ) ) );
+	if ( ! extent )
+		return -ENOMEM;
+	file->extent = extent;
+	extent = &file->extent[ file->count++ ];
+	extent->start = start;
+	extent->len = len;
+
+	return 0;
+}
+
+/**
+ * Open file within a filesystem region
+ *
+ * @v sandev		SAN device
+ * @v start		Starting byte offset on device
+ * @v len		Length of region
+ * @v path		Path within filesystem
+ * @v file		File to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_open_region ( struct san_device *sandev, uint64_t start,
+			       uint64_t len, const char *path,
+			       struct sanfs_file *file ) {
+	struct sanfs_type *type;
+	struct sanfs fs;
+	int rc = -ENOENT;
+
+	/* Allocate metadata cache */
+	memset ( &fs, 0, sizeof ( fs ) );
+	fs.sandev = sandev;
+	fs.start = start;
+	fs.len = len;
+	fs.cache = malloc ( SANFS_CACHE_LEN );
+	if ( ! fs.cache )
+		return -ENOMEM;
+
+	/* Try each filesystem type in turn */
+	for_each_table_entry ( type, SANFS_TYPES ) {
+
+		/* Try mounting filesystem */
+		fs.type = type;
+		if ( type->mount ( &fs ) != 0 )
+			continue;
+		DBGC ( &fs, "SANFS %p found %s filesystem at [%#llx,%#llx)\n",
+		       &fs, type->name, start, ( start + len ) );
+
+		/* Open file */
+		memset ( file, 0, sizeof ( *file ) );
+		rc = type->open ( &fs, path, file );
+		free ( fs.priv );
+		fs.priv = NULL;
+		if ( rc == 0 )
+			break;
+		DBGC ( &fs, "SANFS %p could not open %s: %s\n",
+		       &fs, path, strerror ( rc ) );
+		free ( file->extent );
+		memset ( file, 0, sizeof ( *file ) );
+	}
+
+	free ( fs.cache );
+	return rc;
+}
+
+/**
+ * Open file on SAN device
+ *
+ * @v sandev		SAN device
+ * @v path		Path within filesystem
+ * @v file		File to fill in
+ * @ret rc		Return status code
+ *
+ * Each partition (from a GUID or MBR partition table) is tried in
+ * turn, followed by the whole device.  The first filesystem
+ * containing the file is used.
+ */
+static int sanfs_open_device ( struct san_device *sandev, const char *path,
+			       struct sanfs_file *file ) {
+	struct san_partition_table *table;
+	struct san_partition *partition;
+	uint64_t device_len;
+	size_t blksize;
+	unsigned int i;
+	int rc;
+
+	/* Calculate device length */
+	blksize = sandev_blksize ( sandev );
+	device_len = ( sandev_capacity ( sandev ) * blksize );
+
+	/* Try partitions, if applicable */
+	if ( sanpart_parse ( sandev ) == 0 ) {
+		table = sandev->partitions;
+		for ( i = 0 ; i < table->count ; i++ ) {
+			partition = &table->partition[i];
+			if ( ( rc = sanfs_open_region ( sandev,
+							( partition->lba *
+							  blksize ),
+							( partition->count *
+							  blksize ),
+							path, file ) ) == 0 )
+				return 0;
+		}
+	}
+
+	/* Try whole device */
+	return sanfs_open_region ( sandev, 0, device_len, path, file );
+}
+
+/**
+ * Find SAN device
+ *
+ * @v uri		Block device URI
+ * @ret sandev		SAN device, or NULL
+ *
+ * A registered SAN device using the same block device URI is reused,
+ * since the underlying block device may not allow itself to be
+ * opened twice.
+ */
+static struct san_device * sanfs_find ( struct uri *uri ) {
+	struct san_device *sandev;
+	struct uri *path_uri;
+	unsigned int i;
+
+	for_each_sandev ( sandev ) {
+		for ( i = 0 ; i < sandev->paths ; i++ ) {
+			path_uri = sandev->path[i].uri;
+			if ( path_uri->scheme && path_uri->opaque &&
+			     ( strcasecmp ( path_uri->scheme,
+					    uri->scheme ) == 0 ) &&
+			     ( strcmp ( path_uri->opaque,
+					uri->opaque ) == 0 ) )
+				return sandev;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Free SAN filesystem download
+ *
+ * @v refcnt		Reference count
+ */
+static void sanfs_free ( struct refcnt *refcnt ) {
+	struct sanfs_download *download =
+		container_of ( refcnt, struct sanfs_download, refcnt );
+
+	free ( download->file.extent );
+	free ( download );
+}
+
+/**
+ * Close SAN filesystem download
+ *
+ * @v download		SAN filesystem download
+ * @v rc		Reason for close
+ */
+static void sanfs_close ( struct sanfs_download *download, int rc ) {
+
+	/* Stop process */
+	process_del ( &download->process );
+
+	/* Shut down data transfer interface */
+	intf_shutdown ( &download->xfer, rc );
+
+	/* Release SAN device */
+	if ( download->sandev ) {
+		if ( download->private )
+			close_sandev ( download->sandev );
+		sandev_put ( download->sandev );
+		download->sandev = NULL;
+	}
+}
+
+/**
+ * Read file fragment
+ *
+ * @v download		SAN filesystem download
+ * @v extent		Extent
+ * @v buffer		Data buffer
+ * @v len		Length to read
+ * @ret rc		Return status code
+ */
+static int sanfs_fill ( struct sanfs_download *download,
+			struct sanfs_extent *extent, userptr_t buffer,
+			size_t len ) {
+
+	/* Zero-fill holes */
+	if ( extent->start == SANFS_HOLE ) {
+		memset_user ( buffer, 0, 0, len );
+		return 0;
+	}
+
+	/* Read from device */
+	return sanfs_read_dev ( download->sandev,
+				( extent->start + download->offset ),
+				buffer, len );
+}
+
+#ifdef SANFS_INFLATE
+/**
+ * Decompress file while reading, if applicable
+ *
+ * @v download		SAN filesystem download
+ * @ret rc		Return status code
+ *
+ * A gzip- or zlib-compressed file is decompressed as each fragment
+ * is read, so that decompression overlaps with reading from the SAN
+ * device and the compressed file is never held in memory.
+ */
+static int sanfs_inflate ( struct sanfs_download *download ) {
+	struct sanfs_file *file = &download->file;
+	struct sanfs_extent *extent = &file->extent[0];
+	uint8_t magic[INFLATE_MAGIC_LEN];
+	int rc;
+
+	/* Do nothing unless start of file can be read from a single extent */
+	if ( ( file->len < sizeof ( magic ) ) || ( ! file->count ) ||
+	     ( extent->len < sizeof ( magic ) ) )
+		return 0;
+
+	/* Read start of file */
+	if ( ( rc = sanfs_fill ( download, extent, virt_to_user ( magic ),
+				 sizeof ( magic ) ) ) != 0 )
+		return rc;
+
+	/* Add decompression filter, if applicable */
+	return inflate_add ( &download->xfer, magic, sizeof ( magic ) );
+}
+#else
+static inline int sanfs_inflate ( struct sanfs_download *download __unused ) {
+	return 0;
+}
+#endif
+
+/**
+ * SAN filesystem download process
+ *
+ * @v download		SAN filesystem download
+ *
+ * Each invocation reads a single fragment.  If the receive buffer is
+ * an external (umalloc()-based) buffer large enough to hold the whole
+ * file, then the fragment is read directly into the buffer, and may
+ * be as large as SANFS_DIRECT_LEN; the SAN device will split this
+ * into multiple concurrently outstanding commands.  Otherwise, the
+ * fragment is read into an I/O buffer and delivered as normal.
+ */
+static void sanfs_step ( struct sanfs_download *download ) {
+	struct sanfs_file *file = &download->file;
+	struct sanfs_extent *extent;
+	struct xfer_buffer *xferbuf;
+	struct io_buffer *iobuf = NULL;
+	userptr_t *udata;
+	size_t frag_len;
+	int rc;
+
+	/* Wait until data transfer interface is ready */
+	if ( ! xfer_window ( &download->xfer ) )
+		return;
+
+	/* Presize receive buffer */
+	if ( ! download->presized ) {
+		if ( ( rc = xfer_seek ( &download->xfer, file->len ) ) != 0 )
+			goto err;
+		if ( ( rc = xfer_seek ( &download->xfer, 0 ) ) != 0 )
+			goto err;
+		download->presized = 1;
+	}
+
+	/* Close download when complete */
+	if ( download->pos == file->len ) {
+		sanfs_close ( download, 0 );
+		return;
+	}
+
+	/* Fail if file extents do not cover the whole file */
+	if ( download->index >= file->count ) {
+		DBGC ( download, "SANFS %p file extents are %#zx bytes short\n",
+		       download, ( file->len - download->pos ) );
+		rc = -EIO;
+		goto err;
+	}
+
+	/* Calculate maximum length for this fragment */
+	extent = &file->extent[download->index];
+	frag_len = ( extent->len - download->offset );
+	if ( frag_len > ( file->len - download->pos ) )
+		frag_len = ( file->len - download->pos );
+
+	/* Read fragment */
+	xferbuf = xfer_buffer ( &download->xfer );
+	if ( xferbuf && ( xferbuf->op == &xferbuf_umalloc_operations ) &&
+	     ( xferbuf->len >= file->len ) ) {
+
+		/* Read directly into receive buffer */
+		if ( frag_len > SANFS_DIRECT_LEN )
+			frag_len = SANFS_DIRECT_LEN;
+		udata = xferbuf->data;
+		if ( ( rc = sanfs_fill ( download, extent,
+					 userptr_add ( *udata, download->pos ),
+					 frag_len ) ) != 0 )
+			goto err;
+		xferbuf->pos = ( download->pos + frag_len );
+
+	} else {
+
+		/* Allocate I/O buffer */
+		if ( frag_len > SANFS_FRAG_LEN )
+			frag_len = SANFS_FRAG_LEN;
+		iobuf = xfer_alloc_iob ( &download->xfer, frag_len );
+		if ( ! iobuf ) {
+			rc = -ENOMEM;
+			goto err;
+		}
+
+		/* Read into I/O buffer */
+		if ( ( rc = sanfs_fill ( download, extent,
+					 virt_to_user ( iob_put ( iobuf,
+								  frag_len ) ),
+					 frag_len ) ) != 0 )
+			goto err;
+
+		/* Deliver data */
+		if ( ( rc = xfer_deliver_iob ( &download->xfer,
+					       iob_disown ( iobuf ) ) ) != 0 ) {
+			DBGC ( download, "SANFS %p could not deliver data: "
+			       "%s\n", download, strerror ( rc ) );
+			goto err;
+		}
+	}
+
+	/* Move to next fragment */
+	download->pos += frag_len;
+	download->offset += frag_len;
+	if ( download->offset == extent->len ) {
+		download->index++;
+		download->offset = 0;
+	}
+
+	/* Reschedule process.  (The process is not rescheduled
+	 * automatically, since reading from the SAN device will
+	 * itself call step().)
+	 */
+	process_add ( &download->process );
+
+	return;
+
+ err:
+	free_iob ( iobuf );
+	sanfs_close ( download, rc );
+}
+
+/**
+ * Report SAN filesystem download progress
+ *
+ * @v download		SAN filesystem download
+ * @v progress		Progress report to fill in
+ * @ret ongoing_rc	Ongoing job status code (if known)
+ */
+static int sanfs_progress ( struct sanfs_download *download,
+			    struct job_progress *progress ) {
+
+	progress->completed = download->pos;
+	progress->total = download->file.len;
+	return 0;
+}
+
+/** SAN filesystem data transfer interface operations */
+static struct interface_operation sanfs_xfer_operations[] = {
+	INTF_OP ( xfer_window_changed, struct sanfs_download *, sanfs_step ),
+	INTF_OP ( intf_close, struct sanfs_download *, sanfs_close ),
+	INTF_OP ( job_progress, struct sanfs_download *, sanfs_progress ),
+};
+
+/** SAN filesystem data transfer interface descriptor */
+static struct interface_descriptor sanfs_xfer_desc =
+	INTF_DESC ( struct sanfs_download, xfer, sanfs_xfer_operations );
+
+/** SAN filesystem download process descriptor */
+static struct process_descriptor sanfs_process_desc =
+	PROC_DESC_ONCE ( struct sanfs_download, process, sanfs_step );
+
+/**
+ * Open file on SAN device URI
+ *
+ * @v xfer		Data transfer interface
+ * @v uri		URI (e.g. "nvme://0/boot/vmlinuz")
+ * @ret rc		Return status code
+ *
+ * The block device URI is formed from the URI scheme and host
+ * (e.g. "nvme:0").
+ */
+int sanfs_open_uri ( struct interface *xfer, struct uri *uri ) {
+	struct sanfs_download *download;
+	struct uri *block_uri;
+	char *block_uri_string;
+	int rc;
+
+	/* Sanity check */
+	if ( ! ( uri->scheme && uri->host && uri->path ) ) {
+		rc = -EINVAL;
+		goto err_uri;
+	}
+
+	/* Construct block device URI */
+	if ( asprintf ( &block_uri_string, "%s:%s",
+			uri->scheme, uri->host ) < 0 ) {
+		rc = -ENOMEM;
+		goto err_uri;
+	}
+	block_uri = parse_uri ( block_uri_string );
+	free ( block_uri_string );
+	if ( ! block_uri ) {
+		rc = -ENOMEM;
+		goto err_parse;
+	}
+
+	/* Allocate and initialise structure */
+	download = zalloc ( sizeof ( *download ) );
+	if ( ! download ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	ref_init ( &download->refcnt, sanfs_free );
+	intf_init ( &download->xfer, &sanfs_xfer_desc, &download->refcnt );
+	process_init_stopped ( &download->process, &sanfs_process_desc,
+			       &download->refcnt );
+
+	/* Use registered SAN device, or open a private SAN device */
+	download->sandev = sanfs_find ( block_uri );
+	if ( download->sandev ) {
+		sandev_get ( download->sandev );
+	} else {
+		download->sandev = alloc_sandev ( &block_uri, 1, 0 );
+		if ( ! download->sandev ) {
+			rc = -ENOMEM;
+			goto err_alloc_sandev;
+		}
+		if ( ( rc = open_sandev ( download->sandev ) ) != 0 ) {
+			sandev_put ( download->sandev );
+			download->sandev = NULL;
+			goto err_open_sandev;
+		}
+		download->private = 1;
+	}
+	DBGC ( download, "SANFS %p opening %s on %s:%s via SAN %p\n",
+	       download, uri->path, uri->scheme, uri->host, download->sandev );
+
+	/* Open file */
+	if ( ( rc = sanfs_open_device ( download->sandev, uri->path,
+					&download->file ) ) != 0 ) {
+		DBGC ( download, "SANFS %p could not open %s: %s\n",
+		       download, uri->path, strerror ( rc ) );
+		goto err_open;
+	}
+	DBGC ( download, "SANFS %p opened %s (%#zx bytes in %d extents)\n",
+	       download, uri->path, download->file.len, download->file.count );
+
+	/* Attach to parent interface */
+	intf_plug_plug ( &download->xfer, xfer );
+
+	/* Decompress file while reading, if applicable */
+	if ( ( rc = sanfs_inflate ( download ) ) != 0 ) {
+		DBGC ( download, "SANFS %p could not decompress %s: %s\n",
+		       download, uri->path, strerror ( rc ) );
+		goto err_inflate;
+	}
+
+	/* Start download process, mortalise self, and return */
+	process_add ( &download->process );
+	ref_put ( &download->refcnt );
+	uri_put ( block_uri );
+	return 0;
+
+ err_inflate:
+	intf_unplug ( &download->xfer );
+ err_open:
+ err_open_sandev:
+ err_alloc_sandev:
+	sanfs_close ( download, rc );
+	ref_put ( &download->refcnt );
+ err_alloc:
+	uri_put ( block_uri );
+ err_parse:
+ err_uri:
+	return rc;
+}
@@ -0,0 +1,630 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * ext2/ext3/ext4 SAN device filesystem
+ *
+ * Both extent-mapped and block-mapped inodes are supported.
+ * Directories are searched linearly (ignoring any hash tree index),
+ * and symbolic links are followed.  The journal is ignored.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <byteswap.h>
+#include <ipxe/ext4.h>
+#include <ipxe/sanfs.h>
+
+/** Unsupported incompatible features */
+#define SANFS_EXT_UNSUPPORTED ( EXT4_FEATURE_INCOMPAT_COMPRESSION |	\
+				EXT4_FEATURE_INCOMPAT_JOURNAL_DEV |	\
+				EXT4_FEATURE_INCOMPAT_META_BG |		\
+				EXT4_FEATURE_INCOMPAT_DIRDATA )
+
+/** A mounted ext filesystem */
+struct sanfs_ext {
+	/** Block size shift */
+	unsigned int block_shift;
+	/** Block size */
+	size_t block_len;
+	/** Number of inodes */
+	uint32_t inodes;
+	/** Number of inodes per group */
+	uint32_t inodes_per_group;
+	/** Inode size */
+	size_t inode_len;
+	/** Group descriptor size */
+	size_t desc_len;
+	/** Offset of group descriptor table */
+	uint64_t desc;
+};
+
+/**
+ * Mount ext filesystem
+ *
+ * @v fs		Filesystem
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_mount ( struct sanfs *fs ) {
+	struct ext4_superblock sb;
+	struct sanfs_ext *ext;
+	uint32_t incompat;
+	unsigned int log_block_size;
+	size_t inode_len;
+	size_t desc_len;
+	int rc;
+
+	/* Read superblock */
+	if ( ( rc = sanfs_read ( fs, EXT4_SUPERBLOCK_OFFSET, &sb,
+				 sizeof ( sb ) ) ) != 0 )
+		return rc;
+	if ( sb.magic != cpu_to_le16 ( EXT4_MAGIC ) )
+		return -EINVAL;
+
+	/* Check features */
+	incompat = le32_to_cpu ( sb.feature_incompat );
+	if ( incompat & SANFS_EXT_UNSUPPORTED ) {
+		DBGC ( fs, "SANFS %p ext has unsupported features %#08x\n",
+		       fs, ( incompat & SANFS_EXT_UNSUPPORTED ) );
+		return -ENOTSUP;
+	}
+
+	/* Parse superblock */
+	log_block_size = le32_to_cpu ( sb.log_block_size );
+	if ( log_block_size > 6 )
+		return -EINVAL;
+	if ( le32_to_cpu ( sb.rev_level ) == EXT4_GOOD_OLD_REV ) {
+		inode_len = EXT4_GOOD_OLD_INODE_SIZE;
+	} else {
+		inode_len = le16_to_cpu ( sb.inode_size );
+	}
+	if ( ( inode_len < EXT4_GOOD_OLD_INODE_SIZE ) ||
+	     ( inode_len & ( inode_len - 1 ) ) ||
+	     ( inode_len > ( 1024U << log_block_size ) ) )
+		return -EINVAL;
+	if ( incompat & EXT4_FEATURE_INCOMPAT_64BIT ) {
+		desc_len = le16_to_cpu ( sb.desc_size );
+		if ( desc_len < EXT4_MIN_DESC_SIZE_64BIT )
+			return -EINVAL;
+	} else {
+		desc_len = EXT4_DESC_SIZE;
+	}
+	if ( ! sb.inodes_per_group )
+		return -EINVAL;
+
+	/* Allocate and populate private data */
+	ext = zalloc ( sizeof ( *ext ) );
+	if ( ! ext )
+		return -ENOMEM;
+	ext->block_shift = ( 10 + log_block_size );
+	ext->block_len = ( 1 << ext->block_shift );
+	ext->inodes = le32_to_cpu ( sb.inodes );
+	ext->inodes_per_group = le32_to_cpu ( sb.inodes_per_group );
+	ext->inode_len = inode_len;
+	ext->desc_len = desc_len;
+	ext->desc = ( ( ( uint64_t ) ( le32_to_cpu ( sb.first_data_block ) + 1 ))
+		      << ext->block_shift );
+	fs->priv = ext;
+	DBGC ( fs, "SANFS %p ext has %zd-byte blocks and %zd-byte inodes\n",
+	       fs, ext->block_len, ext->inode_len );
+
+	return 0;
+}
+
+/**
+ * Read inode
+ *
+ * @v fs		Filesystem
+ * @v ino		Inode number
+ * @v inode		Inode to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_inode ( struct sanfs *fs, uint32_t ino,
+			     struct ext4_inode *inode ) {
+	struct sanfs_ext *ext = fs->priv;
+	struct ext4_group_desc desc;
+	uint32_t group;
+	uint32_t index;
+	uint64_t table;
+	size_t len;
+	int rc;
+
+	/* Check inode number */
+	if ( ( ino == 0 ) || ( ino > ext->inodes ) ) {
+		DBGC ( fs, "SANFS %p ext invalid inode %d\n", fs, ino );
+		return -EIO;
+	}
+	group = ( ( ino - 1 ) / ext->inodes_per_group );
+	index = ( ( ino - 1 ) % ext->inodes_per_group );
+
+	/* Read group descriptor */
+	memset ( &desc, 0, sizeof ( desc ) );
+	len = ext->desc_len;
+	if ( len > sizeof ( desc ) )
+		len = sizeof ( desc );
+	if ( ( rc = sanfs_read ( fs, ( ext->desc +
+				       ( ( ( uint64_t ) group ) *
+					 ext->desc_len ) ),
+				 &desc, len ) ) != 0 )
+		return rc;
+	table = ( ( ( ( uint64_t ) le32_to_cpu ( desc.inode_table_hi ) ) << 32 )
+		  | le32_to_cpu ( desc.inode_table_lo ) );
+
+	/* Read inode */
+	if ( ( rc = sanfs_read ( fs, ( ( table << ext->block_shift ) +
+				       ( ( ( uint64_t ) index ) *
+					 ext->inode_len ) ),
+				 inode, sizeof ( *inode ) ) ) != 0 )
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Map extent tree node
+ *
+ * @v fs		Filesystem
+ * @v file		File
+ * @v node		Extent tree node
+ * @v len		Length of extent tree node
+ * @v depth		Expected depth of node (or negative for root node)
+ * @v next		Next logical block to be mapped
+ * @v count		Number of logical blocks in file
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_node ( struct sanfs *fs, struct sanfs_file *file,
+			    const void *node, size_t len, int depth,
+			    uint64_t *next, uint64_t count ) {
+	struct sanfs_ext *ext = fs->priv;
+	const struct ext4_extent_header *header = node;
+	const struct ext4_extent *extent;
+	const struct ext4_extent_idx *idx;
+	unsigned int entries;
+	unsigned int i;
+	uint64_t block;
+	uint64_t start;
+	uint32_t blocks;
+	void *child;
+	int uninit;
+	int rc;
+
+	/* Validate header */
+	if ( ( len < sizeof ( *header ) ) ||
+	     ( header->magic != cpu_to_le16 ( EXT4_EXTENT_MAGIC ) ) )
+		goto err_invalid;
+	entries = le16_to_cpu ( header->entries );
+	if ( ( entries * sizeof ( *extent ) ) > ( len - sizeof ( *header ) ) )
+		goto err_invalid;
+	if ( depth < 0 ) {
+		depth = le16_to_cpu ( header->depth );
+		if ( depth > EXT4_EXTENT_MAX_DEPTH )
+			goto err_invalid;
+	} else if ( le16_to_cpu ( header->depth ) != depth ) {
+		goto err_invalid;
+	}
+
+	/* Map leaf node */
+	if ( depth == 0 ) {
+		extent = ( node + sizeof ( *header ) );
+		for ( i = 0 ; ( i < entries ) && ( *next < count ) ;
+		      i++, extent++ ) {
+			block = le32_to_cpu ( extent->block );
+			blocks = le16_to_cpu ( extent->len );
+			uninit = ( blocks > EXT4_EXTENT_INIT_MAX );
+			if ( uninit )
+				blocks -= EXT4_EXTENT_INIT_MAX;
+			if ( block < *next )
+				goto err_invalid;
+			if ( block >= count )
+				break;
+			if ( blocks > ( count - block ) )
+				blocks = ( count - block );
+			if ( ( rc = sanfs_extend ( fs, file, SANFS_HOLE,
+						   ( ( block - *next ) <<
+						     ext->block_shift ) ) ) !=0)
+				return rc;
+			start = ( ( ( ( uint64_t )
+				      le16_to_cpu ( extent->start_hi ) ) << 32 ) |
+				  le32_to_cpu ( extent->start_lo ) );
+			if ( ( rc = sanfs_extend ( fs, file,
+						   ( uninit ? SANFS_HOLE :
+						     ( start <<
+						       ext->block_shift ) ),
+						   ( ( ( size_t ) blocks ) <<
+						     ext->block_shift ) ) ) !=0)
+				return rc;
+			*next = ( block + blocks );
+		}
+		return 0;
+	}
+
+	/* Map index node */
+	child = malloc ( ext->block_len );
+	if ( ! child )
+		return -ENOMEM;
+	idx = ( node + sizeof ( *header ) );
+	rc = 0;
+	for ( i = 0 ; ( i < entries ) && ( *next < count ) ; i++, idx++ ) {
+		block = ( ( ( ( uint64_t ) le16_to_cpu ( idx->leaf_hi ) ) << 32 )
+			  | le32_to_cpu ( idx->leaf_lo ) );
+		if ( ( rc = sanfs_read ( fs, ( block << ext->block_shift ),
+					 child, ext->block_len ) ) != 0 )
+			break;
+		if ( ( rc = sanfs_ext_node ( fs, file, child, ext->block_len,
+					     ( depth - 1 ), next,
+					     count ) ) != 0 )
+			break;
+	}
+	free ( child );
+	return rc;
+
+ err_invalid:
+	DBGC ( fs, "SANFS %p ext invalid extent tree node\n", fs );
+	return -EIO;
+}
+
+/**
+ * Map indirect block
+ *
+ * @v fs		Filesystem
+ * @v file		File
+ * @v block		Block number (or zero for a hole)
+ * @v level		Level of indirection
+ * @v next		Next logical block to be mapped
+ * @v count		Number of logical blocks in file
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_indirect ( struct sanfs *fs, struct sanfs_file *file,
+				uint32_t block, unsigned int level,
+				uint64_t *next, uint64_t count ) {
+	struct sanfs_ext *ext = fs->priv;
+	unsigned int per_block = ( ext->block_len / sizeof ( block ) );
+	uint64_t span;
+	uint32_t *map;
+	unsigned int i;
+	int rc;
+
+	/* Map data block or hole */
+	span = ( 1ULL << ( level * ( ext->block_shift - 2 ) ) );
+	if ( span > ( count - *next ) )
+		span = ( count - *next );
+	if ( ( level == 0 ) || ( block == 0 ) ) {
+		if ( ( rc = sanfs_extend ( fs, file,
+					   ( block ? ( ( ( uint64_t ) block ) <<
+						       ext->block_shift ) :
+					     SANFS_HOLE ),
+					   ( span << ext->block_shift ) ) ) !=0)
+			return rc;
+		*next += span;
+		return 0;
+	}
+
+	/* Map indirect block entries */
+	map = malloc ( ext->block_len );
+	if ( ! map )
+		return -ENOMEM;
+	if ( ( rc = sanfs_read ( fs, ( ( ( uint64_t ) block ) <<
+				       ext->block_shift ),
+				 map, ext->block_len ) ) != 0 )
+		goto err_read;
+	for ( i = 0 ; ( i < per_block ) && ( *next < count ) ; i++ ) {
+		if ( ( rc = sanfs_ext_indirect ( fs, file,
+						 le32_to_cpu ( map[i] ),
+						 ( level - 1 ), next,
+						 count ) ) != 0 )
+			break;
+	}
+
+ err_read:
+	free ( map );
+	return rc;
+}
+
+/**
+ * Map inode contents
+ *
+ * @v fs		Filesystem
+ * @v inode		Inode
+ * @v file		File to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_map ( struct sanfs *fs, struct ext4_inode *inode,
+			   struct sanfs_file *file ) {
+	struct sanfs_ext *ext = fs->priv;
+	uint32_t flags = le32_to_cpu ( inode->flags );
+	uint64_t size;
+	uint64_t count;
+	uint64_t next = 0;
+	unsigned int level;
+	unsigned int i;
+	int rc;
+
+	/* Check for unsupported inode types */
+	if ( flags & ( EXT4_ENCRYPT_FL | EXT4_INLINE_DATA_FL ) ) {
+		DBGC ( fs, "SANFS %p ext unsupported inode flags %#08x\n",
+		       fs, flags );
+		return -ENOTSUP;
+	}
+
+	/* Calculate file size */
+	size = le32_to_cpu ( inode->size_lo );
+	if ( ( le16_to_cpu ( inode->mode ) & EXT4_S_IFMT ) == EXT4_S_IFREG )
+		size |= ( ( ( uint64_t ) le32_to_cpu ( inode->size_high ) ) << 32 );
+	if ( size > ( ( size_t ) -1 ) )
+		return -ERANGE;
+	file->len = size;
+	count = ( ( size + ext->block_len - 1 ) >> ext->block_shift );
+
+	/* Map extent tree or block map */
+	if ( flags & EXT4_EXTENTS_FL ) {
+		if ( ( rc = sanfs_ext_node ( fs, file, inode->u.block,
+					     sizeof ( inode->u.block ), -1,
+					     &next, count ) ) != 0 )
+			return rc;
+	} else {
+		for ( i = 0 ; ( i < EXT4_N_BLOCKS ) && ( next < count ) ; i++ ) {
+			level = ( ( i < EXT4_NDIR_BLOCKS ) ? 0 :
+				  ( i - EXT4_NDIR_BLOCKS + 1 ) );
+			if ( ( rc = sanfs_ext_indirect ( fs, file,
+						le32_to_cpu ( inode->u.block[i] ),
+						level, &next, count ) ) != 0 )
+				return rc;
+		}
+	}
+
+	/* Treat any unmapped tail as a hole */
+	if ( next < count ) {
+		if ( ( rc = sanfs_extend ( fs, file, SANFS_HOLE,
+					   ( ( count - next ) <<
+					     ext->block_shift ) ) ) != 0 )
+			return rc;
+	}
+
+	return 0;
+}
+
+/**
+ * Find directory entry
+ *
+ * @v fs		Filesystem
+ * @v dir		Directory
+ * @v name		Name to find
+ * @v len		Length of name
+ * @v ino		Inode number to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_find ( struct sanfs *fs, struct sanfs_file *dir,
+			    const char *name, size_t len, uint32_t *ino ) {
+	struct sanfs_ext *ext = fs->priv;
+	struct sanfs_extent *extent;
+	struct ext4_dirent dirent;
+	char candidate[ 256 /* name_len is 8 bits */ ];
+	uint64_t offset;
+	size_t rec_len;
+	size_t pos;
+	unsigned int i;
+	int rc;
+
+	/* Scan each directory extent */
+	for ( i = 0 ; i < dir->count ; i++ ) {
+		extent = &dir->extent[i];
+		if ( extent->start == SANFS_HOLE )
+			continue;
+		for ( pos = 0 ; ( pos + sizeof ( dirent ) ) <= extent->len ;
+		      pos += rec_len ) {
+
+			/* Read directory entry */
+			offset = ( extent->start - fs->start + pos );
+			if ( ( rc = sanfs_read ( fs, offset, &dirent,
+						 sizeof ( dirent ) ) ) != 0 )
+				return rc;
+			rec_len = le16_to_cpu ( dirent.rec_len );
+			if ( ( ext->block_len == 65536 ) &&
+			     ( ( rec_len == 0 ) || ( rec_len == 65535 ) ) )
+				rec_len = 65536;
+			if ( ( rec_len < sizeof ( dirent ) ) || ( rec_len & 3 ) ||
+			     ( rec_len > ( extent->len - pos ) ) ) {
+				DBGC ( fs, "SANFS %p ext invalid directory "
+				       "entry at %#llx\n", fs, offset );
+				return -EIO;
+			}
+
+			/* Check name */
+			if ( ( ! dirent.inode ) || ( dirent.name_len != len ) ||
+			     ( ( sizeof ( dirent ) + len ) > rec_len ) )
+				continue;
+			if ( ( rc = sanfs_read ( fs, ( offset +
+						       sizeof ( dirent ) ),
+						 candidate, len ) ) != 0 )
+				return rc;
+			if ( memcmp ( candidate, name, len ) == 0 ) {
+				*ino = le32_to_cpu ( dirent.inode );
+				return 0;
+			}
+		}
+	}
+
+	return -ENOENT;
+}
+
+/**
+ * Read symbolic link target
+ *
+ * @v fs		Filesystem
+ * @v inode		Inode
+ * @v target		Link target to fill in (must be freed by caller)
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_link ( struct sanfs *fs, struct ext4_inode *inode,
+			    char **target ) {
+	struct sanfs_ext *ext = fs->priv;
+	struct sanfs_file link;
+	size_t len;
+	int rc;
+
+	/* Allocate target */
+	len = le32_to_cpu ( inode->size_lo );
+	if ( len >= ext->block_len )
+		return -ENAMETOOLONG;
+	*target = zalloc ( len + 1 /* NUL */ );
+	if ( ! *target )
+		return -ENOMEM;
+
+	/* Copy fast symbolic link target from inode */
+	if ( ( len < sizeof ( inode->u.symlink ) ) &&
+	     ! ( le32_to_cpu ( inode->flags ) & EXT4_EXTENTS_FL ) ) {
+		memcpy ( *target, inode->u.symlink, len );
+		return 0;
+	}
+
+	/* Read slow symbolic link target from first block */
+	memset ( &link, 0, sizeof ( link ) );
+	if ( ( rc = sanfs_ext_map ( fs, inode, &link ) ) != 0 )
+		goto err_map;
+	if ( ( link.count == 0 ) || ( link.extent[0].start == SANFS_HOLE ) ||
+	     ( link.extent[0].len < len ) ) {
+		rc = -EIO;
+		goto err_extent;
+	}
+	if ( ( rc = sanfs_read ( fs, ( link.extent[0].start - fs->start ),
+				 *target, len ) ) != 0 )
+		goto err_read;
+	free ( link.extent );
+
+	return 0;
+
+ err_read:
+ err_extent:
+ err_map:
+	free ( link.extent );
+	free ( *target );
+	*target = NULL;
+	return rc;
+}
+
+/**
+ * Open file
+ *
+ * @v fs		Filesystem
+ * @v path		Path within filesystem
+ * @v file		File to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_ext_open ( struct sanfs *fs, const char *path,
+			    struct sanfs_file *file ) {
+	struct ext4_inode inode;
+	struct sanfs_file dir;
+	const char *name;
+	char *resolved = NULL;
+	char *target;
+	char *tmp;
+	uint32_t ino = EXT4_ROOT_INO;
+	uint32_t parent;
+	unsigned int links = 0;
+	unsigned int mode;
+	size_t len;
+	int rc;
+
+	/* Read root directory inode */
+	if ( ( rc = sanfs_ext_inode ( fs, ino, &inode ) ) != 0 )
+		goto err;
+
+	/* Walk path */
+	while ( ( name = sanfs_component ( &path, &len ) ) ) {
+
+		/* Look up name within current directory */
+		if ( ( le16_to_cpu ( inode.mode ) & EXT4_S_IFMT ) !=
+		     EXT4_S_IFDIR ) {
+			rc = -ENOTDIR;
+			goto err;
+		}
+		parent = ino;
+		memset ( &dir, 0, sizeof ( dir ) );
+		if ( ( rc = sanfs_ext_map ( fs, &inode, &dir ) ) == 0 )
+			rc = sanfs_ext_find ( fs, &dir, name, len, &ino );
+		free ( dir.extent );
+		if ( rc != 0 )
+			goto err;
+		if ( ( rc = sanfs_ext_inode ( fs, ino, &inode ) ) != 0 )
+			goto err;
+
+		/* Follow symbolic links */
+		mode = ( le16_to_cpu ( inode.mode ) & EXT4_S_IFMT );
+		if ( mode == EXT4_S_IFLNK ) {
+			if ( ++links > SANFS_MAX_LINKS ) {
+				rc = -ELOOP;
+				goto err;
+			}
+			if ( ( rc = sanfs_ext_link ( fs, &inode,
+						     &target ) ) != 0 )
+				goto err;
+			DBGC ( fs, "SANFS %p ext following link to %s\n",
+			       fs, target );
+			if ( asprintf ( &tmp, "%s%s", target, path ) < 0 )
+				tmp = NULL;
+			free ( resolved );
+			resolved = tmp;
+			if ( ! resolved ) {
+				free ( target );
+				rc = -ENOMEM;
+				goto err;
+			}
+			path = resolved;
+			ino = ( ( target[0] == '/' ) ? EXT4_ROOT_INO : parent );
+			free ( target );
+			if ( ( rc = sanfs_ext_inode ( fs, ino, &inode ) ) != 0 )
+				goto err;
+		}
+	}
+
+	/* Check file type */
+	mode = ( le16_to_cpu ( inode.mode ) & EXT4_S_IFMT );
+	if ( mode == EXT4_S_IFDIR ) {
+		rc = -EISDIR;
+		goto err;
+	}
+	if ( mode != EXT4_S_IFREG ) {
+		rc = -ENOTSUP;
+		goto err;
+	}
+
+	/* Map file */
+	if ( ( rc = sanfs_ext_map ( fs, &inode, file ) ) != 0 )
+		goto err;
+
+ err:
+	free ( resolved );
+	return rc;
+}
+
+/** ext filesystem */
+struct sanfs_type sanfs_ext_type __sanfs_type = {
+	.name = "ext",
+	.mount = sanfs_ext_mount,
+	.open = sanfs_ext_open,
+};
@@ -0,0 +1,523 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * FAT SAN device filesystem
+ *
+ * FAT16 and FAT32 filesystems are supported, including long file
+ * names.  File names are matched case-insensitively.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <byteswap.h>
+#include <ipxe/fat.h>
+#include <ipxe/sanfs.h>
+
+/** Maximum number of long file name entries */
+#define SANFS_FAT_LFN_ENTRIES \
+	( ( FAT_LFN_MAX + FAT_LFN_CHARS - 1 ) / FAT_LFN_CHARS )
+
+/** A mounted FAT filesystem */
+struct sanfs_fat {
+	/** FAT entry width (16 or 32 bits) */
+	unsigned int bits;
+	/** Cluster length */
+	size_t cluster_len;
+	/** Number of data clusters */
+	uint32_t clusters;
+	/** Offset of first FAT */
+	uint64_t fat;
+	/** Offset of fixed root directory (FAT16 only) */
+	uint64_t root;
+	/** Length of fixed root directory (FAT16 only) */
+	size_t root_len;
+	/** Root directory cluster (FAT32 only) */
+	uint32_t root_cluster;
+	/** Offset of first data cluster */
+	uint64_t data;
+};
+
+/** A FAT directory lookup */
+struct sanfs_fat_lookup {
+	/** Name to find */
+	const char *name;
+	/** Length of name to find */
+	size_t len;
+	/** Long file name */
+	char lfn[ SANFS_FAT_LFN_ENTRIES * FAT_LFN_CHARS + 1 ];
+	/** Next expected long file name sequence number (or zero) */
+	unsigned int lfn_seq;
+	/** Long file name short name checksum */
+	uint8_t lfn_checksum;
+	/** Long file name is complete */
+	int lfn_valid;
+};
+
+/**
+ * Get cluster offset
+ *
+ * @v fat		FAT filesystem
+ * @v cluster		Cluster number
+ * @ret offset		Offset within filesystem
+ */
+static inline uint64_t sanfs_fat_cluster ( struct sanfs_fat *fat,
+					   uint32_t cluster ) {
+	return ( fat->data + ( ( ( uint64_t ) ( cluster - FAT_FIRST_CLUSTER ) )
+			       * fat->cluster_len ) );
+}
+
+/**
+ * Check cluster number validity
+ *
+ * @v fat		FAT filesystem
+ * @v cluster		Cluster number
+ * @ret is_valid	Cluster number is valid
+ */
+static inline int sanfs_fat_valid ( struct sanfs_fat *fat, uint32_t cluster ) {
+	return ( ( cluster >= FAT_FIRST_CLUSTER ) &&
+		 ( ( cluster - FAT_FIRST_CLUSTER ) < fat->clusters ) );
+}
+
+/**
+ * Get next cluster in chain
+ *
+ * @v fs		Filesystem
+ * @v cluster		Cluster number
+ * @v next		Next cluster number (or zero at end of chain)
+ * @ret rc		Return status code
+ */
+static int sanfs_fat_next ( struct sanfs *fs, uint32_t cluster,
+			    uint32_t *next ) {
+	struct sanfs_fat *fat = fs->priv;
+	uint16_t entry16;
+	uint32_t entry32;
+	int rc;
+
+	/* Read FAT entry */
+	if ( fat->bits == 16 ) {
+		if ( ( rc = sanfs_read ( fs, ( fat->fat + ( cluster * 2 ) ),
+					 &entry16, sizeof ( entry16 ) ) ) != 0 )
+			return rc;
+		*next = le16_to_cpu ( entry16 );
+		if ( *next >= FAT16_EOC )
+			*next = 0;
+	} else {
+		if ( ( rc = sanfs_read ( fs, ( fat->fat + ( cluster * 4 ) ),
+					 &entry32, sizeof ( entry32 ) ) ) != 0 )
+			return rc;
+		*next = ( le32_to_cpu ( entry32 ) & FAT32_MASK );
+		if ( *next >= FAT32_EOC )
+			*next = 0;
+	}
+
+	/* Check validity */
+	if ( *next && ! sanfs_fat_valid ( fat, *next ) ) {
+		DBGC ( fs, "SANFS %p FAT cluster %#x has invalid successor "
+		       "%#x\n", fs, cluster, *next );
+		return -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Mount FAT filesystem
+ *
+ * @v fs		Filesystem
+ * @ret rc		Return status code
+ */
+static int sanfs_fat_mount ( struct sanfs *fs ) {
+	struct fat_boot_sector boot;
+	struct sanfs_fat *fat;
+	uint16_t signature;
+	size_t sector_len;
+	uint32_t cluster_sectors;
+	uint32_t fat_sectors;
+	uint32_t root_sectors;
+	uint32_t sectors;
+	uint32_t meta;
+	uint32_t clusters;
+	int rc;
+
+	/* Read boot sector */
+	if ( ( rc = sanfs_read ( fs, 0, &boot, sizeof ( boot ) ) ) != 0 )
+		return rc;
+	if ( ( rc = sanfs_read ( fs, FAT_SIGNATURE_OFFSET, &signature,
+				 sizeof ( signature ) ) ) != 0 )
+		return rc;
+	if ( signature != cpu_to_le16 ( FAT_SIGNATURE ) )
+		return -EINVAL;
+
+	/* Parse BIOS parameter block */
+	sector_len = le16_to_cpu ( boot.sector_len );
+	cluster_sectors = boot.cluster_sectors;
+	fat_sectors = le16_to_cpu ( boot.fat_sectors16 );
+	if ( ! fat_sectors )
+		fat_sectors = le32_to_cpu ( boot.fat_sectors32 );
+	sectors = le16_to_cpu ( boot.sectors16 );
+	if ( ! sectors )
+		sectors = le32_to_cpu ( boot.sectors32 );
+	if ( ( sector_len < 512 ) || ( sector_len > 4096 ) ||
+	     ( sector_len & ( sector_len - 1 ) ) || ( ! cluster_sectors ) ||
+	     ( cluster_sectors & ( cluster_sectors - 1 ) ) ||
+	     ( ! boot.fats ) || ( ! boot.reserved ) || ( ! fat_sectors ) )
+		return -EINVAL;
+	root_sectors = ( ( ( le16_to_cpu ( boot.root_entries ) *
+			     sizeof ( struct fat_dirent ) ) + sector_len - 1 ) /
+			 sector_len );
+	meta = ( le16_to_cpu ( boot.reserved ) + ( boot.fats * fat_sectors ) +
+		 root_sectors );
+	if ( meta >= sectors )
+		return -EINVAL;
+	clusters = ( ( sectors - meta ) / cluster_sectors );
+	if ( ( ( ( uint64_t ) sectors ) * sector_len ) > fs->len ) {
+		DBGC ( fs, "SANFS %p FAT exceeds partition length\n", fs );
+		return -EINVAL;
+	}
+
+	/* FAT12 is not supported */
+	if ( clusters <= FAT12_MAX_CLUSTERS ) {
+		DBGC ( fs, "SANFS %p FAT12 is not supported\n", fs );
+		return -ENOTSUP;
+	}
+
+	/* Allocate and populate private data */
+	fat = zalloc ( sizeof ( *fat ) );
+	if ( ! fat )
+		return -ENOMEM;
+	fat->bits = ( ( clusters <= FAT16_MAX_CLUSTERS ) ? 16 : 32 );
+	fat->cluster_len = ( cluster_sectors * sector_len );
+	fat->clusters = clusters;
+	fat->fat = ( le16_to_cpu ( boot.reserved ) * sector_len );
+	fat->root = ( fat->fat +
+		      ( ( ( uint64_t ) ( boot.fats * fat_sectors ) ) *
+			sector_len ) );
+	fat->root_len = ( le16_to_cpu ( boot.root_entries ) *
+			  sizeof ( struct fat_dirent ) );
+	fat->data = ( ( ( uint64_t ) meta ) * sector_len );
+	if ( fat->bits == 32 ) {
+		fat->root_cluster = ( le32_to_cpu ( boot.root_cluster ) &
+				      FAT32_MASK );
+		if ( ! sanfs_fat_valid ( fat, fat->root_cluster ) ) {
+			DBGC ( fs, "SANFS %p FAT32 has invalid root cluster "
+			       "%#x\n", fs, fat->root_cluster );
+			free ( fat );
+			return -EINVAL;
+		}
+	}
+	fs->priv = fat;
+	DBGC ( fs, "SANFS %p FAT%d has %d %zd-byte clusters\n",
+	       fs, fat->bits, fat->clusters, fat->cluster_len );
+
+	return 0;
+}
+
+/**
+ * Calculate short name checksum
+ *
+ * @v dirent		Directory entry
+ * @ret checksum	Short name checksum
+ */
+static uint8_t sanfs_fat_checksum ( const struct fat_dirent *dirent ) {
+	const uint8_t *name = ( ( const uint8_t * ) dirent->name );
+	uint8_t checksum = 0;
+	unsigned int i;
+
+	for ( i = 0 ; i < ( sizeof ( dirent->name ) +
+			    sizeof ( dirent->ext ) ) ; i++ ) {
+		checksum = ( ( ( checksum & 1 ) << 7 ) + ( checksum >> 1 ) +
+			     name[i] );
+	}
+	return checksum;
+}
+
+/**
+ * Check for matching name
+ *
+ * @v lookup		Directory lookup
+ * @v name		Candidate name
+ * @ret is_match	Name matches
+ */
+static int sanfs_fat_match ( struct sanfs_fat_lookup *lookup,
+			     const char *name ) {
+	return ( ( strlen ( name ) == lookup->len ) &&
+		 ( strncasecmp ( name, lookup->name, lookup->len ) == 0 ) );
+}
+
+/**
+ * Process long file name directory entry
+ *
+ * @v lookup		Directory lookup
+ * @v lfn		Long file name directory entry
+ */
+static void sanfs_fat_lfn ( struct sanfs_fat_lookup *lookup,
+			    const struct fat_lfn *lfn ) {
+	unsigned int seq = ( lfn->seq & FAT_LFN_SEQ_MASK );
+	uint16_t chars[FAT_LFN_CHARS];
+	char *name;
+	unsigned int i;
+
+	/* Start a new name at the last (i.e. first stored) entry */
+	if ( lfn->seq & FAT_LFN_SEQ_LAST ) {
+		if ( ( seq == 0 ) || ( seq > SANFS_FAT_LFN_ENTRIES ) ) {
+			lookup->lfn_seq = 0;
+			return;
+		}
+		memset ( lookup->lfn, 0, sizeof ( lookup->lfn ) );
+		lookup->lfn_seq = seq;
+		lookup->lfn_checksum = lfn->checksum;
+	}
+
+	/* Discard out-of-sequence entries */
+	if ( ( seq == 0 ) || ( seq != lookup->lfn_seq ) ||
+	     ( lfn->checksum != lookup->lfn_checksum ) ) {
+		lookup->lfn_seq = 0;
+		return;
+	}
+
+	/* Store name characters (as ASCII) */
+	memcpy ( &chars[0], lfn->name1, sizeof ( lfn->name1 ) );
+	memcpy ( &chars[5], lfn->name2, sizeof ( lfn->name2 ) );
+	memcpy ( &chars[11], lfn->name3, sizeof ( lfn->name3 ) );
+	name = &lookup->lfn[ ( seq - 1 ) * FAT_LFN_CHARS ];
+	for ( i = 0 ; i < FAT_LFN_CHARS ; i++ ) {
+		chars[i] = le16_to_cpu ( chars[i] );
+		if ( ( chars[i] == 0x0000 ) || ( chars[i] == 0xffff ) )
+			break;
+		name[i] = ( ( chars[i] < 0x80 ) ? chars[i] : '?' );
+	}
+
+	/* Record completion */
+	lookup->lfn_seq--;
+	lookup->lfn_valid = ( lookup->lfn_seq == 0 );
+}
+
+/**
+ * Process directory entry
+ *
+ * @v lookup		Directory lookup
+ * @v dirent		Directory entry
+ * @ret rc		Return status code
+ *
+ * Returns zero if the entry matches, -ENOENT at the end of the
+ * directory, and -EAGAIN otherwise.
+ */
+static int sanfs_fat_entry ( struct sanfs_fat_lookup *lookup,
+			     const struct fat_dirent *dirent ) {
+	char name[ sizeof ( dirent->name ) + 1 /* "." */ +
+		   sizeof ( dirent->ext ) + 1 /* NUL */ ];
+	unsigned int len;
+	unsigned int i;
+	int lfn_valid;
+
+	/* Check for end of directory */
+	if ( dirent->name[0] == FAT_NAME_END )
+		return -ENOENT;
+
+	/* Handle long file name entries */
+	if ( ( dirent->attr & FAT_ATTR_LFN_MASK ) == FAT_ATTR_LFN ) {
+		if ( ( uint8_t ) dirent->name[0] != FAT_NAME_DELETED ) {
+			sanfs_fat_lfn ( lookup, ( ( const struct fat_lfn * )
+						  dirent ) );
+		}
+		return -EAGAIN;
+	}
+
+	/* Consume any long file name */
+	lfn_valid = ( lookup->lfn_valid &&
+		      ( lookup->lfn_checksum ==
+			sanfs_fat_checksum ( dirent ) ) );
+	lookup->lfn_valid = 0;
+	lookup->lfn_seq = 0;
+
+	/* Skip deleted entries and volume labels */
+	if ( ( ( uint8_t ) dirent->name[0] == FAT_NAME_DELETED ) ||
+	     ( dirent->attr & FAT_ATTR_VOLUME ) )
+		return -EAGAIN;
+
+	/* Check long file name */
+	if ( lfn_valid && sanfs_fat_match ( lookup, lookup->lfn ) )
+		return 0;
+
+	/* Construct and check short name */
+	for ( len = 0 ; len < sizeof ( dirent->name ) ; len++ )
+		name[len] = dirent->name[len];
+	if ( name[0] == FAT_NAME_KANJI )
+		name[0] = FAT_NAME_DELETED;
+	while ( len && ( name[ len - 1 ] == ' ' ) )
+		len--;
+	if ( dirent->ext[0] != ' ' ) {
+		name[len++] = '.';
+		for ( i = 0 ; i < sizeof ( dirent->ext ) ; i++ )
+			name[len++] = dirent->ext[i];
+		while ( name[ len - 1 ] == ' ' )
+			len--;
+	}
+	name[len] = '\0';
+	if ( sanfs_fat_match ( lookup, name ) )
+		return 0;
+
+	return -EAGAIN;
+}
+
+/**
+ * Find directory entry
+ *
+ * @v fs		Filesystem
+ * @v cluster		Directory starting cluster (or zero for FAT16 root)
+ * @v name		Name to find
+ * @v len		Length of name
+ * @v dirent		Directory entry to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_fat_find ( struct sanfs *fs, uint32_t cluster,
+			    const char *name, size_t len,
+			    struct fat_dirent *dirent ) {
+	struct sanfs_fat *fat = fs->priv;
+	struct sanfs_fat_lookup lookup;
+	uint32_t limit = fat->clusters;
+	uint64_t offset;
+	size_t remaining;
+	int rc;
+
+	/* Initialise lookup */
+	memset ( &lookup, 0, sizeof ( lookup ) );
+	lookup.name = name;
+	lookup.len = len;
+
+	/* Start at beginning of directory */
+	if ( cluster ) {
+		offset = sanfs_fat_cluster ( fat, cluster );
+		remaining = fat->cluster_len;
+	} else {
+		offset = fat->root;
+		remaining = fat->root_len;
+	}
+
+	while ( 1 ) {
+
+		/* Scan entries within this cluster (or fixed root) */
+		for ( ; remaining >= sizeof ( *dirent ) ;
+		      offset += sizeof ( *dirent ),
+			      remaining -= sizeof ( *dirent ) ) {
+			if ( ( rc = sanfs_read ( fs, offset, dirent,
+						 sizeof ( *dirent ) ) ) != 0 )
+				return rc;
+			rc = sanfs_fat_entry ( &lookup, dirent );
+			if ( rc != -EAGAIN )
+				return rc;
+		}
+
+		/* Move to next cluster, if applicable */
+		if ( ! cluster )
+			return -ENOENT;
+		if ( ( rc = sanfs_fat_next ( fs, cluster, &cluster ) ) != 0 )
+			return rc;
+		if ( ! cluster )
+			return -ENOENT;
+		if ( ! limit-- ) {
+			DBGC ( fs, "SANFS %p FAT directory chain loops\n", fs );
+			return -EIO;
+		}
+		offset = sanfs_fat_cluster ( fat, cluster );
+		remaining = fat->cluster_len;
+	}
+}
+
+/**
+ * Open file
+ *
+ * @v fs		Filesystem
+ * @v path		Path within filesystem
+ * @v file		File to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_fat_open ( struct sanfs *fs, const char *path,
+			    struct sanfs_file *file ) {
+	struct sanfs_fat *fat = fs->priv;
+	struct fat_dirent dirent;
+	const char *name;
+	uint32_t limit = fat->clusters;
+	uint32_t dir = fat->root_cluster;
+	uint32_t cluster = 0;
+	size_t remaining;
+	size_t frag_len;
+	size_t len;
+	int is_dir = 1;
+	int rc;
+
+	/* Walk path */
+	while ( ( name = sanfs_component ( &path, &len ) ) ) {
+		if ( ! is_dir )
+			return -ENOTDIR;
+		if ( ( rc = sanfs_fat_find ( fs, dir, name, len,
+					     &dirent ) ) != 0 )
+			return rc;
+		cluster = le16_to_cpu ( dirent.cluster_low );
+		if ( fat->bits == 32 )
+			cluster |= ( le16_to_cpu ( dirent.cluster_high ) << 16 );
+		is_dir = ( dirent.attr & FAT_ATTR_DIRECTORY );
+		/* A ".." entry uses cluster zero to refer to the root */
+		dir = ( cluster ? cluster : fat->root_cluster );
+		if ( is_dir && cluster && ! sanfs_fat_valid ( fat, cluster ) )
+			return -EIO;
+	}
+	if ( is_dir )
+		return -EISDIR;
+
+	/* Construct extent list from cluster chain */
+	file->len = le32_to_cpu ( dirent.size );
+	for ( remaining = file->len ; remaining ; remaining -= frag_len ) {
+		if ( ! sanfs_fat_valid ( fat, cluster ) ) {
+			DBGC ( fs, "SANFS %p FAT file has invalid cluster "
+			       "%#x\n", fs, cluster );
+			return -EIO;
+		}
+		frag_len = fat->cluster_len;
+		if ( frag_len > remaining )
+			frag_len = remaining;
+		if ( ( rc = sanfs_extend ( fs, file,
+					   sanfs_fat_cluster ( fat, cluster ),
+					   frag_len ) ) != 0 )
+			return rc;
+		if ( ( rc = sanfs_fat_next ( fs, cluster, &cluster ) ) != 0 )
+			return rc;
+		if ( ! limit-- )
+			return -EIO;
+	}
+
+	return 0;
+}
+
+/** FAT filesystem */
+struct sanfs_type sanfs_fat_type __sanfs_type = {
+	.name = "FAT",
+	.mount = sanfs_fat_mount,
+	.open = sanfs_fat_open,
+};
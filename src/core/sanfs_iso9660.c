@@ -0,0 +1,342 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * ISO9660 SAN device filesystem
+ *
+ * Rock Ridge alternate names are used when present.  Otherwise, the
+ * ISO9660 file identifier is used with any version number suffix
+ * (";1") and trailing dot removed.  File names are matched
+ * case-insensitively.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <byteswap.h>
+#include <ipxe/iso9660.h>
+#include <ipxe/sanfs.h>
+
+/** Maximum length of a file name */
+#define SANFS_ISO9660_NAME_MAX 255
+
+/** A mounted ISO9660 filesystem */
+struct sanfs_iso9660 {
+	/** Logical block size */
+	size_t blksize;
+	/** Root directory record */
+	struct iso9660_dir_record root;
+};
+
+/** An ISO9660 directory entry */
+struct sanfs_iso9660_entry {
+	/** Directory record */
+	struct iso9660_dir_record record;
+	/** Name */
+	char name[ SANFS_ISO9660_NAME_MAX + 1 /* NUL */ ];
+};
+
+/**
+ * Mount ISO9660 filesystem
+ *
+ * @v fs		Filesystem
+ * @ret rc		Return status code
+ */
+static int sanfs_iso9660_mount ( struct sanfs *fs ) {
+	static const struct iso9660_primary_descriptor_fixed primary_check = {
+		.type = ISO9660_TYPE_PRIMARY,
+		.id = ISO9660_ID,
+	};
+	struct iso9660_primary_descriptor primary;
+	struct sanfs_iso9660 *iso;
+	size_t blksize;
+	int rc;
+
+	/* Read primary volume descriptor */
+	if ( ( rc = sanfs_read ( fs, ( ISO9660_PRIMARY_LBA * ISO9660_BLKSIZE ),
+				 &primary, sizeof ( primary ) ) ) != 0 )
+		return rc;
+	if ( memcmp ( &primary.fixed, &primary_check,
+		      sizeof ( primary_check ) ) != 0 )
+		return -EINVAL;
+	blksize = le16_to_cpu ( primary.blksize_le );
+	if ( ( blksize < 512 ) || ( blksize > ISO9660_BLKSIZE ) ||
+	     ( blksize & ( blksize - 1 ) ) )
+		return -EINVAL;
+
+	/* Allocate and populate private data */
+	iso = zalloc ( sizeof ( *iso ) );
+	if ( ! iso )
+		return -ENOMEM;
+	iso->blksize = blksize;
+	memcpy ( &iso->root, &primary.root, sizeof ( iso->root ) );
+	fs->priv = iso;
+
+	return 0;
+}
+
+/**
+ * Get data offset for directory record
+ *
+ * @v iso		ISO9660 filesystem
+ * @v record		Directory record
+ * @ret offset		Offset within filesystem
+ */
+static inline uint64_t
+sanfs_iso9660_offset ( struct sanfs_iso9660 *iso,
+		       const struct iso9660_dir_record *record ) {
+	return ( ( ( uint64_t ) ( le32_to_cpu ( record->extent_le ) +
+				  record->xattr_len ) ) * iso->blksize );
+}
+
+/**
+ * Parse Rock Ridge alternate name
+ *
+ * @v raw		Raw directory record
+ * @v entry		Directory entry to update
+ */
+static void sanfs_iso9660_rock_ridge ( const uint8_t *raw,
+				       struct sanfs_iso9660_entry *entry ) {
+	const struct iso9660_dir_record *record = &entry->record;
+	const struct iso9660_susp *susp;
+	size_t pos;
+	size_t len = 0;
+	size_t frag_len;
+	uint8_t flags;
+
+	/* Scan system use area (which follows the padded identifier) */
+	pos = ( sizeof ( *record ) + record->name_len +
+		( ( record->name_len & 1 ) ? 0 : 1 ) );
+	while ( ( pos + sizeof ( *susp ) ) <= record->len ) {
+		susp = ( ( const void * ) ( raw + pos ) );
+		if ( ( susp->len < sizeof ( *susp ) ) ||
+		     ( susp->len > ( record->len - pos ) ) )
+			break;
+		if ( ( memcmp ( susp->sig, "NM", sizeof ( susp->sig ) ) == 0 ) &&
+		     ( susp->len > sizeof ( *susp ) ) ) {
+			flags = raw[ pos + sizeof ( *susp ) ];
+			if ( flags & ( ISO9660_RR_NM_CURRENT |
+				       ISO9660_RR_NM_PARENT ) )
+				return;
+			frag_len = ( susp->len - sizeof ( *susp ) - 1 );
+			if ( frag_len > ( SANFS_ISO9660_NAME_MAX - len ) )
+				return;
+			memcpy ( &entry->name[len],
+				 ( raw + pos + sizeof ( *susp ) + 1 ), frag_len );
+			len += frag_len;
+			entry->name[len] = '\0';
+		}
+		pos += susp->len;
+	}
+}
+
+/**
+ * Read directory entry
+ *
+ * @v fs		Filesystem
+ * @v offset		Offset within directory (updated to next entry)
+ * @v end		End of directory
+ * @v entry		Directory entry to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_iso9660_entry ( struct sanfs *fs, uint64_t *offset,
+				 uint64_t end,
+				 struct sanfs_iso9660_entry *entry ) {
+	struct iso9660_dir_record *record = &entry->record;
+	uint8_t raw[ 255 /* record length is 8 bits */ ];
+	const char *name;
+	size_t len;
+	char *sep;
+	int rc;
+
+	while ( 1 ) {
+
+		/* Check for end of directory */
+		if ( ( *offset + sizeof ( record->len ) ) > end )
+			return -ENOENT;
+
+		/* Read record length, skipping to next sector if zero */
+		if ( ( rc = sanfs_read ( fs, *offset, &record->len,
+					 sizeof ( record->len ) ) ) != 0 )
+			return rc;
+		if ( ! record->len ) {
+			*offset = ( ( *offset | ( ISO9660_BLKSIZE - 1 ) ) + 1 );
+			continue;
+		}
+
+		/* Read record */
+		if ( ( record->len < sizeof ( *record ) ) ||
+		     ( ( *offset + record->len ) > end ) ) {
+			DBGC ( fs, "SANFS %p ISO9660 invalid directory record "
+			       "at %#llx\n", fs, *offset );
+			return -EIO;
+		}
+		if ( ( rc = sanfs_read ( fs, *offset, raw,
+					 record->len ) ) != 0 )
+			return rc;
+		memcpy ( record, raw, sizeof ( *record ) );
+		*offset += record->len;
+		if ( record->name_len > ( record->len - sizeof ( *record ) ) )
+			return -EIO;
+		break;
+	}
+
+	/* Construct name from ISO9660 file identifier */
+	name = ( ( const char * ) ( raw + sizeof ( *record ) ) );
+	len = record->name_len;
+	if ( ( len == 1 ) && ( name[0] == ISO9660_NAME_SELF ) ) {
+		name = ".";
+	} else if ( ( len == 1 ) && ( name[0] == ISO9660_NAME_PARENT ) ) {
+		name = "..";
+		len = 2;
+	}
+	memcpy ( entry->name, name, len );
+	entry->name[len] = '\0';
+	if ( ( sep = strchr ( entry->name, ';' ) ) )
+		*sep = '\0';
+	len = strlen ( entry->name );
+	if ( ( len > 1 ) && ( entry->name[ len - 1 ] == '.' ) &&
+	     ( strcmp ( entry->name, ".." ) != 0 ) )
+		entry->name[ len - 1 ] = '\0';
+
+	/* Use Rock Ridge alternate name, if present */
+	sanfs_iso9660_rock_ridge ( raw, entry );
+
+	return 0;
+}
+
+/**
+ * Find directory entry
+ *
+ * @v fs		Filesystem
+ * @v dir		Directory record
+ * @v name		Name to find
+ * @v len		Length of name
+ * @v entry		Directory entry to fill in
+ * @v offset		Offset of following directory entry to fill in
+ * @v end		End of directory to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_iso9660_find ( struct sanfs *fs,
+				const struct iso9660_dir_record *dir,
+				const char *name, size_t len,
+				struct sanfs_iso9660_entry *entry,
+				uint64_t *offset, uint64_t *end ) {
+	struct sanfs_iso9660 *iso = fs->priv;
+	int rc;
+
+	/* Scan directory */
+	*offset = sanfs_iso9660_offset ( iso, dir );
+	*end = ( *offset + le32_to_cpu ( dir->size_le ) );
+	while ( ( rc = sanfs_iso9660_entry ( fs, offset, *end,
+					     entry ) ) == 0 ) {
+		if ( ( strlen ( entry->name ) == len ) &&
+		     ( strncasecmp ( entry->name, name, len ) == 0 ) )
+			return 0;
+	}
+
+	return rc;
+}
+
+/**
+ * Open file
+ *
+ * @v fs		Filesystem
+ * @v path		Path within filesystem
+ * @v file		File to fill in
+ * @ret rc		Return status code
+ */
+static int sanfs_iso9660_open ( struct sanfs *fs, const char *path,
+				struct sanfs_file *file ) {
+	struct sanfs_iso9660 *iso = fs->priv;
+	struct sanfs_iso9660_entry *entry;
+	struct iso9660_dir_record *record;
+	const char *name;
+	uint64_t offset = 0;
+	uint64_t end = 0;
+	size_t size;
+	size_t len;
+	int rc;
+
+	/* Allocate directory entry */
+	entry = malloc ( sizeof ( *entry ) );
+	if ( ! entry ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	record = &entry->record;
+	memcpy ( record, &iso->root, sizeof ( *record ) );
+
+	/* Walk path */
+	while ( ( name = sanfs_component ( &path, &len ) ) ) {
+		if ( ! ( record->flags & ISO9660_DIR_DIRECTORY ) ) {
+			rc = -ENOTDIR;
+			goto err_walk;
+		}
+		if ( ( rc = sanfs_iso9660_find ( fs, record, name, len, entry,
+						 &offset, &end ) ) != 0 )
+			goto err_walk;
+	}
+	if ( record->flags & ISO9660_DIR_DIRECTORY ) {
+		rc = -EISDIR;
+		goto err_walk;
+	}
+
+	/* Construct extent list (including any further extents) */
+	while ( 1 ) {
+		size = le32_to_cpu ( record->size_le );
+		if ( ( file->len + size ) < file->len ) {
+			rc = -ERANGE;
+			goto err_extent;
+		}
+		if ( ( rc = sanfs_extend ( fs, file,
+					   sanfs_iso9660_offset ( iso, record ),
+					   size ) ) != 0 )
+			goto err_extent;
+		file->len += size;
+		if ( ! ( record->flags & ISO9660_DIR_MULTI_EXTENT ) )
+			break;
+		if ( ( rc = sanfs_iso9660_entry ( fs, &offset, end,
+						  entry ) ) != 0 )
+			goto err_extent;
+	}
+
+	rc = 0;
+
+ err_extent:
+ err_walk:
+	free ( entry );
+ err_alloc:
+	return rc;
+}
+
+/** ISO9660 filesystem */
+struct sanfs_type sanfs_iso9660_type __sanfs_type = {
+	.name = "ISO9660",
+	.mount = sanfs_iso9660_mount,
+	.open = sanfs_iso9660_open,
+};
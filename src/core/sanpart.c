@@ -0,0 +1,503 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * SAN device partition tables
+ *
+ * The partition table of a SAN device is parsed once, on first use,
+ * and the resulting list of partitions is held by the SAN device
+ * until it is freed.  A GUID partition table (identified by a
+ * protective MBR) has its header and partition entry array CRCs
+ * verified at this point, falling back to the backup table at the
+ * end of the device if the primary table is damaged.  Otherwise, the
+ * MBR primary partitions are used.
+ *
+ * The primary partition table lies within the initial blocks held by
+ * the SAN device's probe buffer, and so parsing it does not normally
+ * require any further device reads.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <byteswap.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/crc32.h>
+#include <ipxe/gpt.h>
+#include <ipxe/sanboot.h>
+#include <ipxe/sanpart.h>
+
+/** MBR partition table offset */
+#define SANPART_MBR_PARTITIONS 0x1be
+
+/** Number of MBR primary partitions */
+#define SANPART_MBR_COUNT 4
+
+/** MBR signature */
+#define SANPART_MBR_MAGIC 0xaa55
+
+/** An MBR partition table entry */
+struct sanpart_mbr_partition {
+	/** Bootable flag */
+	uint8_t bootable;
+	/** C/H/S start address */
+	uint8_t chs_start[3];
+	/** Partition type */
+	uint8_t type;
+	/** C/H/S end address */
+	uint8_t chs_end[3];
+	/** Starting logical block address */
+	uint32_t start;
+	/** Length in logical blocks */
+	uint32_t length;
+} __attribute__ (( packed ));
+
+/** An MBR partition table */
+struct sanpart_mbr {
+	/** Partition table entries */
+	struct sanpart_mbr_partition partitions[SANPART_MBR_COUNT];
+	/** Signature */
+	uint16_t magic;
+} __attribute__ (( packed ));
+
+/**
+ * Calculate GPT checksum
+ *
+ * @v data		Data
+ * @v len		Length of data
+ * @ret crc		CRC32 checksum
+ */
+static uint32_t sanpart_crc32 ( const void *data, size_t len ) {
+
+	return ( ~crc32_le ( 0xffffffffUL, data, len ) );
+}
+
+/**
+ * Calculate length of GPT partition entry array
+ *
+ * @v header		GPT header (in CPU byte order)
+ * @ret len		Length of partition entry array
+ */
+static inline size_t sanpart_gpt_len ( struct gpt_header *header ) {
+
+	return ( header->count * header->entry_size );
+}
+
+/**
+ * Read and validate GPT header
+ *
+ * @v sandev		SAN device
+ * @v lba		Logical block address of header
+ * @v block		Block buffer
+ * @v header		GPT header to fill in (in CPU byte order)
+ * @ret rc		Return status code
+ */
+static int sanpart_gpt_header ( struct san_device *sandev, uint64_t lba,
+				void *block, struct gpt_header *header ) {
+	struct gpt_header *raw = block;
+	size_t blksize = sandev_blksize ( sandev );
+	uint64_t capacity = sandev_capacity ( sandev );
+	uint64_t entries_end;
+	uint32_t crc;
+	size_t len;
+	int rc;
+
+	/* Read header */
+	if ( ( rc = sandev_read ( sandev, lba, 1,
+				  virt_to_user ( block ) ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not read GPT header at LBA "
+		       "%#llx: %s\n", sandev->drive, lba, strerror ( rc ) );
+		return rc;
+	}
+
+	/* Check signature */
+	if ( raw->signature != cpu_to_le64 ( GPT_SIGNATURE ) ) {
+		DBGC ( sandev, "SAN %#02x has no GPT header at LBA %#llx\n",
+		       sandev->drive, lba );
+		return -ENOENT;
+	}
+
+	/* Verify header checksum */
+	len = le32_to_cpu ( raw->header_size );
+	if ( ( len < GPT_HEADER_MIN_LEN ) || ( len > blksize ) ) {
+		DBGC ( sandev, "SAN %#02x GPT header at LBA %#llx has invalid "
+		       "length %#zx\n", sandev->drive, lba, len );
+		return -EINVAL;
+	}
+	crc = le32_to_cpu ( raw->header_crc );
+	raw->header_crc = 0;
+	if ( sanpart_crc32 ( raw, len ) != crc ) {
+		DBGC ( sandev, "SAN %#02x GPT header at LBA %#llx has bad "
+		       "CRC\n", sandev->drive, lba );
+		return -EINVAL;
+	}
+
+	/* Convert to CPU byte order */
+	memcpy ( header, raw, sizeof ( *header ) );
+	header->header_crc = crc;
+	header->my_lba = le64_to_cpu ( header->my_lba );
+	header->alternate_lba = le64_to_cpu ( header->alternate_lba );
+	header->first_usable = le64_to_cpu ( header->first_usable );
+	header->last_usable = le64_to_cpu ( header->last_usable );
+	header->entries_lba = le64_to_cpu ( header->entries_lba );
+	header->count = le32_to_cpu ( header->count );
+	header->entry_size = le32_to_cpu ( header->entry_size );
+	header->entries_crc = le32_to_cpu ( header->entries_crc );
+
+	/* Sanity checks */
+	if ( header->my_lba != lba ) {
+		DBGC ( sandev, "SAN %#02x GPT header at LBA %#llx claims to be "
+		       "at LBA %#llx\n", sandev->drive, lba, header->my_lba );
+		return -EINVAL;
+	}
+	if ( ( header->first_usable > header->last_usable ) ||
+	     ( header->last_usable >= capacity ) ) {
+		DBGC ( sandev, "SAN %#02x GPT header at LBA %#llx has invalid "
+		       "usable range [%#llx,%#llx]\n", sandev->drive, lba,
+		       header->first_usable, header->last_usable );
+		return -EINVAL;
+	}
+	if ( ( header->entry_size < GPT_ENTRY_MIN_LEN ) ||
+	     ( header->entry_size & ( sizeof ( uint64_t ) - 1 ) ) ||
+	     ( header->count >
+	       ( SANPART_GPT_MAX_LEN / header->entry_size ) ) ) {
+		DBGC ( sandev, "SAN %#02x GPT header at LBA %#llx has "
+		       "unsupported entry array %d x %#x\n", sandev->drive,
+		       lba, header->count, header->entry_size );
+		return -ENOTSUP;
+	}
+	entries_end = ( header->entries_lba +
+			( ( sanpart_gpt_len ( header ) + blksize - 1 ) /
+			  blksize ) );
+	if ( ( header->entries_lba > capacity ) ||
+	     ( entries_end > capacity ) ||
+	     ( ( entries_end > header->first_usable ) &&
+	       ( header->entries_lba <= header->last_usable ) ) ) {
+		DBGC ( sandev, "SAN %#02x GPT header at LBA %#llx has invalid "
+		       "entry array at [%#llx,%#llx)\n", sandev->drive, lba,
+		       header->entries_lba, entries_end );
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Read and validate GPT partition entry array
+ *
+ * @v sandev		SAN device
+ * @v header		GPT header (in CPU byte order)
+ * @ret entries		Partition entry array
+ * @ret rc		Return status code
+ *
+ * The caller is responsible for freeing the partition entry array.
+ */
+static int sanpart_gpt_entries ( struct san_device *sandev,
+				 struct gpt_header *header, void **entries ) {
+	size_t blksize = sandev_blksize ( sandev );
+	size_t len = sanpart_gpt_len ( header );
+	unsigned int count = ( ( len + blksize - 1 ) / blksize );
+	int rc;
+
+	/* Allocate and read entry array */
+	*entries = malloc ( count * blksize );
+	if ( ! *entries ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	if ( ( rc = sandev_read ( sandev, header->entries_lba, count,
+				  virt_to_user ( *entries ) ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not read GPT entries at LBA "
+		       "%#llx: %s\n", sandev->drive, header->entries_lba,
+		       strerror ( rc ) );
+		goto err_read;
+	}
+
+	/* Verify entry array checksum */
+	if ( sanpart_crc32 ( *entries, len ) != header->entries_crc ) {
+		DBGC ( sandev, "SAN %#02x GPT entries at LBA %#llx have bad "
+		       "CRC\n", sandev->drive, header->entries_lba );
+		rc = -EINVAL;
+		goto err_crc;
+	}
+
+	return 0;
+
+ err_crc:
+ err_read:
+	free ( *entries );
+	*entries = NULL;
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Parse GUID partition table
+ *
+ * @v sandev		SAN device
+ * @v block		Block buffer
+ * @ret rc		Return status code
+ */
+static int sanpart_parse_gpt ( struct san_device *sandev, void *block ) {
+	static const union uuid unused;
+	struct san_partition_table *table;
+	struct san_partition *partition;
+	const struct gpt_entry *entry;
+	struct gpt_header header;
+	uint64_t backup_lba;
+	uint64_t start;
+	uint64_t end;
+	unsigned int used;
+	unsigned int i;
+	void *entries;
+	int rc;
+
+	/* Read primary table, falling back to backup table */
+	if ( ( ( rc = sanpart_gpt_header ( sandev, GPT_PRIMARY_LBA, block,
+					   &header ) ) != 0 ) ||
+	     ( ( rc = sanpart_gpt_entries ( sandev, &header,
+					    &entries ) ) != 0 ) ) {
+		backup_lba = ( sandev_capacity ( sandev ) - 1 );
+		DBGC ( sandev, "SAN %#02x trying backup GPT at LBA %#llx\n",
+		       sandev->drive, backup_lba );
+		if ( ( rc = sanpart_gpt_header ( sandev, backup_lba, block,
+						 &header ) ) != 0 )
+			goto err_header;
+		if ( ( rc = sanpart_gpt_entries ( sandev, &header,
+						  &entries ) ) != 0 )
+			goto err_entries;
+	}
+
+	/* Count used entries */
+	used = 0;
+	for ( i = 0 ; i < header.count ; i++ ) {
+		entry = ( entries + ( i * header.entry_size ) );
+		if ( memcmp ( &entry->type, &unused, sizeof ( unused ) ) != 0 )
+			used++;
+	}
+
+	/* Allocate partition table */
+	table = zalloc ( sizeof ( *table ) +
+			 ( used * sizeof ( table->partition[0] ) ) );
+	if ( ! table ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	table->gpt = 1;
+	table->first_usable = header.first_usable;
+	table->last_usable = header.last_usable;
+
+	/* Record used entries */
+	for ( i = 0 ; i < header.count ; i++ ) {
+		entry = ( entries + ( i * header.entry_size ) );
+		if ( memcmp ( &entry->type, &unused, sizeof ( unused ) ) == 0 )
+			continue;
+		start = le64_to_cpu ( entry->start );
+		end = le64_to_cpu ( entry->end );
+		if ( ( start < header.first_usable ) || ( end < start ) ||
+		     ( end > header.last_usable ) ) {
+			DBGC ( sandev, "SAN %#02x GPT partition %d has invalid "
+			       "range [%#llx,%#llx]\n", sandev->drive,
+			       ( i + 1 ), start, end );
+			continue;
+		}
+		partition = &table->partition[ table->count++ ];
+		partition->index = ( i + 1 );
+		partition->lba = start;
+		partition->count = ( end - start + 1 );
+		partition->attributes = le64_to_cpu ( entry->attributes );
+		memcpy ( &partition->type_guid, &entry->type,
+			 sizeof ( partition->type_guid ) );
+		memcpy ( &partition->guid, &entry->guid,
+			 sizeof ( partition->guid ) );
+		DBGC ( sandev, "SAN %#02x GPT partition %d at [%#llx,%#llx] "
+		       "is %s\n", sandev->drive, partition->index, start, end,
+		       uuid_ntoa ( &partition->guid ) );
+	}
+	DBGC ( sandev, "SAN %#02x has GPT at LBA %#llx with %d partitions\n",
+	       sandev->drive, header.my_lba, table->count );
+
+	/* Record partition table */
+	sandev->partitions = table;
+	rc = 0;
+
+ err_alloc:
+	free ( entries );
+ err_entries:
+ err_header:
+	return rc;
+}
+
+/**
+ * Parse MBR partition table
+ *
+ * @v sandev		SAN device
+ * @v mbr		MBR partition table
+ * @ret rc		Return status code
+ */
+static int sanpart_parse_mbr ( struct san_device *sandev,
+			       const struct sanpart_mbr *mbr ) {
+	const struct sanpart_mbr_partition *entry;
+	struct san_partition_table *table;
+	struct san_partition *partition;
+	uint64_t capacity = sandev_capacity ( sandev );
+	uint64_t start;
+	uint64_t count;
+	unsigned int i;
+
+	/* Allocate partition table */
+	table = zalloc ( sizeof ( *table ) +
+			 ( SANPART_MBR_COUNT * sizeof ( table->partition[0] ) ));
+	if ( ! table )
+		return -ENOMEM;
+	table->first_usable = 1;
+	table->last_usable = ( capacity - 1 );
+
+	/* Record primary partitions */
+	for ( i = 0 ; i < SANPART_MBR_COUNT ; i++ ) {
+		entry = &mbr->partitions[i];
+		/* Skip empty and extended partitions */
+		if ( ( entry->type == 0x00 ) || ( entry->type == 0x05 ) ||
+		     ( entry->type == 0x0f ) || ( entry->type == 0x85 ) )
+			continue;
+		start = le32_to_cpu ( entry->start );
+		count = le32_to_cpu ( entry->length );
+		if ( ( start == 0 ) || ( count == 0 ) || ( start > capacity ) ||
+		     ( count > ( capacity - start ) ) ) {
+			DBGC ( sandev, "SAN %#02x MBR partition %d has invalid "
+			       "range [%#llx,%#llx)\n", sandev->drive,
+			       ( i + 1 ), start, ( start + count ) );
+			continue;
+		}
+		partition = &table->partition[ table->count++ ];
+		partition->index = ( i + 1 );
+		partition->lba = start;
+		partition->count = count;
+		partition->type = entry->type;
+		DBGC ( sandev, "SAN %#02x MBR partition %d at [%#llx,%#llx) "
+		       "has type %02x\n", sandev->drive, partition->index,
+		       start, ( start + count ), partition->type );
+	}
+
+	/* Record partition table */
+	sandev->partitions = table;
+	return 0;
+}
+
+/**
+ * Parse SAN device partition table
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ *
+ * The partition table is parsed only once, and is held in @c
+ * sandev->partitions until the SAN device is freed (or the table
+ * is overwritten).
+ */
+int sanpart_parse ( struct san_device *sandev ) {
+	const struct sanpart_mbr *mbr;
+	size_t blksize = sandev_blksize ( sandev );
+	void *block;
+	unsigned int i;
+	int protective = 0;
+	int rc;
+
+	/* Do nothing if partition table is already cached */
+	if ( sandev->partitions )
+		return 0;
+
+	/* CD-ROMs do not have partition tables */
+	if ( sandev->is_cdrom || ( blksize < sizeof ( *mbr ) ) )
+		return -ENOTTY;
+
+	/* Allocate block buffer */
+	block = malloc ( blksize );
+	if ( ! block ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+
+	/* Read MBR */
+	if ( ( rc = sandev_read ( sandev, 0, 1,
+				  virt_to_user ( block ) ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not read MBR: %s\n",
+		       sandev->drive, strerror ( rc ) );
+		goto err_read;
+	}
+	mbr = ( block + SANPART_MBR_PARTITIONS );
+	if ( mbr->magic != cpu_to_le16 ( SANPART_MBR_MAGIC ) ) {
+		DBGC ( sandev, "SAN %#02x has no partition table\n",
+		       sandev->drive );
+		rc = -ENOENT;
+		goto err_magic;
+	}
+
+	/* Use GUID partition table if MBR is a protective MBR */
+	for ( i = 0 ; i < SANPART_MBR_COUNT ; i++ ) {
+		if ( mbr->partitions[i].type == GPT_PROTECTIVE_TYPE )
+			protective = 1;
+	}
+	if ( protective ) {
+		if ( ( rc = sanpart_parse_gpt ( sandev, block ) ) != 0 )
+			goto err_parse;
+	} else {
+		if ( ( rc = sanpart_parse_mbr ( sandev, mbr ) ) != 0 )
+			goto err_parse;
+	}
+
+ err_parse:
+ err_magic:
+ err_read:
+	free ( block );
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Find SAN device partition
+ *
+ * @v sandev		SAN device
+ * @v index		Partition number
+ * @ret partition	Partition, or NULL if not found
+ */
+struct san_partition * sanpart_find ( struct san_device *sandev,
+				      unsigned int index ) {
+	struct san_partition_table *table;
+	unsigned int i;
+
+	/* Parse partition table, if not already done */
+	if ( sanpart_parse ( sandev ) != 0 )
+		return NULL;
+
+	/* Find partition */
+	table = sandev->partitions;
+	for ( i = 0 ; i < table->count ; i++ ) {
+		if ( table->partition[i].index == index )
+			return &table->partition[i];
+	}
+
+	return NULL;
+}
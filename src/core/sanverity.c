@@ -0,0 +1,597 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * SAN device hash tree verification
+ *
+ * A verified SAN device carries a dm-verity hash tree (as written by
+ * "veritysetup format --hash-offset=...") following its data area.
+ * Each data block is digested (with a salt) into a leaf hash block,
+ * each hash block is in turn digested into the level above, and the
+ * single top-level hash block is digested into the root hash, which
+ * is compiled into the boot ROM and is therefore trusted.
+ *
+ * Every read is checked against the tree before being returned.
+ * Hash blocks are verified on first use and then held in a cache, so
+ * that reading a data block whose leaf hash block is already cached
+ * costs only the digest of the data block itself.  A read that fails
+ * verification fails as a whole, and the caller's buffer is cleared
+ * rather than being left holding unverified data.
+ *
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <byteswap.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/umalloc.h>
+#include <ipxe/crypto.h>
+#include <ipxe/sha256.h>
+#include <ipxe/base16.h>
+#include <ipxe/sanboot.h>
+#include <ipxe/sanverity.h>
+#include <config/sanboot.h>
+
+/* Disambiguate the various error causes */
+#define EACCES_DATA __einfo_error ( EINFO_EACCES_DATA )
+#define EINFO_EACCES_DATA \
+	__einfo_uniqify ( EINFO_EACCES, 0x01, \
+			  "Data block failed verification" )
+#define EACCES_HASH __einfo_error ( EINFO_EACCES_HASH )
+#define EINFO_EACCES_HASH \
+	__einfo_uniqify ( EINFO_EACCES, 0x02, \
+			  "Hash block failed verification" )
+#define EINVAL_ROOT __einfo_error ( EINFO_EINVAL_ROOT )
+#define EINFO_EINVAL_ROOT \
+	__einfo_uniqify ( EINFO_EINVAL, 0x01, \
+			  "Invalid root hash" )
+#define EINVAL_SUPERBLOCK __einfo_error ( EINFO_EINVAL_SUPERBLOCK )
+#define EINFO_EINVAL_SUPERBLOCK \
+	__einfo_uniqify ( EINFO_EINVAL, 0x02, \
+			  "Invalid superblock" )
+#define ENOTSUP_VERSION __einfo_error ( EINFO_ENOTSUP_VERSION )
+#define EINFO_ENOTSUP_VERSION \
+	__einfo_uniqify ( EINFO_ENOTSUP, 0x01, \
+			  "Unsupported superblock version or hash type" )
+#define ENOTSUP_ALGORITHM __einfo_error ( EINFO_ENOTSUP_ALGORITHM )
+#define EINFO_ENOTSUP_ALGORITHM \
+	__einfo_uniqify ( EINFO_ENOTSUP, 0x02, \
+			  "Unsupported hash algorithm" )
+#define ENOTSUP_BLKSIZE __einfo_error ( EINFO_ENOTSUP_BLKSIZE )
+#define EINFO_ENOTSUP_BLKSIZE \
+	__einfo_uniqify ( EINFO_ENOTSUP, 0x03, \
+			  "Unsupported block size" )
+#define ENOTSUP_LEVELS __einfo_error ( EINFO_ENOTSUP_LEVELS )
+#define EINFO_ENOTSUP_LEVELS \
+	__einfo_uniqify ( EINFO_ENOTSUP, 0x04, \
+			  "Too many hash tree levels" )
+#define ERANGE_DATA __einfo_error ( EINFO_ERANGE_DATA )
+#define EINFO_ERANGE_DATA \
+	__einfo_uniqify ( EINFO_ERANGE, 0x01, \
+			  "Data area exceeds device" )
+
+static int sanverity_expected ( struct san_device *sandev, unsigned int level,
+				uint64_t index, void *digest );
+
+/**
+ * Calculate block size shift
+ *
+ * @v sandev		SAN device
+ * @v len		Block size (in bytes)
+ * @v shift		Block size shift to fill in
+ * @ret rc		Return status code
+ */
+static int sanverity_shift ( struct san_device *sandev, size_t len,
+			     unsigned int *shift ) {
+	size_t blksize = sandev->capacity.blksize;
+
+	/* Find shift relative to underlying block size */
+	for ( *shift = 0 ; ( blksize << *shift ) < len ; (*shift)++ ) {}
+
+	/* Check that block size is a power-of-two multiple of the
+	 * underlying block size, and is large enough to hold at
+	 * least 16 digests.
+	 */
+	if ( ( ( blksize << *shift ) != len ) ||
+	     ( len & ( len - 1 ) ) ||
+	     ( len < ( 16 * SHA256_DIGEST_SIZE ) ) ) {
+		DBGC ( sandev, "SAN %#02x cannot verify %zd-byte blocks with "
+		       "%zd-byte underlying blocks\n",
+		       sandev->drive, len, blksize );
+		return -ENOTSUP_BLKSIZE;
+	}
+
+	return 0;
+}
+
+/**
+ * Get verified hash block
+ *
+ * @v sandev		SAN device
+ * @v level		Hash tree level
+ * @v index		Hash block index within level
+ * @v block		Hash block to fill in
+ * @ret rc		Return status code
+ *
+ * The hash block is returned from the cache if present, otherwise it
+ * is read from the device, verified against the level above, and
+ * added to the cache.  The returned pointer is valid only until the
+ * next call.
+ */
+static int sanverity_hash_block ( struct san_device *sandev,
+				  unsigned int level, uint64_t index,
+				  const void **block ) {
+	struct san_verity *verity = sandev->verity;
+	uint8_t expected[SHA256_DIGEST_SIZE];
+	uint8_t actual[SHA256_DIGEST_SIZE];
+	uint64_t number = ( verity->level[level] + index );
+	unsigned int slot = ( number & ( verity->cache_count - 1 ) );
+	userptr_t cached =
+		userptr_add ( verity->cache, ( slot * verity->hash_len ) );
+	int rc;
+
+	/* Use cached hash block, if present */
+	*block = user_to_virt ( cached, 0 );
+	if ( verity->tag[slot] == ( number + 1 ) )
+		return 0;
+
+	/* Get expected digest from the level above.  This may itself
+	 * need to read (and evict) cached hash blocks, and so must be
+	 * complete before the cache slot is reused.
+	 */
+	if ( ( rc = sanverity_expected ( sandev, ( level + 1 ), index,
+					 expected ) ) != 0 )
+		return rc;
+
+	/* Read hash block into cache slot */
+	verity->tag[slot] = 0;
+	if ( ( rc = sandev_read_unverified ( sandev,
+					     ( number << verity->hash_shift ),
+					     ( 1 << verity->hash_shift ),
+					     cached ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not read hash block %#llx: "
+		       "%s\n", sandev->drive, ( ( unsigned long long ) number ),
+		       strerror ( rc ) );
+		return rc;
+	}
+
+	/* Verify hash block */
+	sha256_multi ( &verity->salted, *block, verity->hash_len, 1, actual );
+	if ( memcmp ( actual, expected, sizeof ( actual ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x hash block %#llx (level %d) failed "
+		       "verification\n", sandev->drive,
+		       ( ( unsigned long long ) number ), level );
+		return -EACCES_HASH;
+	}
+
+	/* Record in cache */
+	verity->tag[slot] = ( number + 1 );
+	DBGC2 ( sandev, "SAN %#02x verified hash block %#llx (level %d)\n",
+		sandev->drive, ( ( unsigned long long ) number ), level );
+
+	return 0;
+}
+
+/**
+ * Get expected digest of block
+ *
+ * @v sandev		SAN device
+ * @v level		Hash tree level holding digest
+ * @v index		Block index within the level below
+ * @v digest		Digest to fill in
+ * @ret rc		Return status code
+ *
+ * Level 0 holds the digests of the data blocks, and each subsequent
+ * level holds the digests of the hash blocks in the level below.  The
+ * digest of the single hash block in the topmost level (or of the
+ * single data block, if there are no hash tree levels) is the root
+ * hash.
+ */
+static int sanverity_expected ( struct san_device *sandev, unsigned int level,
+				uint64_t index, void *digest ) {
+	struct san_verity *verity = sandev->verity;
+	unsigned int entry = ( index & ( ( 1 << verity->fanout_shift ) - 1 ) );
+	size_t stride = ( verity->hash_len >> verity->fanout_shift );
+	const void *block;
+	int rc;
+
+	/* Use root hash above topmost level */
+	if ( level == verity->levels ) {
+		assert ( index == 0 );
+		memcpy ( digest, verity->root, sizeof ( verity->root ) );
+		return 0;
+	}
+
+	/* Get verified hash block */
+	if ( ( rc = sanverity_hash_block ( sandev, level,
+					   ( index >> verity->fanout_shift ),
+					   &block ) ) != 0 )
+		return rc;
+
+	/* Extract digest */
+	memcpy ( digest, ( block + ( entry * stride ) ), SHA256_DIGEST_SIZE );
+	return 0;
+}
+
+/**
+ * Read and verify whole data blocks
+ *
+ * @v sandev		SAN device
+ * @v block		Starting data block
+ * @v count		Number of data blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ *
+ * The data blocks are read directly into the caller's buffer and
+ * verified in place, digesting several blocks in parallel where
+ * supported by the CPU.
+ */
+static int sanverity_read_blocks ( struct san_device *sandev, uint64_t block,
+				   unsigned int count, userptr_t buffer ) {
+	struct san_verity *verity = sandev->verity;
+	uint8_t actual[SHA256_LANES][SHA256_DIGEST_SIZE];
+	uint8_t expected[SHA256_DIGEST_SIZE];
+	const void *data;
+	unsigned int lanes;
+	unsigned int lane;
+	unsigned int i;
+	int rc;
+
+	/* Read data blocks */
+	if ( ( rc = sandev_read_unverified ( sandev,
+					     ( block << verity->data_shift ),
+					     ( count << verity->data_shift ),
+					     buffer ) ) != 0 )
+		return rc;
+
+	/* Verify data blocks */
+	data = user_to_virt ( buffer, 0 );
+	for ( i = 0 ; i < count ; i += lanes ) {
+		lanes = ( count - i );
+		if ( lanes > SHA256_LANES )
+			lanes = SHA256_LANES;
+		sha256_multi ( &verity->salted, data, verity->data_len, lanes,
+			       actual );
+		for ( lane = 0 ; lane < lanes ; lane++ ) {
+			if ( ( rc = sanverity_expected ( sandev, 0, block,
+							 expected ) ) != 0 )
+				goto err;
+			if ( memcmp ( actual[lane], expected,
+				      sizeof ( expected ) ) != 0 ) {
+				DBGC ( sandev, "SAN %#02x data block %#llx "
+				       "failed verification\n", sandev->drive,
+				       ( ( unsigned long long ) block ) );
+				rc = -EACCES_DATA;
+				goto err;
+			}
+			data += verity->data_len;
+			block++;
+		}
+	}
+
+	return 0;
+
+ err:
+	memset_user ( buffer, 0, 0, ( count * verity->data_len ) );
+	return rc;
+}
+
+/**
+ * Read from verified SAN device
+ *
+ * @v sandev		SAN device
+ * @v lba		Starting logical block address (in underlying blocks)
+ * @v count		Number of underlying blocks
+ * @v buffer		Data buffer
+ * @ret rc		Return status code
+ */
+int sanverity_read ( struct san_device *sandev, uint64_t lba,
+		     unsigned int count, userptr_t buffer ) {
+	struct san_verity *verity = sandev->verity;
+	size_t blksize = sandev->capacity.blksize;
+	unsigned int mask = ( ( 1 << verity->data_shift ) - 1 );
+	uint64_t limit = ( verity->data_blocks << verity->data_shift );
+	uint64_t block;
+	userptr_t bounce;
+	unsigned int offset;
+	unsigned int frag;
+	int rc;
+
+	/* Check that range lies within verified data area */
+	if ( ( lba > limit ) || ( count > ( limit - lba ) ) ) {
+		DBGC ( sandev, "SAN %#02x read [%#llx,%#llx) outside verified "
+		       "area [0,%#llx)\n", sandev->drive,
+		       ( ( unsigned long long ) lba ),
+		       ( ( unsigned long long ) ( lba + count ) ),
+		       ( ( unsigned long long ) limit ) );
+		return -ERANGE;
+	}
+
+	/* Read data blocks */
+	while ( count ) {
+
+		block = ( lba >> verity->data_shift );
+		offset = ( lba & mask );
+		if ( offset || ( count <= mask ) ) {
+
+			/* Read partial data block via bounce buffer */
+			frag = ( ( mask + 1 ) - offset );
+			if ( frag > count )
+				frag = count;
+			bounce = virt_to_user ( verity->bounce );
+			if ( ( rc = sanverity_read_blocks ( sandev, block, 1,
+							    bounce ) ) != 0 )
+				return rc;
+			memcpy_user ( buffer, 0, bounce, ( offset * blksize ),
+				      ( frag * blksize ) );
+
+		} else {
+
+			/* Read whole data blocks directly */
+			frag = ( count & ~mask );
+			if ( ( rc = sanverity_read_blocks ( sandev, block,
+					( frag >> verity->data_shift ),
+					buffer ) ) != 0 )
+				return rc;
+		}
+
+		/* Move to next fragment */
+		buffer = userptr_add ( buffer, ( frag * blksize ) );
+		lba += frag;
+		count -= frag;
+	}
+
+	return 0;
+}
+
+/**
+ * Parse dm-verity superblock
+ *
+ * @v sandev		SAN device
+ * @v verity		Hash tree
+ * @v sb		Superblock
+ * @ret rc		Return status code
+ */
+static int sanverity_parse ( struct san_device *sandev,
+			     struct san_verity *verity,
+			     const struct san_verity_superblock *sb ) {
+	size_t salt_len;
+	uint64_t position;
+	uint64_t count;
+	unsigned int i;
+	int rc;
+
+	/* Check signature, version and algorithm */
+	if ( memcmp ( sb->signature, SAN_VERITY_SIGNATURE,
+		      sizeof ( sb->signature ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x has no dm-verity superblock\n",
+		       sandev->drive );
+		return -EINVAL_SUPERBLOCK;
+	}
+	if ( ( le32_to_cpu ( sb->version ) != SAN_VERITY_VERSION ) ||
+	     ( le32_to_cpu ( sb->hash_type ) != SAN_VERITY_HASH_NORMAL ) ) {
+		DBGC ( sandev, "SAN %#02x unsupported dm-verity version %d "
+		       "type %d\n", sandev->drive, le32_to_cpu ( sb->version ),
+		       le32_to_cpu ( sb->hash_type ) );
+		return -ENOTSUP_VERSION;
+	}
+	if ( strncmp ( sb->algorithm, SAN_VERITY_ALGORITHM,
+		       sizeof ( sb->algorithm ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x unsupported dm-verity algorithm "
+		       "\"%.32s\"\n", sandev->drive, sb->algorithm );
+		return -ENOTSUP_ALGORITHM;
+	}
+
+	/* Record block sizes */
+	verity->data_len = le32_to_cpu ( sb->data_block_size );
+	verity->hash_len = le32_to_cpu ( sb->hash_block_size );
+	if ( ( rc = sanverity_shift ( sandev, verity->data_len,
+				      &verity->data_shift ) ) != 0 )
+		return rc;
+	if ( ( rc = sanverity_shift ( sandev, verity->hash_len,
+				      &verity->hash_shift ) ) != 0 )
+		return rc;
+	verity->fanout_shift =
+		( fls ( verity->hash_len / SHA256_DIGEST_SIZE ) - 1 );
+
+	/* Check that data area lies within device */
+	verity->data_blocks = le64_to_cpu ( sb->data_blocks );
+	if ( ( ! verity->data_blocks ) ||
+	     ( verity->data_blocks >
+	       ( sandev->capacity.blocks >> verity->data_shift ) ) ) {
+		DBGC ( sandev, "SAN %#02x dm-verity data area (%#llx blocks) "
+		       "exceeds device\n", sandev->drive,
+		       ( ( unsigned long long ) verity->data_blocks ) );
+		return -ERANGE_DATA;
+	}
+
+	/* Construct salted digest context */
+	salt_len = le16_to_cpu ( sb->salt_size );
+	if ( salt_len > sizeof ( sb->salt ) ) {
+		DBGC ( sandev, "SAN %#02x invalid dm-verity salt length "
+		       "%zd\n", sandev->drive, salt_len );
+		return -EINVAL_SUPERBLOCK;
+	}
+	digest_init ( &sha256_algorithm, &verity->salted );
+	digest_update ( &sha256_algorithm, &verity->salted, sb->salt,
+			salt_len );
+
+	/* Count hash tree levels, and the hash blocks in each level */
+	count = verity->data_blocks;
+	while ( count > 1 ) {
+		if ( verity->levels >= SAN_VERITY_MAX_LEVELS )
+			return -ENOTSUP_LEVELS;
+		count = ( ( count + ( 1 << verity->fanout_shift ) - 1 ) >>
+			  verity->fanout_shift );
+		verity->level[verity->levels++] = count;
+	}
+
+	/* Lay out levels following the superblock, topmost first */
+	position = ( ( SAN_VERITY_HASH_OFFSET + sizeof ( *sb ) +
+		       verity->hash_len - 1 ) / verity->hash_len );
+	for ( i = verity->levels ; i-- ; ) {
+		count = verity->level[i];
+		verity->level[i] = position;
+		position += count;
+	}
+	DBGC ( sandev, "SAN %#02x verifying %#llx %zd-byte blocks using "
+	       "%d-level tree ending at %#llx %zd-byte blocks\n",
+	       sandev->drive, ( ( unsigned long long ) verity->data_blocks ),
+	       verity->data_len, verity->levels,
+	       ( ( unsigned long long ) position ), verity->hash_len );
+
+	return 0;
+}
+
+/**
+ * Attach hash tree to SAN device
+ *
+ * @v sandev		SAN device
+ * @ret rc		Return status code
+ *
+ * The device capacity is reduced to cover only the verified data
+ * area.
+ */
+int sanverity_attach ( struct san_device *sandev ) {
+	size_t blksize = sandev->capacity.blksize;
+	struct san_verity *verity;
+	unsigned int count;
+	void *sb;
+	int len;
+	int rc;
+
+	/* Sanity check */
+	assert ( sandev->parent == NULL );
+	assert ( sandev->verity == NULL );
+
+	/* Allocate and initialise structure */
+	verity = zalloc ( sizeof ( *verity ) );
+	if ( ! verity ) {
+		rc = -ENOMEM;
+		goto err_alloc;
+	}
+	sandev->verity = verity;
+
+	/* Parse root hash */
+	len = base16_decode ( SAN_VERITY_ROOT_HASH, verity->root,
+			      sizeof ( verity->root ) );
+	if ( len != ( ( int ) sizeof ( verity->root ) ) ) {
+		DBGC ( sandev, "SAN %#02x invalid root hash \"%s\"\n",
+		       sandev->drive, SAN_VERITY_ROOT_HASH );
+		rc = -EINVAL_ROOT;
+		goto err_root;
+	}
+
+	/* Read superblock */
+	if ( SAN_VERITY_HASH_OFFSET % blksize ) {
+		DBGC ( sandev, "SAN %#02x misaligned hash offset %#llx\n",
+		       sandev->drive,
+		       ( ( unsigned long long ) SAN_VERITY_HASH_OFFSET ) );
+		rc = -EINVAL_SUPERBLOCK;
+		goto err_offset;
+	}
+	count = ( ( sizeof ( struct san_verity_superblock ) + blksize - 1 ) /
+		  blksize );
+	sb = malloc ( count * blksize );
+	if ( ! sb ) {
+		rc = -ENOMEM;
+		goto err_alloc_sb;
+	}
+	if ( ( rc = sandev_read_unverified ( sandev,
+					     ( SAN_VERITY_HASH_OFFSET /
+					       blksize ), count,
+					     virt_to_user ( sb ) ) ) != 0 ) {
+		DBGC ( sandev, "SAN %#02x could not read dm-verity superblock: "
+		       "%s\n", sandev->drive, strerror ( rc ) );
+		goto err_read_sb;
+	}
+
+	/* Parse superblock */
+	if ( ( rc = sanverity_parse ( sandev, verity, sb ) ) != 0 )
+		goto err_parse;
+
+	/* Allocate hash block cache */
+	verity->cache_count = ( 1 << ( fls ( SAN_VERITY_CACHE ) - 1 ) );
+	verity->tag = zalloc ( verity->cache_count *
+			       sizeof ( verity->tag[0] ) );
+	if ( ! verity->tag ) {
+		rc = -ENOMEM;
+		goto err_alloc_tag;
+	}
+	verity->cache = umalloc ( verity->cache_count * verity->hash_len );
+	if ( ! verity->cache ) {
+		rc = -ENOMEM;
+		goto err_alloc_cache;
+	}
+
+	/* Allocate bounce buffer */
+	verity->bounce = malloc ( verity->data_len );
+	if ( ! verity->bounce ) {
+		rc = -ENOMEM;
+		goto err_alloc_bounce;
+	}
+
+	/* Limit capacity to verified data area */
+	sandev->capacity.blocks = ( verity->data_blocks << verity->data_shift );
+
+	free ( sb );
+	return 0;
+
+ err_alloc_bounce:
+ err_alloc_cache:
+ err_alloc_tag:
+ err_parse:
+ err_read_sb:
+	free ( sb );
+ err_alloc_sb:
+ err_offset:
+ err_root:
+	/* Also frees any partially constructed hash tree */
+	sanverity_discard ( sandev );
+ err_alloc:
+	return rc;
+}
+
+/**
+ * Discard SAN device hash tree
+ *
+ * @v sandev		SAN device
+ */
+void sanverity_discard ( struct san_device *sandev ) {
+	struct san_verity *verity = sandev->verity;
+
+	/* Do nothing unless a hash tree is attached */
+	if ( ! verity )
+		return;
+
+	/* Free hash tree */
+	free ( verity->bounce );
+	ufree ( verity->cache );
+	free ( verity->tag );
+	free ( verity );
+	sandev->verity = NULL;
+}
@@ -405,6 +405,9 @@ parse_settings_name ( const char *name, get_child_settings_t get_child ) {
  */
 struct settings * find_settings ( const char *name ) {
 
+	/* Ensure all settings blocks are registered */
+	initialise_deferred();
+
 	return parse_settings_name ( name, find_child_settings );
 }
 
@@ -678,6 +681,9 @@ int fetch_setting ( struct settings *settings, const struct setting *setting,
 	if ( fetched )
 		memcpy ( fetched, setting, sizeof ( *fetched ) );
 
+	/* Ensure all settings blocks are registered */
+	initialise_deferred();
+
 	/* Find target settings block */
 	settings = settings_target ( settings );
 
@@ -2680,4 +2686,5 @@ static void builtin_init ( void ) {
 /** Built-in settings initialiser */
 struct init_fn builtin_init_fn __init_fn ( INIT_NORMAL ) = {
 	.initialise = builtin_init,
+	.deferrable = 1,
 };
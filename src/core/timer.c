@@ -30,10 +30,19 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/nap.h>
 #include <ipxe/init.h>
 #include <ipxe/timer.h>
+#include <ipxe/nstime.h>
 
 /** Current timer */
 static struct timer *timer;
 
+/** Nanosecond clock multiplier
+ *
+ * This is the number of nanoseconds per cycle counter increment,
+ * scaled by 2^NSTIME_SHIFT, or zero if the cycle counter has not
+ * been calibrated.
+ */
+uint32_t nstime_mult;
+
 /**
  * Get current system time in ticks
  *
@@ -52,6 +61,17 @@ unsigned long currticks ( void ) {
 	return timer->currticks();
 }
 
+/**
+ * Get current time in nanoseconds from system timer
+ *
+ * @ret ns		Current time, in nanoseconds
+ */
+uint64_t nstime_ticks ( void ) {
+
+	return ( ( ( uint64_t ) currticks() ) *
+		 ( ( 1000 * NSTIME_PER_MS ) / TICKS_PER_SEC ) );
+}
+
 /**
  * Delay for a fixed number of microseconds
  *
@@ -63,30 +63,45 @@ void xferbuf_free ( struct xfer_buffer *xferbuf ) {
 }
 
 /**
- * Ensure that data transfer buffer is large enough for the specified size
+ * Resize data transfer buffer
  *
  * @v xferbuf		Data transfer buffer
- * @v len		Required minimum size
+ * @v len		New size
  * @ret rc		Return status code
  */
-static int xferbuf_ensure_size ( struct xfer_buffer *xferbuf, size_t len ) {
+int xferbuf_resize ( struct xfer_buffer *xferbuf, size_t len ) {
 	int rc;
 
-	/* If buffer is already large enough, do nothing */
-	if ( len <= xferbuf->len )
-		return 0;
-
-	/* Extend buffer */
+	/* Resize buffer */
 	if ( ( rc = xferbuf->op->realloc ( xferbuf, len ) ) != 0 ) {
-		DBGC ( xferbuf, "XFERBUF %p could not extend buffer to "
+		DBGC ( xferbuf, "XFERBUF %p could not resize buffer to "
 		       "%zd bytes: %s\n", xferbuf, len, strerror ( rc ) );
 		return rc;
 	}
 	xferbuf->len = len;
+	if ( xferbuf->pos > len )
+		xferbuf->pos = len;
 
 	return 0;
 }
 
+/**
+ * Ensure that data transfer buffer is large enough for the specified size
+ *
+ * @v xferbuf		Data transfer buffer
+ * @v len		Required minimum size
+ * @ret rc		Return status code
+ */
+static int xferbuf_ensure_size ( struct xfer_buffer *xferbuf, size_t len ) {
+
+	/* If buffer is already large enough, do nothing */
+	if ( len <= xferbuf->len )
+		return 0;
+
+	/* Extend buffer */
+	return xferbuf_resize ( xferbuf, len );
+}
+
 /**
  * Write to data transfer buffer
  *
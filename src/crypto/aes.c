@@ -39,6 +39,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/ecb.h>
 #include <ipxe/cbc.h>
 #include <ipxe/gcm.h>
+#include <ipxe/xts.h>
 #include <ipxe/aes.h>
 
 /** AES strides
@@ -387,6 +388,94 @@ static void aes_final ( const struct aes_table *table, size_t stride,
 	aes_addroundkey ( out, key );
 }
 
+/**
+ * Encrypt data blocks
+ *
+ * @v aes		AES context
+ * @v src		Data to encrypt
+ * @v dst		Buffer for encrypted data
+ * @v count		Number of blocks
+ */
+void generic_aes_encrypt_blocks ( struct aes_context *aes, const void *src,
+				  void *dst, size_t count ) {
+	union aes_matrix buffer[2];
+	union aes_matrix *in;
+	union aes_matrix *out;
+	unsigned int rounds = aes->rounds;
+
+	while ( count-- ) {
+
+		/* Initialise input state */
+		in = &buffer[0];
+		out = &buffer[1];
+		memcpy ( in, src, sizeof ( *in ) );
+
+		/* Perform initial round (AddRoundKey) */
+		aes_addroundkey ( in, &aes->encrypt.key[0] );
+
+		/* Perform intermediate rounds (ShiftRows, SubBytes,
+		 * MixColumns, AddRoundKey).
+		 */
+		aes_encrypt_rounds ( in, out, &aes->encrypt.key[1],
+				     ( rounds - 2 ) );
+		in = out;
+
+		/* Perform final round (ShiftRows, SubBytes, AddRoundKey) */
+		out = dst;
+		aes_final ( &aes_mixcolumns, AES_STRIDE_SHIFTROWS, in, out,
+			    &aes->encrypt.key[ rounds - 1 ] );
+
+		/* Move to next block */
+		src += sizeof ( *in );
+		dst += sizeof ( *out );
+	}
+}
+
+/**
+ * Decrypt data blocks
+ *
+ * @v aes		AES context
+ * @v src		Data to decrypt
+ * @v dst		Buffer for decrypted data
+ * @v count		Number of blocks
+ */
+void generic_aes_decrypt_blocks ( struct aes_context *aes, const void *src,
+				  void *dst, size_t count ) {
+	union aes_matrix buffer[2];
+	union aes_matrix *in;
+	union aes_matrix *out;
+	unsigned int rounds = aes->rounds;
+
+	while ( count-- ) {
+
+		/* Initialise input state */
+		in = &buffer[0];
+		out = &buffer[1];
+		memcpy ( in, src, sizeof ( *in ) );
+
+		/* Perform initial round (AddRoundKey) */
+		aes_addroundkey ( in, &aes->decrypt.key[0] );
+
+		/* Perform intermediate rounds (InvShiftRows, InvSubBytes,
+		 * InvMixColumns, AddRoundKey).
+		 */
+		aes_decrypt_rounds ( in, out, &aes->decrypt.key[1],
+				     ( rounds - 2 ) );
+		in = out;
+
+		/* Perform final round (InvShiftRows, InvSubBytes,
+		 * AddRoundKey)
+		 */
+		out = dst;
+		aes_final ( &aes_invmixcolumns, AES_STRIDE_INVSHIFTROWS,
+			    in, out, &aes->decrypt.key[ rounds - 1 ] );
+
+		/* Move to next block */
+		src += sizeof ( *in );
+		dst += sizeof ( *out );
+	}
+}
+
 /**
  * Encrypt data
  *
@@ -394,33 +483,18 @@ static void aes_final ( const struct aes_table *table, size_t stride,
  * @v src		Data to encrypt
  * @v dst		Buffer for encrypted data
  * @v len		Length of data
+ *
+ * Any whole number of blocks may be encrypted (in ECB mode) with a
+ * single call.
  */
 static void aes_encrypt ( void *ctx, const void *src, void *dst, size_t len ) {
 	struct aes_context *aes = ctx;
-	union aes_matrix buffer[2];
-	union aes_matrix *in = &buffer[0];
-	union aes_matrix *out = &buffer[1];
-	unsigned int rounds = aes->rounds;
 
 	/* Sanity check */
-	assert ( len == sizeof ( *in ) );
+	assert ( ( len % AES_BLOCKSIZE ) == 0 );
 
-	/* Initialise input state */
-	memcpy ( in, src, sizeof ( *in ) );
-
-	/* Perform initial round (AddRoundKey) */
-	aes_addroundkey ( in, &aes->encrypt.key[0] );
-
-	/* Perform intermediate rounds (ShiftRows, SubBytes,
-	 * MixColumns, AddRoundKey).
-	 */
-	aes_encrypt_rounds ( in, out, &aes->encrypt.key[1], ( rounds - 2 ) );
-	in = out;
-
-	/* Perform final round (ShiftRows, SubBytes, AddRoundKey) */
-	out = dst;
-	aes_final ( &aes_mixcolumns, AES_STRIDE_SHIFTROWS, in, out,
-		    &aes->encrypt.key[ rounds - 1 ] );
+	/* Encrypt blocks */
+	aes_encrypt_blocks ( aes, src, dst, ( len / AES_BLOCKSIZE ) );
 }
 
 /**
@@ -430,33 +504,18 @@ static void aes_encrypt ( void *ctx, const void *src, void *dst, size_t len ) {
  * @v src		Data to decrypt
  * @v dst		Buffer for decrypted data
  * @v len		Length of data
+ *
+ * Any whole number of blocks may be decrypted (in ECB mode) with a
+ * single call.
  */
 static void aes_decrypt ( void *ctx, const void *src, void *dst, size_t len ) {
 	struct aes_context *aes = ctx;
-	union aes_matrix buffer[2];
-	union aes_matrix *in = &buffer[0];
-	union aes_matrix *out = &buffer[1];
-	unsigned int rounds = aes->rounds;
 
 	/* Sanity check */
-	assert ( len == sizeof ( *in ) );
+	assert ( ( len % AES_BLOCKSIZE ) == 0 );
 
-	/* Initialise input state */
-	memcpy ( in, src, sizeof ( *in ) );
-
-	/* Perform initial round (AddRoundKey) */
-	aes_addroundkey ( in, &aes->decrypt.key[0] );
-
-	/* Perform intermediate rounds (InvShiftRows, InvSubBytes,
-	 * InvMixColumns, AddRoundKey).
-	 */
-	aes_decrypt_rounds ( in, out, &aes->decrypt.key[1], ( rounds - 2 ) );
-	in = out;
-
-	/* Perform final round (InvShiftRows, InvSubBytes, AddRoundKey) */
-	out = dst;
-	aes_final ( &aes_invmixcolumns, AES_STRIDE_INVSHIFTROWS, in, out,
-		    &aes->decrypt.key[ rounds - 1 ] );
+	/* Decrypt blocks */
+	aes_decrypt_blocks ( aes, src, dst, ( len / AES_BLOCKSIZE ) );
 }
 
 /**
@@ -804,3 +863,7 @@ CBC_CIPHER ( aes_cbc, aes_cbc_algorithm,
 /* AES in Galois/Counter mode */
 GCM_CIPHER ( aes_gcm, aes_gcm_algorithm,
 	     aes_algorithm, struct aes_context, AES_BLOCKSIZE );
+
+/* AES in XEX-based tweaked-codebook mode */
+XTS_CIPHER ( aes_xts, aes_xts_algorithm,
+	     aes_algorithm, struct aes_context, AES_BLOCKSIZE );
@@ -21,10 +21,54 @@
 
 FILE_LICENCE ( GPL2_OR_LATER );
 
+#include <stdint.h>
+#include <string.h>
+#include <byteswap.h>
 #include <ipxe/crc32.h>
 
 #define CRCPOLY		0xedb88320
 
+/**
+ * CRC lookup tables
+ *
+ * Entry @c n of table @c k is the CRC of the byte value @c n followed
+ * by @c k zero bytes, allowing eight bytes to be processed at a time
+ * ("slicing-by-8").
+ */
+static u32 crc32_table[8][256];
+
+/** CRC lookup tables have been initialised */
+static int crc32_table_done;
+
+/**
+ * Initialise CRC lookup tables
+ *
+ */
+static void crc32_init_table ( void ) {
+	u32 crc;
+	unsigned int i;
+	unsigned int j;
+
+	/* Construct table for a single byte */
+	for ( i = 0 ; i < 256 ; i++ ) {
+		crc = i;
+		for ( j = 0 ; j < 8 ; j++ )
+			crc = ( ( crc >> 1 ) ^ ( ( crc & 1 ) ? CRCPOLY : 0 ) );
+		crc32_table[0][i] = crc;
+	}
+
+	/* Construct tables for bytes followed by zero bytes */
+	for ( i = 0 ; i < 256 ; i++ ) {
+		crc = crc32_table[0][i];
+		for ( j = 1 ; j < 8 ; j++ ) {
+			crc = ( ( crc >> 8 ) ^ crc32_table[0][ crc & 0xff ] );
+			crc32_table[j][i] = crc;
+		}
+	}
+
+	crc32_table_done = 1;
+}
+
 /**
  * Calculate 32-bit little-endian CRC checksum
  *
@@ -36,20 +80,38 @@ FILE_LICENCE ( GPL2_OR_LATER );
  * protocol. To continue a CRC checksum over multiple calls, pass the
  * return value from one call as the @a seed parameter to the next.
  */
-u32 crc32_le ( u32 seed, const void *data, size_t len )
+u32 generic_crc32_le ( u32 seed, const void *data, size_t len )
 {
 	u32 crc = seed;
 	const u8 *src = data;
-	u32 mult;
-	int i;
-
-	while ( len-- ) {
-		crc ^= *src++;
-		for ( i = 0; i < 8; i++ ) {
-			mult = ( crc & 1 ) ? CRCPOLY : 0;
-			crc = ( crc >> 1 ) ^ mult;
-		}
+	u32 lo;
+	u32 hi;
+
+	/* Initialise lookup tables, if necessary */
+	if ( ! crc32_table_done )
+		crc32_init_table();
+
+	/* Process eight bytes at a time */
+	while ( len >= 8 ) {
+		memcpy ( &lo, src, sizeof ( lo ) );
+		memcpy ( &hi, ( src + sizeof ( lo ) ), sizeof ( hi ) );
+		lo = ( le32_to_cpu ( lo ) ^ crc );
+		hi = le32_to_cpu ( hi );
+		crc = ( crc32_table[7][ lo & 0xff ] ^
+			crc32_table[6][ ( lo >> 8 ) & 0xff ] ^
+			crc32_table[5][ ( lo >> 16 ) & 0xff ] ^
+			crc32_table[4][ lo >> 24 ] ^
+			crc32_table[3][ hi & 0xff ] ^
+			crc32_table[2][ ( hi >> 8 ) & 0xff ] ^
+			crc32_table[1][ ( hi >> 16 ) & 0xff ] ^
+			crc32_table[0][ hi >> 24 ] );
+		src += 8;
+		len -= 8;
 	}
 
+	/* Process any remaining bytes */
+	while ( len-- )
+		crc = ( ( crc >> 8 ) ^ crc32_table[0][ ( crc ^ *src++ ) & 0xff ] );
+
 	return crc;
 }
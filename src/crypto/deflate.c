@@ -28,6 +28,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <errno.h>
 #include <assert.h>
 #include <ctype.h>
+#include <byteswap.h>
 #include <ipxe/uaccess.h>
 #include <ipxe/deflate.h>
 
@@ -40,7 +41,30 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  *
  * Portions of this code are derived from wimboot's xca.c.
  *
+ * Huffman-coded symbols are decoded one bit at a time via a
+ * resumable state machine, which allows decompression to be
+ * suspended at any point when input data is exhausted.  Whenever
+ * sufficient input data and output space are available to decode a
+ * complete literal/length and distance pair without checking for the
+ * end of either buffer, symbols are instead decoded using a
+ * word-sized bit buffer and multi-level lookup tables.
+ *
+ */
+
+/** Minimum input length required for fast decoding
+ *
+ * Each fast decoding iteration refills the bit buffer at most four
+ * times, and each refill reads one word (and consumes less than one
+ * word) of input data.
  */
+#define DEFLATE_FAST_MIN_IN ( 4 * sizeof ( unsigned long ) )
+
+/** Minimum output space required for fast decoding
+ *
+ * Each fast decoding iteration writes at most one maximum-length
+ * duplicated string, which may be overrun by up to one word.
+ */
+#define DEFLATE_FAST_MIN_OUT ( 258 + sizeof ( unsigned long ) )
 
 /**
  * Byte reversal table
@@ -296,6 +320,116 @@ static int deflate_alphabet ( struct deflate *deflate,
 	return 0;
 }
 
+/**
+ * Reverse Huffman-coded symbol
+ *
+ * @v huf		Huffman-coded symbol
+ * @v bits		Length of symbol (in bits)
+ * @ret rev		Bit-reversed symbol
+ */
+static inline unsigned int deflate_fast_reverse ( unsigned int huf,
+						  unsigned int bits ) {
+
+	return ( ( ( deflate_reverse[ huf & 0xff ] << 8 ) |
+		   deflate_reverse[ ( huf >> 8 ) & 0xff ] ) >> ( 16 - bits ) );
+}
+
+/**
+ * Construct fast lookup table
+ *
+ * @v deflate		Decompressor
+ * @v alphabet		Huffman alphabet
+ * @v table		Fast lookup table
+ * @v root		Root table length (in bits)
+ * @v max		Maximum number of table entries
+ * @ret rc		Return status code
+ *
+ * Symbols no longer than the root table length are decoded using a
+ * single lookup in the root table.  Longer symbols are decoded using
+ * a second lookup in a secondary table, sized to fit the longest
+ * symbol sharing the same root table prefix.
+ */
+static int deflate_fast_table ( struct deflate *deflate,
+				struct deflate_alphabet *alphabet,
+				struct deflate_fast_entry *table,
+				unsigned int root, unsigned int max ) {
+	struct deflate_huf_symbols *huf_sym;
+	struct deflate_fast_entry *entry;
+	struct deflate_fast_entry *sub;
+	unsigned int mask = ( ( 1 << root ) - 1 );
+	unsigned int used;
+	unsigned int bits;
+	unsigned int huf;
+	unsigned int rev;
+	unsigned int raw;
+	unsigned int index;
+	unsigned int i;
+
+	/* Clear root table */
+	memset ( table, 0, ( ( mask + 1 ) * sizeof ( table[0] ) ) );
+
+	/* Record secondary table index lengths.  Symbols are
+	 * processed in order of increasing length, so each root table
+	 * entry ends up recording the longest length.
+	 */
+	for ( bits = ( root + 1 ) ; bits <= DEFLATE_HUFFMAN_BITS ; bits++ ) {
+		huf_sym = &alphabet->huf[ bits - 1 ];
+		huf = ( huf_sym->start >> huf_sym->shift );
+		for ( i = 0 ; i < huf_sym->freq ; i++, huf++ ) {
+			rev = deflate_fast_reverse ( huf, bits );
+			table[ rev & mask ].sub = ( bits - root );
+		}
+	}
+
+	/* Allocate secondary tables */
+	used = ( mask + 1 );
+	for ( index = 0 ; index <= mask ; index++ ) {
+		entry = &table[index];
+		if ( ! entry->sub )
+			continue;
+		entry->value = used;
+		entry->bits = root;
+		used += ( 1 << entry->sub );
+		if ( used > max ) {
+			DBGC ( alphabet, "DEFLATE %p \"%s\" has no fast lookup "
+			       "table\n", deflate,
+			       deflate_alphabet_name ( deflate, alphabet ) );
+			return -ENOSPC;
+		}
+	}
+
+	/* Populate root and secondary tables */
+	for ( bits = 1 ; bits <= DEFLATE_HUFFMAN_BITS ; bits++ ) {
+		huf_sym = &alphabet->huf[ bits - 1 ];
+		huf = ( huf_sym->start >> huf_sym->shift );
+		for ( i = 0 ; i < huf_sym->freq ; i++, huf++ ) {
+			rev = deflate_fast_reverse ( huf, bits );
+			raw = huf_sym->raw[huf];
+			if ( bits <= root ) {
+				for ( index = rev ; index <= mask ;
+				      index += ( 1 << bits ) ) {
+					entry = &table[index];
+					entry->value = raw;
+					entry->bits = bits;
+					entry->sub = 0;
+				}
+			} else {
+				entry = &table[ rev & mask ];
+				sub = &table[entry->value];
+				for ( index = ( rev >> root ) ;
+				      index < ( 1U << entry->sub ) ;
+				      index += ( 1 << ( bits - root ) ) ) {
+					sub[index].value = raw;
+					sub[index].bits = ( bits - root );
+					sub[index].sub = 0;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
 /**
  * Attempt to accumulate bits from input stream
  *
@@ -471,6 +605,283 @@ static void deflate_copy ( struct deflate_chunk *out,
 	out->offset += len;
 }
 
+/**
+ * Refill fast decoding bit buffer
+ *
+ * @v in		Input data pointer
+ * @v buf		Bit buffer
+ * @v bits		Number of bits within the bit buffer
+ *
+ * The bit buffer is filled with as many whole bytes as will fit.
+ * Any partial byte read beyond this point is left in place above the
+ * valid bits, and will be read again (with identical values) on the
+ * next refill.
+ */
+static inline __attribute__ (( always_inline )) void
+deflate_fast_refill ( const uint8_t **in, unsigned long *buf,
+		      unsigned int *bits ) {
+	unsigned long word;
+
+	/* Read one (possibly unaligned) word of input data */
+	memcpy ( &word, *in, sizeof ( word ) );
+	if ( sizeof ( word ) == sizeof ( uint64_t ) ) {
+		word = le64_to_cpu ( word );
+	} else {
+		word = le32_to_cpu ( word );
+	}
+
+	/* Consume as many whole bytes as will fit */
+	*buf |= ( word << *bits );
+	*in += ( ( ( 8 * sizeof ( word ) ) - 1 - *bits ) / 8 );
+	*bits |= ( ( 8 * sizeof ( word ) ) - 8 );
+}
+
+/**
+ * Consume bits from fast decoding bit buffer
+ *
+ * @v buf		Bit buffer
+ * @v bits		Number of bits within the bit buffer
+ * @v count		Number of bits to consume
+ * @ret data		Consumed bits
+ */
+static inline __attribute__ (( always_inline )) unsigned int
+deflate_fast_consume ( unsigned long *buf, unsigned int *bits,
+		       unsigned int count ) {
+	unsigned int data;
+
+	data = ( *buf & ( ( 1UL << count ) - 1 ) );
+	*buf >>= count;
+	*bits -= count;
+	return data;
+}
+
+/**
+ * Decode Huffman-coded symbol using fast lookup table
+ *
+ * @v table		Fast lookup table
+ * @v root		Root table length (in bits)
+ * @v buf		Bit buffer
+ * @v bits		Number of bits within the bit buffer
+ * @ret raw		Raw symbol
+ */
+static inline __attribute__ (( always_inline )) unsigned int
+deflate_fast_decode ( const struct deflate_fast_entry *table,
+		      unsigned int root, unsigned long *buf,
+		      unsigned int *bits ) {
+	const struct deflate_fast_entry *entry;
+
+	/* Look up root table entry */
+	entry = &table[ *buf & ( ( 1UL << root ) - 1 ) ];
+
+	/* Look up secondary table entry, if applicable */
+	if ( entry->sub ) {
+		deflate_fast_consume ( buf, bits, root );
+		entry = &table[ entry->value +
+				( *buf & ( ( 1UL << entry->sub ) - 1 ) ) ];
+	}
+
+	/* Consume bits */
+	deflate_fast_consume ( buf, bits, entry->bits );
+
+	return entry->value;
+}
+
+/**
+ * Copy duplicated string using fast decoding
+ *
+ * @v dest		Destination
+ * @v distance		Distance (must be non-zero)
+ * @v len		Length
+ *
+ * Data is copied one word at a time, and may overrun the end of the
+ * duplicated string by up to one word.  A string repeating with a
+ * period shorter than one word also repeats with a period of some
+ * multiple of its distance: once enough bytes have been copied to
+ * establish this longer period, the remainder is copied one word at a
+ * time.
+ */
+static inline __attribute__ (( always_inline )) void
+deflate_fast_copy ( uint8_t *dest, size_t distance, size_t len ) {
+	const uint8_t *src;
+	unsigned long word;
+	size_t stride;
+	size_t prefix;
+
+	/* Handle runs of a single byte */
+	if ( distance == 1 ) {
+		memset ( dest, dest[-1], len );
+		return;
+	}
+
+	/* Copy bytes until the period is at least one word */
+	stride = distance;
+	while ( stride < sizeof ( word ) )
+		stride += distance;
+	src = ( dest - distance );
+	for ( prefix = ( stride - distance ) ; prefix && len ; prefix--, len-- )
+		*(dest++) = *(src++);
+
+	/* Copy remainder one word at a time */
+	src = ( dest - stride );
+	while ( len ) {
+		memcpy ( &word, src, sizeof ( word ) );
+		memcpy ( dest, &word, sizeof ( word ) );
+		if ( len < sizeof ( word ) )
+			break;
+		src += sizeof ( word );
+		dest += sizeof ( word );
+		len -= sizeof ( word );
+	}
+}
+
+/**
+ * Inflate Huffman-coded data using fast lookup tables
+ *
+ * @v deflate		Decompressor
+ * @v in		Compressed input data
+ * @v out		Output data buffer
+ * @ret code		End of block code, zero, or negative error
+ *
+ * Symbols are decoded for as long as sufficient input data and output
+ * space remain to decode a complete literal/length and distance pair.
+ * Decoding then continues via the resumable state machine.  If the
+ * output data buffer has already been filled, then the output is
+ * counted but not written.
+ */
+static int deflate_fast ( struct deflate *deflate, struct deflate_chunk *in,
+			  struct deflate_chunk *out ) {
+	const uint8_t *in_start;
+	const uint8_t *in_ptr;
+	const uint8_t *in_limit;
+	uint8_t *out_data;
+	size_t out_offset;
+	size_t out_limit;
+	unsigned long buf;
+	unsigned int bits;
+	unsigned int code;
+	unsigned int extra;
+	size_t unused;
+	size_t distance;
+	size_t len;
+	unsigned int i;
+	int rc = 0;
+
+	/* Do nothing unless sufficient input data is available */
+	if ( ( in->len - in->offset ) < DEFLATE_FAST_MIN_IN )
+		return 0;
+	in_start = in_ptr = user_to_virt ( in->data, in->offset );
+	in_limit = ( in_start + ( in->len - in->offset ) -
+		     DEFLATE_FAST_MIN_IN );
+
+	/* Write output only if sufficient space is available, or
+	 * count output only if the output data buffer is already full.
+	 */
+	out_offset = out->offset;
+	if ( out_offset >= out->len ) {
+		out_data = NULL;
+		out_limit = ~( ( size_t ) 0 );
+	} else if ( ( out->len - out_offset ) >= DEFLATE_FAST_MIN_OUT ) {
+		out_data = user_to_virt ( out->data, 0 );
+		out_limit = ( out->len - DEFLATE_FAST_MIN_OUT );
+	} else {
+		return 0;
+	}
+
+	/* Take ownership of accumulated bits */
+	buf = deflate->accumulator;
+	bits = deflate->bits;
+
+	/* Decode symbols */
+	while ( ( in_ptr <= in_limit ) && ( out_offset <= out_limit ) ) {
+
+		/* Decode literal/length symbol */
+		if ( bits < DEFLATE_HUFFMAN_BITS )
+			deflate_fast_refill ( &in_ptr, &buf, &bits );
+		code = deflate_fast_decode ( deflate->litlen_fast,
+					     DEFLATE_FAST_LITLEN_BITS,
+					     &buf, &bits );
+
+		/* Handle literals and end of block */
+		if ( code < DEFLATE_LITLEN_END ) {
+			if ( out_data )
+				out_data[out_offset] = code;
+			out_offset++;
+			continue;
+		} else if ( code == DEFLATE_LITLEN_END ) {
+			rc = DEFLATE_LITLEN_END;
+			break;
+		}
+
+		/* Decode length */
+		extra = ( code - DEFLATE_LITLEN_END - 1 );
+		if ( extra < 28 ) {
+			code = ( extra / 4 );
+			if ( code )
+				code--;
+			if ( bits < code )
+				deflate_fast_refill ( &in_ptr, &buf, &bits );
+			len = ( deflate_litlen_base[extra] +
+				deflate_fast_consume ( &buf, &bits, code ) );
+		} else {
+			len = 258;
+		}
+
+		/* Decode distance */
+		if ( bits < DEFLATE_HUFFMAN_BITS )
+			deflate_fast_refill ( &in_ptr, &buf, &bits );
+		extra = deflate_fast_decode ( deflate->distance_fast,
+					      DEFLATE_FAST_DISTANCE_BITS,
+					      &buf, &bits );
+		code = ( extra / 2 );
+		if ( code )
+			code--;
+		if ( bits < code )
+			deflate_fast_refill ( &in_ptr, &buf, &bits );
+		distance = ( deflate_distance_base[extra] +
+			     deflate_fast_consume ( &buf, &bits, code ) );
+
+		/* Sanity check */
+		if ( ( distance == 0 ) || ( distance > out_offset ) ) {
+			DBGC ( deflate, "DEFLATE %p bad distance %zd (max "
+			       "%zd)\n", deflate, distance, out_offset );
+			rc = -EINVAL;
+			break;
+		}
+
+		/* Copy data */
+		if ( out_data ) {
+			deflate_fast_copy ( ( out_data + out_offset ),
+					    distance, len );
+		}
+		out_offset += len;
+	}
+
+	/* Return any unused whole bytes to the input data */
+	unused = ( bits / 8 );
+	if ( unused > ( ( size_t ) ( in_ptr - in_start ) ) )
+		unused = ( in_ptr - in_start );
+	in_ptr -= unused;
+	bits -= ( 8 * unused );
+	if ( bits < ( 8 * sizeof ( buf ) ) )
+		buf &= ( ( 1UL << bits ) - 1 );
+
+	/* Return accumulated bits */
+	deflate->accumulator = buf;
+	deflate->bits = bits;
+	deflate->rotalumucca = 0;
+	for ( i = 0 ; i < sizeof ( deflate->rotalumucca ) ; i++ ) {
+		deflate->rotalumucca = ( ( deflate->rotalumucca << 8 ) |
+					 deflate_reverse[ buf & 0xff ] );
+		buf >>= 8;
+	}
+
+	/* Update offsets */
+	in->offset += ( in_ptr - in_start );
+	out->offset = out_offset;
+
+	return rc;
+}
+
 /**
  * Inflate compressed data
  *
@@ -818,6 +1229,18 @@ int deflate_inflate ( struct deflate *deflate,
 					       distance_count,
 					       distance_offset ) ) != 0 )
 			return rc;
+
+		/* Construct fast lookup tables, if possible */
+		deflate->fast =
+			( ( deflate_fast_table ( deflate, &deflate->litlen,
+						 deflate->litlen_fast,
+						 DEFLATE_FAST_LITLEN_BITS,
+						 DEFLATE_FAST_LITLEN_MAX ) == 0 ) &&
+			  ( deflate_fast_table ( deflate,
+						 &deflate->distance_codelen,
+						 deflate->distance_fast,
+						 DEFLATE_FAST_DISTANCE_BITS,
+						 DEFLATE_FAST_DISTANCE_MAX ) == 0 ) );
 	}
 
  lzhuf_litlen: {
@@ -829,6 +1252,15 @@ int deflate_inflate ( struct deflate *deflate,
 		/* Decode Huffman codes */
 		while ( 1 ) {
 
+			/* Decode using fast lookup tables, if possible */
+			if ( deflate->fast ) {
+				code = deflate_fast ( deflate, in, out );
+				if ( code < 0 )
+					return code;
+				if ( code == DEFLATE_LITLEN_END )
+					goto block_done;
+			}
+
 			/* Decode Huffman code */
 			code = deflate_decode ( deflate, in, &deflate->litlen );
 			if ( code < 0 ) {
@@ -927,7 +1359,7 @@ int deflate_inflate ( struct deflate *deflate,
 			"%zd\n", deflate, dup_len, dup_distance );
 
 		/* Sanity check */
-		if ( dup_distance > out->offset ) {
+		if ( ( dup_distance == 0 ) || ( dup_distance > out->offset ) ) {
 			DBGC ( deflate, "DEFLATE %p bad distance %zd (max "
 			       "%zd)\n", deflate, dup_distance, out->offset );
 			return -EINVAL;
@@ -37,24 +37,8 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/crypto.h>
 #include <ipxe/sha256.h>
 
-/** SHA-256 variables */
-struct sha256_variables {
-	/* This layout matches that of struct sha256_digest_data,
-	 * allowing for efficient endianness-conversion,
-	 */
-	uint32_t a;
-	uint32_t b;
-	uint32_t c;
-	uint32_t d;
-	uint32_t e;
-	uint32_t f;
-	uint32_t g;
-	uint32_t h;
-	uint32_t w[SHA256_ROUNDS];
-} __attribute__ (( packed ));
-
 /** SHA-256 constants */
-static const uint32_t k[SHA256_ROUNDS] = {
+const uint32_t sha256_k[SHA256_ROUNDS] = {
 	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
 	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
 	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
@@ -112,24 +96,20 @@ static void sha256_init ( void *ctx ) {
 }
 
 /**
- * Calculate SHA-256 digest of accumulated data
+ * Perform SHA-256 rounds
  *
- * @v context		SHA-256 context
+ * @v digest		Digest (in host-endian order)
+ * @v wk		Message schedule with round constants added
  */
-static void sha256_digest ( struct sha256_context *context ) {
-        union {
-		union sha256_digest_data_dwords ddd;
-		struct sha256_variables v;
-	} u;
-	uint32_t *a = &u.v.a;
-	uint32_t *b = &u.v.b;
-	uint32_t *c = &u.v.c;
-	uint32_t *d = &u.v.d;
-	uint32_t *e = &u.v.e;
-	uint32_t *f = &u.v.f;
-	uint32_t *g = &u.v.g;
-	uint32_t *h = &u.v.h;
-	uint32_t *w = u.v.w;
+void sha256_rounds ( struct sha256_digest *digest, const uint32_t *wk ) {
+	uint32_t a = digest->h[0];
+	uint32_t b = digest->h[1];
+	uint32_t c = digest->h[2];
+	uint32_t d = digest->h[3];
+	uint32_t e = digest->h[4];
+	uint32_t f = digest->h[5];
+	uint32_t g = digest->h[6];
+	uint32_t h = digest->h[7];
 	uint32_t s0;
 	uint32_t s1;
 	uint32_t maj;
@@ -138,72 +118,125 @@ static void sha256_digest ( struct sha256_context *context ) {
 	uint32_t ch;
 	unsigned int i;
 
-	/* Sanity checks */
-	assert ( ( context->len % sizeof ( context->ddd.dd.data ) ) == 0 );
-	linker_assert ( &u.ddd.dd.digest.h[0] == a, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[1] == b, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[2] == c, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[3] == d, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[4] == e, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[5] == f, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[6] == g, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.digest.h[7] == h, sha256_bad_layout );
-	linker_assert ( &u.ddd.dd.data.dword[0] == w, sha256_bad_layout );
-
-	DBGC ( context, "SHA256 digesting:\n" );
-	DBGC_HDA ( context, 0, &context->ddd.dd.digest,
-		   sizeof ( context->ddd.dd.digest ) );
-	DBGC_HDA ( context, context->len, &context->ddd.dd.data,
-		   sizeof ( context->ddd.dd.data ) );
-
-	/* Convert h[0..7] to host-endian, and initialise a, b, c, d,
-	 * e, f, g, h, and w[0..15]
-	 */
-	for ( i = 0 ; i < ( sizeof ( u.ddd.dword ) /
-			    sizeof ( u.ddd.dword[0] ) ) ; i++ ) {
-		be32_to_cpus ( &context->ddd.dword[i] );
-		u.ddd.dword[i] = context->ddd.dword[i];
-	}
-
-	/* Initialise w[16..63] */
-	for ( i = 16 ; i < SHA256_ROUNDS ; i++ ) {
-		s0 = ( ror32 ( w[i-15], 7 ) ^ ror32 ( w[i-15], 18 ) ^
-		       ( w[i-15] >> 3 ) );
-		s1 = ( ror32 ( w[i-2], 17 ) ^ ror32 ( w[i-2], 19 ) ^
-		       ( w[i-2] >> 10 ) );
-		w[i] = ( w[i-16] + s0 + w[i-7] + s1 );
-	}
-
 	/* Main loop */
 	for ( i = 0 ; i < SHA256_ROUNDS ; i++ ) {
-		s0 = ( ror32 ( *a, 2 ) ^ ror32 ( *a, 13 ) ^ ror32 ( *a, 22 ) );
-		maj = ( ( *a & *b ) ^ ( *a & *c ) ^ ( *b & *c ) );
+		s0 = ( ror32 ( a, 2 ) ^ ror32 ( a, 13 ) ^ ror32 ( a, 22 ) );
+		maj = ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
 		t2 = ( s0 + maj );
-		s1 = ( ror32 ( *e, 6 ) ^ ror32 ( *e, 11 ) ^ ror32 ( *e, 25 ) );
-		ch = ( ( *e & *f ) ^ ( (~*e) & *g ) );
-		t1 = ( *h + s1 + ch + k[i] + w[i] );
-		*h = *g;
-		*g = *f;
-		*f = *e;
-		*e = ( *d + t1 );
-		*d = *c;
-		*c = *b;
-		*b = *a;
-		*a = ( t1 + t2 );
-		DBGC2 ( context, "%2d : %08x %08x %08x %08x %08x %08x %08x "
-			"%08x\n", i, *a, *b, *c, *d, *e, *f, *g, *h );
+		s1 = ( ror32 ( e, 6 ) ^ ror32 ( e, 11 ) ^ ror32 ( e, 25 ) );
+		ch = ( ( e & f ) ^ ( (~e) & g ) );
+		t1 = ( h + s1 + ch + wk[i] );
+		h = g;
+		g = f;
+		f = e;
+		e = ( d + t1 );
+		d = c;
+		c = b;
+		b = a;
+		a = ( t1 + t2 );
+		DBGC2 ( digest, "%2d : %08x %08x %08x %08x %08x %08x %08x "
+			"%08x\n", i, a, b, c, d, e, f, g, h );
 	}
 
-	/* Add chunk to hash and convert back to big-endian */
-	for ( i = 0 ; i < 8 ; i++ ) {
-		context->ddd.dd.digest.h[i] =
-			cpu_to_be32 ( context->ddd.dd.digest.h[i] +
-				      u.ddd.dd.digest.h[i] );
+	/* Add chunk to hash */
+	digest->h[0] += a;
+	digest->h[1] += b;
+	digest->h[2] += c;
+	digest->h[3] += d;
+	digest->h[4] += e;
+	digest->h[5] += f;
+	digest->h[6] += g;
+	digest->h[7] += h;
+}
+
+/**
+ * Digest SHA-256 data blocks
+ *
+ * @v digest		Digest (in host-endian order)
+ * @v data		Data blocks
+ * @v count		Number of blocks
+ */
+void generic_sha256_blocks ( struct sha256_digest *digest, const void *data,
+			     size_t count ) {
+	uint32_t w[SHA256_ROUNDS];
+	uint32_t s0;
+	uint32_t s1;
+	unsigned int i;
+
+	for ( ; count ; count-- ) {
+
+		/* Initialise w[0..15] */
+		memcpy ( w, data, sizeof ( union sha256_block ) );
+		for ( i = 0 ; i < 16 ; i++ )
+			be32_to_cpus ( &w[i] );
+		data += sizeof ( union sha256_block );
+
+		/* Initialise w[16..63] */
+		for ( i = 16 ; i < SHA256_ROUNDS ; i++ ) {
+			s0 = ( ror32 ( w[i-15], 7 ) ^ ror32 ( w[i-15], 18 ) ^
+			       ( w[i-15] >> 3 ) );
+			s1 = ( ror32 ( w[i-2], 17 ) ^ ror32 ( w[i-2], 19 ) ^
+			       ( w[i-2] >> 10 ) );
+			w[i] = ( w[i-16] + s0 + w[i-7] + s1 );
+		}
+
+		/* Add round constants */
+		for ( i = 0 ; i < SHA256_ROUNDS ; i++ )
+			w[i] += sha256_k[i];
+
+		/* Perform rounds */
+		sha256_rounds ( digest, w );
+	}
+}
+
+/**
+ * Digest SHA-256 data blocks from multiple independent messages
+ *
+ * @v digests		Digests (in host-endian order), one per message
+ * @v data		Data blocks, one pointer per message
+ * @v lanes		Number of messages (at most SHA256_LANES)
+ * @v count		Number of blocks within each message
+ */
+void generic_sha256_multi_blocks ( struct sha256_digest *digests,
+				   const void **data, unsigned int lanes,
+				   size_t count ) {
+	unsigned int lane;
+
+	/* Digest each message in turn */
+	for ( lane = 0 ; lane < lanes ; lane++ )
+		sha256_blocks ( &digests[lane], data[lane], count );
+}
+
+/**
+ * Calculate SHA-256 digest of data blocks
+ *
+ * @v context		SHA-256 context
+ * @v data		Data blocks
+ * @v count		Number of blocks
+ */
+static void sha256_digest ( struct sha256_context *context, const void *data,
+			    size_t count ) {
+	struct sha256_digest *digest = &context->ddd.dd.digest;
+	unsigned int i;
+
+	DBGC ( context, "SHA256 digesting %zd block(s):\n", count );
+	DBGC_HDA ( context, 0, digest, sizeof ( *digest ) );
+
+	/* Convert digest to host-endian, digest blocks, and convert
+	 * back to big-endian
+	 */
+	for ( i = 0 ; i < ( sizeof ( digest->h ) /
+			    sizeof ( digest->h[0] ) ) ; i++ ) {
+		be32_to_cpus ( &digest->h[i] );
+	}
+	sha256_blocks ( digest, data, count );
+	for ( i = 0 ; i < ( sizeof ( digest->h ) /
+			    sizeof ( digest->h[0] ) ) ; i++ ) {
+		cpu_to_be32s ( &digest->h[i] );
 	}
 
 	DBGC ( context, "SHA256 digested:\n" );
-	DBGC_HDA ( context, 0, &context->ddd.dd.digest,
-		   sizeof ( context->ddd.dd.digest ) );
+	DBGC_HDA ( context, 0, digest, sizeof ( *digest ) );
 }
 
 /**
@@ -216,17 +249,38 @@ static void sha256_digest ( struct sha256_context *context ) {
 void sha256_update ( void *ctx, const void *data, size_t len ) {
 	struct sha256_context *context = ctx;
 	const uint8_t *byte = data;
+	size_t blksize = sizeof ( context->ddd.dd.data );
 	size_t offset;
+	size_t frag_len;
 
-	/* Accumulate data a byte at a time, performing the digest
-	 * whenever we fill the data buffer
-	 */
-	while ( len-- ) {
-		offset = ( context->len % sizeof ( context->ddd.dd.data ) );
-		context->ddd.dd.data.byte[offset] = *(byte++);
-		context->len++;
-		if ( ( context->len % sizeof ( context->ddd.dd.data ) ) == 0 )
-			sha256_digest ( context );
+	while ( len ) {
+
+		offset = ( context->len % blksize );
+		if ( ( offset == 0 ) && ( len >= blksize ) ) {
+
+			/* Digest whole blocks directly from the input */
+			frag_len = ( len - ( len % blksize ) );
+			sha256_digest ( context, byte, ( frag_len / blksize ) );
+
+		} else {
+
+			/* Accumulate data into the buffer, performing
+			 * the digest whenever we fill the buffer
+			 */
+			frag_len = ( blksize - offset );
+			if ( frag_len > len )
+				frag_len = len;
+			memcpy ( &context->ddd.dd.data.byte[offset], byte,
+				 frag_len );
+			if ( ( offset + frag_len ) == blksize ) {
+				sha256_digest ( context, &context->ddd.dd.data,
+						1 );
+			}
+		}
+
+		byte += frag_len;
+		len -= frag_len;
+		context->len += frag_len;
 	}
 }
 
@@ -237,29 +291,110 @@ void sha256_update ( void *ctx, const void *data, size_t len ) {
  * @v out		Output buffer
  */
 void sha256_final ( void *ctx, void *out ) {
+	static const uint8_t pad[ sizeof ( union sha256_block ) ] = { 0x80 };
 	struct sha256_context *context = ctx;
+	size_t blksize = sizeof ( context->ddd.dd.data );
+	size_t final = offsetof ( typeof ( context->ddd.dd.data ), final.len );
 	uint64_t len_bits;
-	uint8_t pad;
+	size_t pad_len;
 
 	/* Record length before pre-processing */
 	len_bits = cpu_to_be64 ( ( ( uint64_t ) context->len ) * 8 );
 
 	/* Pad with a single "1" bit followed by as many "0" bits as required */
-	pad = 0x80;
-	do {
-		sha256_update ( ctx, &pad, sizeof ( pad ) );
-		pad = 0x00;
-	} while ( ( context->len % sizeof ( context->ddd.dd.data ) ) !=
-		  offsetof ( typeof ( context->ddd.dd.data ), final.len ) );
+	pad_len = ( ( ( final + blksize - 1 -
+			( context->len % blksize ) ) % blksize ) + 1 );
+	sha256_update ( ctx, pad, pad_len );
+	assert ( ( context->len % blksize ) == final );
 
 	/* Append length (in bits) */
 	sha256_update ( ctx, &len_bits, sizeof ( len_bits ) );
-	assert ( ( context->len % sizeof ( context->ddd.dd.data ) ) == 0 );
+	assert ( ( context->len % blksize ) == 0 );
 
 	/* Copy out final digest */
 	memcpy ( out, &context->ddd.dd.digest, context->digestsize );
 }
 
+/**
+ * Calculate SHA-256 digests of multiple equal-length messages
+ *
+ * @v init		Initial SHA-256 context
+ * @v data		Messages (concatenated)
+ * @v len		Length of each message
+ * @v count		Number of messages
+ * @v out		Output buffer for digests (concatenated)
+ *
+ * Each message is digested as though it had been appended to a copy
+ * of the initial context, which may already hold a prefix (such as a
+ * salt) common to all messages.  Whole data blocks from up to
+ * SHA256_LANES messages are digested in parallel, where supported by
+ * the CPU.
+ */
+void sha256_multi ( const struct sha256_context *init, const void *data,
+		    size_t len, unsigned int count, void *out ) {
+	struct sha256_context context[SHA256_LANES];
+	struct sha256_digest digest[SHA256_LANES];
+	const void *block[SHA256_LANES];
+	size_t blksize = sizeof ( init->ddd.dd.data );
+	size_t head;
+	size_t blocks;
+	unsigned int lanes;
+	unsigned int lane;
+	unsigned int i;
+
+	/* Calculate length required to complete any partial block
+	 * held in the initial context, and number of whole blocks
+	 * remaining thereafter
+	 */
+	head = ( ( blksize - ( init->len % blksize ) ) % blksize );
+	if ( head > len )
+		head = len;
+	blocks = ( ( len - head ) / blksize );
+
+	while ( count ) {
+
+		/* Complete any partial block in each lane */
+		lanes = ( ( count < SHA256_LANES ) ? count : SHA256_LANES );
+		for ( lane = 0 ; lane < lanes ; lane++ ) {
+			memcpy ( &context[lane], init,
+				 sizeof ( context[lane] ) );
+			sha256_update ( &context[lane], ( data + lane * len ),
+					head );
+			block[lane] = ( data + lane * len + head );
+		}
+
+		/* Digest whole blocks in parallel */
+		if ( blocks ) {
+			for ( lane = 0 ; lane < lanes ; lane++ ) {
+				for ( i = 0 ; i < 8 ; i++ ) {
+					digest[lane].h[i] = be32_to_cpu (
+					    context[lane].ddd.dd.digest.h[i] );
+				}
+			}
+			sha256_multi_blocks ( digest, block, lanes, blocks );
+			for ( lane = 0 ; lane < lanes ; lane++ ) {
+				for ( i = 0 ; i < 8 ; i++ ) {
+					context[lane].ddd.dd.digest.h[i] =
+					    cpu_to_be32 ( digest[lane].h[i] );
+				}
+				context[lane].len += ( blocks * blksize );
+			}
+		}
+
+		/* Accumulate remaining data and generate digests */
+		for ( lane = 0 ; lane < lanes ; lane++ ) {
+			sha256_update ( &context[lane],
+					( block[lane] + blocks * blksize ),
+					( len - head - blocks * blksize ) );
+			sha256_final ( &context[lane], out );
+			out += init->digestsize;
+		}
+
+		data += ( lanes * len );
+		count -= lanes;
+	}
+}
+
 /** SHA-256 algorithm */
 struct digest_algorithm sha256_algorithm = {
 	.name		= "sha256",
@@ -0,0 +1,199 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <byteswap.h>
+#include <ipxe/crypto.h>
+#include <ipxe/xts.h>
+
+/** @file
+ *
+ * XEX-based tweaked-codebook mode (XTS)
+ *
+ * This is the mode defined by IEEE Std 1619 for encryption of
+ * storage devices, as used by (for example) dm-crypt's
+ * "aes-xts-plain64".  Each data unit (i.e. sector) is encrypted with
+ * an initial tweak derived from its sector number, and so may be
+ * encrypted or decrypted independently of all others.
+ *
+ * Each block is whitened with the current tweak both before and after
+ * passing through the underlying cipher.  This is done as separate
+ * passes over the whole data unit, so that the underlying cipher may
+ * process all of the data unit's blocks in a single call.
+ *
+ * Ciphertext stealing (for data units that are not a whole number of
+ * blocks) is not supported, since sectors are always a whole number
+ * of blocks.
+ *
+ */
+
+/** Reduction polynomial for multiplication in GF(2^128) */
+#define XTS_POLY 0x87
+
+/** An XTS tweak */
+union xts_tweak {
+	/** Raw bytes */
+	uint8_t byte[XTS_BLOCKSIZE];
+	/** Dwords */
+	uint32_t dword[ XTS_BLOCKSIZE / sizeof ( uint32_t ) ];
+	/** Little-endian qwords */
+	uint64_t qword[ XTS_BLOCKSIZE / sizeof ( uint64_t ) ];
+};
+
+/**
+ * Multiply tweak by the primitive element (x) in GF(2^128)
+ *
+ * @v tweak		Tweak
+ */
+static inline __attribute__ (( always_inline )) void
+xts_double ( union xts_tweak *tweak ) {
+	uint64_t lo = le64_to_cpu ( tweak->qword[0] );
+	uint64_t hi = le64_to_cpu ( tweak->qword[1] );
+	uint64_t carry = ( hi >> 63 );
+
+	tweak->qword[1] = cpu_to_le64 ( ( hi << 1 ) | ( lo >> 63 ) );
+	tweak->qword[0] = cpu_to_le64 ( ( lo << 1 ) ^ ( XTS_POLY & -carry ) );
+}
+
+/**
+ * XOR data blocks with successive tweaks
+ *
+ * @v xts_ctx		Initial tweak
+ * @v src		Input data
+ * @v dst		Output data buffer
+ * @v len		Length of data
+ * @v update		Update tweak to follow the data
+ */
+static void xts_xor ( void *xts_ctx, const void *src, void *dst,
+		      size_t len, int update ) {
+	const uint32_t *srcl = src;
+	uint32_t *dstl = dst;
+	union xts_tweak tweak;
+
+	/* Assume that block sizes will always be dword-aligned, for speed */
+	memcpy ( &tweak, xts_ctx, sizeof ( tweak ) );
+	while ( len ) {
+		dstl[0] = ( srcl[0] ^ tweak.dword[0] );
+		dstl[1] = ( srcl[1] ^ tweak.dword[1] );
+		dstl[2] = ( srcl[2] ^ tweak.dword[2] );
+		dstl[3] = ( srcl[3] ^ tweak.dword[3] );
+		xts_double ( &tweak );
+		srcl += ( sizeof ( tweak ) / sizeof ( *srcl ) );
+		dstl += ( sizeof ( tweak ) / sizeof ( *dstl ) );
+		len -= sizeof ( tweak );
+	}
+	if ( update )
+		memcpy ( xts_ctx, &tweak, sizeof ( tweak ) );
+}
+
+/**
+ * Set key
+ *
+ * @v ctx		Context
+ * @v tweak_ctx		Tweak context
+ * @v key		Key (data key followed by tweak key)
+ * @v keylen		Key length
+ * @v raw_cipher	Underlying cipher algorithm
+ * @ret rc		Return status code
+ */
+int xts_setkey ( void *ctx, void *tweak_ctx, const void *key, size_t keylen,
+		 struct cipher_algorithm *raw_cipher ) {
+	size_t half = ( keylen / 2 );
+	int rc;
+
+	/* Sanity check */
+	assert ( raw_cipher->blocksize == XTS_BLOCKSIZE );
+
+	/* Key must comprise two keys of equal length */
+	if ( keylen != ( 2 * half ) )
+		return -EINVAL;
+
+	/* Set data and tweak keys */
+	if ( ( rc = cipher_setkey ( raw_cipher, ctx, key, half ) ) != 0 )
+		return rc;
+	if ( ( rc = cipher_setkey ( raw_cipher, tweak_ctx, ( key + half ),
+				    half ) ) != 0 )
+		return rc;
+
+	return 0;
+}
+
+/**
+ * Set initialisation vector
+ *
+ * @v tweak_ctx		Tweak context
+ * @v iv		Initialisation vector (e.g. little-endian sector number)
+ * @v ivlen		Initialisation vector length
+ * @v raw_cipher	Underlying cipher algorithm
+ * @v xts_ctx		XTS context
+ */
+void xts_setiv ( void *tweak_ctx, const void *iv, size_t ivlen,
+		 struct cipher_algorithm *raw_cipher, void *xts_ctx ) {
+
+	/* Encrypt initialisation vector with tweak key */
+	assert ( ivlen == XTS_BLOCKSIZE );
+	cipher_encrypt ( raw_cipher, tweak_ctx, iv, xts_ctx, XTS_BLOCKSIZE );
+}
+
+/**
+ * Encrypt data
+ *
+ * @v ctx		Context
+ * @v src		Data to encrypt
+ * @v dst		Buffer for encrypted data
+ * @v len		Length of data
+ * @v raw_cipher	Underlying cipher algorithm
+ * @v xts_ctx		XTS context
+ */
+void xts_encrypt ( void *ctx, const void *src, void *dst, size_t len,
+		   struct cipher_algorithm *raw_cipher, void *xts_ctx ) {
+
+	assert ( ( len % XTS_BLOCKSIZE ) == 0 );
+
+	xts_xor ( xts_ctx, src, dst, len, 0 );
+	cipher_encrypt ( raw_cipher, ctx, dst, dst, len );
+	xts_xor ( xts_ctx, dst, dst, len, 1 );
+}
+
+/**
+ * Decrypt data
+ *
+ * @v ctx		Context
+ * @v src		Data to decrypt
+ * @v dst		Buffer for decrypted data
+ * @v len		Length of data
+ * @v raw_cipher	Underlying cipher algorithm
+ * @v xts_ctx		XTS context
+ */
+void xts_decrypt ( void *ctx, const void *src, void *dst, size_t len,
+		   struct cipher_algorithm *raw_cipher, void *xts_ctx ) {
+
+	assert ( ( len % XTS_BLOCKSIZE ) == 0 );
+
+	xts_xor ( xts_ctx, src, dst, len, 0 );
+	cipher_decrypt ( raw_cipher, ctx, dst, dst, len );
+	xts_xor ( xts_ctx, dst, dst, len, 1 );
+}
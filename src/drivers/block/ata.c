@@ -395,6 +395,9 @@ static void atacmd_identify_done ( struct ata_command *atacmd, int rc ) {
 	}
 	capacity.blksize = ATA_SECTOR_SIZE;
 	capacity.max_count = atadev->max_count;
+	capacity.opt_count = 0;
+	capacity.align = 0;
+	capacity.max_outstanding = 0;
 	DBGC ( atadev, "ATA %p is a %s\n", atadev, ata_model ( identity ) );
 	DBGC ( atadev, "ATA %p has %#llx blocks (%ld MB) and uses %s\n",
 	       atadev, capacity.blocks,
@@ -93,12 +93,27 @@ volatile struct nvme_sq {
     volatile u16 tail;
 };
 
+/* Per-controller DMA arena. All memory the controller accesses by DMA (queue
+   rings, the identify buffer, PRP lists and bounce buffers) is carved out of
+   a single page-aligned allocation made when the controller is enabled. */
+struct nvme_arena {
+    void *base;
+    struct dma_mapping map;
+
+    u32 prpl_free;              /* bitmap of free PRP list slots */
+    u32 bounce_free;            /* bitmap of free bounce buffer slots */
+
+    void *large;                /* maximum size bounce buffer */
+    struct dma_mapping large_map;
+};
+
 struct nvme_ctrl {
     struct pci_device *pci;
     struct nvme_device *parent;
     struct nvme_namespace *ns;
 
     volatile struct nvme_reg *reg;
+    struct nvme_arena arena;
 
     u32 doorbell_stride;        /* in bytes */
 
@@ -122,6 +137,7 @@ volatile struct nvme_namespace {
     u32 block_size;
     u32 metadata_size;
     u32 max_req_size;
+    u32 align;                  /* preferred alignment, in blocks */
 };
 
 /* Data structures for NVMe admin identify commands */
@@ -160,8 +176,22 @@ volatile struct nvme_identify_ns {
     u8  nsfeat;
     u8  nlbaf;
     u8  flbas;
-
-    char _boring[128 - 27];
+    u8  mc;
+    u8  dpc;
+    u8  dps;
+    u8  nmic;
+    u8  rescap;
+    u8  fpi;
+    u8  dlfeat;
+    u16 nawun;
+    u16 nawupf;
+    u16 nacwu;
+    u16 nabsn;
+    u16 nabo;
+    u16 nabspf;
+    u16 noiob;                  /* namespace optimal I/O boundary */
+
+    char _boring[128 - 48];
 
     struct nvme_lba_format lbaf[16];
 };
@@ -181,7 +211,9 @@ volatile union nvme_identify {
 
 #define NVME_CC_EN        (1U <<  0)
 
+#define NVME_SQE_OPC_ADMIN_DELETE_IO_SQ 0U
 #define NVME_SQE_OPC_ADMIN_CREATE_IO_SQ 1U
+#define NVME_SQE_OPC_ADMIN_DELETE_IO_CQ 4U
 #define NVME_SQE_OPC_ADMIN_CREATE_IO_CQ 5U
 #define NVME_SQE_OPC_ADMIN_IDENTIFY     6U
 
@@ -197,6 +229,27 @@ volatile union nvme_identify {
 #define NVME_PAGE_SIZE 4096
 #define NVME_PAGE_MASK ~(NVME_PAGE_SIZE - 1)
 
+/* Pages within the DMA arena */
+#define NVME_ARENA_ADMIN_SQ 0
+#define NVME_ARENA_ADMIN_CQ 1
+#define NVME_ARENA_IO_SQ    2
+#define NVME_ARENA_IO_CQ    3
+#define NVME_ARENA_IDENTIFY 4
+#define NVME_ARENA_PRPL     5   /* PRP list slots */
+#define NVME_ARENA_BOUNCE   6   /* one page per bounce buffer slot */
+
+#define NVME_BOUNCE_SLOTS 2
+#define NVME_ARENA_PAGES  (NVME_ARENA_BOUNCE + NVME_BOUNCE_SLOTS)
+
+/* Bounce buffer slot describing the maximum size bounce buffer, which
+   is allocated along with the arena so that bounced transfers never
+   need to allocate memory once the INT 13 runtime is resident. */
+#define NVME_BOUNCE_LARGE NVME_BOUNCE_SLOTS
+
+/* PRP list slots are large enough to describe a maximum size transfer */
+#define NVME_PRPL_SIZE  128
+#define NVME_PRPL_SLOTS (NVME_PAGE_SIZE / NVME_PRPL_SIZE)
+
 /* Length for the queue entries. */
 #define NVME_SQE_SIZE_LOG 6
 #define NVME_CQE_SIZE_LOG 4
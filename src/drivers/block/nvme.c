@@ -2,7 +2,10 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <errno.h>
+#include <assert.h>
 #include <ipxe/xfer.h>
 #include <ipxe/uri.h>
 #include <ipxe/open.h>
@@ -15,6 +18,10 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/io.h>
 #include <ipxe/efi/efi_path.h>
 #include <ipxe/blocktrans.h>
+#include <ipxe/smp.h>
+#include <ipxe/nstime.h>
+#include <ipxe/sanfs.h>
+#include <config/general.h>
 
 #include "nvme.h"
 #include "nvme-int.h"
@@ -28,18 +35,118 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 /** List of NVMe devices */
 static LIST_HEAD ( nvme_devices );
 
-// Page aligned "dma bounce buffer" of size NVME_PAGE_SIZE in high memory
-static void *nvme_dma_buffer;
+/** Open files within SAN filesystems on NVMe devices */
+#if ( defined ( SANFS_FAT ) || defined ( SANFS_EXT ) || \
+      defined ( SANFS_ISO9660 ) )
+#define NVME_SANFS 1
+#else
+#define NVME_SANFS 0
+#endif
 
-struct dma_mapping sqe_map;
-struct dma_mapping cqe_map;
-struct dma_mapping identify_map;
+/******************************************************************************
+ *
+ * DMA arena
+ *
+ ******************************************************************************
+ */
 
-static void * zalloc_page_aligned(u32 size)
-{
-    void *res = malloc_phys(size, NVME_PAGE_SIZE);
-    if (res) memset(res, 0, size);
-    return res;
+/**
+ * Create controller DMA arena
+ *
+ * @v ctrl		NVMe controller
+ * @ret rc		Return status code
+ */
+static int nvme_arena_create ( struct nvme_ctrl *ctrl ) {
+    struct nvme_arena *arena = &ctrl->arena;
+    size_t len = ( NVME_ARENA_PAGES * NVME_PAGE_SIZE );
+
+    /* A PRP list slot must describe a maximum size transfer */
+    linker_assert ( ( ( ( NVME_MAX_XFER_SIZE / NVME_PAGE_SIZE ) *
+                        sizeof ( u64 ) ) <= NVME_PRPL_SIZE ),
+                    nvme_prpl_slot_too_small );
+    linker_assert ( ( NVME_MAX_COMMANDS <= NVME_PRPL_SLOTS ),
+                    nvme_prpl_slots_too_few );
+
+    arena->base = dma_alloc ( &ctrl->pci->dma, &arena->map, len,
+                              NVME_PAGE_SIZE );
+    if ( ! arena->base )
+        goto err_base;
+    memset ( arena->base, 0, len );
+
+    /* Preallocate a maximum size bounce buffer, since the heap is
+     * trimmed once the INT 13 runtime becomes resident.
+     */
+    arena->large = dma_alloc ( &ctrl->pci->dma, &arena->large_map,
+                               NVME_MAX_XFER_SIZE, NVME_PAGE_SIZE );
+    if ( ! arena->large )
+        goto err_large;
+
+    arena->prpl_free = ( ( 1ULL << NVME_PRPL_SLOTS ) - 1 );
+    arena->bounce_free = ( ( 1U << ( NVME_BOUNCE_LARGE + 1 ) ) - 1 );
+    DBGC ( ctrl, "NVMe DMA arena [%08lx,%08lx)\n",
+           dma ( &arena->map, arena->base ),
+           ( dma ( &arena->map, arena->base ) + len ) );
+
+    return 0;
+
+    err_large:
+    dma_free ( &arena->map, arena->base, len );
+    err_base:
+    return -ENOMEM;
+}
+
+/**
+ * Destroy controller DMA arena
+ *
+ * @v ctrl		NVMe controller
+ */
+static void nvme_arena_destroy ( struct nvme_ctrl *ctrl ) {
+    struct nvme_arena *arena = &ctrl->arena;
+
+    dma_free ( &arena->large_map, arena->large, NVME_MAX_XFER_SIZE );
+    arena->large = NULL;
+    dma_free ( &arena->map, arena->base,
+               ( NVME_ARENA_PAGES * NVME_PAGE_SIZE ) );
+    arena->base = NULL;
+}
+
+/**
+ * Get page within controller DMA arena
+ *
+ * @v ctrl		NVMe controller
+ * @v page		Page index
+ * @ret ptr		Page
+ */
+static void * nvme_arena_page ( struct nvme_ctrl *ctrl, unsigned int page ) {
+
+    return ( ctrl->arena.base + ( page * NVME_PAGE_SIZE ) );
+}
+
+/**
+ * Allocate slot from DMA arena
+ *
+ * @v free		Bitmap of free slots
+ * @ret slot		Slot index, or negative if no slots are free
+ */
+static int nvme_arena_alloc ( u32 *free ) {
+    int slot;
+
+    slot = ( ffs ( *free ) - 1 );
+    if ( slot >= 0 )
+        *free &= ~( 1U << slot );
+    return slot;
+}
+
+/**
+ * Free slot to DMA arena
+ *
+ * @v free		Bitmap of free slots
+ * @v slot		Slot index
+ */
+static void nvme_arena_free ( u32 *free, int slot ) {
+
+    assert ( ! ( *free & ( 1U << slot ) ) );
+    *free |= ( 1U << slot );
 }
 
 /******************************************************************************
@@ -61,76 +168,69 @@ static void nvme_init_queue_common(struct nvme_ctrl *ctrl, volatile struct nvme_
 }
 
 
-/* Waits for CSTS.RDY to match rdy. Returns 0 on success. */
+/* Waits for CSTS.RDY to match rdy. Returns 0 on success. The worst-case
+   time is given by CAP.TO, in units of 500ms. A fatal controller status
+   fails only a wait for the controller to become ready: disabling the
+   controller is how the host recovers from a fatal status, and CSTS.CFS
+   may remain set until that completes. */
 static int nvme_wait_csts_rdy(struct nvme_ctrl *ctrl, unsigned rdy)
 {
-//    u32 const max_to = 500 /* ms */ * ((ctrl->reg->cap >> 24) & 0xFFU);
-//    u32 to = timer_calc(max_to);
+    u32 const max_to = 500 /* ms */ * ((ctrl->reg->cap >> 24) & 0xFFU);
+    u64 const deadline = nstime() + (max_to ? max_to : 500) * NSTIME_PER_MS;
     u32 csts;
     mb();
     while (rdy != ((csts = ctrl->reg->csts) & NVME_CSTS_RDY)) {
         mb();
-//        yield();
-
-//        if (csts & NVME_CSTS_FATAL) {
-//            DBGC ( ctrl, "NVMe fatal error during controller shutdown\n");
-//            return -1;
-//        }
-//
-//        if (timer_check(to)) {
-//            warn_timeout();
-//            return -1;
-//        }
+
+        if (rdy && (csts & NVME_CSTS_FATAL)) {
+            DBGC ( ctrl, "NVMe fatal error waiting for CSTS.RDY=%d\n", rdy);
+            return -EIO;
+        }
+
+        if (nstime() > deadline) {
+            DBGC ( ctrl, "NVMe timed out waiting for CSTS.RDY=%d\n", rdy);
+            return -ETIMEDOUT;
+        }
     }
 
     return 0;
 }
 
-static int nvme_init_sq(struct nvme_ctrl *ctrl, volatile struct nvme_sq *sq, u16 q_idx, u16 length,
-                        volatile struct nvme_cq *cq)
+/* Queue rings occupy a single page of the DMA arena. */
+static void nvme_init_sq(struct nvme_ctrl *ctrl, volatile struct nvme_sq *sq, u16 q_idx, u16 length,
+                         volatile struct nvme_cq *cq, unsigned page)
 {
+    assert(sizeof(*sq->sqe) * length <= NVME_PAGE_SIZE);
     nvme_init_queue_common(ctrl, &sq->common, q_idx, length);
-    sq->sqe = dma_alloc ( &ctrl->pci->dma, &sqe_map, sizeof(*sq->sqe) * length, 4096 );
+    sq->sqe = nvme_arena_page(ctrl, page);
     memset(sq->sqe, 0, sizeof(*sq->sqe) * length);
 
-    if (!sq->sqe) {
-        DBGC ( ctrl, "Failed to alloc memory!\n");
-        return -1;
-    }
-
     DBGC ( ctrl, "sq %p q_idx %d sqe %p\n", sq, q_idx, sq->sqe);
     sq->cq   = cq;
     sq->head = 0;
     sq->tail = 0;
-
-    return 0;
 }
 
-static int nvme_init_cq(struct nvme_ctrl *ctrl, volatile struct nvme_cq *cq, u16 q_idx, u16 length)
+static void nvme_init_cq(struct nvme_ctrl *ctrl, volatile struct nvme_cq *cq, u16 q_idx, u16 length,
+                         unsigned page)
 {
+    assert(sizeof(*cq->cqe) * length <= NVME_PAGE_SIZE);
     nvme_init_queue_common(ctrl, &cq->common, q_idx, length);
-    cq->cqe = dma_alloc ( &ctrl->pci->dma, &cqe_map, sizeof(*cq->cqe) * length, 4096 );
+    cq->cqe = nvme_arena_page(ctrl, page);
     memset(cq->cqe, 0, sizeof(*cq->cqe) * length);
 
-    if (!cq->cqe) {
-        DBGC ( ctrl, "Failed to alloc memory!\n");
-        return -1;
-    }
-
     cq->head = 0;
 
     /* All CQE phase bits are initialized to zero. This means initially we wait
        for the host controller to set these to 1. */
     cq->phase = 1;
-
-    return 0;
 }
 
 /* Returns the next submission queue entry (or NULL if the queue is full). It
    also fills out Command Dword 0 and clears the rest. */
 static volatile struct nvme_sqe * nvme_get_next_sqe(volatile struct nvme_sq *sq, u8 opc, void *metadata, void *data, void *data2)
 {
-    if (((sq->head + 1) & sq->common.mask) == sq->tail) {
+    if (((sq->tail + 1) & sq->common.mask) == sq->head) {
         DBGC ( sq, "submission queue is full\n");
         return NULL;
     }
@@ -227,41 +327,35 @@ static void nvme_commit_sqe(volatile struct nvme_sq *sq)
 static struct nvme_cqe nvme_wait(volatile struct nvme_sq *sq)
 {
     static const unsigned nvme_timeout = 5000 /* ms */;
-    //u32 to = timer_calc(nvme_timeout);
+    u64 deadline = nstime() + nvme_timeout * NSTIME_PER_MS;
     mb();
     while (!nvme_poll_cq(sq->cq)) {
         mb();
-        //yield();
 
-        //if (timer_check(to)) {
-        //    warn_timeout();
-        //    return nvme_error_cqe();
-        //}
-        //DBGC ( sq, "nvme_wait()\n");
+        if (nstime() > deadline) {
+            DBGC ( sq, "NVMe timed out waiting for admin command\n");
+            return nvme_error_cqe();
+        }
     }
 
     return nvme_consume_cqe(sq);
 }
 
 /* Perform an identify command on the admin queue and return the resulting
-   buffer. This may be a NULL pointer, if something failed. This function
-   cannot be used after initialization, because it uses buffers in tmp zone. */
-volatile static union nvme_identify * nvme_admin_identify(struct nvme_ctrl *ctrl, u8 cns, u32 nsid)
+   buffer. This may be a NULL pointer, if something failed. The buffer is
+   the identify page of the DMA arena, and so remains valid only until the
+   next identify command. */
+static volatile union nvme_identify * nvme_admin_identify(struct nvme_ctrl *ctrl, u8 cns, u32 nsid)
 {
-    union nvme_identify *identify_buf = dma_alloc ( &ctrl->pci->dma, &identify_map, 4096, 4096 );
-    if (!identify_buf) {
-        /* Could not allocate identify buffer. */
-        DBGC ( ctrl, "Could not allocate identify buffer!\n");
-        return NULL;
-    }
-    memset(identify_buf, 0, 4096);
+    union nvme_identify *identify_buf = nvme_arena_page(ctrl, NVME_ARENA_IDENTIFY);
+    memset(identify_buf, 0, NVME_PAGE_SIZE);
 
     DBGC ( ctrl, "nvme_get_next_sqe(&ctrl->admin_sq\n");
 
     volatile struct nvme_sqe *cmd_identify;
     cmd_identify = nvme_get_next_sqe(&ctrl->admin_sq,
                                      NVME_SQE_OPC_ADMIN_IDENTIFY, NULL,
-                                     dma(&identify_map, identify_buf), NULL);
+                                     dma(&ctrl->arena.map, identify_buf), NULL);
 
     if (!cmd_identify) {
         DBGC ( ctrl, "!cmd_identify!\n");
@@ -278,7 +372,6 @@ volatile static union nvme_identify * nvme_admin_identify(struct nvme_ctrl *ctrl
 
     return identify_buf;
     error:
-    dma_free(&identify_map, identify_buf, 4096);
     return NULL;
 }
 
@@ -293,39 +386,33 @@ static volatile struct nvme_identify_ns * nvme_admin_identify_ns(struct nvme_ctr
                                 ns_id)->ns;
 }
 
-/* Release memory allocated for a completion queue */
+/* Detach a completion queue from its ring. The ring itself belongs to the DMA
+   arena. */
 static void nvme_destroy_cq(volatile struct nvme_cq *cq)
 {
-    free(cq->cqe);
     cq->cqe = NULL;
 }
 
-/* Release memory allocated for a submission queue */
+/* Detach a submission queue from its ring. The ring itself belongs to the DMA
+   arena. */
 static void nvme_destroy_sq(volatile struct nvme_sq *sq)
 {
-    free(sq->sqe);
     sq->sqe = NULL;
 }
 
 /* Returns 0 on success. */
 static int nvme_create_io_cq(struct nvme_ctrl *ctrl, volatile struct nvme_cq *cq, u16 q_idx)
 {
-    int rc;
     struct nvme_sqe *cmd_create_cq;
     u32 length = 1 + (ctrl->reg->cap & 0xffff);
     if (length > NVME_PAGE_SIZE / sizeof(struct nvme_cqe))
         length = NVME_PAGE_SIZE / sizeof(struct nvme_cqe);
 
-    rc = nvme_init_cq(ctrl, cq, q_idx, length);
-    if (rc) {
-        goto err;
-    }
-
-    // FIXME: virt_to_phys oder DMA Buffer?!
+    nvme_init_cq(ctrl, cq, q_idx, length, NVME_ARENA_IO_CQ);
 
     cmd_create_cq = nvme_get_next_sqe(&ctrl->admin_sq,
                                       NVME_SQE_OPC_ADMIN_CREATE_IO_CQ, NULL,
-                                      virt_to_phys(cq->cqe), NULL);
+                                      dma(&ctrl->arena.map, (void *)cq->cqe), NULL);
     if (!cmd_create_cq) {
         goto err_destroy_cq;
     }
@@ -347,29 +434,22 @@ static int nvme_create_io_cq(struct nvme_ctrl *ctrl, volatile struct nvme_cq *cq
 
     err_destroy_cq:
     nvme_destroy_cq(cq);
-    err:
     return -1;
 }
 
 /* Returns 0 on success. */
 static int nvme_create_io_sq(struct nvme_ctrl *ctrl, volatile struct nvme_sq *sq, u16 q_idx, struct nvme_cq *cq)
 {
-    int rc;
     struct nvme_sqe *cmd_create_sq;
     u32 length = 1 + (ctrl->reg->cap & 0xffff);
-    if (length > NVME_PAGE_SIZE / sizeof(struct nvme_cqe))
-        length = NVME_PAGE_SIZE / sizeof(struct nvme_cqe);
-
-    rc = nvme_init_sq(ctrl, sq, q_idx, length, cq);
-    if (rc) {
-        goto err;
-    }
+    if (length > NVME_PAGE_SIZE / sizeof(struct nvme_sqe))
+        length = NVME_PAGE_SIZE / sizeof(struct nvme_sqe);
 
-    // FIXME: virt_to_phys oder DMA Buffer?!
+    nvme_init_sq(ctrl, sq, q_idx, length, cq, NVME_ARENA_IO_SQ);
 
     cmd_create_sq = nvme_get_next_sqe(&ctrl->admin_sq,
                                       NVME_SQE_OPC_ADMIN_CREATE_IO_SQ, NULL,
-                                      virt_to_phys(sq->sqe), NULL);
+                                      dma(&ctrl->arena.map, (void *)sq->sqe), NULL);
     if (!cmd_create_sq) {
         goto err_destroy_sq;
     }
@@ -392,10 +472,32 @@ static int nvme_create_io_sq(struct nvme_ctrl *ctrl, volatile struct nvme_sq *sq
 
     err_destroy_sq:
     nvme_destroy_sq(sq);
-    err:
     return -1;
 }
 
+/* Delete an I/O queue. Returns 0 on success. */
+static int nvme_delete_io_queue(struct nvme_ctrl *ctrl, u8 opc, u16 q_idx)
+{
+    volatile struct nvme_sqe *cmd_delete;
+
+    cmd_delete = nvme_get_next_sqe(&ctrl->admin_sq, opc, NULL, NULL, NULL);
+    if (!cmd_delete)
+        return -1;
+
+    cmd_delete->dword[10] = q_idx >> 1;
+
+    nvme_commit_sqe(&ctrl->admin_sq);
+    struct nvme_cqe cqe = nvme_wait(&ctrl->admin_sq);
+
+    if (!nvme_is_cqe_success(&cqe)) {
+        DBGC ( ctrl, "delete io queue %d failed: %08x %08x %08x %08x\n",
+               q_idx, cqe.dword[0], cqe.dword[1], cqe.dword[2], cqe.dword[3]);
+        return -1;
+    }
+
+    return 0;
+}
+
 static int nvme_create_io_queues(struct nvme_ctrl *ctrl)
 {
     if (nvme_create_io_cq(ctrl, &ctrl->io_cq, 3))
@@ -412,6 +514,30 @@ static int nvme_create_io_queues(struct nvme_ctrl *ctrl)
     return -1;
 }
 
+/* Abort all outstanding I/O commands by deleting and recreating the I/O
+   queues. Deleting the submission queue aborts every command on it, and
+   once the deletion has completed the controller will no longer access
+   their data buffers or post completions for their command identifiers.
+   If the queues cannot be deleted, the controller is disabled instead
+   (which also stops all DMA) and the I/O queues are left unusable.
+   Returns 0 on success. */
+static int nvme_reset_io_queues(struct nvme_ctrl *ctrl)
+{
+    if (nvme_delete_io_queue(ctrl, NVME_SQE_OPC_ADMIN_DELETE_IO_SQ, 2) ||
+        nvme_delete_io_queue(ctrl, NVME_SQE_OPC_ADMIN_DELETE_IO_CQ, 3)) {
+        DBGC ( ctrl, "NVMe could not delete I/O queues; disabling\n");
+        ctrl->reg->cc = 0;
+        nvme_wait_csts_rdy(ctrl, 0);
+        nvme_destroy_sq(&ctrl->io_sq);
+        nvme_destroy_cq(&ctrl->io_cq);
+        return -1;
+    }
+
+    nvme_destroy_sq(&ctrl->io_sq);
+    nvme_destroy_cq(&ctrl->io_cq);
+    return nvme_create_io_queues(ctrl);
+}
+
 static void nvme_probe_ns(struct nvme_ctrl *ctrl, u32 ns_idx, u8 mdts)
 {
     u32 ns_id = ns_idx + 1;
@@ -419,7 +545,7 @@ static void nvme_probe_ns(struct nvme_ctrl *ctrl, u32 ns_idx, u8 mdts)
     volatile struct nvme_identify_ns *id = nvme_admin_identify_ns(ctrl, ns_id);
     if (!id) {
         DBGC ( ctrl, "NVMe couldn't identify namespace %d.\n", ns_id);
-        goto free_buffer;
+        return;
     }
 
     DBG_HDA_IF( LOG, 0, id, sizeof(struct nvme_identify_ns) );
@@ -429,27 +555,18 @@ static void nvme_probe_ns(struct nvme_ctrl *ctrl, u32 ns_idx, u8 mdts)
         DBGC ( ctrl, "NVMe NS %d: current LBA format %d is beyond what the "
                      " namespace supports (%d)?\n",
                ns_id, current_lba_format, id->nlbaf + 1);
-        goto free_buffer;
+        return;
     }
 
     if (!id->nsze) {
         DBGC ( ctrl, "NVMe NS %d is inactive.\n", ns_id);
-        goto free_buffer;
-    }
-
-    if (!nvme_dma_buffer) {
-        nvme_dma_buffer = dma_alloc ( &ctrl->pci->dma, &sqe_map, NVME_PAGE_SIZE, NVME_PAGE_SIZE );
-        if (!nvme_dma_buffer) {
-            DBGC ( ctrl, "Failed to allocate NVMe DMA buffer\n");
-            goto free_buffer;
-        }
-        memset(nvme_dma_buffer, 0, NVME_PAGE_SIZE);
+        return;
     }
 
     struct nvme_namespace *ns = malloc(sizeof(*ns));
     if (!ns) {
         DBGC ( ctrl, "ns could not be allocated.\n");
-        goto free_buffer;
+        return;
     }
     memset(ns, 0, sizeof(*ns));
     ns->ctrl  = ctrl;
@@ -468,16 +585,25 @@ static void nvme_probe_ns(struct nvme_ctrl *ctrl, u32 ns_idx, u8 mdts)
                      "           buffer size.\n",
                ns_id, ns->max_req_size);
         free(ns);
-        goto free_buffer;
+        return;
     }
 
-    if (mdts) {
+    ns->max_req_size = NVME_MAX_XFER_SIZE / ns->block_size;
+    if (mdts && (((1U << mdts) * NVME_PAGE_SIZE) < NVME_MAX_XFER_SIZE)) {
         ns->max_req_size = ((1U << mdts) * NVME_PAGE_SIZE) / ns->block_size;
-        DBGC ( ctrl, "NVME NS %d max request size: %d sectors\n",
-               ns_id, ns->max_req_size);
+    }
+    DBGC ( ctrl, "NVME NS %d max request size: %d sectors\n",
+           ns_id, ns->max_req_size);
+
+    /* Prefer the namespace optimal I/O boundary, if reported, and
+       otherwise keep transfers aligned to controller pages. */
+    if (id->noiob && !(id->noiob & (id->noiob - 1))) {
+        ns->align = id->noiob;
     } else {
-        ns->max_req_size = -1U;
+        ns->align = NVME_PAGE_SIZE / ns->block_size;
     }
+    DBGC ( ctrl, "NVME NS %d preferred alignment: %d sectors\n",
+           ns_id, ns->align);
 
     DBGC ( ctrl,"NVMe NS %d: ", ns_id);
     DBGC ( ctrl,"%d MiB ", (ns->lba_count * ns->block_size) >> 20);
@@ -486,9 +612,6 @@ static void nvme_probe_ns(struct nvme_ctrl *ctrl, u32 ns_idx, u8 mdts)
     DBGC ( ctrl, "blocks + %d-byte metadata)\n", ns->metadata_size);
 
     ctrl->ns = ns;
-
-    free_buffer:
-    dma_free(&identify_map, id, 4096);
 }
 
 static int nvme_controller_enable(struct nvme_ctrl *ctrl)
@@ -504,23 +627,23 @@ static int nvme_controller_enable(struct nvme_ctrl *ctrl)
 
     ctrl->doorbell_stride = 4U << ((ctrl->reg->cap >> 32) & 0xF);
 
-    rc = nvme_init_cq(ctrl, &ctrl->admin_cq, 1,
-                      NVME_PAGE_SIZE / sizeof(struct nvme_cqe));
+    rc = nvme_arena_create(ctrl);
     if (rc) {
+        DBGC ( ctrl, "NVMe could not allocate DMA arena\n");
         return -1;
     }
 
-    rc = nvme_init_sq(ctrl, &ctrl->admin_sq, 0,
-                      NVME_PAGE_SIZE / sizeof(struct nvme_sqe), &ctrl->admin_cq);
-    if (rc) {
-        goto err_destroy_admin_cq;
-    }
+    nvme_init_cq(ctrl, &ctrl->admin_cq, 1,
+                 NVME_PAGE_SIZE / sizeof(struct nvme_cqe), NVME_ARENA_ADMIN_CQ);
+    nvme_init_sq(ctrl, &ctrl->admin_sq, 0,
+                 NVME_PAGE_SIZE / sizeof(struct nvme_sqe), &ctrl->admin_cq,
+                 NVME_ARENA_ADMIN_SQ);
 
     ctrl->reg->aqa = ctrl->admin_cq.common.mask << 16
                      | ctrl->admin_sq.common.mask;
 
-    ctrl->reg->asq = dma(&sqe_map, ctrl->admin_sq.sqe);
-    ctrl->reg->acq = dma(&cqe_map, ctrl->admin_cq.cqe);
+    ctrl->reg->asq = dma(&ctrl->arena.map, ctrl->admin_sq.sqe);
+    ctrl->reg->acq = dma(&ctrl->arena.map, ctrl->admin_cq.cqe);
 
     ctrl->reg->cc = NVME_CC_EN | (NVME_CQE_SIZE_LOG << 20)
                     | (NVME_SQE_SIZE_LOG << 16 /* IOSQES */);
@@ -540,15 +663,11 @@ static int nvme_controller_enable(struct nvme_ctrl *ctrl)
         goto err_destroy_admin_sq;
     }
 
-    DBGC ( ctrl, "NVMe has %d namespace%s.\n",
-           identify->nn, (identify->nn == 1) ? "" : "s");
-
     DBGC ( ctrl, "NVMe has %d namespace%s.\n",
            identify->nn, (identify->nn == 1) ? "" : "s");
 
     ctrl->ns_count = identify->nn;
     u8 mdts = identify->mdts;
-    dma_free(&identify_map, identify, 4096);
 
     if ((ctrl->ns_count == 0) || nvme_create_io_queues(ctrl)) {
         /* No point to continue, if the controller says it doesn't have
@@ -570,279 +689,561 @@ static int nvme_controller_enable(struct nvme_ctrl *ctrl)
 
     err_destroy_admin_sq:
     nvme_destroy_sq(&ctrl->admin_sq);
-    err_destroy_admin_cq:
     nvme_destroy_cq(&ctrl->admin_cq);
+    nvme_arena_destroy(ctrl);
     return -1;
 }
 
-/* Reads count sectors into buf. The buffer cannot cross page boundaries. */
-static int nvme_io_xfer(struct nvme_namespace *ns, u64 lba, void *prp1, void *prp2,
-                        u16 count, int write)
-{
-    if (((u32)prp1 & 0x3) || ((u32)prp2 & 0x3)) {
-        /* Buffer is misaligned */
-        DBGC ( ns, "Internal buffer is misaligned.\n");
-        return -EBUSY;
+/******************************************************************************
+ *
+ * I/O commands
+ *
+ ******************************************************************************
+ */
+
+/** An NVMe I/O command */
+struct nvme_command {
+    /** Reference count */
+    struct refcnt refcnt;
+    /** NVMe device */
+    struct nvme_device *nvme;
+    /** List of outstanding commands */
+    struct list_head list;
+
+    /** Block data interface */
+    struct interface block;
+
+    /** Command identifier */
+    u16 cid;
+    /** Command status */
+    int rc;
+
+    /** Data buffer */
+    userptr_t buffer;
+    /** Length of data buffer */
+    size_t len;
+    /** Data buffer DMA mapping */
+    struct dma_mapping map;
+    /** Bounce buffer (if used) */
+    void *bounce;
+    /** Bounce buffer DMA arena slot, or negative if not in arena */
+    int bounce_slot;
+    /** Bounce buffer DMA mapping (if not in arena) */
+    struct dma_mapping bounce_map;
+    /** PRP list (if used) */
+    u64 *prpl;
+    /** PRP list DMA arena slot, or negative if not used */
+    int prpl_slot;
+    /** PRP entries */
+    u64 prp1;
+    u64 prp2;
+    /** Command is a write */
+    int write;
+    /** Caller has lost interest in the command */
+    int abandoned;
+    /** Submission time (in nanoseconds) */
+    u64 started;
+};
+
+/**
+ * Free NVMe command
+ *
+ * @v refcnt		Reference count
+ */
+static void nvme_command_free ( struct refcnt *refcnt ) {
+    struct nvme_command *cmd =
+        container_of ( refcnt, struct nvme_command, refcnt );
+    struct nvme_arena *arena = &cmd->nvme->ctrl->arena;
+
+    if ( cmd->prpl_slot >= 0 )
+        nvme_arena_free ( &arena->prpl_free, cmd->prpl_slot );
+    if ( cmd->bounce_slot >= 0 ) {
+        nvme_arena_free ( &arena->bounce_free, cmd->bounce_slot );
+    } else if ( cmd->bounce ) {
+        dma_free ( &cmd->bounce_map, cmd->bounce, cmd->len );
     }
-    retry:
-    volatile struct nvme_sqe *io_read = nvme_get_next_sqe(&ns->ctrl->io_sq,
-                                                          write ? NVME_SQE_OPC_IO_WRITE
-                                                                : NVME_SQE_OPC_IO_READ,
-                                                          NULL, prp1, prp2);
-    io_read->nsid = ns->ns_id;
-    io_read->dword[10] = (u32)lba;
-    io_read->dword[11] = (u32)(lba >> 32);
-    io_read->dword[12] = (1U << 31 /* limited retry */) | (count - 1);
+    dma_unmap ( &cmd->map );
+    free ( cmd );
+}
 
-    nvme_commit_sqe(&ns->ctrl->io_sq);
+/**
+ * Complete NVMe command
+ *
+ * @v cmd		NVMe command
+ * @v rc		Completion status
+ */
+static void nvme_command_close ( struct nvme_command *cmd, int rc ) {
 
-    struct nvme_cqe cqe = nvme_wait(&ns->ctrl->io_sq);
-    // DBGC ( ns, "ns %d %s lba %d+%d\n", ns->ns_id, write ? "write" : "read", lba, count);
+    /* Copy out bounced read data */
+    if ( ( rc == 0 ) && cmd->bounce && ( ! cmd->write ) &&
+         ( ! cmd->abandoned ) )
+        smp_memcpy ( user_to_virt ( cmd->buffer, 0 ), cmd->bounce, cmd->len );
 
-    if (!nvme_is_cqe_success(&cqe)) {
-        DBGC ( ns, "read error: %08x %08x %08x %08x\n",
-               cqe.dword[0], cqe.dword[1], cqe.dword[2], cqe.dword[3]);
+    /* Remove from list of outstanding commands */
+    list_del ( &cmd->list );
 
-        goto retry;
-        return -1;
+    /* Shut down interfaces and drop list's reference */
+    intf_shutdown ( &cmd->block, rc );
+    ref_put ( &cmd->refcnt );
+}
+
+/**
+ * Abort all outstanding NVMe I/O commands
+ *
+ * @v nvme		NVMe device
+ * @v rc		Completion status for outstanding commands
+ *
+ * The I/O queues are reset, so that the controller can no longer
+ * write to any outstanding command's data buffer or complete a
+ * command using a stale command identifier.  The aborted commands
+ * are retired by the command completion process.
+ */
+static void nvme_abort ( struct nvme_device *nvme, int rc ) {
+    struct nvme_command *cmd;
+
+    DBGC ( nvme, "NVMe aborting outstanding commands: %s\n", strerror ( rc ) );
+    nvme_reset_io_queues ( nvme->ctrl );
+    list_for_each_entry ( cmd, &nvme->commands, list ) {
+        if ( cmd->rc == -EINPROGRESS )
+            cmd->rc = rc;
     }
+}
 
-    return count;
+/**
+ * Handle closure of NVMe command block interface
+ *
+ * @v cmd		NVMe command
+ * @v rc		Reason for close
+ *
+ * The caller has lost interest in the command, and may reuse its data
+ * buffer as soon as this returns.  If the controller may still be
+ * transferring data, all outstanding commands are therefore aborted
+ * before the caller is released.
+ */
+static void nvme_command_abandon ( struct nvme_command *cmd, int rc ) {
+    cmd->abandoned = 1;
+    if ( cmd->rc == -EINPROGRESS )
+        nvme_abort ( cmd->nvme, -ECANCELED );
+    intf_restart ( &cmd->block, rc );
 }
 
-// Transfer up to one page of data using the internal dma bounce buffer
-static int nvme_bounce_xfer(struct nvme_namespace *ns, u64 lba, void *buf, u16 count,
-                            int write)
-{
-    u16 const max_blocks = NVME_PAGE_SIZE / ns->block_size;
-    u16 blocks = count < max_blocks ? count : max_blocks;
+/** NVMe command block interface operations */
+static struct interface_operation nvme_command_block_op[] = {
+        INTF_OP ( intf_close, struct nvme_command *, nvme_command_abandon ),
+};
 
-    if (write)
-        memcpy(nvme_dma_buffer, buf, blocks * ns->block_size);
+/** NVMe command block interface descriptor */
+static struct interface_descriptor nvme_command_block_desc =
+        INTF_DESC ( struct nvme_command, block, nvme_command_block_op );
 
-    int res = nvme_io_xfer(ns, lba, nvme_dma_buffer, NULL, blocks, write);
+/**
+ * Describe NVMe command data buffer using PRP entries
+ *
+ * @v cmd		NVMe command
+ * @v addr		DMA address of data buffer
+ * @ret rc		Return status code
+ */
+static int nvme_command_prp ( struct nvme_command *cmd, physaddr_t addr ) {
+    struct nvme_ctrl *ctrl = cmd->nvme->ctrl;
+    size_t len = cmd->len;
+    size_t first = ( NVME_PAGE_SIZE - ( addr & ~NVME_PAGE_MASK ) );
+    physaddr_t page;
+    unsigned int i;
+    int slot;
+
+    /* First page is described by PRP1, which may have an offset */
+    cmd->prp1 = addr;
+    if ( len <= first )
+        return 0;
+    len -= first;
+    page = ( ( addr & NVME_PAGE_MASK ) + NVME_PAGE_SIZE );
 
-    if (!write && res >= 0)
-        memcpy(buf, nvme_dma_buffer, res * ns->block_size);
+    /* Directly embed the 2nd page if we only need 2 pages */
+    if ( len <= NVME_PAGE_SIZE ) {
+        cmd->prp2 = page;
+        return 0;
+    }
 
-    return res;
-}
+    /* Build PRP list if we need to describe more than 2 pages */
+    slot = nvme_arena_alloc ( &ctrl->arena.prpl_free );
+    if ( slot < 0 )
+        return -ENOBUFS;
+    cmd->prpl_slot = slot;
+    cmd->prpl = ( nvme_arena_page ( ctrl, NVME_ARENA_PRPL ) +
+                  ( slot * NVME_PRPL_SIZE ) );
+    for ( i = 0 ; len ; i++ ) {
+        assert ( i < ( NVME_PRPL_SIZE / sizeof ( cmd->prpl[0] ) ) );
+        cmd->prpl[i] = page;
+        page += NVME_PAGE_SIZE;
+        len -= ( ( len < NVME_PAGE_SIZE ) ? len : NVME_PAGE_SIZE );
+    }
+    cmd->prp2 = dma ( &ctrl->arena.map, cmd->prpl );
 
-#define NVME_MAX_PRPL_ENTRIES 15 /* Allows requests up to 64kb */
+    return 0;
+}
 
-// Transfer data using page list (if applicable)
-static int nvme_prpl_xfer(struct nvme_namespace *ns, u64 lba, void *buf, u16 count,
-                          int write)
-{
-    u32 base = (long)buf;
-    s32 size;
+/**
+ * Allocate NVMe command bounce buffer
+ *
+ * @v cmd		NVMe command
+ * @ret addr		DMA address of bounce buffer
+ * @ret rc		Return status code
+ *
+ * Bounce buffers of up to one page are taken from the DMA arena, and
+ * larger bounced transfers use the preallocated maximum size bounce
+ * buffer.  Only concurrent large bounced transfers (which are rare)
+ * fall back to a transient allocation.
+ */
+static int nvme_command_bounce ( struct nvme_command *cmd,
+                                 physaddr_t *addr ) {
+    struct nvme_ctrl *ctrl = cmd->nvme->ctrl;
+    struct nvme_arena *arena = &ctrl->arena;
+    u32 large = ( 1U << NVME_BOUNCE_LARGE );
+    u32 free;
+    int slot;
+
+    /* Use a bounce buffer slot from the DMA arena, if possible */
+    free = ( ( cmd->len <= NVME_PAGE_SIZE ) ?
+             ( arena->bounce_free & ~large ) : 0 );
+    if ( ! free )
+        free = ( arena->bounce_free & large );
+    if ( free ) {
+        slot = nvme_arena_alloc ( &free );
+        arena->bounce_free &= ~( 1U << slot );
+        cmd->bounce_slot = slot;
+        if ( slot == NVME_BOUNCE_LARGE ) {
+            cmd->bounce = arena->large;
+            *addr = dma ( &arena->large_map, cmd->bounce );
+        } else {
+            cmd->bounce = nvme_arena_page ( ctrl,
+                                            ( NVME_ARENA_BOUNCE + slot ) );
+            *addr = dma ( &arena->map, cmd->bounce );
+        }
+        return 0;
+    }
 
-    if (count > ns->max_req_size)
-        count = ns->max_req_size;
+    /* Otherwise, allocate a bounce buffer */
+    cmd->bounce = dma_alloc ( &ctrl->pci->dma, &cmd->bounce_map, cmd->len,
+                              NVME_PAGE_SIZE );
+    if ( ! cmd->bounce )
+        return -ENOMEM;
+    *addr = dma ( &cmd->bounce_map, cmd->bounce );
+    return 0;
+}
 
-    size = count * ns->block_size;
-    /* Special case for transfers that fit into PRP1, but are unaligned */
-    if (((size + (base & ~NVME_PAGE_MASK)) <= NVME_PAGE_SIZE))
-        goto single;
+/**
+ * Record NVMe command latency
+ *
+ * @v nvme		NVMe device
+ * @v ns		Latency (in nanoseconds)
+ */
+static void nvme_latency ( struct nvme_device *nvme, u64 ns ) {
+    unsigned int bucket = flsll ( ns >> NVME_LATENCY_SHIFT );
 
-    /* Every request has to be page aligned */
-    if (base & ~NVME_PAGE_MASK)
-        goto bounce;
+    if ( bucket >= NVME_LATENCY_BUCKETS )
+        bucket = ( NVME_LATENCY_BUCKETS - 1 );
+    nvme->latency[bucket]++;
+}
 
-    /* Make sure a full block fits into the last chunk */
-    if (size & (ns->block_size - 1ULL))
-        goto bounce;
+/**
+ * Dump NVMe command latency histogram
+ *
+ * @v nvme		NVMe device
+ */
+static void nvme_latency_dump ( struct nvme_device *nvme ) {
+    unsigned int i;
+
+    for ( i = 0 ; i < NVME_LATENCY_BUCKETS ; i++ ) {
+        if ( ! nvme->latency[i] )
+            continue;
+        DBGC ( nvme, "NVMe %d commands completed in under %lldns\n",
+               nvme->latency[i], ( 1ULL << ( NVME_LATENCY_SHIFT + i ) ) );
+    }
+}
 
-    /* Build PRP list if we need to describe more than 2 pages */
-    if ((ns->block_size * count) > (NVME_PAGE_SIZE * 2)) {
-        u32 prpl_len = 0;
-        u64 *prpl = nvme_dma_buffer;
-        int first_page = 1;
-        for (; size > 0; base += NVME_PAGE_SIZE, size -= NVME_PAGE_SIZE) {
-            if (first_page) {
-                /* First page is special */
-                first_page = 0;
+/**
+ * Poll NVMe I/O completion queue
+ *
+ * @v nvme		NVMe device
+ *
+ * Consumes all available completion queue entries and records the
+ * status of the corresponding outstanding commands.
+ */
+static void nvme_poll ( struct nvme_device *nvme ) {
+    struct nvme_ctrl *ctrl = nvme->ctrl;
+    struct nvme_command *cmd;
+    struct nvme_cqe cqe;
+
+    /* Do nothing if the I/O queues are unusable */
+    if ( ! ctrl->io_cq.cqe )
+        return;
+
+    while ( nvme_poll_cq ( &ctrl->io_cq ) ) {
+        cqe = nvme_consume_cqe ( &ctrl->io_sq );
+        list_for_each_entry ( cmd, &nvme->commands, list ) {
+            if ( ( cmd->cid != cqe.cid ) || ( cmd->rc != -EINPROGRESS ) )
                 continue;
+            nvme_latency ( nvme, ( nstime() - cmd->started ) );
+            if ( nvme_is_cqe_success ( &cqe ) ) {
+                cmd->rc = 0;
+            } else {
+                DBGC ( nvme, "NVMe cid %d failed: %08x %08x %08x %08x\n",
+                       cqe.cid, cqe.dword[0], cqe.dword[1], cqe.dword[2],
+                       cqe.dword[3] );
+                cmd->rc = -EIO;
             }
-            if (prpl_len >= NVME_MAX_PRPL_ENTRIES)
-                goto bounce;
-            prpl[prpl_len++] = base;
+            break;
         }
-        return nvme_io_xfer(ns, lba, virt_to_phys(buf), virt_to_phys(prpl), count, write);
     }
+}
 
-    /* Directly embed the 2nd page if we only need 2 pages */
-    if ((ns->block_size * count) > NVME_PAGE_SIZE)
-        return nvme_io_xfer(ns, lba, virt_to_phys(buf), virt_to_phys(buf + NVME_PAGE_SIZE), count, write);
+/**
+ * NVMe command completion process
+ *
+ * @v nvme		NVMe device
+ */
+static void nvme_step ( struct nvme_device *nvme ) {
+    struct nvme_command *cmd;
+    struct nvme_command *tmp;
+    u64 now;
+
+    /* Collect completions from hardware */
+    nvme_poll ( nvme );
+
+    /* Abort all outstanding commands if any command is overdue */
+    now = nstime();
+    list_for_each_entry ( cmd, &nvme->commands, list ) {
+        if ( ( cmd->rc == -EINPROGRESS ) &&
+             ( ( now - cmd->started ) >
+               ( NVME_IO_TIMEOUT_MS * NSTIME_PER_MS ) ) ) {
+            DBGC ( nvme, "NVMe cid %d timed out\n", cmd->cid );
+            nvme_abort ( nvme, -ECANCELED );
+            cmd->rc = -ETIMEDOUT;
+            break;
+        }
+    }
 
-    single:
-    /* One page is enough, don't expose anything else */
-    return nvme_io_xfer(ns, lba, virt_to_phys(buf), NULL, count, write);
+    /* Complete any finished commands */
+    list_for_each_entry_safe ( cmd, tmp, &nvme->commands, list ) {
+        if ( cmd->rc != -EINPROGRESS )
+            nvme_command_close ( cmd, cmd->rc );
+    }
 
-    bounce:
-    /* Use bounce buffer to make transfer */
-    return nvme_bounce_xfer(ns, lba, virt_to_phys(buf), count, write);
+    /* Stop polling once idle */
+    if ( list_empty ( &nvme->commands ) )
+        process_del ( &nvme->process );
 }
 
-//static int nvme_cmd_readwrite(struct nvme_namespace *ns, struct disk_op_s *op, int write)
-//{
-//    int i;
-//    for (i = 0; i < op->count;) {
-//        u16 blocks_remaining = op->count - i;
-//        char *op_buf = op->buf_fl + i * ns->block_size;
-//        int blocks = nvme_prpl_xfer(ns, op->lba + i, op_buf,
-//                                    blocks_remaining, write);
-//        if (blocks < 0)
-//            return DISK_RET_EBADTRACK;
-//        i += blocks;
-//    }
-//
-//    return DISK_RET_SUCCESS;
-//}
-
-static void nvme_close ( struct nvme_device *nvme, int rc ) {
-    DBGC ( nvme, PCI_FMT " nvme_close()\n", PCI_ARGS ( &nvme->pci_dev ) );
-    intf_shutdown ( &nvme->block, -ENODEV );
-    nvme->opened = 0;
-    //list_del ( &usbblk->list );
-    //nvme_scsi_close ( usbblk, -ENODEV );
-    //ref_put ( &usbblk->refcnt );
+/**
+ * Poll NVMe device for command completions
+ *
+ * @v nvme		NVMe device
+ * @ret rc		Return status code
+ */
+static int nvme_block_poll ( struct nvme_device *nvme ) {
 
-    return;
+    nvme_step ( nvme );
+    return 0;
 }
 
-struct interface dummy;
-uint8_t busy = 0;
+/** NVMe process descriptor */
+static struct process_descriptor nvme_process_desc =
+        PROC_DESC ( struct nvme_device, process, nvme_step );
 
-static void nvme_step ( struct nvme_device *nvme ) {
-    /* Shut down interfaces */
-    //DBGC ( nvme, PCI_FMT " nvme_step calls intfs_shutdown(%p) \n", PCI_ARGS ( &nvme->pci_dev ), &nvme->block );
-    //intfs_shutdown ( 0, &nvme->block, NULL );
-    intfs_shutdown ( 0, &dummy, NULL );
+/**
+ * Create NVMe command
+ *
+ * @v nvme		NVMe device
+ * @ret cmd		NVMe command, or NULL on error
+ *
+ * The command is created in the completed state, and is placed on
+ * the list of outstanding commands.  Commands that must wait for the
+ * hardware should set the status to -EINPROGRESS.
+ */
+static struct nvme_command * nvme_command_create ( struct nvme_device *nvme ) {
+    struct nvme_command *cmd;
 
-    process_del(&nvme->process);
-    ref_put(&nvme->refcnt);
-    busy = 0;
+    /* Allocate and initialise structure */
+    cmd = zalloc ( sizeof ( *cmd ) );
+    if ( ! cmd )
+        return NULL;
+    ref_init ( &cmd->refcnt, nvme_command_free );
+    intf_init ( &cmd->block, &nvme_command_block_desc, &cmd->refcnt );
+    cmd->nvme = nvme;
+    cmd->bounce_slot = -1;
+    cmd->prpl_slot = -1;
+
+    /* Add to list of outstanding commands and start polling */
+    list_add_tail ( &cmd->list, &nvme->commands );
+    process_add ( &nvme->process );
+
+    return cmd;
 }
 
-#define LOGICAL_PAGE_SIZE 512
+/**
+ * Issue NVMe read/write command
+ *
+ * @v nvme		NVMe device
+ * @v block		Block data interface
+ * @v lba		Starting logical block address
+ * @v count		Number of logical blocks
+ * @v buffer		Data buffer
+ * @v len		Length of data buffer
+ * @v write		Command is a write
+ * @ret rc		Return status code
+ */
+static int nvme_rw ( struct nvme_device *nvme, struct interface *block,
+                     uint64_t lba, unsigned int count, userptr_t buffer,
+                     size_t len, int write ) {
+    struct nvme_ctrl *ctrl = nvme->ctrl;
+    struct nvme_namespace *ns = ctrl->ns;
+    volatile struct nvme_sqe *sqe;
+    struct nvme_command *cmd;
+    physaddr_t phys;
+    physaddr_t addr;
+    int rc;
 
-static int nvme_read ( struct nvme_device *nvme,
-                       struct interface *block,
-                       uint64_t lba, unsigned int count,
-                       userptr_t buffer, size_t len ) {
-    //DBGC ( nvme, PCI_FMT " nvme_read()\n", PCI_ARGS ( &nvme->pci_dev ) );
-    if (busy)
-    {
-        DBGC( nvme, "busy!\n");
-        return -EBUSY;
+    /* Sanity checks */
+    if ( ! ns )
+        return -ENODEV;
+    if ( ! ctrl->io_sq.sqe )
+        return -EIO;
+    if ( ( count == 0 ) || ( count > ns->max_req_size ) ||
+         ( len != ( count * ns->block_size ) ) ) {
+        DBGC ( nvme, "NVMe invalid transfer of %d blocks (%zd bytes)\n",
+               count, len );
+        return -EINVAL;
     }
 
-    if ( !nvme->ctrl->ns )
-    {
-        DBGC( nvme, "nvme->ctrl->ns!\n");
-        ref_get(&nvme->refcnt);
-        return -EBUSY;
+    /* Create command */
+    cmd = nvme_command_create ( nvme );
+    if ( ! cmd )
+        return -ENOMEM;
+    cmd->buffer = buffer;
+    cmd->len = len;
+    cmd->write = write;
+
+    /* DMA directly to/from the caller's buffer where possible, or
+     * via a bounce buffer if the buffer is not dword-aligned.
+     */
+    phys = user_to_phys ( buffer, 0 );
+    if ( phys & 0x3 ) {
+        if ( ( rc = nvme_command_bounce ( cmd, &addr ) ) != 0 )
+            goto err;
+        if ( write )
+            copy_from_user ( cmd->bounce, buffer, 0, len );
+    } else {
+        if ( ( rc = dma_map ( &ctrl->pci->dma, &cmd->map, phys, len,
+                              ( write ? DMA_TX : DMA_RX ) ) ) != 0 )
+            goto err;
+        addr = dma_phys ( &cmd->map, phys );
     }
 
-    if ( count != 1 )
-    {
-        DBGC( nvme, "nvme_read() got count != 1, not supported yet!\n");
-        ref_get(&nvme->refcnt);
-        return -EBUSY;
+    /* Describe data buffer */
+    if ( ( rc = nvme_command_prp ( cmd, addr ) ) != 0 )
+        goto err;
+
+    /* Build and submit command */
+    sqe = nvme_get_next_sqe ( &ctrl->io_sq,
+                              ( write ? NVME_SQE_OPC_IO_WRITE :
+                                NVME_SQE_OPC_IO_READ ), NULL, NULL, NULL );
+    if ( ! sqe ) {
+        rc = -EBUSY;
+        goto err;
     }
+    cmd->cid = ( sqe->cdw0 >> 16 );
+    sqe->nsid = ns->ns_id;
+    sqe->dptr_prp1 = cmd->prp1;
+    sqe->dptr_prp2 = cmd->prp2;
+    sqe->dword[10] = (u32)lba;
+    sqe->dword[11] = (u32)(lba >> 32);
+    sqe->dword[12] = (1U << 31 /* limited retry */) | (count - 1);
+    cmd->rc = -EINPROGRESS;
+    cmd->started = nstime();
+    nvme_commit_sqe ( &ctrl->io_sq );
+
+    /* Attach to parent interface */
+    intf_plug_plug ( &cmd->block, block );
+    return 0;
 
-    //DBGC( nvme, "lba: %d, ", lba);
-    //DBGC( nvme, "len: %d \n", len);
+ err:
+    nvme_command_close ( cmd, rc );
+    return rc;
+}
 
-    if ( len % nvme->ctrl->ns->block_size != 0 )
-    {
-//        uint64_t address = lba * LOGICAL_PAGE_SIZE;
-//        uint64_t physical_block = (address / nvme->ctrl->ns->block_size);
-//        uint64_t block_offset = (address % nvme->ctrl->ns->block_size);
-//        DBGC( nvme, "address: %d, ", address);
-//        DBGC( nvme, "phys: %d, ", physical_block);
-//        DBGC( nvme, "offset: %d\n", block_offset);
-//
-//        DBGC( nvme, "lba: %d, ", lba);
-//        DBGC( nvme, "len: %d \n", len);
-//
-//        int res = nvme_io_xfer(nvme->ctrl->ns, physical_block, virt_to_phys(nvme_dma_buffer), NULL, 1, 0);
-//        memcpy(user_to_virt(buffer, 0), nvme_dma_buffer + block_offset, len);
-        DBGC( nvme, "len % nvme->ctrl->ns->block_size != 0!\n");
-        ref_get(&nvme->refcnt);
-        return -EBUSY;
-    }
-    else
-    {
-        int res = nvme_io_xfer(nvme->ctrl->ns, lba, virt_to_phys(nvme_dma_buffer), NULL, 1, 0);
-        copy_to_user ( buffer, 0, nvme_dma_buffer, 512 );
+static void nvme_close ( struct nvme_device *nvme, int rc ) {
+    struct nvme_command *cmd;
 
-        //DBG_HDA_IF( LOG, 0, user_to_virt(buffer, 0), 512 );
-        //nvme_prpl_xfer(nvme->ctrl->ns, lba, user_to_virt(buffer, 0), len / NVME_PAGE_SIZE,  0);
-    }
+    DBGC ( nvme, PCI_FMT " nvme_close()\n", PCI_ARGS ( &nvme->pci_dev ) );
+    nvme_latency_dump ( nvme );
 
-    process_add ( &nvme->process );
-    intf_plug_plug ( &dummy, block );
-    ref_get(&nvme->refcnt);
-    busy = 1;
-    return 0;
+    /* Detach any outstanding commands from their callers.  This
+     * aborts any commands still in progress, which are then retired
+     * by the command completion process.
+     */
+    list_for_each_entry ( cmd, &nvme->commands, list )
+        nvme_command_abandon ( cmd, rc );
+
+    intf_shutdown ( &nvme->block, rc );
+    nvme->opened = 0;
+}
+
+static int nvme_read ( struct nvme_device *nvme,
+                       struct interface *block,
+                       uint64_t lba, unsigned int count,
+                       userptr_t buffer, size_t len ) {
+
+    return nvme_rw ( nvme, block, lba, count, buffer, len, 0 );
 }
 
 static int nvme_write ( struct nvme_device *nvme,
                         struct interface *block,
-                        uint64_t lba, unsigned int count,
-                        userptr_t buffer, size_t len ) {
+                        uint64_t lba __unused, unsigned int count __unused,
+                        userptr_t buffer __unused, size_t len __unused ) {
+    struct nvme_command *cmd;
+
     DBGC ( nvme, PCI_FMT " nvme_write()\n", PCI_ARGS ( &nvme->pci_dev ) );
-    process_add ( &nvme->process );
-    intf_plug_plug ( &dummy, block );
-    ref_get(&nvme->refcnt);
-    busy = 1;
+
+    /* Write support is deliberately disabled: complete the command
+     * immediately without touching the medium.
+     */
+    cmd = nvme_command_create ( nvme );
+    if ( ! cmd )
+        return -ENOMEM;
+    intf_plug_plug ( &cmd->block, block );
+    nvme_command_close ( cmd, 0 );
     return 0;
-    // return atadev_command ( atadev, block, &atacmd_write,
-    //                         lba, count, buffer, len );
+    // return nvme_rw ( nvme, block, lba, count, buffer, len, 1 );
 }
 
-/** NVMe process descriptor */
-static struct process_descriptor nvme_process_desc =
-        PROC_DESC_ONCE ( struct nvme_device, process, nvme_step );
-
-
 static int nvme_read_capacity ( struct nvme_device *nvme,
                                 struct interface *block ) {
-    DBGC ( nvme, PCI_FMT " nvme_read_capacity()\n", PCI_ARGS ( &nvme->pci_dev ) );
+    struct nvme_namespace *ns = nvme->ctrl->ns;
     struct block_device_capacity capacity;
+    struct nvme_command *cmd;
 
-    if ( !nvme->ctrl->ns )
-    {
-        ref_get(&nvme->refcnt);
-        return -EBUSY;
-    }
-
-    process_add ( &nvme->process );
-
-    //capacity.blocks = nvme->ctrl->ns->lba_count * 8;
-    //capacity.blksize = LOGICAL_PAGE_SIZE;
-
-    capacity.blocks = nvme->ctrl->ns->lba_count;
-    //capacity.blocks = 268435456UL;
-    capacity.blksize = nvme->ctrl->ns->block_size;
-    capacity.max_count = 1;
-
-    intf_plug_plug ( &dummy, block );
+    DBGC ( nvme, PCI_FMT " nvme_read_capacity()\n", PCI_ARGS ( &nvme->pci_dev ) );
 
-    /* Return capacity to caller */
-    block_capacity ( &dummy, &capacity );
+    if ( ! ns )
+        return -ENODEV;
 
-    ref_get(&nvme->refcnt);
+    cmd = nvme_command_create ( nvme );
+    if ( ! cmd )
+        return -ENOMEM;
+    intf_plug_plug ( &cmd->block, block );
 
-    /* Shut down interfaces */
-    //intfs_shutdown ( 0, &dummy, NULL );
+    capacity.blocks = ns->lba_count;
+    capacity.blksize = ns->block_size;
+    capacity.max_count = ns->max_req_size;
+    capacity.opt_count = ns->max_req_size;
+    capacity.align = ns->align;
+    capacity.max_outstanding = nvme->max_outstanding;
 
+    /* Return capacity to caller and complete immediately */
+    block_capacity ( &cmd->block, &capacity );
+    nvme_command_close ( cmd, 0 );
 
     return 0;
-    //return atadev_command ( atadev, block, &atacmd_identify,
-    //                        0, 1, UNULL, ATA_SECTOR_SIZE );
 }
 
 static int nvme_edd_describe ( struct nvme_device *nvme,
@@ -867,6 +1268,7 @@ static struct interface_operation nvme_block_op[] = {
         INTF_OP ( block_write, struct nvme_device *, nvme_write ),
         INTF_OP ( block_read_capacity, struct nvme_device *,
                   nvme_read_capacity ),
+        INTF_OP ( block_poll, struct nvme_device *, nvme_block_poll ),
         INTF_OP ( intf_close, struct nvme_device *, nvme_close ),
         INTF_OP ( edd_describe, struct nvme_device *, nvme_edd_describe ),
 };
@@ -875,14 +1277,26 @@ static struct interface_operation nvme_block_op[] = {
 static struct interface_descriptor nvme_block_desc =
         INTF_DESC ( struct nvme_device, block, nvme_block_op );
 
+/**
+ * Find NVMe device
+ *
+ * @v name		Device index (in probe order)
+ * @ret nvme		NVMe device, or NULL
+ */
 static struct nvme_device * nvme_find ( const char *name ) {
     struct nvme_device *nvme;
+    unsigned long index;
+    char *end;
+
+    /* Parse device index */
+    index = strtoul ( name, &end, 0 );
+    if ( *end )
+        return NULL;
 
     /* Look for matching device */
     list_for_each_entry ( nvme, &nvme_devices, list ) {
-        return nvme;
-        //if ( strcmp ( nvme->func->name, name ) == 0 )
-        // 	return usbblk;
+        if ( index-- == 0 )
+            return nvme;
     }
 
     return NULL;
@@ -901,6 +1315,15 @@ static int nvme_open_uri ( struct interface *parent, struct uri *uri ) {
     unsigned long bar_start;
     size_t bar_size;
 
+    /* Open file within filesystem on device, if applicable */
+    if ( uri->path ) {
+#if NVME_SANFS
+        return sanfs_open_uri ( parent, uri );
+#else
+        return -ENOTSUP;
+#endif
+    }
+
     /* Sanity check */
     if ( ! uri->opaque )
         return -EINVAL;
@@ -934,6 +1357,10 @@ static int nvme_open_uri ( struct interface *parent, struct uri *uri ) {
     //pci_write_config_dword( &nvme->pci_dev, PCI_BASE_ADDRESS_0 + 4, 0x1FF00000 );
     //pci_write_config_dword( &nvme->pci_dev, PCI_BASE_ADDRESS_0, 0x1FF00000 | PCI_BASE_ADDRESS_MEM_TYPE_MASK );
 
+    /* Controller remains enabled across reopens */
+    if (nvme->ctrl)
+        goto done;
+
     /* Map registers */
     bar_start = pci_bar_start ( &nvme->pci_dev, PCI_BASE_ADDRESS_0 );
     bar_size = pci_bar_size ( &nvme->pci_dev, PCI_BASE_ADDRESS_0 );
@@ -943,7 +1370,9 @@ static int nvme_open_uri ( struct interface *parent, struct uri *uri ) {
         DBGC ( nvme, PCI_FMT " nvme_open_uri !reg \n", PCI_ARGS ( &nvme->pci_dev ) );
         return -EBUSY;
     }
-    nvme->ctrl = malloc(sizeof(*nvme->ctrl));
+    nvme->ctrl = zalloc(sizeof(*nvme->ctrl));
+    if (!nvme->ctrl)
+        return -ENOMEM;
     nvme->ctrl->reg = reg;
     nvme->ctrl->pci = &nvme->pci_dev;
 
@@ -954,20 +1383,24 @@ static int nvme_open_uri ( struct interface *parent, struct uri *uri ) {
 
     if (~nvme->ctrl->reg->cap & NVME_CAP_CSS_NVME) {
         DBGC ( nvme, "Controller doesn't speak NVMe command set. Skipping.\n");
+        free(nvme->ctrl);
+        nvme->ctrl = NULL;
         return -EBUSY;
     }
 
     if (nvme_controller_enable(nvme->ctrl)) {
         DBGC ( nvme, "Failed to enable NVMe controller.\n");
+        free(nvme->ctrl);
+        nvme->ctrl = NULL;
         return -EBUSY;
     }
 
-//    for (uint64_t i = 0; i < 2097152; ++i) {
-//        DBGC ( nvme, PCI_FMT " reading lba %d()\n", PCI_ARGS ( &nvme->pci_dev ), i );
-//
-//        int res = nvme_io_xfer(nvme->ctrl->ns, i, virt_to_phys(nvme_dma_buffer), NULL, 1, 0);
-//    }
+    /* Leave room in the submission queue for one empty slot */
+    nvme->max_outstanding = NVME_MAX_COMMANDS;
+    if (nvme->max_outstanding > nvme->ctrl->io_sq.common.mask)
+        nvme->max_outstanding = nvme->ctrl->io_sq.common.mask;
 
+ done:
     /* Mark as opened */
     nvme->opened = 1;
     //ref_put ( &nvme->refcnt );
@@ -987,7 +1420,7 @@ struct uri_opener nvme_uri_opener __uri_opener = {
  * @v pci		PCI device
  * @ret rc		Return status code
  */
-static int nvme_probe (struct pci_device *pci) {
+static __init int nvme_probe (struct pci_device *pci) {
     struct nvme_device *nvme;
     int rc;
 
@@ -1004,6 +1437,7 @@ static int nvme_probe (struct pci_device *pci) {
 
     process_init_stopped ( &nvme->process, &nvme_process_desc,
                            &nvme->refcnt );
+    INIT_LIST_HEAD ( &nvme->commands );
 
     /* Add to list of devices */
     INIT_LIST_HEAD( &nvme->list );
@@ -14,6 +14,25 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <ipxe/interface.h>
 #include "nvme-int.h"
 
+/** Maximum number of outstanding NVMe I/O commands */
+#define NVME_MAX_COMMANDS 8
+
+/** Maximum NVMe transfer size (limited by a single PRP list page) */
+#define NVME_MAX_XFER_SIZE ( 64 * 1024 )
+
+/** NVMe I/O command timeout (in ms) */
+#define NVME_IO_TIMEOUT_MS 5000
+
+/** Number of NVMe command latency histogram buckets */
+#define NVME_LATENCY_BUCKETS 24
+
+/** NVMe command latency histogram resolution (expressed as a bit shift)
+ *
+ * Bucket @c n counts commands that completed in under 2^(n+shift)
+ * nanoseconds (the final bucket also counts all slower commands).
+ */
+#define NVME_LATENCY_SHIFT 10
+
 /** A NVMe storage device */
 struct nvme_device {
 	/** Reference count */
@@ -25,8 +44,14 @@ struct nvme_device {
 
 	/** Command process */
 	struct process process;
+	/** List of outstanding commands */
+	struct list_head commands;
+	/** Maximum number of outstanding I/O commands */
+	unsigned int max_outstanding;
 	/** Device opened flag */
 	int opened;
+	/** Command latency histogram */
+	unsigned int latency[NVME_LATENCY_BUCKETS];
 
     struct pci_device pci_dev;
     struct nvme_ctrl *ctrl;
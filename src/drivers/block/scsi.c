@@ -645,6 +645,9 @@ static void scsicmd_read_capacity_done ( struct scsi_command *scsicmd,
 		}
 	}
 	capacity.max_count = -1U;
+	capacity.opt_count = 0;
+	capacity.align = 0;
+	capacity.max_outstanding = 0;
 
 	/* Allow transport layer to update capacity */
 	block_capacity ( &scsidev->scsi, &capacity );
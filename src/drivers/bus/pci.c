@@ -179,7 +179,7 @@ void adjust_pci_device ( struct pci_device *pci ) {
  * @v pci		PCI device
  * @ret rc		Return status code
  */
-int pci_read_config ( struct pci_device *pci ) {
+__init int pci_read_config ( struct pci_device *pci ) {
 	uint32_t busdevfn;
 	uint8_t hdrtype;
 	uint32_t tmp;
@@ -225,6 +225,26 @@ int pci_read_config ( struct pci_device *pci ) {
 	return 0;
 }
 
+/** Probe only a single PCI device */
+static int pci_single;
+
+/** Bus:dev.fn address of the only PCI device to be probed */
+static uint32_t pci_single_busdevfn;
+
+/**
+ * Restrict probing to a single PCI device
+ *
+ * @v busdevfn		Bus:dev.fn address
+ *
+ * This is used by storage-only fast boot builds to avoid scanning
+ * (and probing drivers for) every device on the PCI bus.
+ */
+void pci_probe_only ( uint32_t busdevfn ) {
+
+	pci_single = 1;
+	pci_single_busdevfn = busdevfn;
+}
+
 /**
  * Find next device on PCI bus
  *
@@ -233,7 +253,7 @@ int pci_read_config ( struct pci_device *pci ) {
  * @ret busdevfn	Bus:dev.fn address of next PCI device
  * @ret rc		Return status code
  */
-int pci_find_next ( struct pci_device *pci, uint32_t *busdevfn ) {
+__init int pci_find_next ( struct pci_device *pci, uint32_t *busdevfn ) {
 	static struct pci_range range;
 	uint8_t hdrtype;
 	uint8_t sub;
@@ -289,7 +309,7 @@ int pci_find_next ( struct pci_device *pci, uint32_t *busdevfn ) {
  * @v pci		PCI device
  * @ret rc		Return status code
  */
-int pci_find_driver ( struct pci_device *pci ) {
+__init int pci_find_driver ( struct pci_device *pci ) {
 	struct pci_driver *driver;
 	struct pci_device_id *id;
 	unsigned int i;
@@ -321,7 +341,7 @@ int pci_find_driver ( struct pci_device *pci ) {
  * Searches for a driver for the PCI device.  If a driver is found,
  * its probe() routine is called.
  */
-int pci_probe ( struct pci_device *pci ) {
+__init int pci_probe ( struct pci_device *pci ) {
 	int rc;
 
 	DBGC ( pci, PCI_FMT " (%04x:%04x) has driver \"%s\"\n",
@@ -356,11 +376,15 @@ void pci_remove ( struct pci_device *pci ) {
  * Scans the PCI bus for devices and registers all devices it can
  * find.
  */
-static int pcibus_probe ( struct root_device *rootdev ) {
+static __init int pcibus_probe ( struct root_device *rootdev ) {
 	struct pci_device *pci = NULL;
 	uint32_t busdevfn = 0;
 	int rc;
 
+	/* Start from the only device to be probed, if applicable */
+	if ( pci_single )
+		busdevfn = pci_single_busdevfn;
+
 	do {
 		/* Allocate struct pci_device */
 		if ( ! pci )
@@ -370,9 +394,19 @@ static int pcibus_probe ( struct root_device *rootdev ) {
 			goto err;
 		}
 
-		/* Find next PCI device, if any */
-		if ( ( rc = pci_find_next ( pci, &busdevfn ) ) != 0 )
+		/* Find next PCI device, if any.  If only a single
+		 * device is to be probed, then read its configuration
+		 * directly rather than scanning for it, so that an
+		 * absent device does not trigger a scan of the bus.
+		 */
+		if ( pci_single ) {
+			memset ( pci, 0, sizeof ( *pci ) );
+			pci_init ( pci, busdevfn );
+			if ( ( rc = pci_read_config ( pci ) ) != 0 )
+				break;
+		} else if ( ( rc = pci_find_next ( pci, &busdevfn ) ) != 0 ) {
 			break;
+		}
 
 		/* Look for a driver */
 		if ( ( rc = pci_find_driver ( pci ) ) != 0 ) {
@@ -395,7 +429,7 @@ static int pcibus_probe ( struct root_device *rootdev ) {
 			list_del ( &pci->dev.siblings );
 		}
 
-	} while ( ++busdevfn );
+	} while ( ( ! pci_single ) && ++busdevfn );
 
 	free ( pci );
 	return 0;
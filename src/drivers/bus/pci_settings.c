@@ -125,4 +125,5 @@ static void pci_settings_init ( void ) {
 /** PCI device settings initialiser */
 struct init_fn pci_settings_init_fn __init_fn ( INIT_NORMAL ) = {
 	.initialise = pci_settings_init,
+	.deferrable = 1,
 };
@@ -1917,7 +1917,7 @@ static inline u32 sky2_clk2us(const struct sky2_hw *hw, u32 clk)
 	return clk / sky2_mhz(hw);
 }
 
-static int sky2_init(struct sky2_hw *hw)
+static __init int sky2_init(struct sky2_hw *hw)
 {
 	u8 t8;
 
@@ -1998,7 +1998,7 @@ static int sky2_init(struct sky2_hw *hw)
 	return 0;
 }
 
-static void sky2_reset(struct sky2_hw *hw)
+static __init void sky2_reset(struct sky2_hw *hw)
 {
 	u16 status;
 	int i, cap;
@@ -2176,8 +2176,8 @@ static void sky2_set_multicast(struct net_device *dev)
 }
 
 /* Initialize network device */
-static struct net_device *sky2_init_netdev(struct sky2_hw *hw,
-						     unsigned port)
+static __init struct net_device *sky2_init_netdev(struct sky2_hw *hw,
+						  unsigned port)
 {
 	struct sky2_port *sky2;
 	struct net_device *dev = alloc_etherdev(sizeof(*sky2));
@@ -2260,7 +2260,7 @@ static struct net_device_operations sky2_operations = {
 	.irq      = sky2_net_irq
 };
 
-static int sky2_probe(struct pci_device *pdev)
+static __init int sky2_probe(struct pci_device *pdev)
 {
 	struct net_device *dev;
 	struct sky2_hw *hw;
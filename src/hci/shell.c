@@ -30,6 +30,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <getopt.h>
 #include <readline/readline.h>
 #include <ipxe/command.h>
+#include <ipxe/init.h>
 #include <ipxe/parseopt.h>
 #include <ipxe/shell.h>
 #include <config/branding.h>
@@ -86,6 +87,9 @@ int shell ( void ) {
 	char *line;
 	int rc = 0;
 
+	/* Ensure all subsystems are available to commands */
+	initialise_deferred();
+
 	/* Initialise shell history */
 	memset ( &history, 0, sizeof ( history ) );
 
@@ -0,0 +1,410 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * Streaming decompression
+ *
+ * A decompression filter may be inserted into a data transfer
+ * pipeline to decompress gzip or zlib data as it is received, so
+ * that decompression overlaps with the underlying I/O and the
+ * compressed data never needs to be held in memory in its entirety.
+ *
+ * The decompressor requires access to all previously decompressed
+ * data (to resolve back-references), and so decompressed data is
+ * written directly into the recipient's umalloc()-based data
+ * transfer buffer, which is extended as needed.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <byteswap.h>
+#include <ipxe/refcnt.h>
+#include <ipxe/interface.h>
+#include <ipxe/xfer.h>
+#include <ipxe/iobuf.h>
+#include <ipxe/xferbuf.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/deflate.h>
+#include <ipxe/zlib.h>
+#include <ipxe/gzip.h>
+#include <ipxe/inflate.h>
+
+/** Maximum length of compressed data passed to the decompressor at once
+ *
+ * This bounds the amount of space that must be available within the
+ * receive buffer before calling the decompressor.
+ */
+#define INFLATE_CHUNK_LEN 1024
+
+/** Maximum DEFLATE expansion ratio
+ *
+ * A length/distance pair may be encoded using a single bit for each
+ * code, and may expand to 258 bytes.
+ */
+#define INFLATE_MAX_RATIO ( 258 * 8 / 2 )
+
+/** Maximum length of compressed data held within the decompressor */
+#define INFLATE_MAX_ACCUMULATED \
+	sizeof ( ( ( struct deflate * ) NULL )->accumulator )
+
+/** Pending gzip header fields */
+#define INFLATE_GZIP_FIELDS ( GZIP_FL_HCRC | GZIP_FL_EXTRA | \
+			      GZIP_FL_NAME | GZIP_FL_COMMENT )
+
+/** Pending gzip fixed header (not a valid gzip header flag) */
+#define INFLATE_GZIP_FIXED 0x8000
+
+/** A streaming decompression filter */
+struct inflate {
+	/** Reference count */
+	struct refcnt refcnt;
+	/** Compressed data transfer interface */
+	struct interface compressed;
+	/** Decompressed data transfer interface */
+	struct interface xfer;
+
+	/** Decompressor */
+	struct deflate deflate;
+	/** Decompression is complete */
+	int finished;
+	/** Position within compressed data */
+	size_t pos;
+	/** Length of decompressed data */
+	size_t len;
+
+	/** Pending gzip header fields */
+	unsigned int pending;
+	/** Number of gzip header bytes accumulated */
+	size_t count;
+	/** Number of gzip header bytes remaining to be skipped */
+	size_t skip;
+	/** Accumulated gzip header */
+	struct {
+		/** Fixed header */
+		struct gzip_header header;
+		/** Extra header */
+		struct gzip_extra_header extra;
+	} __attribute__ (( packed )) gzip;
+};
+
+/**
+ * Close decompression filter
+ *
+ * @v inflate		Decompression filter
+ * @v rc		Reason for close
+ */
+static void inflate_close ( struct inflate *inflate, int rc ) {
+	struct xfer_buffer *xferbuf;
+
+	/* Check that decompression is complete */
+	if ( ( rc == 0 ) && ! inflate->finished ) {
+		DBGC ( inflate, "INFLATE %p decompression incomplete\n",
+		       inflate );
+		rc = -EINVAL;
+	}
+
+	/* Trim receive buffer to decompressed length */
+	if ( rc == 0 ) {
+		xferbuf = xfer_buffer ( &inflate->xfer );
+		if ( xferbuf &&
+		     ( ( rc = xferbuf_resize ( xferbuf, inflate->len ) ) != 0 )){
+			DBGC ( inflate, "INFLATE %p could not trim buffer: "
+			       "%s\n", inflate, strerror ( rc ) );
+		}
+	}
+
+	/* Shut down interfaces */
+	intf_shutdown ( &inflate->compressed, rc );
+	intf_shutdown ( &inflate->xfer, rc );
+}
+
+/**
+ * Consume gzip header
+ *
+ * @v inflate		Decompression filter
+ * @v iobuf		I/O buffer
+ * @ret rc		Return status code
+ *
+ * Any gzip header bytes are consumed from the start of the I/O
+ * buffer.  The header may be split across multiple I/O buffers.
+ */
+static int inflate_gzip ( struct inflate *inflate,
+			  struct io_buffer *iobuf ) {
+	struct gzip_header *header = &inflate->gzip.header;
+	uint8_t *raw = ( ( uint8_t * ) &inflate->gzip );
+	uint8_t *data;
+	size_t len;
+
+	while ( ( inflate->pending || inflate->skip ) && iob_len ( iobuf ) ) {
+
+		/* Skip any remaining bytes of the current field */
+		if ( inflate->skip ) {
+			len = iob_len ( iobuf );
+			if ( len > inflate->skip )
+				len = inflate->skip;
+			iob_pull ( iobuf, len );
+			inflate->skip -= len;
+			continue;
+		}
+
+		/* Consume next byte */
+		data = iobuf->data;
+		iob_pull ( iobuf, 1 );
+
+		if ( inflate->pending & INFLATE_GZIP_FIXED ) {
+
+			/* Accumulate fixed header */
+			raw[ inflate->count++ ] = *data;
+			if ( inflate->count < sizeof ( *header ) )
+				continue;
+			if ( header->method != GZIP_METHOD_DEFLATE ) {
+				DBGC ( inflate, "INFLATE %p unsupported gzip "
+				       "method %#02x\n", inflate,
+				       header->method );
+				return -ENOTSUP;
+			}
+			inflate->pending = ( header->flags &
+					     INFLATE_GZIP_FIELDS );
+
+		} else if ( inflate->pending & GZIP_FL_EXTRA ) {
+
+			/* Accumulate extra header length */
+			raw[ inflate->count++ ] = *data;
+			if ( inflate->count < sizeof ( inflate->gzip ) )
+				continue;
+			inflate->skip = le16_to_cpu ( inflate->gzip.extra.len );
+			inflate->pending &= ~GZIP_FL_EXTRA;
+
+		} else if ( inflate->pending & GZIP_FL_NAME ) {
+
+			/* Skip name */
+			if ( *data == 0 )
+				inflate->pending &= ~GZIP_FL_NAME;
+
+		} else if ( inflate->pending & GZIP_FL_COMMENT ) {
+
+			/* Skip comment */
+			if ( *data == 0 )
+				inflate->pending &= ~GZIP_FL_COMMENT;
+
+		} else {
+
+			/* Skip CRC (of which we have consumed one byte) */
+			assert ( inflate->pending == GZIP_FL_HCRC );
+			inflate->skip = ( sizeof ( struct gzip_crc_header ) - 1 );
+			inflate->pending = 0;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Receive compressed data
+ *
+ * @v inflate		Decompression filter
+ * @v iobuf		I/O buffer
+ * @v meta		Data transfer metadata
+ * @ret rc		Return status code
+ */
+static int inflate_deliver ( struct inflate *inflate,
+			     struct io_buffer *iobuf,
+			     struct xfer_metadata *meta ) {
+	struct xfer_buffer *xferbuf;
+	struct deflate_chunk in;
+	struct deflate_chunk out;
+	userptr_t *udata;
+	size_t required;
+	size_t pos;
+	size_t len;
+	int rc;
+
+	/* Calculate position within compressed data.  Compressed
+	 * data must be delivered sequentially; empty deliveries
+	 * (e.g. seeks used to presize a receive buffer) are ignored.
+	 */
+	pos = ( ( meta->flags & XFER_FL_ABS_OFFSET ) ? 0 : inflate->pos );
+	pos += meta->offset;
+	len = iob_len ( iobuf );
+	if ( len && ( pos != inflate->pos ) ) {
+		DBGC ( inflate, "INFLATE %p non-sequential data at %#zx\n",
+		       inflate, pos );
+		rc = -ENOTSUP;
+		goto err;
+	}
+	inflate->pos = ( pos + len );
+
+	/* Identify receive buffer */
+	xferbuf = xfer_buffer ( &inflate->xfer );
+	if ( ! ( xferbuf && ( xferbuf->op == &xferbuf_umalloc_operations ) ) ) {
+		DBGC ( inflate, "INFLATE %p has no receive buffer\n", inflate );
+		rc = -ENOTSUP;
+		goto err;
+	}
+	udata = xferbuf->data;
+
+	/* Consume gzip header, if applicable */
+	if ( ( rc = inflate_gzip ( inflate, iobuf ) ) != 0 )
+		goto err;
+
+	/* Decompress data.  Any data following the end of the
+	 * compressed data stream (e.g. a gzip footer) is ignored.
+	 */
+	while ( iob_len ( iobuf ) && ! inflate->finished ) {
+
+		/* Limit input length to bound the output length */
+		len = iob_len ( iobuf );
+		if ( len > INFLATE_CHUNK_LEN )
+			len = INFLATE_CHUNK_LEN;
+
+		/* Extend receive buffer, if necessary */
+		required = ( inflate->len + ( ( len + INFLATE_MAX_ACCUMULATED ) *
+					      INFLATE_MAX_RATIO ) );
+		if ( xferbuf->len < required ) {
+			required += ( required / 2 );
+			if ( ( rc = xferbuf_resize ( xferbuf, required ) ) != 0 )
+				goto err;
+		}
+
+		/* Decompress data */
+		deflate_chunk_init ( &in, virt_to_user ( iobuf->data ), 0, len );
+		deflate_chunk_init ( &out, *udata, inflate->len, xferbuf->len );
+		if ( ( rc = deflate_inflate ( &inflate->deflate, &in,
+					      &out ) ) != 0 ) {
+			DBGC ( inflate, "INFLATE %p could not decompress: %s\n",
+			       inflate, strerror ( rc ) );
+			goto err;
+		}
+		assert ( out.offset <= xferbuf->len );
+		iob_pull ( iobuf, in.offset );
+		inflate->len = out.offset;
+		xferbuf->pos = out.offset;
+		inflate->finished = deflate_finished ( &inflate->deflate );
+	}
+
+	free_iob ( iobuf );
+	return 0;
+
+ err:
+	free_iob ( iobuf );
+	inflate_close ( inflate, rc );
+	return rc;
+}
+
+/**
+ * Get underlying data transfer buffer
+ *
+ * @v inflate		Decompression filter
+ * @ret xferbuf		Data transfer buffer, or NULL
+ *
+ * Compressed data must not be written directly into the decompressed
+ * data transfer buffer.
+ */
+static struct xfer_buffer * inflate_buffer ( struct inflate *inflate __unused){
+
+	return NULL;
+}
+
+/** Decompression filter compressed data interface operations */
+static struct interface_operation inflate_compressed_operations[] = {
+	INTF_OP ( xfer_deliver, struct inflate *, inflate_deliver ),
+	INTF_OP ( xfer_buffer, struct inflate *, inflate_buffer ),
+	INTF_OP ( intf_close, struct inflate *, inflate_close ),
+};
+
+/** Decompression filter compressed data interface descriptor */
+static struct interface_descriptor inflate_compressed_desc =
+	INTF_DESC_PASSTHRU ( struct inflate, compressed,
+			     inflate_compressed_operations, xfer );
+
+/** Decompression filter decompressed data interface operations */
+static struct interface_operation inflate_xfer_operations[] = {
+	INTF_OP ( intf_close, struct inflate *, inflate_close ),
+};
+
+/** Decompression filter decompressed data interface descriptor */
+static struct interface_descriptor inflate_xfer_desc =
+	INTF_DESC_PASSTHRU ( struct inflate, xfer,
+			     inflate_xfer_operations, compressed );
+
+/**
+ * Add decompression filter
+ *
+ * @v xfer		Data transfer interface
+ * @v magic		Start of data
+ * @v len		Length of start of data
+ * @ret rc		Return status code
+ *
+ * If the start of the data (which must be at least INFLATE_MAGIC_LEN
+ * bytes to be recognised) identifies a gzip or zlib data stream, then
+ * a decompression filter is inserted into the data transfer
+ * interface.  Otherwise, the data transfer interface is left
+ * unchanged.
+ */
+int inflate_add ( struct interface *xfer, const void *magic, size_t len ) {
+	union {
+		/** gzip magic */
+		uint16_t gzip;
+		/** zlib magic */
+		union zlib_magic zlib;
+	} __attribute__ (( packed )) start;
+	struct inflate *inflate;
+	enum deflate_format format;
+	unsigned int pending;
+
+	/* Identify compression format */
+	if ( len < INFLATE_MAGIC_LEN )
+		return 0;
+	memcpy ( &start, magic, sizeof ( start ) );
+	if ( start.gzip == cpu_to_be16 ( GZIP_MAGIC ) ) {
+		format = DEFLATE_RAW;
+		pending = INFLATE_GZIP_FIXED;
+	} else if ( zlib_magic_is_valid ( &start.zlib ) ) {
+		format = DEFLATE_ZLIB;
+		pending = 0;
+	} else {
+		return 0;
+	}
+
+	/* Allocate and initialise structure */
+	inflate = zalloc ( sizeof ( *inflate ) );
+	if ( ! inflate )
+		return -ENOMEM;
+	ref_init ( &inflate->refcnt, NULL );
+	intf_init ( &inflate->compressed, &inflate_compressed_desc,
+		    &inflate->refcnt );
+	intf_init ( &inflate->xfer, &inflate_xfer_desc, &inflate->refcnt );
+	deflate_init ( &inflate->deflate, format );
+	inflate->pending = pending;
+	DBGC ( inflate, "INFLATE %p decompressing %s data\n",
+	       inflate, ( pending ? "gzip" : "zlib" ) );
+
+	/* Insert filter, mortalise self, and return */
+	intf_insert ( xfer, &inflate->compressed, &inflate->xfer );
+	ref_put ( &inflate->refcnt );
+	return 0;
+}
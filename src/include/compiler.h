@@ -604,6 +604,20 @@ char __debug_disable(OBJECT) = ( DBGLVL_MAX & ~DBGLVL_DFLT );
  */
 #define __used __attribute__ (( used ))
 
+/**
+ * Declare a function as used only during initialisation
+ *
+ * Initialisation-only functions are grouped together, so that their
+ * code may be discarded while an operating system continues to use
+ * iPXE (e.g. via INT 13).  Such a function must never be reachable
+ * from a runtime path.
+ *
+ * Each function is placed in its own section, so that unused
+ * functions can still be garbage-collected by the linker.
+ */
+#define __init __attribute__ (( noinline, section ( \
+	".text.__init." _S2 ( __COUNTER__ ) ) ))
+
 /** Declare a data structure to be aligned with 16-byte alignment */
 #define __aligned __attribute__ (( aligned ( 16 ) ))
 
@@ -0,0 +1,26 @@
+#ifndef _BITS_AES_H
+#define _BITS_AES_H
+
+/** @file
+ *
+ * AES algorithm
+ *
+ * This architecture has no optimised implementation.
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+static inline __attribute__ (( always_inline )) void
+aes_encrypt_blocks ( struct aes_context *aes, const void *src, void *dst,
+		     size_t count ) {
+	generic_aes_encrypt_blocks ( aes, src, dst, count );
+}
+
+static inline __attribute__ (( always_inline )) void
+aes_decrypt_blocks ( struct aes_context *aes, const void *src, void *dst,
+		     size_t count ) {
+	generic_aes_decrypt_blocks ( aes, src, dst, count );
+}
+
+#endif /* _BITS_AES_H */
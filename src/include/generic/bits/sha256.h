@@ -0,0 +1,26 @@
+#ifndef _BITS_SHA256_H
+#define _BITS_SHA256_H
+
+/** @file
+ *
+ * SHA-256 algorithm
+ *
+ * This architecture has no optimised implementation.
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+static inline __attribute__ (( always_inline )) void
+sha256_blocks ( struct sha256_digest *digest, const void *data,
+		size_t count ) {
+	generic_sha256_blocks ( digest, data, count );
+}
+
+static inline __attribute__ (( always_inline )) void
+sha256_multi_blocks ( struct sha256_digest *digests, const void **data,
+		      unsigned int lanes, size_t count ) {
+	generic_sha256_multi_blocks ( digests, data, lanes, count );
+}
+
+#endif /* _BITS_SHA256_H */
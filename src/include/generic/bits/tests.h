@@ -0,0 +1,14 @@
+#ifndef _BITS_TESTS_H
+#define _BITS_TESTS_H
+
+/** @file
+ *
+ * Architecture-specific self-tests
+ *
+ * This architecture has no self-tests of its own.
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#endif /* _BITS_TESTS_H */
@@ -48,6 +48,16 @@ extern struct cipher_algorithm aes_algorithm;
 extern struct cipher_algorithm aes_ecb_algorithm;
 extern struct cipher_algorithm aes_cbc_algorithm;
 extern struct cipher_algorithm aes_gcm_algorithm;
+extern struct cipher_algorithm aes_xts_algorithm;
+
+extern void generic_aes_encrypt_blocks ( struct aes_context *aes,
+					 const void *src, void *dst,
+					 size_t count );
+extern void generic_aes_decrypt_blocks ( struct aes_context *aes,
+					 const void *src, void *dst,
+					 size_t count );
+
+#include <bits/aes.h>
 
 int aes_wrap ( const void *kek, const void *src, void *dest, int nblk );
 int aes_unwrap ( const void *kek, const void *src, void *dest, int nblk );
@@ -22,6 +22,24 @@ struct block_device_capacity {
 	size_t blksize;
 	/** Maximum number of blocks per single transfer */
 	unsigned int max_count;
+	/** Optimal number of blocks per single transfer
+	 *
+	 * Zero indicates that the device has no preference beyond the
+	 * maximum transfer size.
+	 */
+	unsigned int opt_count;
+	/** Preferred transfer alignment (in blocks)
+	 *
+	 * This must be a power of two.  Zero indicates that the
+	 * device has no alignment preference.
+	 */
+	unsigned int align;
+	/** Maximum number of concurrently outstanding transfers
+	 *
+	 * Zero indicates that the device can handle only a single
+	 * transfer at a time.
+	 */
+	unsigned int max_outstanding;
 };
 
 extern int block_read ( struct interface *control, struct interface *data,
@@ -45,6 +63,10 @@ extern int block_read_capacity ( struct interface *control,
 #define block_read_capacity_TYPE( object_type )				\
 	typeof ( int ( object_type, struct interface *data ) )
 
+extern int block_poll ( struct interface *control );
+#define block_poll_TYPE( object_type )					\
+	typeof ( int ( object_type ) )
+
 extern void block_capacity ( struct interface *intf,
 			     struct block_device_capacity *capacity );
 #define block_capacity_TYPE( object_type )				\
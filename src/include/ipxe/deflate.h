@@ -81,6 +81,38 @@ enum deflate_format {
 /** Quick lookup shift */
 #define DEFLATE_HUFFMAN_QL_SHIFT ( 16 - DEFLATE_HUFFMAN_QL_BITS )
 
+/** Fast lookup root table length for the literal/length alphabet (in bits)
+ *
+ * This is a policy decision.
+ */
+#define DEFLATE_FAST_LITLEN_BITS 9
+
+/** Fast lookup root table length for the distance alphabet (in bits)
+ *
+ * This is a policy decision.
+ */
+#define DEFLATE_FAST_DISTANCE_BITS 6
+
+/** Maximum number of entries in the literal/length fast lookup table
+ *
+ * This is the size required for any complete code of up to 286
+ * symbols with a 9-bit root table, as calculated by zlib's "enough"
+ * utility.  Pathological codes using the invalid symbols 286-287 may
+ * require more space; such blocks are decoded without using the fast
+ * lookup tables.
+ */
+#define DEFLATE_FAST_LITLEN_MAX 852
+
+/** Maximum number of entries in the distance fast lookup table
+ *
+ * This is the size required for any complete code of up to 30
+ * symbols with a 6-bit root table, as calculated by zlib's "enough"
+ * utility.  Pathological codes using the invalid symbols 30-31 may
+ * require more space; such blocks are decoded without using the fast
+ * lookup tables.
+ */
+#define DEFLATE_FAST_DISTANCE_MAX 592
+
 /** Literal/length end of block code */
 #define DEFLATE_LITLEN_END 256
 
@@ -144,6 +176,21 @@ struct deflate_alphabet {
 	uint16_t raw[0];
 };
 
+/** A fast lookup table entry
+ *
+ * A fast lookup table comprises a root table indexed by the next
+ * (unreversed) bits of the input stream, followed by secondary tables
+ * for codes longer than the root table length.
+ */
+struct deflate_fast_entry {
+	/** Raw symbol, or offset of secondary table */
+	uint16_t value;
+	/** Number of bits consumed by this entry */
+	uint8_t bits;
+	/** Secondary table index length (in bits), or zero for a symbol */
+	uint8_t sub;
+} __attribute__ (( packed ));
+
 /** A static Huffman alphabet length pattern */
 struct deflate_static_length_pattern {
 	/** Length pair */
@@ -219,6 +266,13 @@ struct deflate {
 	/** Number of symbols in the distance Huffman alphabet */
 	unsigned int distance_count;
 
+	/** Fast lookup tables are valid for the current block */
+	int fast;
+	/** Literal/length fast lookup table */
+	struct deflate_fast_entry litlen_fast[DEFLATE_FAST_LITLEN_MAX];
+	/** Distance fast lookup table */
+	struct deflate_fast_entry distance_fast[DEFLATE_FAST_DISTANCE_MAX];
+
 	/** Huffman code lengths
 	 *
 	 * The literal/length and distance code lengths are
@@ -79,6 +79,13 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define ERRFILE_cachedhcp	       ( ERRFILE_CORE | 0x00270000 )
 #define ERRFILE_acpimac		       ( ERRFILE_CORE | 0x00280000 )
 #define ERRFILE_efi_strings	       ( ERRFILE_CORE | 0x00290000 )
+#define ERRFILE_sanfs		       ( ERRFILE_CORE | 0x002a0000 )
+#define ERRFILE_sanfs_fat	       ( ERRFILE_CORE | 0x002b0000 )
+#define ERRFILE_sanfs_ext	       ( ERRFILE_CORE | 0x002c0000 )
+#define ERRFILE_sanfs_iso9660	       ( ERRFILE_CORE | 0x002d0000 )
+#define ERRFILE_sanpart		       ( ERRFILE_CORE | 0x002e0000 )
+#define ERRFILE_sanverity	       ( ERRFILE_CORE | 0x002f0000 )
+#define ERRFILE_sancrypt	       ( ERRFILE_CORE | 0x00300000 )
 
 #define ERRFILE_eisa		     ( ERRFILE_DRIVER | 0x00000000 )
 #define ERRFILE_isa		     ( ERRFILE_DRIVER | 0x00010000 )
@@ -219,6 +226,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define ERRFILE_ice		     ( ERRFILE_DRIVER | 0x00d20000 )
 #define ERRFILE_ecam		     ( ERRFILE_DRIVER | 0x00d30000 )
 #define ERRFILE_pcibridge	     ( ERRFILE_DRIVER | 0x00d40000 )
+#define ERRFILE_nvme		     ( ERRFILE_DRIVER | 0x00d50000 )
 
 #define ERRFILE_aoe			( ERRFILE_NET | 0x00000000 )
 #define ERRFILE_arp			( ERRFILE_NET | 0x00010000 )
@@ -311,6 +319,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define ERRFILE_archive		      ( ERRFILE_IMAGE | 0x000a0000 )
 #define ERRFILE_zlib		      ( ERRFILE_IMAGE | 0x000b0000 )
 #define ERRFILE_gzip		      ( ERRFILE_IMAGE | 0x000c0000 )
+#define ERRFILE_inflate		      ( ERRFILE_IMAGE | 0x000d0000 )
 
 #define ERRFILE_asn1		      ( ERRFILE_OTHER | 0x00000000 )
 #define ERRFILE_chap		      ( ERRFILE_OTHER | 0x00010000 )
@@ -407,6 +416,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #define ERRFILE_efi_rng		      ( ERRFILE_OTHER | 0x005c0000 )
 #define ERRFILE_efi_shim	      ( ERRFILE_OTHER | 0x005d0000 )
 #define ERRFILE_efi_settings	      ( ERRFILE_OTHER | 0x005e0000 )
+#define ERRFILE_xts		      ( ERRFILE_OTHER | 0x005f0000 )
 
 /** @} */
 
@@ -0,0 +1,325 @@
+#ifndef _IPXE_EXT4_H
+#define _IPXE_EXT4_H
+
+/**
+ * @file
+ *
+ * ext2/ext3/ext4 filesystem
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+
+/** Offset of ext superblock */
+#define EXT4_SUPERBLOCK_OFFSET 1024
+
+/** An ext superblock (initial portion) */
+struct ext4_superblock {
+	/** Number of inodes */
+	uint32_t inodes;
+	/** Number of blocks (low 32 bits) */
+	uint32_t blocks_lo;
+	/** Number of reserved blocks (low 32 bits) */
+	uint32_t reserved_blocks_lo;
+	/** Number of free blocks (low 32 bits) */
+	uint32_t free_blocks_lo;
+	/** Number of free inodes */
+	uint32_t free_inodes;
+	/** First data block */
+	uint32_t first_data_block;
+	/** Block size (as log2 of size in kB) */
+	uint32_t log_block_size;
+	/** Cluster size (as log2 of size in kB) */
+	uint32_t log_cluster_size;
+	/** Number of blocks per group */
+	uint32_t blocks_per_group;
+	/** Number of clusters per group */
+	uint32_t clusters_per_group;
+	/** Number of inodes per group */
+	uint32_t inodes_per_group;
+	/** Mount time */
+	uint32_t mtime;
+	/** Write time */
+	uint32_t wtime;
+	/** Mount count */
+	uint16_t mnt_count;
+	/** Maximum mount count */
+	uint16_t max_mnt_count;
+	/** Magic signature */
+	uint16_t magic;
+	/** Filesystem state */
+	uint16_t state;
+	/** Error behaviour */
+	uint16_t errors;
+	/** Minor revision level */
+	uint16_t minor_rev_level;
+	/** Last check time */
+	uint32_t lastcheck;
+	/** Check interval */
+	uint32_t checkinterval;
+	/** Creator OS */
+	uint32_t creator_os;
+	/** Revision level */
+	uint32_t rev_level;
+	/** Default reserved block owner */
+	uint16_t def_resuid;
+	/** Default reserved block group */
+	uint16_t def_resgid;
+	/** First non-reserved inode */
+	uint32_t first_ino;
+	/** Inode size */
+	uint16_t inode_size;
+	/** Block group containing this superblock */
+	uint16_t block_group_nr;
+	/** Compatible features */
+	uint32_t feature_compat;
+	/** Incompatible features */
+	uint32_t feature_incompat;
+	/** Read-only compatible features */
+	uint32_t feature_ro_compat;
+	/** Filesystem UUID */
+	uint8_t uuid[16];
+	/** Volume name */
+	char volume_name[16];
+	/** Last mount directory */
+	char last_mounted[64];
+	/** Compression algorithm bitmap */
+	uint32_t algorithm_usage_bitmap;
+	/** Number of blocks to preallocate for files */
+	uint8_t prealloc_blocks;
+	/** Number of blocks to preallocate for directories */
+	uint8_t prealloc_dir_blocks;
+	/** Number of reserved GDT entries */
+	uint16_t reserved_gdt_blocks;
+	/** Journal UUID */
+	uint8_t journal_uuid[16];
+	/** Journal inode */
+	uint32_t journal_inum;
+	/** Journal device */
+	uint32_t journal_dev;
+	/** Head of orphan inode list */
+	uint32_t last_orphan;
+	/** Directory hash seed */
+	uint32_t hash_seed[4];
+	/** Default hash version */
+	uint8_t def_hash_version;
+	/** Journal backup type */
+	uint8_t jnl_backup_type;
+	/** Group descriptor size */
+	uint16_t desc_size;
+} __attribute__ (( packed ));
+
+/** ext superblock magic signature */
+#define EXT4_MAGIC 0xef53
+
+/** ext original revision (fixed inode size) */
+#define EXT4_GOOD_OLD_REV 0
+
+/** ext original revision inode size */
+#define EXT4_GOOD_OLD_INODE_SIZE 128
+
+/** ext root directory inode number */
+#define EXT4_ROOT_INO 2
+
+/** Incompatible feature: compression */
+#define EXT4_FEATURE_INCOMPAT_COMPRESSION 0x0001
+
+/** Incompatible feature: directory entries record file type */
+#define EXT4_FEATURE_INCOMPAT_FILETYPE 0x0002
+
+/** Incompatible feature: journal needs recovery */
+#define EXT4_FEATURE_INCOMPAT_RECOVER 0x0004
+
+/** Incompatible feature: separate journal device */
+#define EXT4_FEATURE_INCOMPAT_JOURNAL_DEV 0x0008
+
+/** Incompatible feature: meta block groups */
+#define EXT4_FEATURE_INCOMPAT_META_BG 0x0010
+
+/** Incompatible feature: extent-mapped files */
+#define EXT4_FEATURE_INCOMPAT_EXTENTS 0x0040
+
+/** Incompatible feature: 64-bit block numbers */
+#define EXT4_FEATURE_INCOMPAT_64BIT 0x0080
+
+/** Incompatible feature: multiple mount protection */
+#define EXT4_FEATURE_INCOMPAT_MMP 0x0100
+
+/** Incompatible feature: flexible block groups */
+#define EXT4_FEATURE_INCOMPAT_FLEX_BG 0x0200
+
+/** Incompatible feature: extended attributes in inodes */
+#define EXT4_FEATURE_INCOMPAT_EA_INODE 0x0400
+
+/** Incompatible feature: data in directory entries */
+#define EXT4_FEATURE_INCOMPAT_DIRDATA 0x1000
+
+/** Incompatible feature: checksum seed in superblock */
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED 0x2000
+
+/** Incompatible feature: large directories */
+#define EXT4_FEATURE_INCOMPAT_LARGEDIR 0x4000
+
+/** Incompatible feature: data in inodes */
+#define EXT4_FEATURE_INCOMPAT_INLINE_DATA 0x8000
+
+/** Incompatible feature: encrypted inodes */
+#define EXT4_FEATURE_INCOMPAT_ENCRYPT 0x10000
+
+/** Incompatible feature: case-folded directories */
+#define EXT4_FEATURE_INCOMPAT_CASEFOLD 0x20000
+
+/** Minimum ext 64-bit group descriptor size */
+#define EXT4_MIN_DESC_SIZE_64BIT 64
+
+/** An ext block group descriptor (initial portion) */
+struct ext4_group_desc {
+	/** Block bitmap (low 32 bits) */
+	uint32_t block_bitmap_lo;
+	/** Inode bitmap (low 32 bits) */
+	uint32_t inode_bitmap_lo;
+	/** Inode table (low 32 bits) */
+	uint32_t inode_table_lo;
+	/** Unused fields */
+	uint8_t unused[28];
+	/** Block bitmap (high 32 bits) */
+	uint32_t block_bitmap_hi;
+	/** Inode bitmap (high 32 bits) */
+	uint32_t inode_bitmap_hi;
+	/** Inode table (high 32 bits) */
+	uint32_t inode_table_hi;
+} __attribute__ (( packed ));
+
+/** Size of ext 32-bit block group descriptor */
+#define EXT4_DESC_SIZE 32
+
+/** Number of ext block map entries within an inode */
+#define EXT4_N_BLOCKS 15
+
+/** Number of ext direct block map entries */
+#define EXT4_NDIR_BLOCKS 12
+
+/** An ext inode (initial portion) */
+struct ext4_inode {
+	/** File mode */
+	uint16_t mode;
+	/** Owner UID (low 16 bits) */
+	uint16_t uid;
+	/** Size (low 32 bits) */
+	uint32_t size_lo;
+	/** Access time */
+	uint32_t atime;
+	/** Inode change time */
+	uint32_t ctime;
+	/** Modification time */
+	uint32_t mtime;
+	/** Deletion time */
+	uint32_t dtime;
+	/** Group ID (low 16 bits) */
+	uint16_t gid;
+	/** Link count */
+	uint16_t links_count;
+	/** Block count (low 32 bits) */
+	uint32_t blocks_lo;
+	/** Flags */
+	uint32_t flags;
+	/** OS-dependent value */
+	uint32_t osd1;
+	/** Block map or extent tree */
+	union {
+		/** Block map */
+		uint32_t block[EXT4_N_BLOCKS];
+		/** Fast symbolic link target */
+		char symlink[ EXT4_N_BLOCKS * sizeof ( uint32_t ) ];
+	} u;
+	/** File version */
+	uint32_t generation;
+	/** Extended attribute block (low 32 bits) */
+	uint32_t file_acl_lo;
+	/** Size (high 32 bits) */
+	uint32_t size_high;
+} __attribute__ (( packed ));
+
+/** ext file mode: file type mask */
+#define EXT4_S_IFMT 0xf000
+
+/** ext file mode: symbolic link */
+#define EXT4_S_IFLNK 0xa000
+
+/** ext file mode: regular file */
+#define EXT4_S_IFREG 0x8000
+
+/** ext file mode: directory */
+#define EXT4_S_IFDIR 0x4000
+
+/** ext inode flag: encrypted */
+#define EXT4_ENCRYPT_FL 0x00000800
+
+/** ext inode flag: extent-mapped */
+#define EXT4_EXTENTS_FL 0x00080000
+
+/** ext inode flag: data stored in inode */
+#define EXT4_INLINE_DATA_FL 0x10000000
+
+/** An ext extent tree node header */
+struct ext4_extent_header {
+	/** Magic signature */
+	uint16_t magic;
+	/** Number of valid entries */
+	uint16_t entries;
+	/** Maximum number of entries */
+	uint16_t max;
+	/** Depth of tree below this node */
+	uint16_t depth;
+	/** Generation */
+	uint32_t generation;
+} __attribute__ (( packed ));
+
+/** ext extent tree node header magic signature */
+#define EXT4_EXTENT_MAGIC 0xf30a
+
+/** Maximum ext extent tree depth */
+#define EXT4_EXTENT_MAX_DEPTH 5
+
+/** An ext extent tree leaf entry */
+struct ext4_extent {
+	/** First logical block */
+	uint32_t block;
+	/** Number of blocks */
+	uint16_t len;
+	/** Physical block (high 16 bits) */
+	uint16_t start_hi;
+	/** Physical block (low 32 bits) */
+	uint32_t start_lo;
+} __attribute__ (( packed ));
+
+/** Maximum length of an initialised ext extent */
+#define EXT4_EXTENT_INIT_MAX 32768
+
+/** An ext extent tree index entry */
+struct ext4_extent_idx {
+	/** First logical block covered */
+	uint32_t block;
+	/** Child node physical block (low 32 bits) */
+	uint32_t leaf_lo;
+	/** Child node physical block (high 16 bits) */
+	uint16_t leaf_hi;
+	/** Unused */
+	uint16_t unused;
+} __attribute__ (( packed ));
+
+/** An ext directory entry (fixed portion) */
+struct ext4_dirent {
+	/** Inode number */
+	uint32_t inode;
+	/** Record length */
+	uint16_t rec_len;
+	/** Name length */
+	uint8_t name_len;
+	/** File type (if EXT4_FEATURE_INCOMPAT_FILETYPE) */
+	uint8_t file_type;
+} __attribute__ (( packed ));
+
+#endif /* _IPXE_EXT4_H */
@@ -0,0 +1,162 @@
+#ifndef _IPXE_FAT_H
+#define _IPXE_FAT_H
+
+/**
+ * @file
+ *
+ * FAT filesystem
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+
+/** A FAT boot sector (BIOS parameter block) */
+struct fat_boot_sector {
+	/** Jump instruction */
+	uint8_t jump[3];
+	/** OEM name */
+	char oem[8];
+	/** Bytes per sector */
+	uint16_t sector_len;
+	/** Sectors per cluster */
+	uint8_t cluster_sectors;
+	/** Number of reserved sectors */
+	uint16_t reserved;
+	/** Number of FATs */
+	uint8_t fats;
+	/** Number of root directory entries (FAT12/16 only) */
+	uint16_t root_entries;
+	/** Total number of sectors (16-bit) */
+	uint16_t sectors16;
+	/** Media descriptor */
+	uint8_t media;
+	/** Sectors per FAT (FAT12/16 only) */
+	uint16_t fat_sectors16;
+	/** Sectors per track */
+	uint16_t track_sectors;
+	/** Number of heads */
+	uint16_t heads;
+	/** Number of hidden sectors */
+	uint32_t hidden;
+	/** Total number of sectors (32-bit) */
+	uint32_t sectors32;
+	/** Sectors per FAT (FAT32 only) */
+	uint32_t fat_sectors32;
+	/** Extended flags (FAT32 only) */
+	uint16_t flags;
+	/** Filesystem version (FAT32 only) */
+	uint16_t version;
+	/** Root directory cluster (FAT32 only) */
+	uint32_t root_cluster;
+} __attribute__ (( packed ));
+
+/** Offset of FAT boot sector signature */
+#define FAT_SIGNATURE_OFFSET 510
+
+/** FAT boot sector signature */
+#define FAT_SIGNATURE 0xaa55
+
+/** Maximum number of clusters in a FAT12 filesystem */
+#define FAT12_MAX_CLUSTERS 4084
+
+/** Maximum number of clusters in a FAT16 filesystem */
+#define FAT16_MAX_CLUSTERS 65524
+
+/** First data cluster number */
+#define FAT_FIRST_CLUSTER 2
+
+/** FAT16 end of chain marker (minimum value) */
+#define FAT16_EOC 0xfff8
+
+/** FAT32 cluster number mask */
+#define FAT32_MASK 0x0fffffffUL
+
+/** FAT32 end of chain marker (minimum value) */
+#define FAT32_EOC 0x0ffffff8UL
+
+/** A FAT directory entry */
+struct fat_dirent {
+	/** Short name */
+	char name[8];
+	/** Short name extension */
+	char ext[3];
+	/** Attributes */
+	uint8_t attr;
+	/** Reserved */
+	uint8_t reserved;
+	/** Creation time (tenths of a second) */
+	uint8_t ctime_tenths;
+	/** Creation time */
+	uint16_t ctime;
+	/** Creation date */
+	uint16_t cdate;
+	/** Access date */
+	uint16_t adate;
+	/** Starting cluster (high 16 bits) */
+	uint16_t cluster_high;
+	/** Modification time */
+	uint16_t mtime;
+	/** Modification date */
+	uint16_t mdate;
+	/** Starting cluster (low 16 bits) */
+	uint16_t cluster_low;
+	/** File size */
+	uint32_t size;
+} __attribute__ (( packed ));
+
+/** FAT directory entry attribute: volume label */
+#define FAT_ATTR_VOLUME 0x08
+
+/** FAT directory entry attribute: directory */
+#define FAT_ATTR_DIRECTORY 0x10
+
+/** FAT directory entry attribute: long file name entry */
+#define FAT_ATTR_LFN 0x0f
+
+/** FAT directory entry attribute mask for long file name entries */
+#define FAT_ATTR_LFN_MASK 0x3f
+
+/** FAT directory entry name: end of directory */
+#define FAT_NAME_END 0x00
+
+/** FAT directory entry name: deleted entry */
+#define FAT_NAME_DELETED 0xe5
+
+/** FAT directory entry name: escaped 0xe5 initial character */
+#define FAT_NAME_KANJI 0x05
+
+/** A FAT long file name directory entry */
+struct fat_lfn {
+	/** Sequence number */
+	uint8_t seq;
+	/** Name characters 1-5 */
+	uint16_t name1[5];
+	/** Attributes (always FAT_ATTR_LFN) */
+	uint8_t attr;
+	/** Type (always zero) */
+	uint8_t type;
+	/** Short name checksum */
+	uint8_t checksum;
+	/** Name characters 6-11 */
+	uint16_t name2[6];
+	/** Starting cluster (always zero) */
+	uint16_t cluster;
+	/** Name characters 12-13 */
+	uint16_t name3[2];
+} __attribute__ (( packed ));
+
+/** FAT long file name sequence number mask */
+#define FAT_LFN_SEQ_MASK 0x1f
+
+/** FAT long file name sequence number: last entry */
+#define FAT_LFN_SEQ_LAST 0x40
+
+/** Number of name characters in a FAT long file name entry */
+#define FAT_LFN_CHARS 13
+
+/** Maximum length of a FAT long file name */
+#define FAT_LFN_MAX 255
+
+#endif /* _IPXE_FAT_H */
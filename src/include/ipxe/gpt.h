@@ -0,0 +1,84 @@
+#ifndef _IPXE_GPT_H
+#define _IPXE_GPT_H
+
+/** @file
+ *
+ * GUID partition table
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <ipxe/uuid.h>
+
+/** Logical block address of primary GPT header */
+#define GPT_PRIMARY_LBA 1
+
+/** GPT header signature ("EFI PART") */
+#define GPT_SIGNATURE 0x5452415020494645ULL
+
+/** Minimum GPT header size */
+#define GPT_HEADER_MIN_LEN 92
+
+/** Minimum GPT partition entry size */
+#define GPT_ENTRY_MIN_LEN 128
+
+/** MBR partition type used by a protective MBR */
+#define GPT_PROTECTIVE_TYPE 0xee
+
+/** A GPT header */
+struct gpt_header {
+	/** Signature */
+	uint64_t signature;
+	/** Revision */
+	uint32_t revision;
+	/** Header size */
+	uint32_t header_size;
+	/** CRC32 of header (calculated with this field zeroed) */
+	uint32_t header_crc;
+	/** Reserved */
+	uint32_t reserved;
+	/** Logical block address of this header */
+	uint64_t my_lba;
+	/** Logical block address of alternate header */
+	uint64_t alternate_lba;
+	/** First logical block usable by partitions */
+	uint64_t first_usable;
+	/** Last logical block usable by partitions */
+	uint64_t last_usable;
+	/** Disk GUID */
+	union uuid guid;
+	/** Starting logical block address of partition entry array */
+	uint64_t entries_lba;
+	/** Number of partition entries */
+	uint32_t count;
+	/** Size of each partition entry */
+	uint32_t entry_size;
+	/** CRC32 of partition entry array */
+	uint32_t entries_crc;
+} __attribute__ (( packed ));
+
+/** A GPT partition entry */
+struct gpt_entry {
+	/** Partition type GUID (all zeroes for an unused entry) */
+	union uuid type;
+	/** Unique partition GUID */
+	union uuid guid;
+	/** Starting logical block address */
+	uint64_t start;
+	/** Ending logical block address (inclusive) */
+	uint64_t end;
+	/** Attributes */
+	uint64_t attributes;
+	/** Partition name (UCS-2) */
+	uint16_t name[36];
+} __attribute__ (( packed ));
+
+/** GPT partition is required by the platform */
+#define GPT_ATTR_REQUIRED 0x0000000000000001ULL
+
+/** GPT partition is bootable by legacy BIOS */
+#define GPT_ATTR_LEGACY_BOOTABLE 0x0000000000000004ULL
+
+#endif /* _IPXE_GPT_H */
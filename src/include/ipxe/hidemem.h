@@ -13,5 +13,7 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <stdint.h>
 
 extern void hide_umalloc ( physaddr_t start, physaddr_t end );
+extern void hide_compact ( void );
+extern void unhide_compact ( void );
 
 #endif /* _IPXE_HIDEMEM_H */
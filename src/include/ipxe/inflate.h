@@ -0,0 +1,21 @@
+#ifndef _IPXE_INFLATE_H
+#define _IPXE_INFLATE_H
+
+/** @file
+ *
+ * Streaming decompression
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <ipxe/interface.h>
+
+/** Length of data required to identify a compressed data stream */
+#define INFLATE_MAGIC_LEN 2
+
+extern int inflate_add ( struct interface *xfer, const void *magic,
+			 size_t len );
+
+#endif /* _IPXE_INFLATE_H */
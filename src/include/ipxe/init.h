@@ -13,6 +13,13 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  */
 struct init_fn {
 	void ( * initialise ) ( void );
+	/** Function is not required to boot from local storage
+	 *
+	 * In a storage-only fast boot build (ROM_FAST_BOOT), such
+	 * functions are deferred until initialise_deferred() is
+	 * called.
+	 */
+	int deferrable;
 };
 
 /** Initialisation function table */
@@ -42,6 +49,13 @@ struct startup_fn {
 	const char *name;
 	void ( * startup ) ( void );
 	void ( * shutdown ) ( int booting );
+	/** Function is not required to boot from local storage
+	 *
+	 * In a storage-only fast boot build (ROM_FAST_BOOT), such
+	 * functions are deferred until initialise_deferred() is
+	 * called.
+	 */
+	int deferrable;
 };
 
 /** Startup/shutdown function table */
@@ -66,6 +80,7 @@ struct startup_fn {
 /** @} */
 
 extern void initialise ( void );
+extern void initialise_deferred ( void );
 extern void startup ( void );
 extern void shutdown ( int booting );
 
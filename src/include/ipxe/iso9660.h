@@ -23,10 +23,64 @@ struct iso9660_primary_descriptor_fixed {
 	uint8_t id[5];
 } __attribute__ (( packed ));
 
+/** An ISO9660 directory record (fixed portion) */
+struct iso9660_dir_record {
+	/** Length of directory record */
+	uint8_t len;
+	/** Length of extended attribute record */
+	uint8_t xattr_len;
+	/** Starting block address (little-endian) */
+	uint32_t extent_le;
+	/** Starting block address (big-endian) */
+	uint32_t extent_be;
+	/** Data length (little-endian) */
+	uint32_t size_le;
+	/** Data length (big-endian) */
+	uint32_t size_be;
+	/** Recording date and time */
+	uint8_t date[7];
+	/** Flags */
+	uint8_t flags;
+	/** File unit size (for interleaved files) */
+	uint8_t unit_size;
+	/** Interleave gap size (for interleaved files) */
+	uint8_t gap_size;
+	/** Volume sequence number (little-endian) */
+	uint16_t volume_le;
+	/** Volume sequence number (big-endian) */
+	uint16_t volume_be;
+	/** Length of file identifier */
+	uint8_t name_len;
+} __attribute__ (( packed ));
+
+/** ISO9660 directory record flag: directory */
+#define ISO9660_DIR_DIRECTORY 0x02
+
+/** ISO9660 directory record flag: not the final record for this file */
+#define ISO9660_DIR_MULTI_EXTENT 0x80
+
+/** ISO9660 file identifier for the current directory */
+#define ISO9660_NAME_SELF 0x00
+
+/** ISO9660 file identifier for the parent directory */
+#define ISO9660_NAME_PARENT 0x01
+
 /** An ISO9660 Primary Volume Descriptor */
 struct iso9660_primary_descriptor {
 	/** Fixed portion */
 	struct iso9660_primary_descriptor_fixed fixed;
+	/** Unused fields */
+	uint8_t reserved_a[122];
+	/** Logical block size (little-endian) */
+	uint16_t blksize_le;
+	/** Logical block size (big-endian) */
+	uint16_t blksize_be;
+	/** Unused fields */
+	uint8_t reserved_b[24];
+	/** Root directory record */
+	struct iso9660_dir_record root;
+	/** Root directory file identifier */
+	uint8_t root_name;
 } __attribute__ (( packed ));
 
 /** ISO9660 Primary Volume Descriptor type */
@@ -41,4 +95,23 @@ struct iso9660_primary_descriptor {
 /** ISO9660 identifier */
 #define ISO9660_ID "CD001"
 
+/** A Rock Ridge (SUSP) system use entry header */
+struct iso9660_susp {
+	/** Signature */
+	char sig[2];
+	/** Length of entry */
+	uint8_t len;
+	/** Entry version */
+	uint8_t version;
+} __attribute__ (( packed ));
+
+/** Rock Ridge alternate name flag: continues in next "NM" entry */
+#define ISO9660_RR_NM_CONTINUE 0x01
+
+/** Rock Ridge alternate name flag: current directory */
+#define ISO9660_RR_NM_CURRENT 0x02
+
+/** Rock Ridge alternate name flag: parent directory */
+#define ISO9660_RR_NM_PARENT 0x04
+
 #endif /* _IPXE_ISO9660_H */
@@ -0,0 +1,53 @@
+#ifndef _IPXE_NSTIME_H
+#define _IPXE_NSTIME_H
+
+/** @file
+ *
+ * Nanosecond clock
+ *
+ * The nanosecond clock is derived from the CPU cycle counter (as used
+ * for profiling) when a platform has been able to calibrate it, and
+ * from the (much coarser) system timer otherwise.  It is intended
+ * for measuring short intervals and deadlines, not wall-clock time.
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <bits/profile.h>
+
+/** Nanosecond clock multiplier scale (expressed as a bit shift) */
+#define NSTIME_SHIFT 24
+
+/** Number of nanoseconds per millisecond */
+#define NSTIME_PER_MS 1000000ULL
+
+extern uint32_t nstime_mult;
+
+extern uint64_t nstime_ticks ( void );
+
+/**
+ * Get current time in nanoseconds
+ *
+ * @ret ns		Current time, in nanoseconds
+ */
+static inline __attribute__ (( always_inline )) uint64_t nstime ( void ) {
+	uint64_t cycles;
+	uint32_t high;
+	uint32_t low;
+
+	/* Use system timer if cycle counter is not calibrated */
+	if ( ! nstime_mult )
+		return nstime_ticks();
+
+	/* Scale cycle counter, avoiding 64-bit overflow */
+	cycles = profile_timestamp();
+	high = ( cycles >> 32 );
+	low = cycles;
+	return ( ( ( ( ( uint64_t ) high ) * nstime_mult ) <<
+		   ( 32 - NSTIME_SHIFT ) ) +
+		 ( ( ( ( uint64_t ) low ) * nstime_mult ) >> NSTIME_SHIFT ) );
+}
+
+#endif /* _IPXE_NSTIME_H */
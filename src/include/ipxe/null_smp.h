@@ -0,0 +1,44 @@
+#ifndef _IPXE_NULL_SMP_H
+#define _IPXE_NULL_SMP_H
+
+/** @file
+ *
+ * Null application processor worker
+ *
+ * All work is performed directly by the bootstrap processor.
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <string.h>
+
+#ifdef SMP_NULL
+#define SMP_PREFIX_null
+#else
+#define SMP_PREFIX_null __null_
+#endif
+
+static inline __always_inline void
+SMP_INLINE ( null, smp_submit ) ( struct smp_work *work ) {
+	work->run ( work );
+	work->done = 1;
+}
+
+static inline __always_inline void
+SMP_INLINE ( null, smp_wait ) ( struct smp_work *work __unused ) {
+	/* Nothing to do */
+}
+
+static inline __always_inline void
+SMP_INLINE ( null, smp_memcpy ) ( void *dest, const void *src,
+				   size_t len ) {
+	memcpy ( dest, src, len );
+}
+
+static inline __always_inline void
+SMP_INLINE ( null, smp_park ) ( void ) {
+	/* Nothing to do */
+}
+
+#endif /* _IPXE_NULL_SMP_H */
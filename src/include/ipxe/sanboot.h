@@ -39,10 +39,42 @@ struct san_path {
 	/** Path status */
 	int path_rc;
 
+	/** Number of fragments outstanding on this path */
+	unsigned int inflight;
+	/** Smoothed fragment completion time
+	 *
+	 * This is measured in nanoseconds, scaled down by
+	 * SAN_LATENCY_SCALE bits.
+	 */
+	unsigned long latency;
+
 	/** ACPI descriptor (if applicable) */
 	struct acpi_descriptor *desc;
 };
 
+/** Maximum number of concurrently outstanding SAN fragments */
+#define SAN_MAX_OUTSTANDING 8
+
+/** A SAN device read/write fragment */
+struct san_fragment {
+	/** Containing SAN device */
+	struct san_device *sandev;
+	/** Block data interface */
+	struct interface block;
+	/** Path to which fragment was issued, or NULL if not yet issued */
+	struct san_path *path;
+	/** Time at which fragment was issued (in nanoseconds) */
+	uint64_t started;
+	/** Starting logical block address (in underlying blocks) */
+	uint64_t lba;
+	/** Number of underlying blocks, or zero if fragment is idle */
+	unsigned int count;
+	/** Data buffer */
+	userptr_t buffer;
+	/** Fragment status */
+	int rc;
+};
+
 /** A SAN device */
 struct san_device {
 	/** Reference count */
@@ -73,10 +105,50 @@ struct san_device {
 	unsigned int blksize_shift;
 	/** Drive is a CD-ROM */
 	int is_cdrom;
+	/** RAID-0 chunk size shift (in underlying blocks) */
+	unsigned int chunk_shift;
+
+	/** Parent SAN device (for a partition slice)
+	 *
+	 * A partition slice has no paths of its own.  All I/O is
+	 * passed to the parent device, offset by the slice's starting
+	 * block, and so shares the parent's paths, fragment pipeline
+	 * and probe buffer.
+	 */
+	struct san_device *parent;
+	/** Starting block within parent device (in underlying blocks) */
+	uint64_t start;
+
+	/** Probe buffer
+	 *
+	 * This holds the initial underlying blocks of the device, as
+	 * read in a single request during registration, and is used
+	 * to satisfy subsequent reads of those blocks.  A partition
+	 * slice has no probe buffer of its own.
+	 */
+	void *probe;
+	/** Number of underlying blocks held in probe buffer */
+	unsigned int probe_count;
+	/** Write count
+	 *
+	 * This is incremented by every write to the device, including
+	 * a write via a partition slice of the device, and may be used
+	 * to detect that externally cached data has become stale.
+	 */
+	unsigned int writes;
+	/** Cached partition table (if parsed) */
+	struct san_partition_table *partitions;
+	/** Hash tree (for a verified device) */
+	struct san_verity *verity;
+	/** Encryption (for an encrypted device) */
+	struct san_crypt *crypt;
 
 	/** Driver private data */
 	void *priv;
 
+	/** Read/write fragments */
+	struct san_fragment frag[SAN_MAX_OUTSTANDING];
+
 	/** Number of paths */
 	unsigned int paths;
 	/** Current active path */
@@ -93,6 +165,38 @@ struct san_device {
 enum san_device_flags {
 	/** Device should not be included in description tables */
 	SAN_NO_DESCRIBE = 0x0001,
+	/** Distribute I/O across all available paths
+	 *
+	 * All paths are assumed to provide access to identical
+	 * content with identical capacity.
+	 */
+	SAN_MULTIPATH = 0x0002,
+	/** Stripe data across all paths as a RAID-0 volume
+	 *
+	 * Each path is a member device.  All members must be
+	 * available, and are assumed to have identical capacity.
+	 */
+	SAN_RAID0 = 0x0004,
+	/** Mirror data across all paths as a RAID-1 volume
+	 *
+	 * Each path is a member device holding a complete copy of the
+	 * data.  Reads are directed to the least loaded member and
+	 * writes are applied to all available members.
+	 */
+	SAN_RAID1 = 0x0008,
+	/** Verify reads against a dm-verity hash tree
+	 *
+	 * The hash tree is stored on the device itself, and is
+	 * verified against a root hash configured at build time.  A
+	 * verified device is read-only.
+	 */
+	SAN_VERIFY = 0x0010,
+	/** Decrypt reads and encrypt writes using AES-XTS
+	 *
+	 * The device is encrypted as for dm-crypt's "aes-xts-plain64"
+	 * cipher, using a key configured at build time.
+	 */
+	SAN_DECRYPT = 0x0020,
 };
 
 /**
@@ -148,9 +252,22 @@ int san_hook ( unsigned int drive, struct uri **uris, unsigned int count,
  * Unhook SAN device
  *
  * @v drive		Drive number
+ *
+ * Any partitions hooked as separate drives are unhooked first.
  */
 void san_unhook ( unsigned int drive );
 
+/**
+ * Hook SAN device partition as a separate drive
+ *
+ * @v drive		Drive number
+ * @v parent		Drive number of parent SAN device
+ * @v index		Partition number
+ * @ret drive		Drive number, or negative error
+ */
+int san_hook_partition ( unsigned int drive, unsigned int parent,
+			 unsigned int index );
+
 /**
  * Attempt to boot from a SAN device
  *
@@ -230,21 +347,42 @@ static inline uint64_t sandev_capacity ( struct san_device *sandev ) {
  * @ret needs_reopen	SAN device needs to be reopened
  */
 static inline int sandev_needs_reopen ( struct san_device *sandev ) {
+	/* A partition slice is open whenever its parent is open */
+	if ( sandev->parent )
+		sandev = sandev->parent;
 	return ( sandev->active == NULL );
 }
 
 extern struct san_device * sandev_find ( unsigned int drive );
+extern struct san_device * sandev_find_slice ( struct san_device *sandev );
 extern int sandev_reopen ( struct san_device *sandev );
 extern int sandev_reset ( struct san_device *sandev );
 extern int sandev_read ( struct san_device *sandev, uint64_t lba,
 			 unsigned int count, userptr_t buffer );
 extern int sandev_write ( struct san_device *sandev, uint64_t lba,
 			  unsigned int count, userptr_t buffer );
+extern int sandev_read_unverified ( struct san_device *sandev, uint64_t lba,
+				    unsigned int count, userptr_t buffer );
+extern int sandev_rw_raw ( struct san_device *sandev, uint64_t lba,
+			   unsigned int count, userptr_t buffer,
+			   int ( * block_rw ) ( struct interface *control,
+						struct interface *data,
+						uint64_t lba,
+						unsigned int count,
+						userptr_t buffer,
+						size_t len ) );
+extern const void * sandev_probed ( struct san_device *sandev, uint64_t lba,
+				    unsigned int count );
 extern struct san_device * alloc_sandev ( struct uri **uris, unsigned int count,
 					  size_t priv_size );
+extern struct san_device * alloc_sandev_slice ( struct san_device *parent,
+						uint64_t lba, uint64_t count,
+						size_t priv_size );
 extern int register_sandev ( struct san_device *sandev, unsigned int drive,
 			     unsigned int flags );
 extern void unregister_sandev ( struct san_device *sandev );
+extern int open_sandev ( struct san_device *sandev );
+extern void close_sandev ( struct san_device *sandev );
 extern unsigned int san_default_drive ( void );
 
 #endif /* _IPXE_SANBOOT_H */
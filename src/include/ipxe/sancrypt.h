@@ -0,0 +1,56 @@
+#ifndef _IPXE_SANCRYPT_H
+#define _IPXE_SANCRYPT_H
+
+/** @file
+ *
+ * SAN device encryption
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/crypto.h>
+#include <ipxe/sanboot.h>
+
+/** Maximum length of SAN device encryption key */
+#define SAN_CRYPT_MAX_KEY 64
+
+/** A plain64 initialisation vector */
+struct san_crypt_iv {
+	/** Sector number (little-endian) */
+	uint64_t sector;
+	/** Reserved (must be zero) */
+	uint8_t reserved[8];
+} __attribute__ (( packed ));
+
+/** A SAN device encryption */
+struct san_crypt {
+	/** Cipher algorithm */
+	struct cipher_algorithm *cipher;
+	/** Cipher context */
+	void *ctx;
+	/** Encryption sector size (in bytes) */
+	size_t sector_len;
+	/** Encryption sector size shift (relative to underlying block size)
+	 *
+	 * Each underlying block holds ( 1 << sector_shift ) sectors.
+	 */
+	unsigned int sector_shift;
+	/** Bounce buffer for writes */
+	void *bounce;
+	/** Number of underlying blocks held in bounce buffer */
+	unsigned int bounce_count;
+};
+
+extern int sancrypt_attach ( struct san_device *sandev );
+extern int sancrypt_rw ( struct san_device *sandev, uint64_t lba,
+			 unsigned int count, userptr_t buffer,
+			 int ( * block_rw ) ( struct interface *control,
+					      struct interface *data,
+					      uint64_t lba, unsigned int count,
+					      userptr_t buffer, size_t len ) );
+extern void sancrypt_discard ( struct san_device *sandev );
+
+#endif /* _IPXE_SANCRYPT_H */
@@ -0,0 +1,110 @@
+#ifndef _IPXE_SANFS_H
+#define _IPXE_SANFS_H
+
+/** @file
+ *
+ * SAN device filesystems
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <ipxe/tables.h>
+#include <ipxe/interface.h>
+#include <ipxe/uri.h>
+#include <ipxe/sanboot.h>
+
+/** Length of filesystem metadata read cache
+ *
+ * Filesystem metadata (such as a FAT or an inode table) is read
+ * through a small cache, so that walking a cluster chain or a
+ * directory does not issue one device read per entry.
+ */
+#define SANFS_CACHE_LEN 4096
+
+/** Maximum number of symbolic links followed while resolving a path */
+#define SANFS_MAX_LINKS 8
+
+/** Device offset used to represent a hole within a file */
+#define SANFS_HOLE ( ~( ( uint64_t ) 0 ) )
+
+/** A filesystem extent */
+struct sanfs_extent {
+	/** Starting byte offset on device (or SANFS_HOLE) */
+	uint64_t start;
+	/** Length */
+	size_t len;
+};
+
+/** A file within a filesystem */
+struct sanfs_file {
+	/** Length of file */
+	size_t len;
+	/** Extents (in file order) */
+	struct sanfs_extent *extent;
+	/** Number of extents */
+	unsigned int count;
+};
+
+/** A mounted filesystem */
+struct sanfs {
+	/** SAN device */
+	struct san_device *sandev;
+	/** Starting byte offset on device */
+	uint64_t start;
+	/** Length */
+	uint64_t len;
+	/** Filesystem type */
+	struct sanfs_type *type;
+	/** Filesystem private data */
+	void *priv;
+
+	/** Metadata read cache */
+	void *cache;
+	/** Offset of metadata read cache within filesystem */
+	uint64_t cache_offset;
+	/** Metadata read cache is valid */
+	int cache_valid;
+};
+
+/** A filesystem type */
+struct sanfs_type {
+	/** Name */
+	const char *name;
+	/**
+	 * Mount filesystem
+	 *
+	 * @v fs		Filesystem
+	 * @ret rc		Return status code
+	 *
+	 * The filesystem type may record private data in @c fs->priv,
+	 * which will be freed when the filesystem is unmounted.
+	 */
+	int ( * mount ) ( struct sanfs *fs );
+	/**
+	 * Open file
+	 *
+	 * @v fs		Filesystem
+	 * @v path		Path within filesystem
+	 * @v file		File to fill in
+	 * @ret rc		Return status code
+	 */
+	int ( * open ) ( struct sanfs *fs, const char *path,
+			 struct sanfs_file *file );
+};
+
+/** Filesystem type table */
+#define SANFS_TYPES __table ( struct sanfs_type, "sanfs_types" )
+
+/** Declare a filesystem type */
+#define __sanfs_type __table_entry ( SANFS_TYPES, 01 )
+
+extern int sanfs_read ( struct sanfs *fs, uint64_t offset, void *data,
+			size_t len );
+extern const char * sanfs_component ( const char **path, size_t *len );
+extern int sanfs_extend ( struct sanfs *fs, struct sanfs_file *file,
+			  uint64_t offset, size_t len );
+extern int sanfs_open_uri ( struct interface *xfer, struct uri *uri );
+
+#endif /* _IPXE_SANFS_H */
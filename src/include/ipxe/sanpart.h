@@ -0,0 +1,71 @@
+#ifndef _IPXE_SANPART_H
+#define _IPXE_SANPART_H
+
+/** @file
+ *
+ * SAN device partition tables
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <ipxe/uuid.h>
+#include <ipxe/sanboot.h>
+
+/** Maximum length of a GPT partition entry array
+ *
+ * This allows for 512 entries of the standard 128-byte size, four
+ * times the minimum array size required by the UEFI specification.
+ */
+#define SANPART_GPT_MAX_LEN ( 64 * 1024 )
+
+/** A SAN device partition */
+struct san_partition {
+	/** Partition number (starting from 1) */
+	unsigned int index;
+	/** Starting logical block address */
+	uint64_t lba;
+	/** Number of logical blocks */
+	uint64_t count;
+	/** MBR partition type (or zero for a GPT partition) */
+	uint8_t type;
+	/** GPT partition attributes */
+	uint64_t attributes;
+	/** GPT partition type GUID */
+	union uuid type_guid;
+	/** GPT unique partition GUID */
+	union uuid guid;
+};
+
+/** A SAN device partition table */
+struct san_partition_table {
+	/** Table is a GUID partition table */
+	int gpt;
+	/** First logical block usable by partitions */
+	uint64_t first_usable;
+	/** Last logical block usable by partitions */
+	uint64_t last_usable;
+	/** Number of partitions */
+	unsigned int count;
+	/** Partitions */
+	struct san_partition partition[0];
+};
+
+extern int sanpart_parse ( struct san_device *sandev );
+extern struct san_partition * sanpart_find ( struct san_device *sandev,
+					     unsigned int index );
+
+/**
+ * Discard cached SAN device partition table
+ *
+ * @v sandev		SAN device
+ */
+static inline void sanpart_discard ( struct san_device *sandev ) {
+
+	free ( sandev->partitions );
+	sandev->partitions = NULL;
+}
+
+#endif /* _IPXE_SANPART_H */
@@ -0,0 +1,110 @@
+#ifndef _IPXE_SANVERITY_H
+#define _IPXE_SANVERITY_H
+
+/** @file
+ *
+ * SAN device hash tree verification
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stdint.h>
+#include <ipxe/uaccess.h>
+#include <ipxe/sha256.h>
+#include <ipxe/sanboot.h>
+
+/** dm-verity superblock signature */
+#define SAN_VERITY_SIGNATURE "verity\0\0"
+
+/** dm-verity superblock version */
+#define SAN_VERITY_VERSION 1
+
+/** dm-verity standard hash type (salt prepended to each block) */
+#define SAN_VERITY_HASH_NORMAL 1
+
+/** dm-verity hash algorithm */
+#define SAN_VERITY_ALGORITHM "sha256"
+
+/** Maximum length of dm-verity salt */
+#define SAN_VERITY_MAX_SALT 256
+
+/** A dm-verity superblock
+ *
+ * This is written by "veritysetup format" at the start of the hash
+ * area, with the hash tree following from the next hash block
+ * boundary.  All fields are little-endian.
+ */
+struct san_verity_superblock {
+	/** Signature */
+	char signature[8];
+	/** Superblock version */
+	uint32_t version;
+	/** Hash type */
+	uint32_t hash_type;
+	/** UUID of hash device */
+	uint8_t uuid[16];
+	/** Hash algorithm name */
+	char algorithm[32];
+	/** Data block size (in bytes) */
+	uint32_t data_block_size;
+	/** Hash block size (in bytes) */
+	uint32_t hash_block_size;
+	/** Number of data blocks */
+	uint64_t data_blocks;
+	/** Length of salt */
+	uint16_t salt_size;
+	/** Reserved */
+	uint8_t reserved_a[6];
+	/** Salt */
+	uint8_t salt[SAN_VERITY_MAX_SALT];
+	/** Reserved */
+	uint8_t reserved_b[168];
+} __attribute__ (( packed ));
+
+/** Maximum number of hash tree levels
+ *
+ * A hash block holds at least 16 digests, so this allows for any
+ * 64-bit number of data blocks.
+ */
+#define SAN_VERITY_MAX_LEVELS 16
+
+/** A SAN device hash tree */
+struct san_verity {
+	/** Data block size (in bytes) */
+	size_t data_len;
+	/** Data block size shift (relative to underlying block size) */
+	unsigned int data_shift;
+	/** Number of data blocks */
+	uint64_t data_blocks;
+	/** Hash block size (in bytes) */
+	size_t hash_len;
+	/** Hash block size shift (relative to underlying block size) */
+	unsigned int hash_shift;
+	/** Number of digests per hash block (as a power of two) */
+	unsigned int fanout_shift;
+	/** Number of hash tree levels */
+	unsigned int levels;
+	/** Starting hash block of each level (level 0 holds leaves) */
+	uint64_t level[SAN_VERITY_MAX_LEVELS];
+	/** Root digest */
+	uint8_t root[SHA256_DIGEST_SIZE];
+	/** Digest context holding salt */
+	struct sha256_context salted;
+
+	/** Number of cached hash blocks (a power of two) */
+	unsigned int cache_count;
+	/** Cached hash block numbers (plus one, or zero if unused) */
+	uint64_t *tag;
+	/** Cached hash blocks, all of which have been verified */
+	userptr_t cache;
+	/** Bounce buffer for partial data block reads */
+	void *bounce;
+};
+
+extern int sanverity_attach ( struct san_device *sandev );
+extern int sanverity_read ( struct san_device *sandev, uint64_t lba,
+			    unsigned int count, userptr_t buffer );
+extern void sanverity_discard ( struct san_device *sandev );
+
+#endif /* _IPXE_SANVERITY_H */
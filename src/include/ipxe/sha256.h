@@ -79,11 +79,28 @@ struct sha256_context {
 /** SHA-224 digest size */
 #define SHA224_DIGEST_SIZE ( SHA256_DIGEST_SIZE * 224 / 256 )
 
+/** Maximum number of messages digested in parallel */
+#define SHA256_LANES 4
+
+extern const uint32_t sha256_k[SHA256_ROUNDS];
+
+extern void sha256_rounds ( struct sha256_digest *digest, const uint32_t *wk );
+extern void generic_sha256_blocks ( struct sha256_digest *digest,
+				    const void *data, size_t count );
+extern void generic_sha256_multi_blocks ( struct sha256_digest *digests,
+					  const void **data,
+					  unsigned int lanes, size_t count );
+
+#include <bits/sha256.h>
+
 extern void sha256_family_init ( struct sha256_context *context,
 				 const struct sha256_digest *init,
 				 size_t digestsize );
 extern void sha256_update ( void *ctx, const void *data, size_t len );
 extern void sha256_final ( void *ctx, void *out );
+extern void sha256_multi ( const struct sha256_context *init,
+			   const void *data, size_t len, unsigned int count,
+			   void *out );
 
 extern struct digest_algorithm sha256_algorithm;
 extern struct digest_algorithm sha224_algorithm;
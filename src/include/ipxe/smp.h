@@ -0,0 +1,108 @@
+#ifndef _IPXE_SMP_H
+#define _IPXE_SMP_H
+
+/**
+ * @file
+ *
+ * Application processor worker
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <stddef.h>
+#include <ipxe/api.h>
+#include <config/smp.h>
+
+/** An application processor work item
+ *
+ * A work item runs on the application processor concurrently with
+ * the rest of iPXE.  Its function must therefore touch only memory
+ * that the submitter leaves alone until smp_wait() returns, and must
+ * not call back into any other part of iPXE.
+ */
+struct smp_work {
+	/** Perform work
+	 *
+	 * @v work		Work item
+	 */
+	void ( * run ) ( struct smp_work *work );
+	/** Work has completed */
+	volatile int done;
+};
+
+/**
+ * Calculate static inline application processor worker API function name
+ *
+ * @v _prefix		Subsystem prefix
+ * @v _api_func		API function
+ * @ret _subsys_func	Subsystem API function
+ */
+#define SMP_INLINE( _subsys, _api_func ) \
+	SINGLE_API_INLINE ( SMP_PREFIX_ ## _subsys, _api_func )
+
+/**
+ * Provide an application processor worker API implementation
+ *
+ * @v _prefix		Subsystem prefix
+ * @v _api_func		API function
+ * @v _func		Implementing function
+ */
+#define PROVIDE_SMP( _subsys, _api_func, _func ) \
+	PROVIDE_SINGLE_API ( SMP_PREFIX_ ## _subsys, _api_func, _func )
+
+/**
+ * Provide a static inline application processor worker API
+ * implementation
+ *
+ * @v _prefix		Subsystem prefix
+ * @v _api_func		API function
+ */
+#define PROVIDE_SMP_INLINE( _subsys, _api_func ) \
+	PROVIDE_SINGLE_API_INLINE ( SMP_PREFIX_ ## _subsys, _api_func )
+
+/* Include all architecture-independent application processor worker
+ * API headers
+ */
+#include <ipxe/null_smp.h>
+
+/* Include all architecture-dependent application processor worker
+ * API headers
+ */
+#include <bits/smp.h>
+
+/**
+ * Submit work to worker
+ *
+ * @v work		Work item
+ *
+ * The work is performed immediately if there is no worker available.
+ */
+void smp_submit ( struct smp_work *work );
+
+/**
+ * Wait for work to complete
+ *
+ * @v work		Work item
+ */
+void smp_wait ( struct smp_work *work );
+
+/**
+ * Copy memory using the worker
+ *
+ * @v dest		Destination
+ * @v src		Source
+ * @v len		Length
+ */
+void smp_memcpy ( void *dest, const void *src, size_t len );
+
+/**
+ * Park worker
+ *
+ * Waits for all outstanding work to complete and returns all
+ * application processors to the state expected by an operating
+ * system.
+ */
+void smp_park ( void );
+
+#endif /* _IPXE_SMP_H */
@@ -0,0 +1,88 @@
+#ifndef _IPXE_XTS_H
+#define _IPXE_XTS_H
+
+/** @file
+ *
+ * XEX-based tweaked-codebook mode (XTS)
+ *
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+#include <ipxe/crypto.h>
+
+/** XTS block size
+ *
+ * XTS is defined only for ciphers with a 128-bit block size.
+ */
+#define XTS_BLOCKSIZE 16
+
+extern int xts_setkey ( void *ctx, void *tweak_ctx, const void *key,
+			size_t keylen, struct cipher_algorithm *raw_cipher );
+extern void xts_setiv ( void *tweak_ctx, const void *iv, size_t ivlen,
+			struct cipher_algorithm *raw_cipher, void *xts_ctx );
+extern void xts_encrypt ( void *ctx, const void *src, void *dst,
+			  size_t len, struct cipher_algorithm *raw_cipher,
+			  void *xts_ctx );
+extern void xts_decrypt ( void *ctx, const void *src, void *dst,
+			  size_t len, struct cipher_algorithm *raw_cipher,
+			  void *xts_ctx );
+
+/**
+ * Create an XEX-based tweaked-codebook mode of an existing cipher
+ *
+ * @v _xts_name		Name for the new XTS cipher
+ * @v _xts_cipher	New cipher algorithm
+ * @v _raw_cipher	Underlying cipher algorithm
+ * @v _raw_context	Context structure for the underlying cipher
+ * @v _blocksize	Cipher block size
+ *
+ * The underlying cipher must accept any whole number of blocks in a
+ * single call, encrypting or decrypting each block independently.
+ */
+#define XTS_CIPHER( _xts_name, _xts_cipher, _raw_cipher, _raw_context,	\
+		    _blocksize )					\
+struct _xts_name ## _context {						\
+	_raw_context raw_ctx;						\
+	_raw_context tweak_ctx;						\
+	uint8_t xts_ctx[_blocksize];					\
+};									\
+static int _xts_name ## _setkey ( void *ctx, const void *key,		\
+				  size_t keylen ) {			\
+	struct _xts_name ## _context * _xts_name ## _ctx = ctx;		\
+	return xts_setkey ( &_xts_name ## _ctx->raw_ctx,		\
+			    &_xts_name ## _ctx->tweak_ctx, key, keylen,	\
+			    &_raw_cipher );				\
+}									\
+static void _xts_name ## _setiv ( void *ctx, const void *iv,		\
+				  size_t ivlen ) {			\
+	struct _xts_name ## _context * _xts_name ## _ctx = ctx;		\
+	xts_setiv ( &_xts_name ## _ctx->tweak_ctx, iv, ivlen,		\
+		    &_raw_cipher, &_xts_name ## _ctx->xts_ctx );	\
+}									\
+static void _xts_name ## _encrypt ( void *ctx, const void *src,		\
+				    void *dst, size_t len ) {		\
+	struct _xts_name ## _context * _xts_name ## _ctx = ctx;		\
+	xts_encrypt ( &_xts_name ## _ctx->raw_ctx, src, dst, len,	\
+		      &_raw_cipher, &_xts_name ## _ctx->xts_ctx );	\
+}									\
+static void _xts_name ## _decrypt ( void *ctx, const void *src,		\
+				    void *dst, size_t len ) {		\
+	struct _xts_name ## _context * _xts_name ## _ctx = ctx;		\
+	xts_decrypt ( &_xts_name ## _ctx->raw_ctx, src, dst, len,	\
+		      &_raw_cipher, &_xts_name ## _ctx->xts_ctx );	\
+}									\
+struct cipher_algorithm _xts_cipher = {					\
+	.name		= #_xts_name,					\
+	.ctxsize	= sizeof ( struct _xts_name ## _context ),	\
+	.blocksize	= _blocksize,					\
+	.alignsize	= _blocksize,					\
+	.authsize	= 0,						\
+	.setkey		= _xts_name ## _setkey,				\
+	.setiv		= _xts_name ## _setiv,				\
+	.encrypt	= _xts_name ## _encrypt,			\
+	.decrypt	= _xts_name ## _decrypt,			\
+	.auth		= cipher_null_auth,				\
+};
+
+#endif /* _IPXE_XTS_H */
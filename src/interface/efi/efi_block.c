@@ -402,6 +402,24 @@ static void efi_block_unhook ( unsigned int drive ) {
 	}
 }
 
+/**
+ * Hook EFI block device partition as a separate drive
+ *
+ * @v drive		Drive number
+ * @v parent		Drive number of parent SAN device
+ * @v index		Partition number
+ * @ret drive		Drive number, or negative error
+ *
+ * The UEFI firmware's own partition driver already exposes each
+ * partition of a hooked block device as a block device in its own
+ * right.
+ */
+static int efi_block_hook_partition ( unsigned int drive __unused,
+				      unsigned int parent __unused,
+				      unsigned int index __unused ) {
+	return -ENOTSUP;
+}
+
 /** An installed ACPI table */
 struct efi_acpi_table {
 	/** List of installed tables */
@@ -679,5 +697,6 @@ static int efi_block_boot ( unsigned int drive, const char *filename ) {
 
 PROVIDE_SANBOOT ( efi, san_hook, efi_block_hook );
 PROVIDE_SANBOOT ( efi, san_unhook, efi_block_unhook );
+PROVIDE_SANBOOT ( efi, san_hook_partition, efi_block_hook_partition );
 PROVIDE_SANBOOT ( efi, san_describe, efi_block_describe );
 PROVIDE_SANBOOT ( efi, san_boot, efi_block_boot );
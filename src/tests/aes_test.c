@@ -34,6 +34,8 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  *    http://csrc.nist.gov/groups/ST/toolkit/documents/Examples/AES_ECB.pdf
  *    http://csrc.nist.gov/groups/ST/toolkit/documents/Examples/AES_CBC.pdf
  *
+ * The XTS-mode test vectors are taken from IEEE Std 1619-2007 Annex B.
+ *
  */
 
 /* Forcibly enable assertions */
@@ -156,22 +158,275 @@ CIPHER_TEST ( aes_256_cbc, &aes_cbc_algorithm,
 		     0xb2, 0xeb, 0x05, 0xe2, 0xc3, 0x9b, 0xe9, 0xfc,
 		     0xda, 0x6c, 0x19, 0x07, 0x8c, 0x6a, 0x9d, 0x1b ), AUTH() );
 
+/** AES-128-XTS (IEEE 1619 vector 1) */
+CIPHER_TEST ( aes_128_xts_1, &aes_xts_algorithm,
+	KEY ( 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 ),
+	IV ( 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 ),
+	ADDITIONAL(),
+	PLAINTEXT ( 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 ),
+	CIPHERTEXT ( 0x91, 0x7c, 0xf6, 0x9e, 0xbd, 0x68, 0xb2, 0xec,
+		     0x9b, 0x9f, 0xe9, 0xa3, 0xea, 0xdd, 0xa6, 0x92,
+		     0xcd, 0x43, 0xd2, 0xf5, 0x95, 0x98, 0xed, 0x85,
+		     0x8c, 0x02, 0xc2, 0x65, 0x2f, 0xbf, 0x92, 0x2e ), AUTH() );
+
+/** AES-128-XTS (IEEE 1619 vector 2) */
+CIPHER_TEST ( aes_128_xts_2, &aes_xts_algorithm,
+	KEY ( 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	      0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+	      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22 ),
+	IV ( 0x33, 0x33, 0x33, 0x33, 0x33, 0x00, 0x00, 0x00,
+	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 ),
+	ADDITIONAL(),
+	PLAINTEXT ( 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44 ),
+	CIPHERTEXT ( 0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e,
+		     0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+		     0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4,
+		     0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0 ), AUTH() );
+
+/** AES-128-XTS (IEEE 1619 vector 3) */
+CIPHER_TEST ( aes_128_xts_3, &aes_xts_algorithm,
+	KEY ( 0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8,
+	      0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0,
+	      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+	      0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22 ),
+	IV ( 0x33, 0x33, 0x33, 0x33, 0x33, 0x00, 0x00, 0x00,
+	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 ),
+	ADDITIONAL(),
+	PLAINTEXT ( 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+		    0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44 ),
+	CIPHERTEXT ( 0xaf, 0x85, 0x33, 0x6b, 0x59, 0x7a, 0xfc, 0x1a,
+		     0x90, 0x0b, 0x2e, 0xb2, 0x1e, 0xc9, 0x49, 0xd2,
+		     0x92, 0xdf, 0x4c, 0x04, 0x7e, 0x0b, 0x21, 0x53,
+		     0x21, 0x86, 0xa5, 0x97, 0x1a, 0x22, 0x7a, 0x89 ), AUTH() );
+
+/** AES-256-XTS (IEEE 1619 vector 10) */
+CIPHER_TEST ( aes_256_xts_10, &aes_xts_algorithm,
+	KEY ( 0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45,
+	      0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26,
+	      0x62, 0x49, 0x77, 0x57, 0x24, 0x70, 0x93, 0x69,
+	      0x99, 0x59, 0x57, 0x49, 0x66, 0x96, 0x76, 0x27,
+	      0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93,
+	      0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95,
+	      0x02, 0x88, 0x41, 0x97, 0x16, 0x93, 0x99, 0x37,
+	      0x51, 0x05, 0x82, 0x09, 0x74, 0x94, 0x45, 0x92 ),
+	IV ( 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 ),
+	ADDITIONAL(),
+	PLAINTEXT ( 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+		    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+		    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+		    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+		    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+		    0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+		    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+		    0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+		    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+		    0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+		    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+		    0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+		    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+		    0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+		    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
+		    0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+		    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		    0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+		    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+		    0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+		    0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		    0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+		    0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+		    0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+		    0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+		    0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+		    0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+		    0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+		    0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+		    0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+		    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+		    0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+		    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+		    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+		    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+		    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+		    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+		    0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+		    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+		    0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+		    0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+		    0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+		    0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57,
+		    0x58, 0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+		    0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
+		    0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+		    0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
+		    0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+		    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		    0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+		    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+		    0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+		    0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+		    0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+		    0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
+		    0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+		    0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+		    0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+		    0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+		    0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+		    0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+		    0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+		    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+		    0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff ),
+	CIPHERTEXT ( 0x1c, 0x3b, 0x3a, 0x10, 0x2f, 0x77, 0x03, 0x86,
+		     0xe4, 0x83, 0x6c, 0x99, 0xe3, 0x70, 0xcf, 0x9b,
+		     0xea, 0x00, 0x80, 0x3f, 0x5e, 0x48, 0x23, 0x57,
+		     0xa4, 0xae, 0x12, 0xd4, 0x14, 0xa3, 0xe6, 0x3b,
+		     0x5d, 0x31, 0xe2, 0x76, 0xf8, 0xfe, 0x4a, 0x8d,
+		     0x66, 0xb3, 0x17, 0xf9, 0xac, 0x68, 0x3f, 0x44,
+		     0x68, 0x0a, 0x86, 0xac, 0x35, 0xad, 0xfc, 0x33,
+		     0x45, 0xbe, 0xfe, 0xcb, 0x4b, 0xb1, 0x88, 0xfd,
+		     0x57, 0x76, 0x92, 0x6c, 0x49, 0xa3, 0x09, 0x5e,
+		     0xb1, 0x08, 0xfd, 0x10, 0x98, 0xba, 0xec, 0x70,
+		     0xaa, 0xa6, 0x69, 0x99, 0xa7, 0x2a, 0x82, 0xf2,
+		     0x7d, 0x84, 0x8b, 0x21, 0xd4, 0xa7, 0x41, 0xb0,
+		     0xc5, 0xcd, 0x4d, 0x5f, 0xff, 0x9d, 0xac, 0x89,
+		     0xae, 0xba, 0x12, 0x29, 0x61, 0xd0, 0x3a, 0x75,
+		     0x71, 0x23, 0xe9, 0x87, 0x0f, 0x8a, 0xcf, 0x10,
+		     0x00, 0x02, 0x08, 0x87, 0x89, 0x14, 0x29, 0xca,
+		     0x2a, 0x3e, 0x7a, 0x7d, 0x7d, 0xf7, 0xb1, 0x03,
+		     0x55, 0x16, 0x5c, 0x8b, 0x9a, 0x6d, 0x0a, 0x7d,
+		     0xe8, 0xb0, 0x62, 0xc4, 0x50, 0x0d, 0xc4, 0xcd,
+		     0x12, 0x0c, 0x0f, 0x74, 0x18, 0xda, 0xe3, 0xd0,
+		     0xb5, 0x78, 0x1c, 0x34, 0x80, 0x3f, 0xa7, 0x54,
+		     0x21, 0xc7, 0x90, 0xdf, 0xe1, 0xde, 0x18, 0x34,
+		     0xf2, 0x80, 0xd7, 0x66, 0x7b, 0x32, 0x7f, 0x6c,
+		     0x8c, 0xd7, 0x55, 0x7e, 0x12, 0xac, 0x3a, 0x0f,
+		     0x93, 0xec, 0x05, 0xc5, 0x2e, 0x04, 0x93, 0xef,
+		     0x31, 0xa1, 0x2d, 0x3d, 0x92, 0x60, 0xf7, 0x9a,
+		     0x28, 0x9d, 0x6a, 0x37, 0x9b, 0xc7, 0x0c, 0x50,
+		     0x84, 0x14, 0x73, 0xd1, 0xa8, 0xcc, 0x81, 0xec,
+		     0x58, 0x3e, 0x96, 0x45, 0xe0, 0x7b, 0x8d, 0x96,
+		     0x70, 0x65, 0x5b, 0xa5, 0xbb, 0xcf, 0xec, 0xc6,
+		     0xdc, 0x39, 0x66, 0x38, 0x0a, 0xd8, 0xfe, 0xcb,
+		     0x17, 0xb6, 0xba, 0x02, 0x46, 0x9a, 0x02, 0x0a,
+		     0x84, 0xe1, 0x8e, 0x8f, 0x84, 0x25, 0x20, 0x70,
+		     0xc1, 0x3e, 0x9f, 0x1f, 0x28, 0x9b, 0xe5, 0x4f,
+		     0xbc, 0x48, 0x14, 0x57, 0x77, 0x8f, 0x61, 0x60,
+		     0x15, 0xe1, 0x32, 0x7a, 0x02, 0xb1, 0x40, 0xf1,
+		     0x50, 0x5e, 0xb3, 0x09, 0x32, 0x6d, 0x68, 0x37,
+		     0x8f, 0x83, 0x74, 0x59, 0x5c, 0x84, 0x9d, 0x84,
+		     0xf4, 0xc3, 0x33, 0xec, 0x44, 0x23, 0x88, 0x51,
+		     0x43, 0xcb, 0x47, 0xbd, 0x71, 0xc5, 0xed, 0xae,
+		     0x9b, 0xe6, 0x9a, 0x2f, 0xfe, 0xce, 0xb1, 0xbe,
+		     0xc9, 0xde, 0x24, 0x4f, 0xbe, 0x15, 0x99, 0x2b,
+		     0x11, 0xb7, 0x7c, 0x04, 0x0f, 0x12, 0xbd, 0x8f,
+		     0x6a, 0x97, 0x5a, 0x44, 0xa0, 0xf9, 0x0c, 0x29,
+		     0xa9, 0xab, 0xc3, 0xd4, 0xd8, 0x93, 0x92, 0x72,
+		     0x84, 0xc5, 0x87, 0x54, 0xcc, 0xe2, 0x94, 0x52,
+		     0x9f, 0x86, 0x14, 0xdc, 0xd2, 0xab, 0xa9, 0x91,
+		     0x92, 0x5f, 0xed, 0xc4, 0xae, 0x74, 0xff, 0xac,
+		     0x6e, 0x33, 0x3b, 0x93, 0xeb, 0x4a, 0xff, 0x04,
+		     0x79, 0xda, 0x9a, 0x41, 0x0e, 0x44, 0x50, 0xe0,
+		     0xdd, 0x7a, 0xe4, 0xc6, 0xe2, 0x91, 0x09, 0x00,
+		     0x57, 0x5d, 0xa4, 0x01, 0xfc, 0x07, 0x05, 0x9f,
+		     0x64, 0x5e, 0x8b, 0x7e, 0x9b, 0xfd, 0xef, 0x33,
+		     0x94, 0x30, 0x54, 0xff, 0x84, 0x01, 0x14, 0x93,
+		     0xc2, 0x7b, 0x34, 0x29, 0xea, 0xed, 0xb4, 0xed,
+		     0x53, 0x76, 0x44, 0x1a, 0x77, 0xed, 0x43, 0x85,
+		     0x1a, 0xd7, 0x7f, 0x16, 0xf5, 0x41, 0xdf, 0xd2,
+		     0x69, 0xd5, 0x0d, 0x6a, 0x5f, 0x14, 0xfb, 0x0a,
+		     0xab, 0x1c, 0xbb, 0x4c, 0x15, 0x50, 0xbe, 0x97,
+		     0xf7, 0xab, 0x40, 0x66, 0x19, 0x3c, 0x4c, 0xaa,
+		     0x77, 0x3d, 0xad, 0x38, 0x01, 0x4b, 0xd2, 0x09,
+		     0x2f, 0xa7, 0x55, 0xc8, 0x24, 0xbb, 0x5e, 0x54,
+		     0xc4, 0xf3, 0x6f, 0xfd, 0xa9, 0xfc, 0xea, 0x70,
+		     0xb9, 0xc6, 0xe6, 0x93, 0xe1, 0x48, 0xc1, 0x51 ), AUTH() );
+
 /**
- * Perform AES self-test
+ * Perform AES correctness tests
  *
  */
-static void aes_test_exec ( void ) {
-	struct cipher_algorithm *ecb = &aes_ecb_algorithm;
-	struct cipher_algorithm *cbc = &aes_cbc_algorithm;
-	unsigned int keylen;
+static void aes_test_all ( void ) {
 
-	/* Correctness tests */
 	cipher_ok ( &aes_128_ecb );
 	cipher_ok ( &aes_128_cbc );
 	cipher_ok ( &aes_192_ecb );
 	cipher_ok ( &aes_192_cbc );
 	cipher_ok ( &aes_256_ecb );
 	cipher_ok ( &aes_256_cbc );
+	cipher_ok ( &aes_128_xts_1 );
+	cipher_ok ( &aes_128_xts_2 );
+	cipher_ok ( &aes_128_xts_3 );
+	cipher_ok ( &aes_256_xts_10 );
+}
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+
+/**
+ * Perform AES tests for a specific x86 implementation
+ *
+ * @v impl		AES implementation
+ * @v name		Implementation name
+ */
+static void aes_test_x86 ( enum x86_aes_impl impl, const char *name ) {
+	enum x86_aes_impl saved = x86_aes_impl;
+	unsigned int keylen;
+
+	/* Skip implementations not supported by this CPU */
+	if ( x86_aes_force ( impl ) != 0 ) {
+		DBG ( "AES (%s) not supported\n", name );
+		return;
+	}
+
+	/* Perform tests */
+	aes_test_all();
+	for ( keylen = 128 ; keylen <= 256 ; keylen += 64 ) {
+		DBG ( "AES-%d-ECB (%s) encryption required %ld cycles per "
+		      "byte\n", keylen, name,
+		      cipher_cost_encrypt ( &aes_ecb_algorithm,
+					    ( keylen / 8 ) ) );
+		DBG ( "AES-%d-ECB (%s) decryption required %ld cycles per "
+		      "byte\n", keylen, name,
+		      cipher_cost_decrypt ( &aes_ecb_algorithm,
+					    ( keylen / 8 ) ) );
+	}
+
+	/* Restore original implementation */
+	x86_aes_force ( saved );
+}
+
+#endif
+
+/**
+ * Perform AES self-test
+ *
+ */
+static void aes_test_exec ( void ) {
+	struct cipher_algorithm *ecb = &aes_ecb_algorithm;
+	struct cipher_algorithm *cbc = &aes_cbc_algorithm;
+	struct cipher_algorithm *xts = &aes_xts_algorithm;
+	unsigned int keylen;
+
+	/* Correctness tests */
+	aes_test_all();
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+	/* Implementation-specific tests */
+	aes_test_x86 ( X86_AES_GENERIC, "tables" );
+	aes_test_x86 ( X86_AES_NI, "AES-NI" );
+#endif
 
 	/* Speed tests */
 	for ( keylen = 128 ; keylen <= 256 ; keylen += 64 ) {
@@ -184,6 +439,12 @@ static void aes_test_exec ( void ) {
 		DBG ( "AES-%d-CBC decryption required %ld cycles per byte\n",
 		      keylen, cipher_cost_decrypt ( cbc, ( keylen / 8 ) ) );
 	}
+	for ( keylen = 128 ; keylen <= 256 ; keylen += 128 ) {
+		DBG ( "AES-%d-XTS encryption required %ld cycles per byte\n",
+		      keylen, cipher_cost_encrypt ( xts, ( keylen / 4 ) ) );
+		DBG ( "AES-%d-XTS decryption required %ld cycles per byte\n",
+		      keylen, cipher_cost_decrypt ( xts, ( keylen / 4 ) ) );
+	}
 }
 
 /** AES self-test */
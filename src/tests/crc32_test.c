@@ -34,15 +34,27 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
  *
  *    printf "%#08x", crc ( $data, 32, $seed, 0, 1, 0x04c11db7, 1 );
  *
+ * Pattern test vectors are calculated over the data generated by
+ * crc32_pattern(), with @c data[i] = ( ( i * 0x5b ) ^ ( i >> 8 ) ).
+ *
  */
 
 /* Forcibly enable assertions */
 #undef NDEBUG
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ipxe/crc32.h>
+#include <ipxe/profile.h>
 #include <ipxe/test.h>
 
+/** Number of sample iterations for profiling */
+#define PROFILE_COUNT 16
+
+/** Length of pattern data */
+#define CRC32_PATTERN_LEN 4096
+
 /** Define inline data */
 #define DATA(...) { __VA_ARGS__ }
 
@@ -87,6 +99,52 @@ struct crc32_test {
 	ok ( crc32 == (test)->crc32 );					\
 	} while ( 0 )
 
+/** A CRC32 pattern test */
+struct crc32_pattern_test {
+	/** Offset within pattern data */
+	size_t offset;
+	/** Length of test data */
+	size_t len;
+	/** Seed */
+	uint32_t seed;
+	/** Expected CRC32 */
+	uint32_t crc32;
+};
+
+/**
+ * Define a CRC32 pattern test
+ *
+ * @v name		Test name
+ * @v OFFSET		Offset within pattern data
+ * @v LEN		Length of test data
+ * @v SEED		Seed
+ * @v CRC32		Expected CRC32
+ * @ret test		CRC32 pattern test
+ */
+#define CRC32_PATTERN_TEST( name, OFFSET, LEN, SEED, CRC32 )		\
+	static struct crc32_pattern_test name = {			\
+		.offset = OFFSET,					\
+		.len = LEN,						\
+		.seed = SEED,						\
+		.crc32 = CRC32,						\
+	};
+
+/** Pattern data */
+static uint8_t crc32_pattern_data[CRC32_PATTERN_LEN];
+
+/**
+ * Report a CRC32 pattern test result
+ *
+ * @v test		CRC32 pattern test
+ */
+#define crc32_pattern_ok( test ) do {					\
+	const void *data = ( crc32_pattern_data + (test)->offset );	\
+	ok ( crc32_le ( (test)->seed, data, (test)->len ) ==		\
+	     (test)->crc32 );						\
+	ok ( generic_crc32_le ( (test)->seed, data, (test)->len ) ==	\
+	     (test)->crc32 );						\
+	} while ( 0 )
+
 /* CRC32 tests */
 CRC32_TEST ( empty_test,
 	     DATA ( ),
@@ -101,16 +159,158 @@ CRC32_TEST ( hw_split_part2_test,
 	     DATA ( ' ', 'w', 'o', 'r', 'l', 'd' ),
 	     0xc9ef5979UL, 0xf2b5ee7aUL );
 
+/* CRC32 pattern tests */
+CRC32_PATTERN_TEST ( pattern_all_test, 0, 4096, 0xffffffffUL, 0x48e52b9fUL );
+CRC32_PATTERN_TEST ( pattern_unaligned_test,
+		     1, 4095, 0xffffffffUL, 0x4b3bfed3UL );
+CRC32_PATTERN_TEST ( pattern_zero_seed_test, 3, 1000, 0, 0xf24dee6aUL );
+CRC32_PATTERN_TEST ( pattern_min_test, 0, 64, 0xffffffffUL, 0x057f838bUL );
+CRC32_PATTERN_TEST ( pattern_short_test,
+		     5, 63, 0x12345678UL, 0x5a7bc703UL );
+CRC32_PATTERN_TEST ( pattern_partial_test,
+		     7, 79, 0xffffffffUL, 0x7611d6c3UL );
+CRC32_PATTERN_TEST ( pattern_seed_test,
+		     16, 4080, 0x87654321UL, 0xdcc13285UL );
+
 /**
- * Perform CRC32 self-tests
+ * Generate pattern data
  *
  */
-static void crc32_test_exec ( void ) {
+static void crc32_pattern ( void ) {
+	unsigned int i;
+
+	for ( i = 0 ; i < sizeof ( crc32_pattern_data ) ; i++ )
+		crc32_pattern_data[i] = ( ( i * 0x5b ) ^ ( i >> 8 ) );
+}
+
+/**
+ * Check CRC32 consistency across lengths and split points
+ *
+ */
+static void crc32_consistency_ok ( void ) {
+	const uint8_t *data = crc32_pattern_data;
+	uint32_t crc32;
+	size_t len;
+	size_t split;
+	int consistent = 1;
+
+	for ( len = 0 ; len <= 300 ; len++ ) {
+		crc32 = generic_crc32_le ( 0xffffffffUL, ( data + len ), len );
+		if ( crc32_le ( 0xffffffffUL, ( data + len ), len ) != crc32 )
+			consistent = 0;
+		split = ( len / 3 );
+		if ( crc32_le ( crc32_le ( 0xffffffffUL, ( data + len ), split ),
+				( data + len + split ),
+				( len - split ) ) != crc32 )
+			consistent = 0;
+	}
+	ok ( consistent );
+}
+
+/**
+ * Calculate CRC32 cost
+ *
+ * @v crc32		CRC32 implementation
+ * @ret cost		Cost (in cycles per byte)
+ */
+static unsigned long crc32_cost ( uint32_t ( * crc32 ) ( uint32_t seed,
+							  const void *data,
+							  size_t len ) ) {
+	static uint8_t random[8192]; /* Too large for stack */
+	struct profiler profiler;
+	unsigned long cost;
+	unsigned int i;
+
+	/* Fill buffer with pseudo-random data */
+	srand ( 0x1234568 );
+	for ( i = 0 ; i < sizeof ( random ) ; i++ )
+		random[i] = rand();
+
+	/* Profile CRC calculation */
+	memset ( &profiler, 0, sizeof ( profiler ) );
+	for ( i = 0 ; i < PROFILE_COUNT ; i++ ) {
+		profile_start ( &profiler );
+		crc32 ( 0xffffffffUL, random, sizeof ( random ) );
+		profile_stop ( &profiler );
+	}
+
+	/* Round to nearest whole number of cycles per byte */
+	cost = ( ( profile_mean ( &profiler ) + ( sizeof ( random ) / 2 ) ) /
+		 sizeof ( random ) );
+
+	return cost;
+}
+
+/**
+ * Perform CRC32 correctness tests
+ *
+ */
+static void crc32_test_all ( void ) {
 
 	crc32_ok ( &empty_test );
 	crc32_ok ( &hw_test );
 	crc32_ok ( &hw_split_part1_test );
 	crc32_ok ( &hw_split_part2_test );
+
+	/* Pattern tests */
+	crc32_pattern_ok ( &pattern_all_test );
+	crc32_pattern_ok ( &pattern_unaligned_test );
+	crc32_pattern_ok ( &pattern_zero_seed_test );
+	crc32_pattern_ok ( &pattern_min_test );
+	crc32_pattern_ok ( &pattern_short_test );
+	crc32_pattern_ok ( &pattern_partial_test );
+	crc32_pattern_ok ( &pattern_seed_test );
+	crc32_consistency_ok();
+}
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+
+/**
+ * Perform CRC32 tests for a specific x86 implementation
+ *
+ * @v impl		CRC32 implementation
+ * @v name		Implementation name
+ */
+static void crc32_test_x86 ( enum x86_crc32_impl impl, const char *name ) {
+	enum x86_crc32_impl saved = x86_crc32_impl;
+
+	/* Skip implementations not supported by this CPU */
+	if ( x86_crc32_force ( impl ) != 0 ) {
+		DBG ( "CRC32 (%s) not supported\n", name );
+		return;
+	}
+
+	/* Perform tests */
+	crc32_test_all();
+	DBG ( "CRC32 (%s) required %ld cycles per byte\n",
+	      name, crc32_cost ( crc32_le ) );
+
+	/* Restore original implementation */
+	x86_crc32_force ( saved );
+}
+
+#endif
+
+/**
+ * Perform CRC32 self-tests
+ *
+ */
+static void crc32_test_exec ( void ) {
+
+	/* Correctness tests */
+	crc32_pattern();
+	crc32_test_all();
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+	/* Implementation-specific tests */
+	crc32_test_x86 ( X86_CRC32_GENERIC, "x86 generic" );
+	crc32_test_x86 ( X86_CRC32_PCLMUL, "PCLMULQDQ" );
+#endif
+
+	/* Speed tests */
+	DBG ( "CRC32 required %ld cycles per byte\n", crc32_cost ( crc32_le ) );
+	DBG ( "CRC32 (generic) required %ld cycles per byte\n",
+	      crc32_cost ( generic_crc32_le ) );
 }
 
 /** CRC32 self-test */
@@ -36,8 +36,12 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 #include <stdlib.h>
 #include <string.h>
 #include <ipxe/deflate.h>
+#include <ipxe/profile.h>
 #include <ipxe/test.h>
 
+/** Number of sample iterations for profiling */
+#define PROFILE_COUNT 16
+
 /** A DEFLATE test */
 struct deflate_test {
 	/** Compression format */
@@ -143,6 +147,215 @@ static struct deflate_test_fragments zlib_fragments[] = {
 	{ { 48, -1UL } },
 };
 
+/** A DEFLATE generated text test */
+struct deflate_text_test {
+	/** Compression format */
+	enum deflate_format format;
+	/** Compressed data */
+	const void *compressed;
+	/** Length of compressed data */
+	size_t compressed_len;
+	/** Length of expected uncompressed (generated) text */
+	size_t expected_len;
+};
+
+/** Define a DEFLATE generated text test */
+#define DEFLATE_TEXT( name, FORMAT, COMPRESSED, EXPECTED_LEN )		\
+	static const uint8_t name ## _compressed[] = COMPRESSED;	\
+	static struct deflate_text_test name = {			\
+		.format = FORMAT,					\
+		.compressed = name ## _compressed,			\
+		.compressed_len = sizeof ( name ## _compressed ),	\
+		.expected_len = EXPECTED_LEN,				\
+	};
+
+/** Generated text vocabulary */
+static const char *deflate_text_words[] = {
+	"boot", "image", "kernel", "initrd", "network", "disk", "iPXE", "the",
+	"and", "of", "to", "a", "in", "is", "for", "with", "loading", "from",
+	"http", "tftp", "chain", "script", "menu", "device", "--------",
+	"lalalala",
+};
+
+/* Generated text, dynamic Huffman alphabet
+ *
+ * The occasional random bytes within the generated text give rise to
+ * literal/length and distance codes longer than the fast lookup root
+ * table lengths.
+ */
+DEFLATE_TEXT ( text_dynamic, DEFLATE_RAW,
+	  DATA ( 0x65, 0x57, 0x4b, 0x92, 0xe3, 0x54, 0x10, 0xdc, 0xeb, 0x14,
+		 0xda, 0xb0, 0x44, 0xb7, 0x60, 0x0d, 0x4b, 0xb6, 0x9a, 0xb6,
+		 0x7b, 0xac, 0xe8, 0x6e, 0x79, 0xc2, 0x36, 0xcc, 0x9a, 0x08,
+		 0xee, 0xc0, 0x96, 0xeb, 0x70, 0x0d, 0x4e, 0x42, 0xe5, 0xaf,
+		 0x9e, 0xdc, 0x40, 0x44, 0x5b, 0xef, 0x53, 0x59, 0x99, 0x59,
+		 0xf5, 0x9e, 0x34, 0x97, 0xc7, 0xe3, 0xdb, 0xfc, 0xb8, 0xce,
+		 0xd7, 0x57, 0xfc, 0x7d, 0x3b, 0xdf, 0xf6, 0xf3, 0xfb, 0x7c,
+		 0x7f, 0xb9, 0x6d, 0xdf, 0x1e, 0xf3, 0x97, 0xeb, 0xf5, 0x31,
+		 0x6f, 0xf7, 0xf9, 0xe3, 0xbc, 0xff, 0x36, 0xbf, 0x5f, 0xd7,
+		 0xd3, 0xb6, 0x7f, 0xd5, 0xe4, 0xf7, 0xed, 0x71, 0x99, 0xb7,
+		 0x7d, 0x7b, 0xdc, 0x4e, 0xd9, 0xec, 0x98, 0x1f, 0xfd, 0x1f,
+		 0x00, 0x3d, 0x55, 0x08, 0xeb, 0x7e, 0x9a, 0x4f, 0xdb, 0xfd,
+		 0x2d, 0x53, 0x95, 0xaa, 0x66, 0x1f, 0x97, 0x33, 0xb6, 0xd5,
+		 0x13, 0xf1, 0x92, 0xe1, 0xe5, 0xb2, 0x6e, 0xfb, 0x7c, 0x01,
+		 0x31, 0xce, 0x93, 0xc6, 0xeb, 0xed, 0xfa, 0xd1, 0x1c, 0x38,
+		 0x38, 0x9d, 0x7f, 0xdf, 0x5e, 0x08, 0x00, 0x74, 0x6e, 0xdf,
+		 0x7e, 0xf9, 0xf5, 0x27, 0xc8, 0xe0, 0x40, 0x30, 0xd0, 0xf5,
+		 0x5a, 0x48, 0x48, 0x77, 0x9d, 0x19, 0xc8, 0xf1, 0xfb, 0xaa,
+		 0xff, 0xad, 0x62, 0x99, 0xb8, 0xa4, 0x18, 0xe9, 0xde, 0xb5,
+		 0x5b, 0x53, 0x23, 0x50, 0xe3, 0x22, 0xa8, 0x07, 0xe4, 0xb6,
+		 0x11, 0x9f, 0x20, 0xe5, 0xd4, 0x7e, 0x7e, 0x7c, 0xbf, 0xde,
+		 0xde, 0xe6, 0xd7, 0xeb, 0x4d, 0x44, 0x08, 0x9e, 0x59, 0x61,
+		 0x50, 0x25, 0x80, 0x6c, 0x3f, 0x65, 0x6c, 0x1f, 0xeb, 0xd7,
+		 0x33, 0x68, 0x7b, 0x12, 0x66, 0x49, 0xc9, 0x5e, 0x09, 0x67,
+		 0xab, 0xa7, 0xa9, 0x42, 0x89, 0x7d, 0xc1, 0xb6, 0xfb, 0x99,
+		 0x5e, 0x0f, 0x58, 0x07, 0xc8, 0xae, 0x17, 0x15, 0x56, 0x3a,
+		 0x87, 0x11, 0xb8, 0x86, 0x3f, 0x1f, 0x13, 0x05, 0xcb, 0x73,
+		 0xd1, 0xed, 0xce, 0x28, 0xab, 0x03, 0x5c, 0xe5, 0x45, 0x29,
+		 0xd8, 0x38, 0x06, 0x0c, 0xf7, 0x60, 0x6c, 0xf7, 0x65, 0x5a,
+		 0x65, 0x31, 0x52, 0x2f, 0x53, 0x78, 0xc3, 0x29, 0x29, 0x8a,
+		 0x1d, 0xea, 0x33, 0x02, 0xc0, 0xa5, 0xa6, 0xdc, 0x0f, 0xac,
+		 0xf7, 0xca, 0x7e, 0x5a, 0x97, 0x89, 0xd4, 0x0f, 0xb4, 0x97,
+		 0xa9, 0x98, 0x95, 0x7c, 0x19, 0x2a, 0x30, 0x43, 0x37, 0xc2,
+		 0x48, 0x8a, 0x27, 0x64, 0xb1, 0xa9, 0xdd, 0x26, 0x6a, 0x57,
+		 0xc7, 0x69, 0xd1, 0x39, 0x2c, 0x90, 0x15, 0x66, 0x5f, 0x37,
+		 0xef, 0xe7, 0xbe, 0x46, 0x05, 0xe3, 0xb2, 0xc8, 0x38, 0x72,
+		 0x34, 0xb8, 0x3a, 0xaf, 0xce, 0xcb, 0xdc, 0xcd, 0x54, 0xdc,
+		 0xff, 0x34, 0x20, 0x1d, 0xd0, 0x16, 0xb8, 0x9b, 0x6e, 0x97,
+		 0x5e, 0x9c, 0x2e, 0xd1, 0x1a, 0x5a, 0x62, 0x69, 0x7e, 0x5d,
+		 0x30, 0x06, 0x00, 0x6c, 0x99, 0x3a, 0x8d, 0x38, 0x94, 0xf6,
+		 0xaa, 0xb9, 0xb7, 0xb5, 0xe1, 0x6c, 0xbd, 0x22, 0x3f, 0x9a,
+		 0x11, 0x86, 0x8e, 0xc6, 0x5f, 0xe7, 0x24, 0xc0, 0xb9, 0xa6,
+		 0xcd, 0x83, 0x43, 0xea, 0x6d, 0xb3, 0xd8, 0x12, 0x4c, 0x46,
+		 0x78, 0xfe, 0x51, 0x48, 0x55, 0x88, 0xaa, 0xee, 0x03, 0xad,
+		 0x72, 0x8e, 0x0a, 0xe1, 0x02, 0x30, 0xb3, 0x3f, 0x0c, 0x36,
+		 0x3a, 0x4e, 0x17, 0x92, 0x52, 0x63, 0x23, 0x25, 0x32, 0xcd,
+		 0xc8, 0x25, 0xf8, 0x3a, 0x3d, 0xcd, 0x90, 0x64, 0x86, 0x60,
+		 0x90, 0x8e, 0x92, 0xc1, 0x93, 0x50, 0x99, 0x86, 0x15, 0xec,
+		 0x36, 0x97, 0x2e, 0xea, 0x08, 0xd2, 0xc1, 0xac, 0x72, 0x5b,
+		 0xeb, 0x66, 0x41, 0x81, 0x0e, 0x64, 0xf6, 0x9c, 0x34, 0xd1,
+		 0x29, 0x29, 0x7a, 0xa0, 0x12, 0x02, 0x58, 0x64, 0x79, 0x9a,
+		 0xec, 0x6d, 0x46, 0x26, 0x0e, 0xe9, 0xc7, 0x55, 0x99, 0xc5,
+		 0xbe, 0xa3, 0xa8, 0x05, 0x09, 0xd4, 0xfb, 0x04, 0xcf, 0x26,
+		 0x08, 0xa2, 0xc2, 0x21, 0x58, 0x75, 0x77, 0x33, 0x71, 0xad,
+		 0xa5, 0xb8, 0x11, 0x8f, 0xf4, 0x0c, 0xaa, 0xfb, 0xf7, 0xce,
+		 0x7b, 0x8e, 0x54, 0x6c, 0x10, 0xe7, 0x93, 0xac, 0x71, 0x64,
+		 0x49, 0x99, 0xd6, 0x33, 0x74, 0xa6, 0x18, 0x3f, 0x5b, 0x57,
+		 0x13, 0x2d, 0x91, 0x55, 0xcb, 0x28, 0xf6, 0xe7, 0x78, 0x66,
+		 0x5e, 0xc0, 0xe8, 0xcd, 0x35, 0x27, 0xd8, 0xb7, 0x13, 0x81,
+		 0xa1, 0xb6, 0x30, 0x49, 0x90, 0x7f, 0xd8, 0x13, 0x4f, 0x1c,
+		 0x55, 0x85, 0xcf, 0xf8, 0xed, 0x3c, 0xf7, 0xf2, 0x2e, 0xad,
+		 0xba, 0x20, 0x0f, 0x8f, 0x3d, 0xde, 0x30, 0xff, 0x3b, 0xa4,
+		 0xb4, 0xce, 0xb3, 0xae, 0x65, 0xe5, 0xae, 0x3a, 0x20, 0x24,
+		 0x84, 0x49, 0xeb, 0xe8, 0xa7, 0xad, 0xc1, 0x51, 0x30, 0x89,
+		 0xbf, 0x48, 0xb2, 0x9d, 0xe2, 0x88, 0x76, 0xc5, 0x56, 0x83,
+		 0x7b, 0xbb, 0x00, 0x9c, 0x37, 0x69, 0xbc, 0x46, 0xb2, 0x75,
+		 0x46, 0xbb, 0xf9, 0xb4, 0x99, 0x56, 0xa0, 0x41, 0x70, 0xf3,
+		 0x04, 0x35, 0x09, 0xeb, 0x92, 0xb0, 0x85, 0x7d, 0x21, 0xac,
+		 0x11, 0x4b, 0xb3, 0x96, 0x49, 0xa7, 0x18, 0x94, 0xdb, 0xa7,
+		 0x24, 0xc4, 0x61, 0x94, 0xd3, 0x6a, 0x3e, 0x25, 0xcc, 0x8d,
+		 0x62, 0x96, 0xf2, 0xbc, 0x63, 0xe9, 0x71, 0xd2, 0x27, 0x15,
+		 0x7c, 0x03, 0x58, 0xfd, 0xc2, 0x76, 0xe3, 0xe7, 0x8c, 0xf0,
+		 0x15, 0x3f, 0x9a, 0xc5, 0x26, 0x2a, 0x25, 0xe1, 0xaa, 0x5a,
+		 0xfc, 0x75, 0x78, 0xfd, 0xb0, 0x3c, 0xa4, 0x16, 0x7d, 0x51,
+		 0x0e, 0x97, 0x44, 0x29, 0x2b, 0x6e, 0xf2, 0x66, 0xd8, 0xe5,
+		 0xe4, 0x17, 0x10, 0x30, 0x87, 0x72, 0xb2, 0x94, 0x04, 0xfb,
+		 0x16, 0x14, 0x26, 0xa3, 0x57, 0x99, 0xc9, 0x2f, 0x0f, 0x5f,
+		 0x51, 0x14, 0x6f, 0xe8, 0xeb, 0x54, 0xb0, 0x2a, 0x87, 0x43,
+		 0x87, 0x31, 0xa8, 0xee, 0xfd, 0x65, 0x12, 0x57, 0xf6, 0x45,
+		 0x51, 0x31, 0xf3, 0x9c, 0x8c, 0x50, 0x45, 0x75, 0x48, 0x40,
+		 0x1d, 0x57, 0x12, 0x99, 0x14, 0xb9, 0x18, 0xf9, 0x4f, 0xfa,
+		 0xb7, 0xf2, 0x85, 0x16, 0x8c, 0x60, 0xcb, 0xd4, 0x1c, 0x63,
+		 0x47, 0xf5, 0xf4, 0xb6, 0x25, 0x44, 0x0e, 0x94, 0x80, 0x79,
+		 0x4d, 0xf7, 0x0d, 0x0b, 0xf6, 0x5d, 0xc9, 0x22, 0xe7, 0xb2,
+		 0x31, 0xae, 0xe7, 0x19, 0x68, 0x9e, 0x72, 0xa2, 0xa2, 0x56,
+		 0x7f, 0xd2, 0xed, 0xf8, 0x6e, 0x4b, 0x37, 0x15, 0x1f, 0x20,
+		 0x82, 0x53, 0x9d, 0xc1, 0xba, 0xca, 0xa1, 0xca, 0x91, 0x34,
+		 0x47, 0x04, 0x3d, 0x43, 0xdb, 0xb2, 0xaa, 0xaf, 0xc5, 0x28,
+		 0xa3, 0x1a, 0xe6, 0x72, 0xab, 0x3c, 0xdb, 0xf3, 0x03, 0x32,
+		 0x38, 0xe9, 0x78, 0x3f, 0x1c, 0xc1, 0x97, 0x49, 0x23, 0x16,
+		 0x9a, 0x89, 0x4a, 0x5d, 0xd0, 0x11, 0x9d, 0x67, 0xae, 0x71,
+		 0xd7, 0xb3, 0x68, 0xf3, 0x5a, 0xd1, 0xd0, 0xdc, 0x43, 0x4a,
+		 0x87, 0x3e, 0x6a, 0x7b, 0x18, 0x7c, 0x50, 0x5a, 0x05, 0x07,
+		 0xdb, 0x5e, 0xd7, 0x12, 0x5e, 0x2f, 0x45, 0x35, 0x3d, 0xcc,
+		 0x49, 0xb5, 0x02, 0x4a, 0xcc, 0x0c, 0xdd, 0x53, 0xce, 0xdd,
+		 0x7b, 0xf7, 0x63, 0xff, 0xaa, 0xd7, 0xc7, 0xf7, 0xd8, 0xe7,
+		 0xa8, 0xe1, 0x87, 0x88, 0xb1, 0xd6, 0xc8, 0x01, 0xd5, 0x46,
+		 0xae, 0xd2, 0x60, 0x54, 0x3f, 0xb1, 0x21, 0xb9, 0xaa, 0x7c,
+		 0xcb, 0xf4, 0x2f, 0xb6, 0xbb, 0xdf, 0xb2, 0x70, 0x7d, 0x5d,
+		 0x26, 0x3b, 0x9e, 0xa9, 0x74, 0x64, 0xff, 0xbb, 0x84, 0x25,
+		 0xf6, 0x77, 0x42, 0xb7, 0xf1, 0xb3, 0x19, 0x8e, 0x71, 0x55,
+		 0xf3, 0xb2, 0x2f, 0x22, 0x01, 0x6d, 0x39, 0xd5, 0x56, 0xc4,
+		 0x70, 0x52, 0xdd, 0x61, 0xf9, 0xac, 0x6f, 0x1d, 0x3c, 0xe0,
+		 0x14, 0xca, 0xcd, 0x72, 0x94, 0x3c, 0xca, 0x87, 0xc6, 0x7a,
+		 0xae, 0x05, 0x19, 0x85, 0x01, 0x01, 0x7a, 0xbd, 0x23, 0x04,
+		 0x44, 0xcc, 0xc8, 0xc4, 0x1d, 0xc6, 0x1e, 0xd1, 0x31, 0x2d,
+		 0xff, 0x60, 0x13, 0x06, 0xcb, 0xc4, 0x29, 0xdf, 0x42, 0x51,
+		 0xd2, 0xa0, 0xa5, 0xae, 0x71, 0x11, 0xb2, 0x1e, 0xde, 0xe8,
+		 0xa4, 0xca, 0x34, 0xa9, 0x84, 0x88, 0x75, 0x00, 0x33, 0x9a,
+		 0x02, 0xbb, 0xa4, 0x7c, 0xc1, 0x2d, 0x82, 0x16, 0xc3, 0x59,
+		 0x13, 0x51, 0xe5, 0xef, 0x52, 0x07, 0xeb, 0xa8, 0x94, 0x8b,
+		 0x02, 0xcf, 0x72, 0x27, 0xd1, 0x9b, 0x03, 0x27, 0x99, 0x4f,
+		 0x42, 0xbb, 0x33, 0x4f, 0x7d, 0x6e, 0x22, 0x15, 0xda, 0x05,
+		 0xdc, 0xad, 0x91, 0x27, 0x28, 0x57, 0x18, 0x29, 0x0e, 0x67,
+		 0x18, 0xcd, 0x61, 0x09, 0xaf, 0x2a, 0x24, 0x1b, 0xab, 0x14,
+		 0x73, 0x98, 0x87, 0xfc, 0xf5, 0x12, 0x60, 0xd0, 0xf3, 0x29,
+		 0x48, 0x5c, 0x42, 0x90, 0xfe, 0x6f, 0x84, 0x70, 0x5b, 0xb5,
+		 0x19, 0x15, 0xc1, 0x0b, 0x3e, 0x0c, 0xbb, 0x0f, 0x4a, 0xa5,
+		 0x97, 0xfe, 0x22, 0xbc, 0x04, 0xca, 0xf0, 0x52, 0x83, 0xc0,
+		 0xc3, 0x0b, 0xa8, 0x86, 0x49, 0x24, 0x6f, 0x73, 0xdb, 0x93,
+		 0x29, 0x53, 0x76, 0x86, 0x30, 0xeb, 0x09, 0x60, 0x2b, 0x55,
+		 0xc1, 0x50, 0x3a, 0xa5, 0xe1, 0x75, 0xcd, 0x87, 0x14, 0x0b,
+		 0x83, 0x0e, 0x12, 0x6d, 0x85, 0x15, 0xb1, 0x80, 0xe6, 0x5a,
+		 0xa3, 0x8a, 0x2f, 0xff, 0x01 ), 4096 );
+
+/* Generated text, static Huffman alphabet */
+DEFLATE_TEXT ( text_static, DEFLATE_ZLIB,
+	  DATA ( 0x78, 0x01, 0xcb, 0x28, 0x29, 0x29, 0x50, 0x28, 0xc9, 0x57,
+		 0xc8, 0x4f, 0x03, 0x91, 0xd9, 0xa9, 0x45, 0x79, 0xa9, 0x39,
+		 0x0a, 0xc5, 0xc9, 0x45, 0x99, 0x05, 0x25, 0x0a, 0x49, 0xf9,
+		 0xf9, 0x25, 0x0a, 0x99, 0xc5, 0x0a, 0xb9, 0xa9, 0x79, 0xa5,
+		 0x0a, 0x39, 0xf9, 0x89, 0x29, 0x99, 0x79, 0xe9, 0x10, 0xc1,
+		 0xf2, 0xcc, 0x92, 0x0c, 0x85, 0xcc, 0xbc, 0xcc, 0x92, 0xa2,
+		 0x14, 0x98, 0x62, 0x28, 0xa5, 0x0b, 0x05, 0x20, 0x03, 0xa1,
+		 0x42, 0x40, 0x13, 0x12, 0xf3, 0x52, 0x14, 0x52, 0x32, 0x8b,
+		 0xb3, 0x61, 0x42, 0x40, 0xab, 0x80, 0xa2, 0x25, 0x19, 0xa9,
+		 0x20, 0x65, 0x40, 0x16, 0xd8, 0x3c, 0x98, 0x0d, 0xc9, 0x19,
+		 0x89, 0x99, 0x79, 0x0a, 0x19, 0x20, 0x87, 0x81, 0xc5, 0xc1,
+		 0x36, 0xa6, 0x15, 0xe5, 0xe7, 0xc2, 0x55, 0x80, 0x39, 0x29,
+		 0xa9, 0x65, 0x99, 0xc9, 0x60, 0x03, 0x40, 0xa6, 0x83, 0x95,
+		 0x67, 0x06, 0x44, 0xb8, 0x82, 0xcc, 0x06, 0x73, 0x20, 0xc6,
+		 0x80, 0xfc, 0x95, 0x06, 0x92, 0x2a, 0x06, 0x49, 0x80, 0x35,
+		 0x82, 0xf9, 0x39, 0x89, 0x10, 0x08, 0xf5, 0x85, 0x1e, 0x17,
+		 0x58, 0x0a, 0xa2, 0x07, 0xe2, 0xef, 0x3c, 0x05, 0x24, 0x21,
+		 0x84, 0x46, 0x08, 0x1f, 0x88, 0x20, 0x0c, 0x90, 0xdd, 0xd0,
+		 0x80, 0x40, 0x33, 0x12, 0x62, 0x4c, 0x5e, 0x6a, 0x49, 0x79,
+		 0x7e, 0x51, 0xb6, 0x42, 0x5a, 0x7e, 0x11, 0x44, 0x3f, 0x8a,
+		 0x28, 0xc4, 0x0c, 0xb0, 0x2f, 0x41, 0x06, 0x41, 0x83, 0x1f,
+		 0xec, 0x8d, 0xcc, 0xdc, 0xc4, 0xf4, 0x54, 0x90, 0xb3, 0xa1,
+		 0x82, 0xa0, 0xc0, 0x82, 0xf8, 0x04, 0x6c, 0x3b, 0xd4, 0xf7,
+		 0xe0, 0x40, 0x85, 0x98, 0x02, 0x0b, 0x1c, 0x98, 0xd9, 0xd0,
+		 0xa0, 0x86, 0x09, 0x27, 0x22, 0x99, 0x85, 0x64, 0x24, 0x3c,
+		 0xbe, 0xc0, 0x3e, 0x04, 0x2a, 0x81, 0x6a, 0x03, 0x1b, 0x0c,
+		 0xe4, 0xfa, 0x23, 0x5b, 0x04, 0x33, 0x0b, 0x2a, 0x06, 0xf3,
+		 0x37, 0x54, 0x14, 0x18, 0xd4, 0x30, 0x83, 0xf3, 0x21, 0x7e,
+		 0x00, 0x27, 0x1c, 0x58, 0x94, 0x43, 0xdd, 0x0e, 0x53, 0x9d,
+		 0x59, 0xac, 0xc7, 0x95, 0x08, 0xb1, 0x15, 0x44, 0xe8, 0x71,
+		 0x21, 0x87, 0x14, 0xc4, 0x47, 0xb0, 0xe0, 0x80, 0x58, 0x03,
+		 0x36, 0x00, 0x14, 0x4a, 0x70, 0x27, 0xc3, 0x19, 0xe0, 0xf8,
+		 0x4e, 0x04, 0xfb, 0x27, 0x51, 0x8f, 0x0b, 0xec, 0x54, 0x24,
+		 0x67, 0xeb, 0x71, 0x81, 0xd2, 0x08, 0x2c, 0x40, 0x21, 0x86,
+		 0x41, 0x8d, 0x46, 0xf8, 0x1e, 0x6e, 0x29, 0x88, 0x05, 0xb2,
+		 0x05, 0x1a, 0xa8, 0xf0, 0x38, 0x85, 0x24, 0x57, 0xa8, 0x3e,
+		 0x88, 0x24, 0xd4, 0x0e, 0xa8, 0x07, 0xc1, 0x31, 0x9c, 0x8f,
+		 0x14, 0xca, 0xb0, 0x98, 0x85, 0xf9, 0x18, 0xa4, 0x1f, 0x16,
+		 0xca, 0x10, 0xc7, 0x20, 0xe7, 0x33, 0xb0, 0x0c, 0x2c, 0xc7,
+		 0x25, 0x22, 0x2c, 0x06, 0xba, 0xbd, 0x05, 0x16, 0xac, 0xf0,
+		 0xf4, 0x03, 0x49, 0x21, 0xd0, 0xd4, 0x0e, 0xf1, 0x2f, 0x22,
+		 0x21, 0x20, 0xfc, 0x02, 0x0b, 0x52, 0x18, 0x0d, 0xf5, 0x3c,
+		 0x58, 0x2d, 0xc8, 0x30, 0x3d, 0xae, 0x1c, 0x00, 0x77, 0x33,
+		 0x67, 0xe0 ), 1024 );
+
 /**
  * Report DEFLATE test result
  *
@@ -207,6 +420,165 @@ static void deflate_okx ( struct deflate *deflate,
 #define deflate_ok( deflate, test, frags ) \
 	deflate_okx ( deflate, test, frags, __FILE__, __LINE__ )
 
+/**
+ * Generate text
+ *
+ * @v data		Buffer to fill in
+ * @v len		Length of buffer
+ *
+ * The generated text comprises pseudo-randomly chosen words from a
+ * fixed vocabulary, interspersed with occasional random bytes.
+ */
+static void deflate_text ( uint8_t *data, size_t len ) {
+	uint32_t seed = 0x1badb002;
+	const char *word;
+	const char *sep;
+	unsigned int random;
+
+	while ( len ) {
+
+		/* Generate pseudo-random number */
+		seed = ( ( seed * 1103515245 ) + 12345 );
+		random = ( seed >> 16 );
+
+		/* Append occasional random byte */
+		if ( ( random & 0x3f ) == 0 ) {
+			*(data++) = ( random >> 6 );
+			len--;
+			continue;
+		}
+
+		/* Append word and separator */
+		word = deflate_text_words[ random %
+					   ( sizeof ( deflate_text_words ) /
+					     sizeof ( deflate_text_words[0] ) ) ];
+		sep = ( ( ( random & 0x1f ) == 1 ) ? ".\n" : " " );
+		for ( ; *word && len ; len-- )
+			*(data++) = *(word++);
+		for ( ; *sep && len ; len-- )
+			*(data++) = *(sep++);
+	}
+}
+
+/**
+ * Decompress generated text
+ *
+ * @v deflate		Decompressor
+ * @v test		Generated text test
+ * @v data		Output buffer, or UNULL to count output
+ * @v frag_len		Length of each input fragment
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void deflate_text_inflate ( struct deflate *deflate,
+				   struct deflate_text_test *test,
+				   userptr_t data, size_t frag_len,
+				   const char *file, unsigned int line ) {
+	struct deflate_chunk in;
+	struct deflate_chunk out;
+	size_t offset;
+	size_t len;
+
+	/* Initialise decompressor and output chunk */
+	deflate_init ( deflate, test->format );
+	deflate_chunk_init ( &out, data, 0,
+			     ( ( data == UNULL ) ? 0 : test->expected_len ) );
+
+	/* Process input in fragments */
+	for ( offset = 0 ; offset < test->compressed_len ; offset += len ) {
+		len = ( test->compressed_len - offset );
+		if ( len > frag_len )
+			len = frag_len;
+		deflate_chunk_init ( &in, virt_to_user ( test->compressed ),
+				     offset, ( offset + len ) );
+		okx ( deflate_inflate ( deflate, &in, &out ) == 0, file, line );
+		okx ( in.offset == in.len, file, line );
+	}
+
+	/* Check decompression has terminated as expected */
+	okx ( deflate_finished ( deflate ), file, line );
+	okx ( out.offset == test->expected_len, file, line );
+}
+
+/**
+ * Report DEFLATE generated text test result
+ *
+ * @v deflate		Decompressor
+ * @v test		Generated text test
+ * @v frag_len		Length of each input fragment
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void deflate_text_okx ( struct deflate *deflate,
+			       struct deflate_text_test *test, size_t frag_len,
+			       const char *file, unsigned int line ) {
+	uint8_t *expected;
+	uint8_t *data;
+
+	/* Allocate buffers */
+	expected = malloc ( test->expected_len );
+	data = malloc ( test->expected_len );
+	okx ( expected != NULL, file, line );
+	okx ( data != NULL, file, line );
+	if ( ! ( expected && data ) )
+		goto err_alloc;
+
+	/* Generate expected text */
+	deflate_text ( expected, test->expected_len );
+
+	/* Count decompressed length */
+	deflate_text_inflate ( deflate, test, UNULL, frag_len, file, line );
+
+	/* Decompress and verify */
+	deflate_text_inflate ( deflate, test, virt_to_user ( data ), frag_len,
+			       file, line );
+	okx ( memcmp ( data, expected, test->expected_len ) == 0, file, line );
+
+ err_alloc:
+	free ( data );
+	free ( expected );
+}
+#define deflate_text_ok( deflate, test, frag_len ) \
+	deflate_text_okx ( deflate, test, frag_len, __FILE__, __LINE__ )
+
+/**
+ * Calculate DEFLATE decompression cost
+ *
+ * @v deflate		Decompressor
+ * @v test		Generated text test
+ * @ret cost		Cost (in cycles per decompressed byte)
+ */
+static unsigned long deflate_text_cost ( struct deflate *deflate,
+					 struct deflate_text_test *test ) {
+	struct profiler profiler;
+	unsigned long cost;
+	uint8_t *data;
+	unsigned int i;
+
+	/* Allocate buffer */
+	data = malloc ( test->expected_len );
+	if ( ! data )
+		return 0;
+
+	/* Profile decompression */
+	memset ( &profiler, 0, sizeof ( profiler ) );
+	for ( i = 0 ; i < PROFILE_COUNT ; i++ ) {
+		profile_start ( &profiler );
+		deflate_text_inflate ( deflate, test, virt_to_user ( data ),
+				       test->compressed_len, __FILE__, __LINE__ );
+		profile_stop ( &profiler );
+	}
+
+	/* Round to nearest whole number of cycles per byte */
+	cost = ( ( profile_mean ( &profiler ) + ( test->expected_len / 2 ) ) /
+		 test->expected_len );
+
+	/* Free buffer */
+	free ( data );
+
+	return cost;
+}
+
 /**
  * Perform DEFLATE self-test
  *
@@ -237,6 +609,20 @@ static void deflate_test_exec ( void ) {
 				    sizeof ( zlib_fragments[0] ) ) ; i++ ) {
 			deflate_ok ( deflate, &zlib, &zlib_fragments[i] );
 		}
+
+		/* Test generated text */
+		deflate_text_ok ( deflate, &text_dynamic, -1UL );
+		deflate_text_ok ( deflate, &text_dynamic, 1 );
+		deflate_text_ok ( deflate, &text_dynamic, 37 );
+		deflate_text_ok ( deflate, &text_dynamic, 256 );
+		deflate_text_ok ( deflate, &text_static, -1UL );
+		deflate_text_ok ( deflate, &text_static, 5 );
+
+		/* Benchmark decompression */
+		DBG ( "DEFLATE dynamic alphabet required %ld cycles per "
+		      "byte\n", deflate_text_cost ( deflate, &text_dynamic ) );
+		DBG ( "DEFLATE static alphabet required %ld cycles per "
+		      "byte\n", deflate_text_cost ( deflate, &text_static ) );
 	}
 
 	/* Free shared structure */
@@ -0,0 +1,247 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * Streaming decompression tests
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <stdint.h>
+#include <string.h>
+#include <ipxe/interface.h>
+#include <ipxe/xfer.h>
+#include <ipxe/xferbuf.h>
+#include <ipxe/umalloc.h>
+#include <ipxe/inflate.h>
+#include <ipxe/test.h>
+
+/** A streaming decompression test */
+struct inflate_test {
+	/** Compressed data */
+	const void *compressed;
+	/** Length of compressed data */
+	size_t compressed_len;
+	/** Expected uncompressed data (repeated) */
+	const void *expected;
+	/** Length of expected uncompressed data */
+	size_t expected_len;
+	/** Number of repetitions of expected uncompressed data */
+	unsigned int count;
+};
+
+/** A streaming decompression test recipient */
+struct inflate_test_recipient {
+	/** Data transfer interface */
+	struct interface xfer;
+	/** Data transfer buffer */
+	struct xfer_buffer buffer;
+	/** Buffer data */
+	userptr_t data;
+	/** Close status code */
+	int rc;
+	/** Interface has been closed */
+	int closed;
+};
+
+/** Define inline data */
+#define DATA(...) { __VA_ARGS__ }
+
+/** Define a streaming decompression test */
+#define INFLATE( name, COMPRESSED, EXPECTED, COUNT )			\
+	static const uint8_t name ## _compressed[] = COMPRESSED;	\
+	static const uint8_t name ## _expected[] = EXPECTED;		\
+	static struct inflate_test name = {				\
+		.compressed = name ## _compressed,			\
+		.compressed_len = sizeof ( name ## _compressed ),	\
+		.expected = name ## _expected,				\
+		.expected_len = sizeof ( name ## _expected ),		\
+		.count = COUNT,						\
+	};
+
+/** "Hello world" (zlib) */
+INFLATE ( zlib_hello_world,
+	  DATA ( 0x78, 0x9c, 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0x28, 0xcf,
+		 0x2f, 0xca, 0x49, 0x01, 0x00, 0x18, 0xab, 0x04, 0x3d ),
+	  DATA ( 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x77, 0x6f, 0x72, 0x6c,
+		 0x64 ), 1 );
+
+/** "Hello assorted headers" (gzip) */
+INFLATE ( gzip_hello_headers,
+	  DATA ( 0x1f, 0x8b, 0x08, 0x1c, 0x11, 0x5c, 0x96, 0x60, 0x00, 0x03,
+		 0x05, 0x00, 0x41, 0x70, 0x01, 0x00, 0x0d, 0x68, 0x77, 0x2e,
+		 0x74, 0x78, 0x74, 0x00, 0x2f, 0x2f, 0x77, 0x68, 0x79, 0x3f,
+		 0x00, 0xf3, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0x48, 0x2c, 0x2e,
+		 0xce, 0x2f, 0x2a, 0x49, 0x4d, 0x51, 0xc8, 0x48, 0x4d, 0x4c,
+		 0x49, 0x2d, 0x2a, 0x06, 0x00, 0x59, 0xa4, 0x19, 0x61, 0x16,
+		 0x00, 0x00, 0x00 ),
+	  DATA ( 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x20, 0x61, 0x73, 0x73, 0x6f,
+		 0x72, 0x74, 0x65, 0x64, 0x20, 0x68, 0x65, 0x61, 0x64, 0x65,
+		 0x72, 0x73 ), 1 );
+
+/** Highly compressible data (zlib) */
+INFLATE ( zlib_repeated,
+	  DATA ( 0x78, 0xda, 0xed, 0xc4, 0x21, 0x01, 0x00, 0x00, 0x08, 0x03,
+		 0xb0, 0x2a, 0x94, 0xc1, 0x23, 0xa9, 0xf0, 0xfe, 0x05, 0x48,
+		 0x81, 0xdb, 0xc4, 0x32, 0xdb, 0x15, 0x49, 0x92, 0x24, 0x49,
+		 0x92, 0x24, 0x49, 0x9f, 0x1d, 0x8f, 0x75, 0xb5, 0x3c ),
+	  DATA ( 0x69, 0x50, 0x58, 0x45, 0x20 ), 1000 );
+
+/** Highly compressible data (gzip) */
+INFLATE ( gzip_repeated,
+	  DATA ( 0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03,
+		 0xed, 0xc4, 0x21, 0x01, 0x00, 0x00, 0x08, 0x03, 0xb0, 0x2a,
+		 0x94, 0xc1, 0x23, 0xa9, 0xf0, 0xfe, 0x05, 0x48, 0x81, 0xdb,
+		 0xc4, 0x32, 0xdb, 0x15, 0x49, 0x92, 0x24, 0x49, 0x92, 0x24,
+		 0x49, 0x9f, 0x1d, 0x4c, 0xa0, 0x85, 0x63, 0x88, 0x13, 0x00,
+		 0x00 ),
+	  DATA ( 0x69, 0x50, 0x58, 0x45, 0x20 ), 1000 );
+
+/**
+ * Get test recipient data transfer buffer
+ *
+ * @v recipient		Test recipient
+ * @ret xferbuf		Data transfer buffer
+ */
+static struct xfer_buffer *
+inflate_test_buffer ( struct inflate_test_recipient *recipient ) {
+
+	return &recipient->buffer;
+}
+
+/**
+ * Close test recipient
+ *
+ * @v recipient		Test recipient
+ * @v rc		Reason for close
+ */
+static void inflate_test_close ( struct inflate_test_recipient *recipient,
+				 int rc ) {
+
+	intf_restart ( &recipient->xfer, rc );
+	recipient->rc = rc;
+	recipient->closed = 1;
+}
+
+/** Test recipient data transfer interface operations */
+static struct interface_operation inflate_test_operations[] = {
+	INTF_OP ( xfer_buffer, struct inflate_test_recipient *,
+		  inflate_test_buffer ),
+	INTF_OP ( intf_close, struct inflate_test_recipient *,
+		  inflate_test_close ),
+};
+
+/** Test recipient data transfer interface descriptor */
+static struct interface_descriptor inflate_test_desc =
+	INTF_DESC ( struct inflate_test_recipient, xfer,
+		    inflate_test_operations );
+
+/**
+ * Report streaming decompression test result
+ *
+ * @v test		Streaming decompression test
+ * @v frag_len		Length of each delivered fragment
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void inflate_okx ( struct inflate_test *test, size_t frag_len,
+			  const char *file, unsigned int line ) {
+	struct inflate_test_recipient recipient;
+	struct interface source = INTF_INIT ( null_intf_desc );
+	size_t offset;
+	size_t len;
+	unsigned int i;
+
+	/* Initialise recipient */
+	memset ( &recipient, 0, sizeof ( recipient ) );
+	intf_init ( &recipient.xfer, &inflate_test_desc, NULL );
+	xferbuf_umalloc_init ( &recipient.buffer, &recipient.data );
+	intf_plug_plug ( &source, &recipient.xfer );
+
+	/* Add decompression filter */
+	okx ( inflate_add ( &source, test->compressed,
+			    test->compressed_len ) == 0, file, line );
+	okx ( source.dest != &recipient.xfer, file, line );
+
+	/* Deliver compressed data */
+	for ( offset = 0 ; offset < test->compressed_len ; offset += len ) {
+		len = ( test->compressed_len - offset );
+		if ( len > frag_len )
+			len = frag_len;
+		okx ( xfer_deliver_raw ( &source, ( test->compressed + offset ),
+					 len ) == 0, file, line );
+	}
+	intf_shutdown ( &source, 0 );
+	okx ( recipient.closed, file, line );
+	okx ( recipient.rc == 0, file, line );
+
+	/* Verify decompressed data */
+	okx ( recipient.buffer.len == ( test->expected_len * test->count ),
+	      file, line );
+	for ( i = 0 ; i < test->count ; i++ ) {
+		okx ( memcmp_user ( recipient.data, ( i * test->expected_len ),
+				    virt_to_user ( test->expected ), 0,
+				    test->expected_len ) == 0, file, line );
+	}
+
+	/* Free decompressed data */
+	xferbuf_free ( &recipient.buffer );
+}
+#define inflate_ok( test, frag_len ) \
+	inflate_okx ( test, frag_len, __FILE__, __LINE__ )
+
+/**
+ * Perform streaming decompression self-test
+ *
+ */
+static void inflate_test_exec ( void ) {
+	static const uint8_t uncompressed[] = { 0x69, 0x50, 0x58, 0x45 };
+	struct interface source = INTF_INIT ( null_intf_desc );
+
+	/* Uncompressed data should be left unfiltered */
+	ok ( inflate_add ( &source, uncompressed,
+			   sizeof ( uncompressed ) ) == 0 );
+	ok ( source.dest == &null_intf );
+
+	/* Decompress whole data streams */
+	inflate_ok ( &zlib_hello_world, ~( ( size_t ) 0 ) );
+	inflate_ok ( &gzip_hello_headers, ~( ( size_t ) 0 ) );
+	inflate_ok ( &zlib_repeated, ~( ( size_t ) 0 ) );
+	inflate_ok ( &gzip_repeated, ~( ( size_t ) 0 ) );
+
+	/* Decompress data streams delivered in small fragments */
+	inflate_ok ( &zlib_hello_world, 1 );
+	inflate_ok ( &gzip_hello_headers, 1 );
+	inflate_ok ( &gzip_hello_headers, 7 );
+	inflate_ok ( &zlib_repeated, 1 );
+	inflate_ok ( &gzip_repeated, 3 );
+}
+
+/** Streaming decompression self-test */
+struct self_test inflate_test __self_test = {
+	.name = "inflate",
+	.exec = inflate_test_exec,
+};
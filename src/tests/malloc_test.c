@@ -0,0 +1,178 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ *
+ * You can also choose to distribute this program under the terms of
+ * the Unmodified Binary Distribution Licence (as given in the file
+ * COPYING.UBDL), provided that you have satisfied its requirements.
+ */
+
+FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
+
+/** @file
+ *
+ * Memory allocation tests
+ *
+ */
+
+/* Forcibly enable assertions */
+#undef NDEBUG
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ipxe/malloc.h>
+#include <ipxe/io.h>
+#include <ipxe/test.h>
+
+/** Number of objects used to fill several slabs */
+#define MALLOC_TEST_COUNT 300
+
+/** Objects used to fill several slabs */
+static void *malloc_test_ptrs[MALLOC_TEST_COUNT];
+
+/**
+ * Report physically aligned allocation test result
+ *
+ * @v size		Requested size
+ * @v align		Physical alignment
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void malloc_phys_okx ( size_t size, size_t align, const char *file,
+			      unsigned int line ) {
+	void *ptr;
+
+	/* Allocate memory */
+	ptr = malloc_phys ( size, align );
+	okx ( ptr != NULL, file, line );
+	if ( ! ptr )
+		return;
+
+	/* Validate alignment */
+	okx ( ( virt_to_phys ( ptr ) & ( align - 1 ) ) == 0, file, line );
+
+	/* Overwrite entire content (for Valgrind) */
+	memset ( ptr, 0x55, size );
+
+	/* Free memory */
+	free_phys ( ptr, size );
+}
+#define malloc_phys_ok( size, align ) \
+	malloc_phys_okx ( size, align, __FILE__, __LINE__ )
+
+/**
+ * Report slab fill test result
+ *
+ * @v size		Requested size
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void malloc_fill_okx ( size_t size, const char *file,
+			      unsigned int line ) {
+	uint8_t *ptr;
+	unsigned int i;
+	unsigned int j;
+	int intact = 1;
+
+	/* Allocate objects, each filled with a distinct pattern */
+	for ( i = 0 ; i < MALLOC_TEST_COUNT ; i++ ) {
+		ptr = malloc ( size );
+		okx ( ptr != NULL, file, line );
+		malloc_test_ptrs[i] = ptr;
+		if ( ptr )
+			memset ( ptr, i, size );
+	}
+
+	/* Verify that no object has been overwritten by another */
+	for ( i = 0 ; i < MALLOC_TEST_COUNT ; i++ ) {
+		ptr = malloc_test_ptrs[i];
+		for ( j = 0 ; ptr && ( j < size ) ; j++ ) {
+			if ( ptr[j] != ( i & 0xff ) )
+				intact = 0;
+		}
+	}
+	okx ( intact, file, line );
+
+	/* Free every other object, then the remainder */
+	for ( i = 0 ; i < MALLOC_TEST_COUNT ; i += 2 )
+		free ( malloc_test_ptrs[i] );
+	for ( i = 1 ; i < MALLOC_TEST_COUNT ; i += 2 )
+		free ( malloc_test_ptrs[i] );
+}
+#define malloc_fill_ok( size ) \
+	malloc_fill_okx ( size, __FILE__, __LINE__ )
+
+/**
+ * Perform memory allocation self-tests
+ *
+ */
+static void malloc_test_exec ( void ) {
+	uint8_t *ptr;
+	unsigned int i;
+	int intact = 1;
+
+	/* Check small (slab) allocations with natural alignment */
+	malloc_phys_ok ( 1, 1 );
+	malloc_phys_ok ( 16, 16 );
+	malloc_phys_ok ( 24, 8 );
+	malloc_phys_ok ( 64, 64 );
+	malloc_phys_ok ( 100, 128 );
+	malloc_phys_ok ( 512, 512 );
+
+	/* Check small allocations with strict alignment */
+	malloc_phys_ok ( 16, 1024 );
+	malloc_phys_ok ( 32, 4096 );
+
+	/* Check large (free block list) allocations */
+	malloc_phys_ok ( 4096, 4096 );
+	malloc_phys_ok ( 5000, 16 );
+	malloc_phys_ok ( 65536, 4096 );
+
+	/* Check allocations spanning several slabs */
+	malloc_fill_ok ( 8 );
+	malloc_fill_ok ( 60 );
+	malloc_fill_ok ( 200 );
+	malloc_fill_ok ( 1000 );
+
+	/* Check reallocation across size classes */
+	ptr = malloc ( 10 );
+	ok ( ptr != NULL );
+	if ( ptr ) {
+		for ( i = 0 ; i < 10 ; i++ )
+			ptr[i] = i;
+		ptr = realloc ( ptr, 300 );
+		ok ( ptr != NULL );
+	}
+	if ( ptr ) {
+		ptr = realloc ( ptr, 3000 );
+		ok ( ptr != NULL );
+	}
+	if ( ptr ) {
+		for ( i = 0 ; i < 10 ; i++ ) {
+			if ( ptr[i] != i )
+				intact = 0;
+		}
+		ok ( intact );
+		free ( ptr );
+	}
+}
+
+/** Memory allocation self-test */
+struct self_test malloc_test __self_test = {
+	.name = "malloc",
+	.exec = malloc_test_exec,
+};
@@ -264,6 +264,13 @@ static void memcpy_test_exec ( void ) {
 			memcpy_test_speed ( dest_offset, src_offset, 4096 );
 		}
 	}
+
+	/* Large copy speed tests (e.g. block device bounce buffers) */
+	memcpy_test_speed ( 0, 0, 16384 );
+	memcpy_test_speed ( 0, 0, 65536 );
+	memcpy_test_speed ( 1, 0, 65536 );
+	memcpy_test_speed ( 0, 3, 65536 );
+	memcpy_test_speed ( 2, 1, 65535 );
 }
 
 /** memcpy() self-test */
@@ -37,10 +37,45 @@ FILE_LICENCE ( GPL2_OR_LATER_OR_UBDL );
 /* Forcibly enable assertions */
 #undef NDEBUG
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <ipxe/sha256.h>
+#include <ipxe/profile.h>
 #include <ipxe/test.h>
 #include "digest_test.h"
 
+/** Number of sample iterations for profiling */
+#define PROFILE_COUNT 16
+
+/** Multi-buffer test block size */
+#define SHA256_MULTI_BLKSIZE 4096
+
+/** Multi-buffer test maximum number of blocks */
+#define SHA256_MULTI_MAX_COUNT 9
+
+/** A SHA-256 multi-buffer test */
+struct sha256_multi_test {
+	/** Length of salt */
+	size_t salt_len;
+	/** Length of each message */
+	size_t len;
+	/** Number of messages */
+	unsigned int count;
+};
+
+/** Define a SHA-256 multi-buffer test */
+#define SHA256_MULTI_TEST( name, SALT_LEN, LEN, COUNT )			\
+	static struct sha256_multi_test name = {			\
+		.salt_len = SALT_LEN,					\
+		.len = LEN,						\
+		.count = COUNT,						\
+	}
+
+/** Multi-buffer test data (too large for stack) */
+static uint8_t sha256_multi_data[ SHA256_MULTI_BLKSIZE *
+				  ( SHA256_MULTI_MAX_COUNT + 1 ) ];
+
 /* Empty test vector (digest obtained from "sha256sum /dev/null") */
 DIGEST_TEST ( sha256_empty, &sha256_algorithm, DIGEST_EMPTY,
 	      DIGEST ( 0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a,
@@ -83,13 +118,165 @@ DIGEST_TEST ( sha224_nist_abc_opq, &sha224_algorithm, DIGEST_NIST_ABC_OPQ,
 		       0x45, 0x5c, 0xb4, 0xf5, 0x8b, 0x19, 0x52, 0x52, 0x25,
 		       0x25 ) );
 
+/* Single message without salt */
+SHA256_MULTI_TEST ( sha256_multi_single, 0, SHA256_MULTI_BLKSIZE, 1 );
+
+/* Exactly one group of messages */
+SHA256_MULTI_TEST ( sha256_multi_lanes, 0, SHA256_MULTI_BLKSIZE,
+		    SHA256_LANES );
+
+/* Several groups of messages with a block-aligned salt */
+SHA256_MULTI_TEST ( sha256_multi_aligned, 64, SHA256_MULTI_BLKSIZE, 9 );
+
+/* Several groups of messages with a dm-verity style salt */
+SHA256_MULTI_TEST ( sha256_multi_salted, 32, SHA256_MULTI_BLKSIZE, 7 );
+
+/* Messages shorter than a block */
+SHA256_MULTI_TEST ( sha256_multi_short, 7, 20, 5 );
+
+/* Messages with a partial final block */
+SHA256_MULTI_TEST ( sha256_multi_partial, 5, 1000, 6 );
+
+/* Empty messages */
+SHA256_MULTI_TEST ( sha256_multi_empty, 13, 0, 3 );
+
 /**
- * Perform SHA-256 family self-test
+ * Fill multi-buffer test data with pseudo-random data
  *
  */
-static void sha256_test_exec ( void ) {
+static void sha256_multi_fill ( void ) {
+	unsigned int i;
 
-	/* Correctness tests */
+	srand ( 0x5ca1ab1e );
+	for ( i = 0 ; i < sizeof ( sha256_multi_data ) ; i++ )
+		sha256_multi_data[i] = rand();
+}
+
+/**
+ * Report SHA-256 multi-buffer test result
+ *
+ * @v test		Multi-buffer test
+ * @v file		Test code file
+ * @v line		Test code line
+ */
+static void sha256_multi_okx ( struct sha256_multi_test *test,
+			       const char *file, unsigned int line ) {
+	const uint8_t *salt = sha256_multi_data;
+	const uint8_t *data = ( salt + test->salt_len );
+	uint8_t out[ SHA256_MULTI_MAX_COUNT * SHA256_DIGEST_SIZE ];
+	uint8_t expected[SHA256_DIGEST_SIZE];
+	struct sha256_context init;
+	struct sha256_context ctx;
+	unsigned int i;
+
+	/* Sanity check */
+	okx ( test->count <= SHA256_MULTI_MAX_COUNT, file, line );
+	okx ( ( test->salt_len + ( test->count * test->len ) ) <=
+	      sizeof ( sha256_multi_data ), file, line );
+
+	/* Calculate digests in parallel */
+	digest_init ( &sha256_algorithm, &init );
+	digest_update ( &sha256_algorithm, &init, salt, test->salt_len );
+	sha256_multi ( &init, data, test->len, test->count, out );
+
+	/* Compare against individually calculated digests */
+	for ( i = 0 ; i < test->count ; i++ ) {
+		memcpy ( &ctx, &init, sizeof ( ctx ) );
+		digest_update ( &sha256_algorithm, &ctx,
+				( data + ( i * test->len ) ), test->len );
+		digest_final ( &sha256_algorithm, &ctx, expected );
+		okx ( memcmp ( &out[ i * SHA256_DIGEST_SIZE ], expected,
+			       sizeof ( expected ) ) == 0, file, line );
+	}
+}
+#define sha256_multi_ok( test ) sha256_multi_okx ( test, __FILE__, __LINE__ )
+
+/**
+ * Check consistency of accelerated and generic block digests
+ *
+ */
+static void sha256_blocks_consistency_ok ( void ) {
+	struct sha256_digest digest;
+	struct sha256_digest expected;
+	size_t count = ( sizeof ( sha256_multi_data ) /
+			 sizeof ( union sha256_block ) );
+
+	memset ( &digest, 0x5a, sizeof ( digest ) );
+	memset ( &expected, 0x5a, sizeof ( expected ) );
+	sha256_blocks ( &digest, sha256_multi_data, count );
+	generic_sha256_blocks ( &expected, sha256_multi_data, count );
+	ok ( memcmp ( &digest, &expected, sizeof ( digest ) ) == 0 );
+}
+
+/**
+ * Calculate SHA-256 block digest cost
+ *
+ * @v blocks		Block digest implementation
+ * @ret cost		Cost (in cycles per byte)
+ */
+static unsigned long sha256_blocks_cost ( void ( * blocks )
+					  ( struct sha256_digest *digest,
+					    const void *data, size_t count ) ) {
+	struct sha256_digest digest;
+	struct profiler profiler;
+	size_t count = ( sizeof ( sha256_multi_data ) /
+			 sizeof ( union sha256_block ) );
+	unsigned long cost;
+	unsigned int i;
+
+	/* Profile block digests */
+	memset ( &digest, 0, sizeof ( digest ) );
+	memset ( &profiler, 0, sizeof ( profiler ) );
+	for ( i = 0 ; i < PROFILE_COUNT ; i++ ) {
+		profile_start ( &profiler );
+		blocks ( &digest, sha256_multi_data, count );
+		profile_stop ( &profiler );
+	}
+
+	/* Round to nearest whole number of cycles per byte */
+	cost = ( ( profile_mean ( &profiler ) +
+		   ( sizeof ( sha256_multi_data ) / 2 ) ) /
+		 sizeof ( sha256_multi_data ) );
+
+	return cost;
+}
+
+/**
+ * Calculate SHA-256 multi-buffer digest cost
+ *
+ * @ret cost		Cost (in cycles per byte)
+ */
+static unsigned long sha256_multi_cost ( void ) {
+	uint8_t out[ SHA256_MULTI_MAX_COUNT * SHA256_DIGEST_SIZE ];
+	struct sha256_context init;
+	struct profiler profiler;
+	size_t len = ( SHA256_MULTI_MAX_COUNT * SHA256_MULTI_BLKSIZE );
+	unsigned long cost;
+	unsigned int i;
+
+	/* Profile multi-buffer digests of 4kB blocks */
+	digest_init ( &sha256_algorithm, &init );
+	memset ( &profiler, 0, sizeof ( profiler ) );
+	for ( i = 0 ; i < PROFILE_COUNT ; i++ ) {
+		profile_start ( &profiler );
+		sha256_multi ( &init, sha256_multi_data, SHA256_MULTI_BLKSIZE,
+			       SHA256_MULTI_MAX_COUNT, out );
+		profile_stop ( &profiler );
+	}
+
+	/* Round to nearest whole number of cycles per byte */
+	cost = ( ( profile_mean ( &profiler ) + ( len / 2 ) ) / len );
+
+	return cost;
+}
+
+/**
+ * Perform SHA-256 family correctness tests
+ *
+ */
+static void sha256_test_all ( void ) {
+
+	/* Digest tests */
 	digest_ok ( &sha256_empty );
 	digest_ok ( &sha256_nist_abc );
 	digest_ok ( &sha256_nist_abc_opq );
@@ -97,11 +284,75 @@ static void sha256_test_exec ( void ) {
 	digest_ok ( &sha224_nist_abc );
 	digest_ok ( &sha224_nist_abc_opq );
 
+	/* Multi-buffer tests */
+	sha256_multi_ok ( &sha256_multi_single );
+	sha256_multi_ok ( &sha256_multi_lanes );
+	sha256_multi_ok ( &sha256_multi_aligned );
+	sha256_multi_ok ( &sha256_multi_salted );
+	sha256_multi_ok ( &sha256_multi_short );
+	sha256_multi_ok ( &sha256_multi_partial );
+	sha256_multi_ok ( &sha256_multi_empty );
+	sha256_blocks_consistency_ok();
+}
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+
+/**
+ * Perform SHA-256 tests for a specific x86 implementation
+ *
+ * @v impl		SHA-256 implementation
+ * @v name		Implementation name
+ */
+static void sha256_test_x86 ( enum x86_sha256_impl impl, const char *name ) {
+	enum x86_sha256_impl saved = x86_sha256_impl;
+
+	/* Skip implementations not supported by this CPU */
+	if ( x86_sha256_force ( impl ) != 0 ) {
+		DBG ( "SHA256 (%s) not supported\n", name );
+		return;
+	}
+
+	/* Perform tests */
+	sha256_test_all();
+	DBG ( "SHA256 blocks (%s) required %ld cycles per byte\n",
+	      name, sha256_blocks_cost ( sha256_blocks ) );
+	DBG ( "SHA256 multi-buffer (%s) required %ld cycles per byte\n",
+	      name, sha256_multi_cost() );
+
+	/* Restore original implementation */
+	x86_sha256_force ( saved );
+}
+
+#endif
+
+/**
+ * Perform SHA-256 family self-test
+ *
+ */
+static void sha256_test_exec ( void ) {
+
+	/* Correctness tests */
+	sha256_multi_fill();
+	sha256_test_all();
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+	/* Implementation-specific tests */
+	sha256_test_x86 ( X86_SHA256_GENERIC, "x86 generic" );
+	sha256_test_x86 ( X86_SHA256_SSSE3, "SSSE3" );
+	sha256_test_x86 ( X86_SHA256_SHANI, "SHA-NI" );
+#endif
+
 	/* Speed tests */
 	DBG ( "SHA256 required %ld cycles per byte\n",
 	      digest_cost ( &sha256_algorithm ) );
 	DBG ( "SHA224 required %ld cycles per byte\n",
 	      digest_cost ( &sha224_algorithm ) );
+	DBG ( "SHA256 blocks required %ld cycles per byte\n",
+	      sha256_blocks_cost ( sha256_blocks ) );
+	DBG ( "SHA256 blocks (generic) required %ld cycles per byte\n",
+	      sha256_blocks_cost ( generic_sha256_blocks ) );
+	DBG ( "SHA256 multi-buffer required %ld cycles per byte\n",
+	      sha256_multi_cost() );
 }
 
 /** SHA-256 family self-test */
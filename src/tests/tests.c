@@ -69,15 +69,20 @@ REQUIRE_OBJECT ( setjmp_test );
 REQUIRE_OBJECT ( pccrc_test );
 REQUIRE_OBJECT ( linebuf_test );
 REQUIRE_OBJECT ( iobuf_test );
+REQUIRE_OBJECT ( malloc_test );
 REQUIRE_OBJECT ( bitops_test );
 REQUIRE_OBJECT ( der_test );
 REQUIRE_OBJECT ( pem_test );
 REQUIRE_OBJECT ( ntlm_test );
 REQUIRE_OBJECT ( zlib_test );
 REQUIRE_OBJECT ( gzip_test );
+REQUIRE_OBJECT ( inflate_test );
 REQUIRE_OBJECT ( utf8_test );
 REQUIRE_OBJECT ( acpi_test );
 REQUIRE_OBJECT ( hmac_test );
 REQUIRE_OBJECT ( dhe_test );
 REQUIRE_OBJECT ( gcm_test );
 REQUIRE_OBJECT ( nap_test );
+
+/* Drag in all architecture-specific self-tests */
+#include <bits/tests.h>
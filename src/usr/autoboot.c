@@ -383,20 +383,41 @@ int ipxe ( struct net_device *netdev ) {
 
     struct uri *test = parse_uri("");
     struct uri *nvme_uri = parse_uri("nvme:0");
+#if defined ( SANBOOT_MULTIPATH ) || defined ( SANBOOT_RAID0 ) || \
+    defined ( SANBOOT_RAID1 )
+    struct uri *nvme_uris[] = {nvme_uri, parse_uri("nvme:1")};
+#else
     struct uri *nvme_uris[] = {nvme_uri};
+#endif
 
     //uriboot(NULL, nvme_uris, 1, 0x80, NULL, 0);
 
     struct uri *filename = NULL;
     struct uri **root_paths = nvme_uris;
-    unsigned int root_path_count = 1;
+    unsigned int root_path_count = ( sizeof ( nvme_uris ) /
+                                     sizeof ( nvme_uris[0] ) );
     int drive = 0x80;
     const char *san_filename = NULL;
     unsigned int flags = 0;
-
-    drive = san_hook ( drive, root_paths, root_path_count,
-                       ( ( flags & URIBOOT_NO_SAN_DESCRIBE ) ?
-                         SAN_NO_DESCRIBE : 0 ) );
+    unsigned int san_flags = ( ( flags & URIBOOT_NO_SAN_DESCRIBE ) ?
+                               SAN_NO_DESCRIBE : 0 );
+#ifdef SANBOOT_MULTIPATH
+    san_flags |= SAN_MULTIPATH;
+#endif
+#ifdef SANBOOT_RAID0
+    san_flags |= SAN_RAID0;
+#endif
+#ifdef SANBOOT_RAID1
+    san_flags |= SAN_RAID1;
+#endif
+#ifdef SANBOOT_VERITY
+    san_flags |= SAN_VERIFY;
+#endif
+#ifdef SANBOOT_CRYPT
+    san_flags |= SAN_DECRYPT;
+#endif
+
+    drive = san_hook ( drive, root_paths, root_path_count, san_flags );
     if ( drive < 0 ) {
         rc = drive;
         printf ( "Could not open SAN device: %s\n",
@@ -405,6 +426,17 @@ int ipxe ( struct net_device *netdev ) {
     }
     printf ( "Registered SAN device %#02x\n", drive );
 
+    if ( SAN_HOOK_PARTITION ) {
+        rc = san_hook_partition ( 0xff, drive, SAN_HOOK_PARTITION );
+        if ( rc < 0 ) {
+            printf ( "Could not register SAN partition %d: %s\n",
+                     SAN_HOOK_PARTITION, strerror ( rc ) );
+        } else {
+            printf ( "Registered SAN partition %d as device %#02x\n",
+                     SAN_HOOK_PARTITION, rc );
+        }
+    }
+
     if ( ( rc = san_describe() ) != 0 ) {
         printf ( "Could not describe SAN devices: %s\n",
                  strerror ( rc ) );
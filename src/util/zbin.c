@@ -1,13 +1,21 @@
 #include <stdint.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <lzma.h>
 
 #define DEBUG 0
 
+/* Print compression report */
+static int report = 0;
+
+/* Pack "PACK" records using fast LZ rather than LZMA */
+static int pack_lz = 0;
+
 /* LZMA filter choices.  Must match those used by unlzma.S */
 #define LZMA_LC 2
 #define LZMA_LP 0
@@ -16,6 +24,18 @@
 /* LZMA preset choice.  This is a policy decision */
 #define LZMA_PRESET ( LZMA_PRESET_DEFAULT | LZMA_PRESET_EXTREME )
 
+/* Fast LZ format parameters.  Must match those used by unlz.S */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xffff
+#define LZ_MAX_NIBBLE 15
+
+/* Fast LZ compression effort.  This is a policy decision */
+#define LZ_HASH_BITS 16
+#define LZ_CHAIN_DEPTH 1024
+
+/* Number of decompression runs used when measuring decompression time */
+#define REPORT_RUNS 16
+
 struct input_file {
 	void *buf;
 	size_t len;
@@ -260,20 +280,370 @@ static uint32_t crc32_le ( uint32_t crc, const void *data, size_t len ) {
 	return crc;
 }
 
-static int process_zinfo_pack ( struct input_file *input,
-				struct output_file *output,
-				union zinfo_record *zinfo ) {
+static int lzma_pack ( void *data, size_t len, void *packed,
+		       size_t *packed_len, size_t max_len ) {
+	lzma_options_lzma options;
+	const lzma_filter filters[] = {
+		{ .id = LZMA_FILTER_LZMA1, .options = &options },
+		{ .id = LZMA_VLI_UNKNOWN }
+	};
+
+	*packed_len = 0;
+	lzma_lzma_preset ( &options, LZMA_PRESET );
+	options.lc = LZMA_LC;
+	options.lp = LZMA_LP;
+	options.pb = LZMA_PB;
+	if ( lzma_raw_buffer_encode ( filters, NULL, data, len, packed,
+				      packed_len, max_len ) != LZMA_OK ) {
+		fprintf ( stderr, "Compression failure\n" );
+		return -1;
+	}
+	return 0;
+}
+
+static int lzma_unpack ( const void *packed, size_t packed_len, void *data,
+			 size_t len ) {
+	lzma_options_lzma options;
+	const lzma_filter filters[] = {
+		{ .id = LZMA_FILTER_LZMA1, .options = &options },
+		{ .id = LZMA_VLI_UNKNOWN }
+	};
+	size_t in_pos = 0;
+	size_t out_pos = 0;
+
+	lzma_lzma_preset ( &options, LZMA_PRESET );
+	options.lc = LZMA_LC;
+	options.lp = LZMA_LP;
+	options.pb = LZMA_PB;
+	if ( lzma_raw_buffer_decode ( filters, NULL, packed, &in_pos,
+				      packed_len, data, &out_pos,
+				      len ) != LZMA_OK ) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The fast LZ format is a byte-oriented sequence of (literal run,
+ * match) pairs.  Each pair starts with a token byte holding the
+ * literal run length in the high nibble and the match length (minus
+ * LZ_MIN_MATCH) in the low nibble.  A nibble value of LZ_MAX_NIBBLE
+ * is extended by following bytes, each of which is added to the
+ * length, until a byte other than 0xff is found.  The token (and any
+ * literal length extension) is followed by the literal bytes, a
+ * 16-bit little-endian match offset, and any match length extension.
+ * The final pair consists only of the token and the literal run.
+ */
+
+static uint8_t * lz_put_length ( uint8_t *out, size_t len ) {
+	while ( len >= 0xff ) {
+		*(out++) = 0xff;
+		len -= 0xff;
+	}
+	*(out++) = len;
+	return out;
+}
+
+static int lz_put_sequence ( const uint8_t *literals, size_t literal_len,
+			     size_t offset, size_t match_len,
+			     uint8_t **out, const uint8_t *out_end ) {
+	size_t match_code = ( match_len ? ( match_len - LZ_MIN_MATCH ) : 0 );
+	uint8_t *token = *out;
+	uint8_t *pos = ( token + 1 );
+
+	/* Check for space (including worst-case length extensions) */
+	if ( ( out_end - pos ) < ( ptrdiff_t ) ( literal_len + 2 +
+					      ( literal_len / 0xff ) + 1 +
+					      ( match_code / 0xff ) + 1 ) )
+		return -1;
+
+	/* Construct token and literal run */
+	*token = ( ( ( literal_len < LZ_MAX_NIBBLE ) ?
+		     literal_len : LZ_MAX_NIBBLE ) << 4 );
+	if ( literal_len >= LZ_MAX_NIBBLE )
+		pos = lz_put_length ( pos, ( literal_len - LZ_MAX_NIBBLE ) );
+	memcpy ( pos, literals, literal_len );
+	pos += literal_len;
+
+	/* Construct match, if any */
+	if ( match_len ) {
+		*token |= ( ( match_code < LZ_MAX_NIBBLE ) ?
+			    match_code : LZ_MAX_NIBBLE );
+		*(pos++) = ( offset & 0xff );
+		*(pos++) = ( offset >> 8 );
+		if ( match_code >= LZ_MAX_NIBBLE )
+			pos = lz_put_length ( pos,
+					      ( match_code - LZ_MAX_NIBBLE ) );
+	}
+
+	*out = pos;
+	return 0;
+}
+
+static uint32_t lz_hash ( const uint8_t *data ) {
+	uint32_t val;
+
+	memcpy ( &val, data, sizeof ( val ) );
+	return ( ( val * 2654435761U ) >> ( 32 - LZ_HASH_BITS ) );
+}
+
+static int lz_pack ( const void *data, size_t len, void *packed,
+		     size_t *packed_len, size_t max_len ) {
+	const uint8_t *in = data;
+	uint8_t *out = packed;
+	uint8_t *out_end = ( out + max_len );
+	size_t literal = 0;
+	size_t pos = 0;
+	size_t best_len;
+	size_t best_offset;
+	size_t match_len;
+	size_t limit;
+	long *head;
+	long *prev;
+	long candidate;
+	unsigned int depth;
+	uint32_t hash;
+	int rc = -1;
+
+	head = malloc ( ( 1 << LZ_HASH_BITS ) * sizeof ( head[0] ) );
+	prev = malloc ( ( len + 1 ) * sizeof ( prev[0] ) );
+	if ( ( ! head ) || ( ! prev ) ) {
+		fprintf ( stderr, "Could not allocate LZ hash chains\n" );
+		goto err;
+	}
+	memset ( head, 0xff, ( ( 1 << LZ_HASH_BITS ) * sizeof ( head[0] ) ) );
+
+	while ( ( pos + LZ_MIN_MATCH ) <= len ) {
+
+		/* Find longest match within window */
+		hash = lz_hash ( in + pos );
+		best_len = 0;
+		best_offset = 0;
+		for ( candidate = head[hash], depth = 0 ;
+		      ( candidate >= 0 ) && ( depth < LZ_CHAIN_DEPTH ) &&
+		      ( ( pos - candidate ) <= LZ_MAX_OFFSET ) ;
+		      candidate = prev[candidate], depth++ ) {
+			limit = ( len - pos );
+			for ( match_len = 0 ; match_len < limit ; match_len++ ){
+				if ( in[ candidate + match_len ] !=
+				     in[ pos + match_len ] )
+					break;
+			}
+			if ( match_len > best_len ) {
+				best_len = match_len;
+				best_offset = ( pos - candidate );
+			}
+		}
+
+		/* Emit literal or match */
+		if ( best_len < LZ_MIN_MATCH ) {
+			prev[pos] = head[hash];
+			head[hash] = pos;
+			pos++;
+			continue;
+		}
+		if ( lz_put_sequence ( ( in + literal ), ( pos - literal ),
+				       best_offset, best_len, &out,
+				       out_end ) != 0 )
+			goto overrun;
+		for ( ; best_len-- ; pos++ ) {
+			if ( ( pos + LZ_MIN_MATCH ) <= len ) {
+				hash = lz_hash ( in + pos );
+				prev[pos] = head[hash];
+				head[hash] = pos;
+			}
+		}
+		literal = pos;
+	}
+
+	/* Emit final literal run, if any */
+	if ( ( literal < len ) &&
+	     ( lz_put_sequence ( ( in + literal ), ( len - literal ), 0, 0,
+				 &out, out_end ) != 0 ) )
+		goto overrun;
+
+	*packed_len = ( out - ( uint8_t * ) packed );
+	rc = 0;
+	goto err;
+
+ overrun:
+	fprintf ( stderr, "Output buffer overrun on LZ pack\n" );
+ err:
+	free ( prev );
+	free ( head );
+	return rc;
+}
+
+static int lz_get_length ( const uint8_t **in, const uint8_t *in_end,
+			   size_t *len ) {
+	uint8_t byte;
+
+	if ( *len != LZ_MAX_NIBBLE )
+		return 0;
+	do {
+		if ( *in >= in_end )
+			return -1;
+		byte = *((*in)++);
+		*len += byte;
+	} while ( byte == 0xff );
+	return 0;
+}
+
+static int lz_unpack ( const void *packed, size_t packed_len, void *data,
+		       size_t len ) {
+	const uint8_t *in = packed;
+	const uint8_t *in_end = ( in + packed_len );
+	uint8_t *out = data;
+	uint8_t *out_end = ( out + len );
+	size_t literal_len;
+	size_t match_len;
+	size_t offset;
+	uint8_t token;
+
+	while ( in < in_end ) {
+		token = *(in++);
+
+		/* Copy literal run */
+		literal_len = ( token >> 4 );
+		if ( lz_get_length ( &in, in_end, &literal_len ) != 0 )
+			return -1;
+		if ( ( literal_len > ( size_t ) ( in_end - in ) ) ||
+		     ( literal_len > ( size_t ) ( out_end - out ) ) )
+			return -1;
+		memcpy ( out, in, literal_len );
+		in += literal_len;
+		out += literal_len;
+		if ( in == in_end )
+			break;
+
+		/* Copy match */
+		if ( ( in_end - in ) < 2 )
+			return -1;
+		offset = ( in[0] | ( in[1] << 8 ) );
+		in += 2;
+		match_len = ( token & 0x0f );
+		if ( lz_get_length ( &in, in_end, &match_len ) != 0 )
+			return -1;
+		match_len += LZ_MIN_MATCH;
+		if ( ( offset == 0 ) ||
+		     ( offset > ( size_t ) ( out - ( uint8_t * ) data ) ) ||
+		     ( match_len > ( size_t ) ( out_end - out ) ) )
+			return -1;
+		for ( ; match_len-- ; out++ )
+			*out = *( out - offset );
+	}
+
+	return ( ( out == out_end ) ? 0 : -1 );
+}
+
+static int lz_verify ( const void *packed, size_t packed_len,
+		       const void *data, size_t len ) {
+	void *unpacked;
+	int rc = -1;
+
+	unpacked = malloc ( len );
+	if ( ! unpacked ) {
+		fprintf ( stderr, "Could not allocate LZ verification buffer\n" );
+		return -1;
+	}
+	if ( ( lz_unpack ( packed, packed_len, unpacked, len ) == 0 ) &&
+	     ( memcmp ( unpacked, data, len ) == 0 ) ) {
+		rc = 0;
+	} else {
+		fprintf ( stderr, "LZ verification failure\n" );
+	}
+	free ( unpacked );
+	return rc;
+}
+
+static unsigned long long timestamp ( void ) {
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ( ( ts.tv_sec * 1000000000ULL ) + ts.tv_nsec );
+#endif
+}
+
+static unsigned long long time_unpack ( int ( * unpack ) ( const void *packed,
+							   size_t packed_len,
+							   void *data,
+							   size_t len ),
+					const void *packed, size_t packed_len,
+					void *data, size_t len ) {
+	unsigned long long best = ~0ULL;
+	unsigned long long start;
+	unsigned long long elapsed;
+	unsigned int i;
+
+	for ( i = 0 ; i < REPORT_RUNS ; i++ ) {
+		start = timestamp();
+		if ( unpack ( packed, packed_len, data, len ) != 0 )
+			return 0;
+		elapsed = ( timestamp() - start );
+		if ( elapsed < best )
+			best = elapsed;
+	}
+	return best;
+}
+
+static void report_pack ( const char *type, const void *data, size_t len ) {
+	void *copy;
+	void *packed;
+	void *unpacked;
+	size_t max_len = ( ( len * 2 ) + 64 );
+	size_t lzma_len;
+	size_t lz_len;
+	unsigned long long lzma_time = 0;
+	unsigned long long lz_time = 0;
+
+	copy = malloc ( len );
+	packed = malloc ( max_len );
+	unpacked = malloc ( len );
+	if ( ! ( copy && packed && unpacked ) )
+		goto out;
+
+	/* LZMA (with BCJ filter, which the decompressor must undo) */
+	memcpy ( copy, data, len );
+	bcj_filter ( copy, len );
+	if ( lzma_pack ( copy, len, packed, &lzma_len, max_len ) == 0 ) {
+		lzma_time = time_unpack ( lzma_unpack, packed, lzma_len,
+					  unpacked, len );
+	}
+
+	/* Fast LZ */
+	if ( lz_pack ( data, len, packed, &lz_len, max_len ) == 0 ) {
+		lz_time = time_unpack ( lz_unpack, packed, lz_len,
+					unpacked, len );
+	}
+
+	/* The timings are for zbin's own C decoders running on the
+	 * build host, not for unlzma.S or unlz.S running in the
+	 * prefix, and so are only a relative guide.
+	 */
+	fprintf ( stderr, "%s %#zx bytes: LZMA %#zx bytes (host C decoder "
+		  "%llu cycles), LZ %#zx bytes (host C decoder %llu "
+		  "cycles)\n", type, len, lzma_len, lzma_time, lz_len,
+		  lz_time );
+
+ out:
+	free ( unpacked );
+	free ( packed );
+	free ( copy );
+}
+
+static int process_zinfo_pack_common ( struct input_file *input,
+				       struct output_file *output,
+				       union zinfo_record *zinfo,
+				       int lz ) {
 	struct zinfo_pack *pack = &zinfo->pack;
 	size_t offset = pack->offset;
 	size_t len = pack->len;
 	size_t start_len;
 	size_t packed_len = 0;
 	size_t remaining;
-	lzma_options_lzma options;
-	const lzma_filter filters[] = {
-		{ .id = LZMA_FILTER_LZMA1, .options = &options },
-		{ .id = LZMA_VLI_UNKNOWN }
-	};
 	void *packed;
 	uint32_t *len32;
 	uint32_t *crc32;
@@ -283,6 +653,10 @@ static int process_zinfo_pack ( struct input_file *input,
 		return -1;
 	}
 
+	if ( report )
+		report_pack ( ( lz ? "PKLZ" : "PACK" ), ( input->buf + offset ),
+			      len );
+
 	output->len = align ( output->len, pack->align );
 	start_len = output->len;
 	len32 = ( output->buf + output->len );
@@ -292,19 +666,20 @@ static int process_zinfo_pack ( struct input_file *input,
 		return -1;
 	}
 
-	bcj_filter ( ( input->buf + offset ), len );
-
 	packed = ( output->buf + output->len );
 	remaining = ( output->max_len - output->len );
-	lzma_lzma_preset ( &options, LZMA_PRESET );
-	options.lc = LZMA_LC;
-	options.lp = LZMA_LP;
-	options.pb = LZMA_PB;
-	if ( lzma_raw_buffer_encode ( filters, NULL, ( input->buf + offset ),
-				      len, packed, &packed_len,
-				      remaining ) != LZMA_OK ) {
-		fprintf ( stderr, "Compression failure\n" );
-		return -1;
+	if ( lz ) {
+		if ( lz_pack ( ( input->buf + offset ), len, packed,
+			       &packed_len, remaining ) != 0 )
+			return -1;
+		if ( lz_verify ( packed, packed_len, ( input->buf + offset ),
+				 len ) != 0 )
+			return -1;
+	} else {
+		bcj_filter ( ( input->buf + offset ), len );
+		if ( lzma_pack ( ( input->buf + offset ), len, packed,
+				 &packed_len, remaining ) != 0 )
+			return -1;
 	}
 	output->len += packed_len;
 
@@ -318,14 +693,26 @@ static int process_zinfo_pack ( struct input_file *input,
 	*crc32 = crc32_le ( CRCSEED, packed, packed_len );
 
 	if ( DEBUG ) {
-		fprintf ( stderr, "PACK [%#zx,%#zx) to [%#zx,%#zx) crc %#08x\n",
-			  offset, ( offset + len ), start_len, output->len,
-			  *crc32 );
+		fprintf ( stderr, "%s [%#zx,%#zx) to [%#zx,%#zx) crc %#08x\n",
+			  ( lz ? "PKLZ" : "PACK" ), offset, ( offset + len ),
+			  start_len, output->len, *crc32 );
 	}
 
 	return 0;
 }
 
+static int process_zinfo_pack ( struct input_file *input,
+				struct output_file *output,
+				union zinfo_record *zinfo ) {
+	return process_zinfo_pack_common ( input, output, zinfo, pack_lz );
+}
+
+static int process_zinfo_pklz ( struct input_file *input,
+				struct output_file *output,
+				union zinfo_record *zinfo ) {
+	return process_zinfo_pack_common ( input, output, zinfo, 1 );
+}
+
 static int process_zinfo_payl ( struct input_file *input
 					__attribute__ (( unused )),
 				struct output_file *output,
@@ -523,6 +910,7 @@ struct zinfo_processor {
 static struct zinfo_processor zinfo_processors[] = {
 	{ "COPY", process_zinfo_copy },
 	{ "PACK", process_zinfo_pack },
+	{ "PKLZ", process_zinfo_pklz },
 	{ "PAYL", process_zinfo_payl },
 	{ "ADDB", process_zinfo_addb },
 	{ "ADDW", process_zinfo_addw },
@@ -573,8 +961,19 @@ int main ( int argc, char **argv ) {
 	struct zinfo_file zinfo;
 	unsigned int i;
 
+	while ( ( argc > 1 ) && ( argv[1][0] == '-' ) ) {
+		if ( strcmp ( argv[1], "-r" ) == 0 ) {
+			report = 1;
+		} else if ( strcmp ( argv[1], "-l" ) == 0 ) {
+			pack_lz = 1;
+		} else {
+			break;
+		}
+		argc--;
+		argv++;
+	}
 	if ( argc != 3 ) {
-		fprintf ( stderr, "Syntax: %s file.bin file.zinfo "
+		fprintf ( stderr, "Syntax: %s [-r] [-l] file.bin file.zinfo "
 			  "> file.zbin\n", argv[0] );
 		exit ( 1 );
 	}